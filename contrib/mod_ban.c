@@ -3250,6 +3250,7 @@ static void ban_mod_unload_ev(const void *event_data, void *user_data) {
     }
 
     pr_event_unregister(&ban_module, NULL, NULL);
+    (void) pr_session_unregister_precheck(&ban_module, NULL);
 
     if (ban_pool) {
       destroy_pool(ban_pool);
@@ -3558,6 +3559,62 @@ static void ban_userdefined_ev(const void *event_data, void *user_data) {
   ban_handle_event(BAN_EV_TYPE_USER_DEFINED, BAN_TYPE_HOST, ipstr, tmpl);
 }
 
+/* Precheck, run by the daemon process for each new connection, so that
+ * banned hosts and classes can be turned away without forking a session
+ * process for them.  The session process still checks the ban lists as
+ * well, e.g. for any configured BanCache.
+ */
+static int ban_precheck_cb(pool *p, server_rec *s,
+    const pr_netaddr_t *remote_addr) {
+  config_rec *c;
+  const char *remote_ip;
+  const pr_class_t *cls;
+
+  if (ban_engine != TRUE ||
+      ban_lists == NULL) {
+    return 0;
+  }
+
+  c = find_config(s->conf, CONF_PARAM, "BanEngine", FALSE);
+  if (c != NULL) {
+    int use_bans;
+
+    use_bans = *((int *) c->argv[0]);
+    if (use_bans == FALSE) {
+      return 0;
+    }
+  }
+
+  /* Make sure the list is up-to-date. */
+  ban_list_expire();
+
+  if (ban_lists->bans.bl_listlen == 0) {
+    return 0;
+  }
+
+  remote_ip = pr_netaddr_get_ipstr(remote_addr);
+  if (ban_list_exists(NULL, BAN_TYPE_HOST, s->sid, remote_ip, NULL) == 0) {
+    (void) pr_log_writefile(ban_logfd, MOD_BAN_VERSION,
+      "connection from host '%s' denied due to host ban", remote_ip);
+
+    errno = EACCES;
+    return -1;
+  }
+
+  cls = pr_class_match_addr(remote_addr);
+  if (cls != NULL &&
+      ban_list_exists(NULL, BAN_TYPE_CLASS, s->sid, cls->cls_name,
+        NULL) == 0) {
+    (void) pr_log_writefile(ban_logfd, MOD_BAN_VERSION,
+      "connection from class '%s' denied due to class ban", cls->cls_name);
+
+    errno = EACCES;
+    return -1;
+  }
+
+  return 0;
+}
+
 /* Initialization routines
  */
 
@@ -3590,6 +3647,12 @@ static int ban_init(void) {
   pr_event_register(&ban_module, "core.restart", ban_restart_ev, NULL);
   pr_event_register(&ban_module, "core.shutdown", ban_shutdown_ev, NULL);
 
+  if (pr_session_register_precheck(&ban_module, "ban-list",
+      ban_precheck_cb) < 0) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_BAN_VERSION
+      ": error registering connection precheck: %s", strerror(errno));
+  }
+
   return 0;
 }
 
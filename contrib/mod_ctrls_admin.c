@@ -600,6 +600,76 @@ static int ctrls_handle_down(pr_ctrls_t *ctrl, int reqargc,
   return 0;
 }
 
+static int ctrls_handle_fscache(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+  pr_scoreboard_entry_t *score;
+  unsigned int nsessions = 0;
+
+  /* Check the fscache ACL. */
+  if (!pr_ctrls_check_acl(ctrl, ctrls_admin_acttab, "fscache")) {
+
+    /* Access denied. */
+    pr_ctrls_add_response(ctrl, "access denied");
+    return -1;
+  }
+
+  if (pr_rewind_scoreboard() < 0) {
+    pr_ctrls_log(MOD_CTRLS_ADMIN_VERSION, "error rewinding scoreboard: %s",
+      strerror(errno));
+    pr_ctrls_add_response(ctrl, "error rewinding scoreboard: %s",
+      strerror(errno));
+    return -1;
+  }
+
+  /* Each session publishes its FS statcache counters in its scoreboard
+   * entry; show them for all sessions, or for the given users/PIDs.
+   */
+  while ((score = pr_scoreboard_entry_read()) != NULL) {
+    unsigned long nlookups;
+
+    pr_signals_handle();
+
+    if (reqargc > 0) {
+      register int i;
+      int matched = FALSE;
+
+      for (i = 0; i < reqargc; i++) {
+        if (strcmp(reqargv[i], score->sce_user) == 0 ||
+            (unsigned long) atol(reqargv[i]) ==
+              (unsigned long) score->sce_pid) {
+          matched = TRUE;
+          break;
+        }
+      }
+
+      if (matched == FALSE) {
+        continue;
+      }
+    }
+
+    nlookups = score->sce_statcache_hits + score->sce_statcache_misses;
+    pr_ctrls_add_response(ctrl,
+      "fscache: PID %lu (%s): %lu hits, %lu misses (%0.1f%% hit rate), "
+      "%lu evictions", (unsigned long) score->sce_pid,
+      *score->sce_user ? score->sce_user : "-", score->sce_statcache_hits,
+      score->sce_statcache_misses,
+      nlookups > 0 ? (score->sce_statcache_hits * 100.0) / nlookups : 0.0,
+      score->sce_statcache_evictions);
+    nsessions++;
+  }
+
+  if (pr_restore_scoreboard() < 0) {
+    pr_ctrls_log(MOD_CTRLS_ADMIN_VERSION, "error restoring scoreboard: %s",
+      strerror(errno));
+  }
+
+  if (nsessions == 0) {
+    pr_ctrls_add_response(ctrl, "fscache: no matching sessions");
+  }
+
+  return 0;
+}
+
 static int ctrls_handle_get(pr_ctrls_t *ctrl, int reqargc,
     char **reqargv) {
   int res = 0;
@@ -1017,6 +1087,85 @@ static int ctrls_handle_kick(pr_ctrls_t *ctrl, int reqargc,
   return res;
 }
 
+static int ctrls_handle_pool(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+  pr_scoreboard_entry_t *score;
+  pr_pool_stats_t stats;
+  unsigned int nsessions = 0;
+
+  /* Check the pool ACL. */
+  if (!pr_ctrls_check_acl(ctrl, ctrls_admin_acttab, "pool")) {
+
+    /* Access denied. */
+    pr_ctrls_add_response(ctrl, "access denied");
+    return -1;
+  }
+
+  /* Without arguments, the daemon's own counters are shown first. */
+  if (reqargc == 0) {
+    memset(&stats, 0, sizeof(stats));
+    (void) pr_pool_get_stats(&stats);
+
+    pr_ctrls_add_response(ctrl,
+      "pool: daemon: %lu bytes allocated, %lu blocks reused, "
+      "%lu free blocks (%lu bytes), %lu blocks released",
+      stats.bytes_allocated, stats.blocks_reused, stats.freelist_len,
+      stats.freelist_bytes, stats.blocks_released);
+  }
+
+  if (pr_rewind_scoreboard() < 0) {
+    pr_ctrls_log(MOD_CTRLS_ADMIN_VERSION, "error rewinding scoreboard: %s",
+      strerror(errno));
+    pr_ctrls_add_response(ctrl, "error rewinding scoreboard: %s",
+      strerror(errno));
+    return -1;
+  }
+
+  /* Each session publishes its pool counters in its scoreboard entry; show
+   * them for all sessions, or for the given users/PIDs.
+   */
+  while ((score = pr_scoreboard_entry_read()) != NULL) {
+    pr_signals_handle();
+
+    if (reqargc > 0) {
+      register int i;
+      int matched = FALSE;
+
+      for (i = 0; i < reqargc; i++) {
+        if (strcmp(reqargv[i], score->sce_user) == 0 ||
+            (unsigned long) atol(reqargv[i]) ==
+              (unsigned long) score->sce_pid) {
+          matched = TRUE;
+          break;
+        }
+      }
+
+      if (matched == FALSE) {
+        continue;
+      }
+    }
+
+    pr_ctrls_add_response(ctrl,
+      "pool: PID %lu (%s): %lu bytes allocated, %lu blocks reused, "
+      "%lu free blocks", (unsigned long) score->sce_pid,
+      *score->sce_user ? score->sce_user : "-", score->sce_pool_bytes,
+      score->sce_pool_reused, score->sce_pool_freelist_len);
+    nsessions++;
+  }
+
+  if (pr_restore_scoreboard() < 0) {
+    pr_ctrls_log(MOD_CTRLS_ADMIN_VERSION, "error restoring scoreboard: %s",
+      strerror(errno));
+  }
+
+  if (reqargc > 0 &&
+      nsessions == 0) {
+    pr_ctrls_add_response(ctrl, "pool: no matching sessions");
+  }
+
+  return 0;
+}
+
 static int ctrls_handle_restart(pr_ctrls_t *ctrl, int reqargc,
     char **reqargv) {
 
@@ -1704,10 +1853,14 @@ static ctrls_acttab_t ctrls_admin_acttab[] = {
     ctrls_handle_dns },
   { "down",     "disable an individual virtual server", NULL,
     ctrls_handle_down },
+  { "fscache",	"show sessions' FS cache counters",	NULL,
+    ctrls_handle_fscache },
   { "get",      "list configuration data",	NULL,
     ctrls_handle_get },
   { "kick",	"disconnect a class, host, or user",	NULL,
     ctrls_handle_kick },
+  { "pool",	"show memory pool counters",	NULL,
+    ctrls_handle_pool },
   { "restart",  "restart the daemon (similar to using HUP)",	NULL,
     ctrls_handle_restart },
   { "scoreboard", "clean the ScoreboardFile", NULL,
@@ -44,7 +44,7 @@
 # include <sys/uio.h>
 #endif
 
-#define MOD_STATCACHE_VERSION			"mod_statcache/0.2"
+#define MOD_STATCACHE_VERSION			"mod_statcache/0.3"
 
 /* Make sure the version of proftpd is as necessary. */
 #if PROFTPD_VERSION_NUMBER < 0x0001030402
@@ -68,6 +68,12 @@
  */
 #define STATCACHE_COLS_PER_ROW		10
 
+/* Default number of entries allowed in a cached directory listing, and the
+ * average name length assumed when sizing the space for those entries.
+ */
+#define STATCACHE_DEFAULT_LISTING_MAX_ENTRIES	1024
+#define STATCACHE_LISTING_NAMELEN		48
+
 /* Max number of lock attempts */
 #define STATCACHE_MAX_LOCK_ATTEMPTS	10
 
@@ -97,6 +103,43 @@ struct statcache_entry {
   time_t sce_ts;
 };
 
+/* A cached directory listing.  The stat of the directory itself is kept,
+ * and the listing is only used while the device, inode, mtime and ctime of
+ * the directory are unchanged.  The entries follow this header, packed as
+ * variable-length statcache_listing_entry records.
+ */
+struct statcache_listing {
+  uint32_t scl_hash;
+  char scl_path[PR_TUNABLE_PATH_MAX+1];
+  size_t scl_pathlen;
+  struct stat scl_stat;
+  time_t scl_ts;
+  uint32_t scl_nents;
+  size_t scl_datalen;
+};
+
+struct statcache_listing_entry {
+  struct stat scle_stat;
+  unsigned short scle_namelen;
+  unsigned char scle_type;
+
+  /* The NUL-terminated name follows. */
+};
+
+#define STATCACHE_LISTING_ALIGN(n) \
+  (((n) + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1))
+#define STATCACHE_LISTING_RECLEN(namelen) \
+  STATCACHE_LISTING_ALIGN(sizeof(struct statcache_listing_entry) + \
+    (namelen) + 1)
+
+struct statcache_listing_stats {
+  uint32_t count;
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t stale;
+  uint32_t rejects;
+};
+
 /*  Storage structure:
  *
  *    Header (stats):
@@ -111,6 +154,12 @@ struct statcache_entry {
  *    nrows = capacity / STATCACHE_COLS_PER_ROW
  *    row_len = sizeof(struct statcache_entry) * STATCACHE_COLS_PER_ROW
  *    row_start = ((hash % nrows) * row_len) + data_start
+ *
+ *  Listings (if StatCacheListings is configured), starting at the next
+ *  8-byte boundary after the entries:
+ *    struct statcache_listing_stats
+ *    slot_len = sizeof(struct statcache_listing) + (max_entries * avg_reclen)
+ *    slot_start = ((hash % nslots) * slot_len) + listings_start + stats_len
  */
 
 static int statcache_engine = FALSE;
@@ -128,6 +177,56 @@ static size_t statcache_tablesz = 0;
 static void *statcache_table_stats = NULL;
 static struct statcache_entry *statcache_table_data = NULL;
 
+static unsigned int statcache_listing_nslots = 0;
+static unsigned int statcache_listing_max_entries =
+  STATCACHE_DEFAULT_LISTING_MAX_ENTRIES;
+static size_t statcache_listing_slotlen = 0;
+static off_t statcache_listings_start = 0;
+static struct statcache_listing_stats *statcache_listing_stats = NULL;
+static char *statcache_listing_data = NULL;
+
+/* The most recently read listing in this process.  Listing a directory
+ * involves reading it, then looking up each entry; those lookups are
+ * answered from here, rather than by locking shared memory for each one.
+ */
+struct statcache_dirlist {
+  pool *pool;
+  const char *path;
+  size_t pathlen;
+  time_t ts;
+  unsigned int refcount;
+
+  struct statcache_dirent *ents;
+  unsigned int nents;
+  pr_table_t *tab;
+};
+
+struct statcache_dirent {
+  const char *name;
+  size_t namelen;
+  unsigned char type;
+  struct stat st;
+};
+
+/* Handle returned by our opendir.  For a directory with too many entries to
+ * be cached, the entries read so far are returned first, and then the
+ * remaining entries are read from the directory itself.
+ */
+struct statcache_dirh {
+  pool *pool;
+  struct statcache_dirlist *list;
+  unsigned int idx;
+  DIR *dir;
+
+  /* On some platforms, d_name is not large enough for a full name. */
+  union {
+    struct dirent dent;
+    char buf[sizeof(struct dirent) + NAME_MAX_GUESS + 1];
+  } de;
+};
+
+static struct statcache_dirlist *statcache_curr_dirlist = NULL;
+
 static const char *trace_channel = "statcache";
 
 static int statcache_wlock_row(int fd, uint32_t hash);
@@ -441,8 +540,8 @@ static int statcache_stats_incr_count(int32_t incr) {
   count = ((uint32_t *) statcache_table_stats);
 
   /* highest = statcache_table_stats + (1 * sizeof(uint32_t)) */
-  highest = ((uint32_t *) ((char *) statcache_table_stats) +
-    (1 * sizeof(uint32_t)));
+  highest = ((uint32_t *) ((char *) statcache_table_stats +
+    (1 * sizeof(uint32_t))));
 
   if (incr < 0) {
     /* Prevent underflow. */
@@ -472,8 +571,8 @@ static int statcache_stats_incr_hits(int32_t incr) {
   }
 
   /* hits = statcache_table_stats + (2 * sizeof(uint32_t)) */
-  hits = ((uint32_t *) ((char *) statcache_table_stats) +
-    (2 * sizeof(uint32_t)));
+  hits = ((uint32_t *) ((char *) statcache_table_stats +
+    (2 * sizeof(uint32_t))));
 
   /* Prevent underflow. */
   if (incr < 0 &&
@@ -495,8 +594,8 @@ static int statcache_stats_incr_misses(int32_t incr) {
   }
  
   /* misses = statcache_table_stats + (3 * sizeof(uint32_t)) */
-  misses = ((uint32_t *) ((char *) statcache_table_stats) +
-    (3 * sizeof(uint32_t)));
+  misses = ((uint32_t *) ((char *) statcache_table_stats +
+    (3 * sizeof(uint32_t))));
 
   /* Prevent underflow. */
   if (incr < 0 &&
@@ -518,8 +617,8 @@ static int statcache_stats_incr_expires(int32_t incr) {
   }
  
   /* expires = statcache_table_stats + (4 * sizeof(uint32_t)) */
-  expires = ((uint32_t *) ((char *) statcache_table_stats) +
-    (4 * sizeof(uint32_t)));
+  expires = ((uint32_t *) ((char *) statcache_table_stats +
+    (4 * sizeof(uint32_t))));
 
   /* Prevent underflow. */
   if (incr < 0 &&
@@ -541,8 +640,8 @@ static int statcache_stats_incr_rejects(int32_t incr) {
   }
 
   /* rejects = statcache_table_stats + (5 * sizeof(uint32_t)) */
-  rejects = ((uint32_t *) ((char *) statcache_table_stats) +
-    (5 * sizeof(uint32_t)));
+  rejects = ((uint32_t *) ((char *) statcache_table_stats +
+    (5 * sizeof(uint32_t))));
 
   /* Prevent underflow. */
   if (incr < 0 &&
@@ -568,13 +667,14 @@ static int get_row_range(uint32_t hash, off_t *row_start, off_t *row_len) {
   return 0;
 }
 
-static int lock_row(int fd, int lock_type, uint32_t hash) {
+static int lock_range(int fd, int lock_type, off_t start, off_t len) {
   struct flock lock;
   unsigned int nattempts = 1;
 
   lock.l_type = lock_type;
   lock.l_whence = 0;
-  get_row_range(hash, &lock.l_start, &lock.l_len);
+  lock.l_start = start;
+  lock.l_len = len;
 
   pr_trace_msg(trace_channel, 15,
     "attempt #%u to acquire row %s lock on StatCacheTable fd %d "
@@ -639,6 +739,13 @@ static int lock_row(int fd, int lock_type, uint32_t hash) {
   return 0;
 }
 
+static int lock_row(int fd, int lock_type, uint32_t hash) {
+  off_t row_start, row_len;
+
+  get_row_range(hash, &row_start, &row_len);
+  return lock_range(fd, lock_type, row_start, row_len);
+}
+
 static int statcache_wlock_row(int fd, uint32_t hash) {
   return lock_row(fd, F_WRLCK, hash);
 }
@@ -996,6 +1103,477 @@ static const char *statcache_get_canon_path(pool *p, const char *path,
   return canon_path;
 }
 
+/* Listing cache routines */
+
+static const char *statcache_get_listing_path(pool *p, const char *path,
+    size_t *pathlen) {
+  const char *canon_path;
+  char *clean_path;
+  size_t canon_pathlen = 0, clean_pathlen;
+
+  canon_path = statcache_get_canon_path(p, path, &canon_pathlen);
+  if (canon_path == NULL) {
+    return NULL;
+  }
+
+  /* Directories are usually opened as ".", after changing into them; make
+   * sure that such paths have the same key as the directory's full path.
+   */
+  clean_pathlen = canon_pathlen + 1;
+  clean_path = palloc(p, clean_pathlen);
+  pr_fs_clean_path(canon_path, clean_path, clean_pathlen);
+
+  clean_pathlen = strlen(clean_path);
+  if (clean_pathlen > 1 &&
+      clean_path[clean_pathlen-1] == '/') {
+    clean_path[--clean_pathlen] = '\0';
+  }
+
+  *pathlen = clean_pathlen;
+  return clean_path;
+}
+
+static struct statcache_listing *statcache_listing_get_slot(uint32_t hash) {
+  return (struct statcache_listing *) (statcache_listing_data +
+    ((hash % statcache_listing_nslots) * statcache_listing_slotlen));
+}
+
+static int lock_listing(int fd, int lock_type, uint32_t hash) {
+  off_t slot_start;
+
+  slot_start = statcache_listings_start +
+    STATCACHE_LISTING_ALIGN(sizeof(struct statcache_listing_stats)) +
+    ((hash % statcache_listing_nslots) * statcache_listing_slotlen);
+  return lock_range(fd, lock_type, slot_start, statcache_listing_slotlen);
+}
+
+static void statcache_listing_stats_incr(int fd, uint32_t *counter,
+    int32_t incr) {
+  if (lock_range(fd, F_WRLCK, statcache_listings_start,
+      sizeof(struct statcache_listing_stats)) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error write-locking shared memory: %s", strerror(errno));
+  }
+
+  /* Prevent underflow. */
+  if (incr < 0 &&
+      *counter < (uint32_t) -incr) {
+    *counter = 0;
+
+  } else {
+    *counter += incr;
+  }
+
+  if (lock_range(fd, F_UNLCK, statcache_listings_start,
+      sizeof(struct statcache_listing_stats)) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error un-locking shared memory: %s", strerror(errno));
+  }
+}
+
+static struct statcache_dirlist *statcache_dirlist_alloc(const char *path,
+    size_t pathlen) {
+  pool *p;
+  struct statcache_dirlist *list;
+
+  p = make_sub_pool(statcache_pool);
+  pr_pool_tag(p, "statcache dirlist pool");
+
+  list = pcalloc(p, sizeof(struct statcache_dirlist));
+  list->pool = p;
+  list->path = pstrndup(p, path, pathlen);
+  list->pathlen = pathlen;
+  list->refcount = 1;
+
+  return list;
+}
+
+static void statcache_dirlist_release(struct statcache_dirlist *list) {
+  if (list == NULL) {
+    return;
+  }
+
+  list->refcount--;
+  if (list->refcount == 0) {
+    destroy_pool(list->pool);
+  }
+}
+
+static void statcache_dirlist_set_curr(struct statcache_dirlist *list) {
+  register unsigned int i;
+  unsigned int max_ents;
+
+  if (list->tab == NULL) {
+    list->tab = pr_table_alloc(list->pool, 0);
+
+    max_ents = list->nents + 1;
+    (void) pr_table_ctl(list->tab, PR_TABLE_CTL_SET_MAX_ENTS, &max_ents);
+
+    for (i = 0; i < list->nents; i++) {
+      (void) pr_table_add(list->tab, list->ents[i].name, &(list->ents[i]),
+        sizeof(struct statcache_dirent));
+    }
+  }
+
+  statcache_dirlist_release(statcache_curr_dirlist);
+  statcache_curr_dirlist = list;
+  list->refcount++;
+}
+
+/* Look up the given path in the most recently read listing. */
+static int statcache_dirlist_get(const char *path, size_t pathlen,
+    struct stat *st, unsigned char op) {
+  const char *name;
+  size_t dirlen;
+  const struct statcache_dirent *ent;
+  struct statcache_dirlist *list;
+
+  list = statcache_curr_dirlist;
+  if (list == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  name = strrchr(path, '/');
+  if (name == NULL ||
+      name[1] == '\0') {
+    errno = ENOENT;
+    return -1;
+  }
+
+  dirlen = name - path;
+  if (dirlen == 0) {
+    /* The root directory. */
+    dirlen = 1;
+  }
+
+  if (dirlen != list->pathlen ||
+      strncmp(path, list->path, dirlen) != 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (time(NULL) > (list->ts + statcache_max_positive_age)) {
+    statcache_dirlist_release(list);
+    statcache_curr_dirlist = NULL;
+
+    errno = ENOENT;
+    return -1;
+  }
+
+  ent = pr_table_get(list->tab, name + 1, NULL);
+  if (ent == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  /* A stat(2) of a symlink needs the target, which we do not have. */
+  if (op == FSIO_FILE_STAT &&
+      S_ISLNK(ent->st.st_mode)) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  memcpy(st, &(ent->st), sizeof(struct stat));
+  return 0;
+}
+
+/* Copy the listing for the given directory out of shared memory, if the
+ * listing is present, and the directory has not changed since it was read.
+ */
+static struct statcache_dirlist *statcache_listing_get(int fd,
+    const char *path, size_t pathlen, struct stat *dir_st, uint32_t hash) {
+  register unsigned int i;
+  struct statcache_listing *scl;
+  struct statcache_dirlist *list = NULL;
+  uint32_t *counter;
+  char *data;
+
+  if (lock_listing(fd, F_RDLCK, hash) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error read-locking shared memory: %s", strerror(errno));
+  }
+
+  scl = statcache_listing_get_slot(hash);
+  counter = &(statcache_listing_stats->misses);
+
+  if (scl->scl_ts > 0 &&
+      scl->scl_hash == hash &&
+      scl->scl_pathlen == pathlen &&
+      strncmp(scl->scl_path, path, pathlen + 1) == 0) {
+
+    if (scl->scl_stat.st_dev != dir_st->st_dev ||
+        scl->scl_stat.st_ino != dir_st->st_ino ||
+        scl->scl_stat.st_mtime != dir_st->st_mtime ||
+        scl->scl_stat.st_ctime != dir_st->st_ctime ||
+        time(NULL) > (scl->scl_ts + statcache_max_positive_age)) {
+      pr_trace_msg(trace_channel, 17,
+        "ignoring stale listing for directory '%s'", path);
+      counter = &(statcache_listing_stats->stale);
+
+    } else {
+      list = statcache_dirlist_alloc(path, pathlen);
+      list->ts = scl->scl_ts;
+      list->nents = scl->scl_nents;
+      list->ents = pcalloc(list->pool,
+        (list->nents + 1) * sizeof(struct statcache_dirent));
+
+      /* Copy the packed entries in one go, then point into the copy. */
+      data = palloc(list->pool, scl->scl_datalen + 1);
+      memcpy(data, ((char *) scl) + sizeof(struct statcache_listing),
+        scl->scl_datalen);
+
+      for (i = 0; i < list->nents; i++) {
+        struct statcache_listing_entry *scle;
+        struct statcache_dirent *ent;
+
+        scle = (struct statcache_listing_entry *) data;
+        ent = &(list->ents[i]);
+
+        memcpy(&(ent->st), &(scle->scle_stat), sizeof(struct stat));
+        ent->namelen = scle->scle_namelen;
+        ent->type = scle->scle_type;
+        ent->name = data + sizeof(struct statcache_listing_entry);
+
+        data += STATCACHE_LISTING_RECLEN(ent->namelen);
+      }
+
+      pr_trace_msg(trace_channel, 9,
+        "using cached listing (%u entries) for directory '%s'",
+        list->nents, path);
+      counter = &(statcache_listing_stats->hits);
+    }
+  }
+
+  if (lock_listing(fd, F_UNLCK, hash) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error unlocking shared memory: %s", strerror(errno));
+  }
+
+  statcache_listing_stats_incr(fd, counter, 1);
+  return list;
+}
+
+static int statcache_listing_add(int fd, struct statcache_dirlist *list,
+    struct stat *dir_st, uint32_t hash) {
+  register unsigned int i;
+  struct statcache_listing *scl;
+  size_t datalen = 0;
+  char *data;
+  int replaced = FALSE;
+
+  /* Timestamps only have a resolution of seconds; a directory changed in
+   * the same second as it was read might change again without its mtime
+   * changing.  Such listings are not shared.
+   */
+  if (dir_st->st_mtime >= list->ts ||
+      dir_st->st_ctime >= list->ts) {
+    pr_trace_msg(trace_channel, 17,
+      "directory '%s' changed too recently to cache its listing", list->path);
+    errno = EAGAIN;
+    return -1;
+  }
+
+  for (i = 0; i < list->nents; i++) {
+    datalen += STATCACHE_LISTING_RECLEN(list->ents[i].namelen);
+  }
+
+  if (list->pathlen > PR_TUNABLE_PATH_MAX ||
+      datalen > (statcache_listing_slotlen -
+        sizeof(struct statcache_listing))) {
+    pr_trace_msg(trace_channel, 9,
+      "listing for directory '%s' (%u entries, %lu bytes) too large to cache",
+      list->path, list->nents, (unsigned long) datalen);
+    statcache_listing_stats_incr(fd, &(statcache_listing_stats->rejects), 1);
+
+    errno = ENOSPC;
+    return -1;
+  }
+
+  if (lock_listing(fd, F_WRLCK, hash) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error write-locking shared memory: %s", strerror(errno));
+  }
+
+  scl = statcache_listing_get_slot(hash);
+  replaced = (scl->scl_ts > 0);
+
+  scl->scl_hash = hash;
+  memcpy(scl->scl_path, list->path, list->pathlen + 1);
+  scl->scl_pathlen = list->pathlen;
+  memcpy(&(scl->scl_stat), dir_st, sizeof(struct stat));
+  scl->scl_nents = list->nents;
+  scl->scl_datalen = datalen;
+
+  data = ((char *) scl) + sizeof(struct statcache_listing);
+  for (i = 0; i < list->nents; i++) {
+    struct statcache_listing_entry *scle;
+    struct statcache_dirent *ent;
+
+    ent = &(list->ents[i]);
+    scle = (struct statcache_listing_entry *) data;
+
+    memcpy(&(scle->scle_stat), &(ent->st), sizeof(struct stat));
+    scle->scle_namelen = ent->namelen;
+    scle->scle_type = ent->type;
+    memcpy(data + sizeof(struct statcache_listing_entry), ent->name,
+      ent->namelen + 1);
+
+    data += STATCACHE_LISTING_RECLEN(ent->namelen);
+  }
+
+  scl->scl_ts = list->ts;
+
+  if (lock_listing(fd, F_UNLCK, hash) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error unlocking shared memory: %s", strerror(errno));
+  }
+
+  pr_trace_msg(trace_channel, 9,
+    "adding listing (%u entries, %lu bytes) for directory '%s' at slot %lu",
+    list->nents, (unsigned long) datalen, list->path,
+    (unsigned long) (hash % statcache_listing_nslots) + 1);
+
+  if (replaced == FALSE) {
+    statcache_listing_stats_incr(fd, &(statcache_listing_stats->count), 1);
+  }
+
+  return 0;
+}
+
+/* Changing a path changes the listing of its parent directory. */
+static void statcache_listing_remove(int fd, const char *path,
+    size_t pathlen) {
+  const char *ptr;
+  size_t dirlen;
+  uint32_t hash;
+  struct statcache_listing *scl;
+  int removed = FALSE;
+
+  if (statcache_listing_nslots == 0 ||
+      path[0] != '/') {
+    return;
+  }
+
+  ptr = strrchr(path, '/');
+  dirlen = ptr - path;
+  if (dirlen == 0) {
+    dirlen = 1;
+  }
+
+  if (statcache_curr_dirlist != NULL &&
+      statcache_curr_dirlist->pathlen == dirlen &&
+      strncmp(statcache_curr_dirlist->path, path, dirlen) == 0) {
+    statcache_dirlist_release(statcache_curr_dirlist);
+    statcache_curr_dirlist = NULL;
+  }
+
+  hash = statcache_hash(path, dirlen);
+
+  if (lock_listing(fd, F_WRLCK, hash) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error write-locking shared memory: %s", strerror(errno));
+  }
+
+  scl = statcache_listing_get_slot(hash);
+  if (scl->scl_ts > 0 &&
+      scl->scl_hash == hash &&
+      scl->scl_pathlen == dirlen &&
+      strncmp(scl->scl_path, path, dirlen) == 0) {
+    pr_trace_msg(trace_channel, 9,
+      "removing listing for directory '%s'", scl->scl_path);
+    scl->scl_ts = 0;
+    removed = TRUE;
+  }
+
+  if (lock_listing(fd, F_UNLCK, hash) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error unlocking shared memory: %s", strerror(errno));
+  }
+
+  if (removed == TRUE) {
+    statcache_listing_stats_incr(fd, &(statcache_listing_stats->count), -1);
+  }
+}
+
+/* Read the directory, up to the configured maximum number of entries.
+ * Returns TRUE if all of the entries were read, and looked up.
+ */
+static int statcache_listing_read(struct statcache_dirh *dirh,
+    struct statcache_dirlist *list) {
+  register unsigned int i, j;
+  array_header *ents;
+  struct dirent *dent;
+  int complete = TRUE;
+
+  ents = make_array(list->pool, 64, sizeof(struct statcache_dirent));
+
+  while ((dent = readdir(dirh->dir)) != NULL) {
+    struct statcache_dirent *ent;
+
+    pr_signals_handle();
+
+    ent = push_array(ents);
+    memset(ent, 0, sizeof(struct statcache_dirent));
+    ent->namelen = strlen(dent->d_name);
+    ent->name = pstrndup(list->pool, dent->d_name, ent->namelen);
+    ent->st.st_ino = dent->d_ino;
+#ifdef DT_UNKNOWN
+    ent->type = dent->d_type;
+#endif /* DT_UNKNOWN */
+
+    if ((unsigned int) ents->nelts > statcache_listing_max_entries) {
+      /* Too many entries; the rest are read from the directory itself. */
+      complete = FALSE;
+      break;
+    }
+  }
+
+  list->ents = ents->elts;
+  list->nents = ents->nelts;
+
+  if (complete == FALSE) {
+    return FALSE;
+  }
+
+  (void) closedir(dirh->dir);
+  dirh->dir = NULL;
+
+  /* Look up each entry, as the caller would.  Entries which have since
+   * been removed are dropped; any other error means that this session's
+   * view of the directory may differ from others', and is not shared.
+   */
+  for (i = 0, j = 0; i < list->nents; i++) {
+    struct statcache_dirent *ent;
+    const char *path;
+
+    pr_signals_handle();
+
+    ent = &(list->ents[i]);
+    path = pdircat(list->pool, list->path, ent->name, NULL);
+    if (lstat(path, &(ent->st)) < 0) {
+      int xerrno = errno;
+
+      if (xerrno == ENOENT) {
+        continue;
+      }
+
+      pr_trace_msg(trace_channel, 9,
+        "error looking up '%s': %s, not caching listing for directory '%s'",
+        path, strerror(xerrno), list->path);
+      complete = FALSE;
+    }
+
+    if (j != i) {
+      memcpy(&(list->ents[j]), ent, sizeof(struct statcache_dirent));
+    }
+    j++;
+  }
+
+  list->nents = j;
+  return complete;
+}
+
 /* FSIO callbacks
  */
 
@@ -1018,6 +1596,15 @@ static int statcache_fsio_stat(pr_fs_t *fs, const char *path,
     return -1;
   }
 
+  if (statcache_curr_dirlist != NULL &&
+      statcache_dirlist_get(canon_path, canon_pathlen, st, FSIO_FILE_STAT) == 0) {
+    pr_trace_msg(trace_channel, 11,
+      "using listing stat for path '%s'", canon_path);
+
+    destroy_pool(p);
+    return 0;
+  }
+
   hash = statcache_hash(canon_path, canon_pathlen);
   tab_fd = statcache_tabfh->fh_fd;
 
@@ -1185,6 +1772,15 @@ static int statcache_fsio_lstat(pr_fs_t *fs, const char *path,
     return -1;
   }
 
+  if (statcache_curr_dirlist != NULL &&
+      statcache_dirlist_get(canon_path, canon_pathlen, st, FSIO_FILE_LSTAT) == 0) {
+    pr_trace_msg(trace_channel, 11,
+      "using listing lstat for path '%s'", canon_path);
+
+    destroy_pool(p);
+    return 0;
+  }
+
   hash = statcache_hash(canon_path, canon_pathlen);
   tab_fd = statcache_tabfh->fh_fd;
 
@@ -1296,6 +1892,7 @@ static int statcache_fsio_rename(pr_fs_t *fs, const char *rnfm,
     }   
 
     (void) statcache_table_remove(tab_fd, canon_rnfm, canon_rnfmlen, hash_rnfm);
+    statcache_listing_remove(tab_fd, canon_rnfm, canon_rnfmlen);
 
     if (statcache_unlock_row(tab_fd, hash_rnfm) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1308,6 +1905,7 @@ static int statcache_fsio_rename(pr_fs_t *fs, const char *rnfm,
     }
 
     (void) statcache_table_remove(tab_fd, canon_rnto, canon_rntolen, hash_rnto);
+    statcache_listing_remove(tab_fd, canon_rnto, canon_rntolen);
 
     if (statcache_unlock_row(tab_fd, hash_rnto) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1354,6 +1952,7 @@ static int statcache_fsio_unlink(pr_fs_t *fs, const char *path) {
     }
 
     (void) statcache_table_remove(tab_fd, canon_path, canon_pathlen, hash);
+    statcache_listing_remove(tab_fd, canon_path, canon_pathlen);
 
     if (statcache_unlock_row(tab_fd, hash) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1370,7 +1969,7 @@ static int statcache_fsio_unlink(pr_fs_t *fs, const char *path) {
 static int statcache_fsio_open(pr_fh_t *fh, const char *path, int flags) {
   int res, xerrno;
 
-  res = open(path, flags);
+  res = open(path, flags, PR_OPEN_MODE);
   xerrno = errno;
 
   if (res >= 0) {
@@ -1407,6 +2006,7 @@ static int statcache_fsio_open(pr_fh_t *fh, const char *path, int flags) {
       pr_trace_msg(trace_channel, 14,
         "removing entry for path '%s' due to open(2) flags", canon_path);
       (void) statcache_table_remove(tab_fd, canon_path, canon_pathlen, hash);
+      statcache_listing_remove(tab_fd, canon_path, canon_pathlen);
 
       if (statcache_unlock_row(tab_fd, hash) < 0) {
         pr_trace_msg(trace_channel, 3,
@@ -1443,6 +2043,7 @@ static int statcache_fsio_write(pr_fh_t *fh, int fd, const char *buf,
     }
   
     (void) statcache_table_remove(tab_fd, fh->fh_path, pathlen, hash);
+    statcache_listing_remove(tab_fd, fh->fh_path, pathlen);
 
     if (statcache_unlock_row(tab_fd, hash) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1487,6 +2088,7 @@ static int statcache_fsio_truncate(pr_fs_t *fs, const char *path, off_t len) {
     }
  
     (void) statcache_table_remove(tab_fd, canon_path, canon_pathlen, hash);
+    statcache_listing_remove(tab_fd, canon_path, canon_pathlen);
 
     if (statcache_unlock_row(tab_fd, hash) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1521,6 +2123,7 @@ static int statcache_fsio_ftruncate(pr_fh_t *fh, int fd, off_t len) {
     }
  
     (void) statcache_table_remove(tab_fd, fh->fh_path, pathlen, hash);
+    statcache_listing_remove(tab_fd, fh->fh_path, pathlen);
 
     if (statcache_unlock_row(tab_fd, hash) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1565,6 +2168,7 @@ static int statcache_fsio_chmod(pr_fs_t *fs, const char *path, mode_t mode) {
     }
  
     (void) statcache_table_remove(tab_fd, canon_path, canon_pathlen, hash);
+    statcache_listing_remove(tab_fd, canon_path, canon_pathlen);
 
     if (statcache_unlock_row(tab_fd, hash) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1599,6 +2203,7 @@ static int statcache_fsio_fchmod(pr_fh_t *fh, int fd, mode_t mode) {
     }
  
     (void) statcache_table_remove(tab_fd, fh->fh_path, pathlen, hash);
+    statcache_listing_remove(tab_fd, fh->fh_path, pathlen);
 
     if (statcache_unlock_row(tab_fd, hash) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1644,6 +2249,7 @@ static int statcache_fsio_chown(pr_fs_t *fs, const char *path, uid_t uid,
     }
  
     (void) statcache_table_remove(tab_fd, canon_path, canon_pathlen, hash);
+    statcache_listing_remove(tab_fd, canon_path, canon_pathlen);
 
     if (statcache_unlock_row(tab_fd, hash) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1678,6 +2284,7 @@ static int statcache_fsio_fchown(pr_fh_t *fh, int fd, uid_t uid, gid_t gid) {
     }
  
     (void) statcache_table_remove(tab_fd, fh->fh_path, pathlen, hash);
+    statcache_listing_remove(tab_fd, fh->fh_path, pathlen);
 
     if (statcache_unlock_row(tab_fd, hash) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1724,6 +2331,7 @@ static int statcache_fsio_lchown(pr_fs_t *fs, const char *path, uid_t uid,
     }
  
     (void) statcache_table_remove(tab_fd, canon_path, canon_pathlen, hash);
+    statcache_listing_remove(tab_fd, canon_path, canon_pathlen);
 
     if (statcache_unlock_row(tab_fd, hash) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1772,6 +2380,7 @@ static int statcache_fsio_utimes(pr_fs_t *fs, const char *path,
     }
  
     (void) statcache_table_remove(tab_fd, canon_path, canon_pathlen, hash);
+    statcache_listing_remove(tab_fd, canon_path, canon_pathlen);
 
     if (statcache_unlock_row(tab_fd, hash) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1816,6 +2425,7 @@ static int statcache_fsio_futimes(pr_fh_t *fh, int fd, struct timeval *tvs) {
     }
  
     (void) statcache_table_remove(tab_fd, fh->fh_path, pathlen, hash);
+    statcache_listing_remove(tab_fd, fh->fh_path, pathlen);
 
     if (statcache_unlock_row(tab_fd, hash) < 0) {
       pr_trace_msg(trace_channel, 3,
@@ -1830,6 +2440,134 @@ static int statcache_fsio_futimes(pr_fh_t *fh, int fd, struct timeval *tvs) {
 #endif /* HAVE_FUTIMES */
 }
 
+static void *statcache_fsio_opendir(pr_fs_t *fs, const char *path) {
+  int tab_fd, xerrno;
+  const char *canon_path = NULL;
+  size_t canon_pathlen = 0;
+  pool *p;
+  uint32_t hash;
+  struct stat st;
+  struct statcache_dirh *dirh;
+  struct statcache_dirlist *list = NULL;
+  DIR *dir;
+
+  /* Stat the directory before reading it, so that a change made while it
+   * is being read makes the cached listing stale, rather than hiding it.
+   */
+  if (stat(path, &st) < 0) {
+    return NULL;
+  }
+
+  dir = opendir(path);
+  if (dir == NULL) {
+    return NULL;
+  }
+
+  p = make_sub_pool(statcache_pool);
+  pr_pool_tag(p, "statcache_fsio_opendir sub-pool");
+
+  dirh = pcalloc(p, sizeof(struct statcache_dirh));
+  dirh->pool = p;
+  dirh->dir = dir;
+
+  canon_path = statcache_get_listing_path(p, path, &canon_pathlen);
+  if (canon_path == NULL) {
+    return dirh;
+  }
+
+  hash = statcache_hash(canon_path, canon_pathlen);
+  tab_fd = statcache_tabfh->fh_fd;
+
+  /* The listing may have been read by a session with different
+   * permissions; we need to be able to look up the entries ourselves.
+   */
+  if (pr_fsio_access(path, X_OK, session.uid, session.gid,
+      session.gids) == 0) {
+    list = statcache_listing_get(tab_fd, canon_path, canon_pathlen, &st,
+      hash);
+  }
+
+  if (list != NULL) {
+    (void) closedir(dir);
+    dirh->dir = NULL;
+
+  } else {
+    int complete;
+
+    list = statcache_dirlist_alloc(canon_path, canon_pathlen);
+    list->ts = time(NULL);
+
+    complete = statcache_listing_read(dirh, list);
+    if (complete == TRUE) {
+      if (statcache_listing_add(tab_fd, list, &st, hash) < 0) {
+        xerrno = errno;
+
+        if (xerrno != ENOSPC &&
+            xerrno != EAGAIN) {
+          pr_trace_msg(trace_channel, 3,
+            "error adding listing for directory '%s': %s", canon_path,
+            strerror(xerrno));
+        }
+      }
+    }
+
+    if (complete == FALSE) {
+      dirh->list = list;
+      return dirh;
+    }
+  }
+
+  statcache_dirlist_set_curr(list);
+  dirh->list = list;
+  return dirh;
+}
+
+static struct dirent *statcache_fsio_readdir(pr_fs_t *fs, void *dir) {
+  struct statcache_dirh *dirh;
+  struct statcache_dirlist *list;
+
+  dirh = dir;
+  list = dirh->list;
+
+  if (list != NULL &&
+      dirh->idx < list->nents) {
+    struct statcache_dirent *ent;
+    struct dirent *dent;
+
+    ent = &(list->ents[dirh->idx++]);
+    dent = &(dirh->de.dent);
+
+    memcpy(dent->d_name, ent->name, ent->namelen + 1);
+    dent->d_ino = ent->st.st_ino;
+#ifdef DT_UNKNOWN
+    dent->d_type = ent->type;
+#endif /* DT_UNKNOWN */
+
+    return dent;
+  }
+
+  if (dirh->dir != NULL) {
+    return readdir(dirh->dir);
+  }
+
+  return NULL;
+}
+
+static int statcache_fsio_closedir(pr_fs_t *fs, void *dir) {
+  int res = 0;
+  struct statcache_dirh *dirh;
+
+  dirh = dir;
+  if (dirh->dir != NULL) {
+    res = closedir(dirh->dir);
+  }
+
+  statcache_dirlist_release(dirh->list);
+  destroy_pool(dirh->pool);
+
+  return res;
+}
+
 #ifdef PR_USE_CTRLS
 /* Controls handlers
  */
@@ -1901,6 +2639,47 @@ static int statcache_handle_statcache(pr_ctrls_t *ctrl, int reqargc,
       (unsigned long) highest, (unsigned long) statcache_capacity,
       highest_usage);
 
+    if (statcache_listing_nslots > 0) {
+      struct statcache_listing_stats listing_stats;
+      int fd;
+
+      fd = statcache_tabfh->fh_fd;
+      if (lock_range(fd, F_RDLCK, statcache_listings_start,
+          sizeof(struct statcache_listing_stats)) < 0) {
+        pr_ctrls_add_response(ctrl, "error locking shared memory: %s",
+          strerror(errno));
+        return -1;
+      }
+
+      memcpy(&listing_stats, statcache_listing_stats,
+        sizeof(struct statcache_listing_stats));
+
+      if (lock_range(fd, F_UNLCK, statcache_listings_start,
+          sizeof(struct statcache_listing_stats)) < 0) {
+        pr_trace_msg(trace_channel, 3,
+          "error un-locking shared memory: %s", strerror(errno));
+      }
+
+      hit_rate = 0.0;
+      if ((listing_stats.hits + listing_stats.misses +
+           listing_stats.stale) > 0) {
+        hit_rate = (((float) listing_stats.hits /
+          (float) (listing_stats.hits + listing_stats.misses +
+            listing_stats.stale)) * 100.0);
+      }
+
+      pr_ctrls_add_response(ctrl,
+        " listing hits %lu, misses %lu, stale %lu: %02.1f%% hit rate",
+        (unsigned long) listing_stats.hits,
+        (unsigned long) listing_stats.misses,
+        (unsigned long) listing_stats.stale, hit_rate);
+      pr_ctrls_add_response(ctrl, "   rejects %lu",
+        (unsigned long) listing_stats.rejects);
+      pr_ctrls_add_response(ctrl, " current listings: %lu (of %lu)",
+        (unsigned long) listing_stats.count,
+        (unsigned long) statcache_listing_nslots);
+    }
+
   } else if (strcmp(reqargv[0], "dump") == 0) {
     register unsigned int i;
     time_t now;
@@ -1947,6 +2726,27 @@ static int statcache_handle_statcache(pr_ctrls_t *ctrl, int reqargc,
       }
     }
 
+    if (statcache_listing_nslots > 0) {
+      pr_ctrls_add_response(ctrl, "  Listings:");
+
+      for (i = 0; i < statcache_listing_nslots; i++) {
+        struct statcache_listing *scl;
+
+        pr_signals_handle();
+
+        scl = statcache_listing_get_slot(i);
+        if (scl->scl_ts > 0) {
+          pr_ctrls_add_response(ctrl,
+            "    Slot %u: '%s' (%lu entries, %u secs old)", i + 1,
+            scl->scl_path, (unsigned long) scl->scl_nents,
+            (unsigned int) (now - scl->scl_ts));
+
+        } else {
+          pr_ctrls_add_response(ctrl, "    Slot %u: <empty>", i + 1);
+        }
+      }
+    }
+
     statcache_unlock_table(statcache_tabfh->fh_fd);
 
   } else {
@@ -2053,6 +2853,36 @@ MODRET set_statcacheengine(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: StatCacheListings count [max-entries] */
+MODRET set_statcachelistings(cmd_rec *cmd) {
+  int count, max_entries = STATCACHE_DEFAULT_LISTING_MAX_ENTRIES;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  count = atoi(cmd->argv[1]);
+  if (count < 0) {
+    CONF_ERROR(cmd, "count parameter must be 0 or greater");
+  }
+
+  if (cmd->argc == 3) {
+    max_entries = atoi(cmd->argv[2]);
+    if (max_entries <= 0 ||
+        max_entries > 65535) {
+      CONF_ERROR(cmd, "max-entries parameter must be between 1 and 65535");
+    }
+  }
+
+  statcache_listing_nslots = count;
+  statcache_listing_max_entries = max_entries;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: StatCacheMaxAge secs */
 MODRET set_statcachemaxage(cmd_rec *cmd) {
   int positive_age;
@@ -2144,6 +2974,12 @@ MODRET statcache_post_pass(cmd_rec *cmd) {
   fs->utimes = statcache_fsio_utimes;
   fs->futimes = statcache_fsio_futimes;
 
+  if (statcache_listing_nslots > 0) {
+    fs->opendir = statcache_fsio_opendir;
+    fs->readdir = statcache_fsio_readdir;
+    fs->closedir = statcache_fsio_closedir;
+  }
+
   pr_fs_setcwd(pr_fs_getvwd());
   pr_fs_clear_cache();
 
@@ -2392,6 +3228,20 @@ static void statcache_postparse_ev(const void *event_data, void *user_data) {
   tablesz = (6 * sizeof(uint32_t)) +
     (statcache_capacity * sizeof(struct statcache_entry));
 
+  /* Any cached listings follow, each in a slot sized for the configured
+   * maximum number of entries, with names of average length.
+   */
+  if (statcache_listing_nslots > 0) {
+    statcache_listings_start = STATCACHE_LISTING_ALIGN(tablesz);
+    statcache_listing_slotlen = STATCACHE_LISTING_ALIGN(
+      sizeof(struct statcache_listing) + (statcache_listing_max_entries *
+        STATCACHE_LISTING_RECLEN(STATCACHE_LISTING_NAMELEN)));
+
+    tablesz = statcache_listings_start +
+      STATCACHE_LISTING_ALIGN(sizeof(struct statcache_listing_stats)) +
+      (statcache_listing_nslots * statcache_listing_slotlen);
+  }
+
   /* Get the shm for storing all of our stat info. */
   table = statcache_get_shm(statcache_tabfh, tablesz);
   if (table == NULL) {
@@ -2409,12 +3259,24 @@ static void statcache_postparse_ev(const void *event_data, void *user_data) {
   statcache_table = table;
   statcache_tablesz = tablesz;
   statcache_table_stats = statcache_table;
-  statcache_table_data = ((struct statcache_entry *) statcache_table) +
-    (6 * sizeof(uint32_t));
+  statcache_table_data = (struct statcache_entry *)
+    ((char *) statcache_table + (6 * sizeof(uint32_t)));
 
   statcache_nrows = (statcache_capacity / STATCACHE_COLS_PER_ROW);
   statcache_rowlen = (STATCACHE_COLS_PER_ROW * sizeof(struct statcache_entry));
 
+  if (statcache_listing_nslots > 0) {
+    statcache_listing_stats = (struct statcache_listing_stats *)
+      ((char *) statcache_table + statcache_listings_start);
+    statcache_listing_data = (char *) statcache_listing_stats +
+      STATCACHE_LISTING_ALIGN(sizeof(struct statcache_listing_stats));
+
+    pr_trace_msg(trace_channel, 9,
+      "allocated %lu bytes of shared memory for %u listings of up to %u "
+      "entries", (unsigned long) (tablesz - statcache_listings_start),
+      statcache_listing_nslots, statcache_listing_max_entries);
+  }
+
   return;
 }
 
@@ -2529,6 +3391,7 @@ static conftable statcache_conftab[] = {
   { "StatCacheCapacity",	set_statcachecapacity,	NULL },
   { "StatCacheControlsACLs",	set_statcachectrlsacls,	NULL },
   { "StatCacheEngine",		set_statcacheengine,	NULL },
+  { "StatCacheListings",	set_statcachelistings,	NULL },
   { "StatCacheMaxAge",		set_statcachemaxage,	NULL },
   { "StatCacheTable",		set_statcachetable,	NULL },
   { NULL }
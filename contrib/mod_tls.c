@@ -428,6 +428,19 @@ static unsigned int tls_npkeys = 0;
 static uint64_t tls_data_adaptive_bytes_written_ms = 0L;
 static off_t tls_data_adaptive_bytes_written_count = 0;
 
+/* The sessions established on the control connection (by its handshake,
+ * renegotiations, or as TLSv1.3 tickets), which data connections resume
+ * without looking them up in the session cache.
+ */
+#define TLS_CTRL_SESS_MAX				4
+
+static SSL_SESSION *tls_ctrl_sessions[TLS_CTRL_SESS_MAX];
+static unsigned int tls_ctrl_sess_count = 0;
+static unsigned char tls_data_resumed_ctrl_sess = FALSE;
+
+static unsigned long tls_data_handshakes_full = 0UL;
+static unsigned long tls_data_handshakes_resumed = 0UL;
+
 /* Module variables */
 #if OPENSSL_VERSION_NUMBER > 0x000907000L
 static const char *tls_crypto_device = NULL;
@@ -443,8 +456,16 @@ static unsigned long tls_stapling_opts = 0UL;
 # define TLS_STAPLING_OPT_NO_NONCE		0x0001
 # define TLS_STAPLING_OPT_NO_VERIFY		0x0002
 # define TLS_STAPLING_OPT_NO_FAKE_TRY_LATER	0x0004
+# define TLS_STAPLING_OPT_NO_PREFETCH		0x0008
 static const char *tls_stapling_responder = NULL;
 static unsigned int tls_stapling_timeout = 10;
+
+/* When the daemon is refreshing the cached OCSP responses in the
+ * background, handshakes only ever use the cached responses.
+ */
+static int tls_stapling_prefetch = FALSE;
+static pid_t tls_stapling_refresh_pid = 0;
+# define TLS_STAPLING_REFRESH_INTERVAL		60
 #endif
 
 static char *tls_passphrase_provider = NULL;
@@ -518,6 +539,7 @@ static unsigned char *tls_authenticated = NULL;
 #define TLS_OPT_VERIFY_CERT_CN				0x0800
 #define TLS_OPT_NO_AUTO_ECDH				0x1000
 #define TLS_OPT_ALLOW_WEAK_DH				0x2000
+#define TLS_OPT_ENABLE_KTLS				0x4000
 
 /* mod_tls SSCN modes */
 #define TLS_SSCN_MODE_SERVER				0
@@ -636,6 +658,13 @@ static int tls_sess_cache_add_sess_cb(SSL *, SSL_SESSION *);
 static SSL_SESSION *tls_sess_cache_get_sess_cb(SSL *, unsigned char *, int,
   int *);
 static void tls_sess_cache_delete_sess_cb(SSL_CTX *, SSL_SESSION *);
+static int tls_sess_new_cb(SSL *, SSL_SESSION *);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && \
+    !defined(HAVE_LIBRESSL)
+static SSL_SESSION *tls_sess_get_cb(SSL *, const unsigned char *, int, int *);
+#else
+static SSL_SESSION *tls_sess_get_cb(SSL *, unsigned char *, int, int *);
+#endif
 
 /* OCSP response cache API */
 static tls_ocsp_cache_t *tls_ocsp_cache_get_cache(const char *);
@@ -3964,8 +3993,9 @@ static OCSP_RESPONSE *ocsp_send_request(pool *p, BIO *bio, const char *host,
   OCSP_REQ_CTX *ctx = NULL;
   const char *header_name, *header_value;
 
+  /* Note that the daemon, with its stdin closed, may well get fd 0. */
   res = BIO_get_fd(bio, &fd);
-  if (res <= 0) {
+  if (res < 0) {
     pr_trace_msg(trace_channel, 3,
       "error obtaining OCSP responder socket fd: %s", tls_get_errors());
     return NULL;
@@ -5086,6 +5116,40 @@ static int ocsp_add_cached_response(pool *p, const char *fingerprint,
   return res;
 }
 
+static OCSP_RESPONSE *ocsp_fetch_response(pool *p, X509 *cert, SSL *ssl,
+    const char *fingerprint) {
+  const char *ocsp_url;
+
+  if (tls_stapling_responder == NULL) {
+    ocsp_url = ocsp_get_responder_url(p, cert);
+    if (ocsp_url != NULL) {
+      pr_trace_msg(trace_channel, 8,
+        "found OCSP responder URL '%s' in certificate "
+        "(fingerprint '%s')", ocsp_url, fingerprint);
+
+    } else {
+      pr_trace_msg(trace_channel, 8,
+        "no OCSP responder URL found in certificate "
+        "(fingerprint '%s')", fingerprint);
+    }
+
+  } else {
+    ocsp_url = tls_stapling_responder;
+    pr_trace_msg(trace_channel, 8,
+      "using configured OCSP responder URL '%s'", ocsp_url);
+  }
+
+  if (ocsp_url == NULL) {
+    pr_trace_msg(trace_channel, 5,
+      "no OCSP responder URL found in certificate (fingerprint '%s')",
+      fingerprint);
+    errno = ENOENT;
+    return NULL;
+  }
+
+  return ocsp_request_response(p, cert, ssl, ocsp_url, tls_stapling_timeout);
+}
+
 static int tls_feature_cmp(ASN1_STRING *str, void *feat_data,
     size_t feat_datasz) {
   int is_feat = FALSE, res;
@@ -5239,58 +5303,38 @@ static OCSP_RESPONSE *ocsp_get_response(pool *p, SSL *ssl) {
         int xerrno = errno;
         OCSP_RESPONSE *fresh_resp = NULL;
 
-        if (xerrno == ENOENT ||
-            stale_cache == TRUE) {
-          const char *ocsp_url;
-
-          if (tls_stapling_responder == NULL) {
-            ocsp_url = ocsp_get_responder_url(p, cert);
-            if (ocsp_url != NULL) {
-              pr_trace_msg(trace_channel, 8,
-                "found OCSP responder URL '%s' in certificate "
-                "(fingerprint '%s')", ocsp_url, fingerprint);
-
-            } else {
-              pr_trace_msg(trace_channel, 8,
-                "no OCSP responder URL found in certificate "
-                "(fingerprint '%s')", fingerprint);
-            }
-
-          } else {
-            ocsp_url = tls_stapling_responder;
-            pr_trace_msg(trace_channel, 8,
-              "using configured OCSP responder URL '%s'", ocsp_url);
-          }
+        if (tls_stapling_prefetch == TRUE &&
+            tls_ocsp_cache != NULL) {
+          /* The daemon keeps the cached responses fresh; a stale response
+           * is still valid, and we do not want to wait on the responder.
+           */
+          pr_trace_msg(trace_channel, 8,
+            "leaving %s OCSP response for fingerprint '%s' to be refreshed",
+            cached_resp != NULL ? "stale" : "missing", fingerprint);
 
-          if (ocsp_url != NULL) {
-            fresh_resp = ocsp_request_response(p, cert, ssl, ocsp_url,
-              tls_stapling_timeout);
-            if (fresh_resp != NULL) {
-              resp = fresh_resp;
+        } else if (xerrno == ENOENT ||
+            stale_cache == TRUE) {
+          fresh_resp = ocsp_fetch_response(p, cert, ssl, fingerprint);
+          if (fresh_resp != NULL) {
+            resp = fresh_resp;
 
-              /* If our previously cached response was stale, delete it so
-               * that we can cache our new one.
-               */
-              if (stale_cache == TRUE) {
-                int res;
-
-                res = (tls_ocsp_cache->delete)(tls_ocsp_cache, fingerprint);
-                if (res < 0) {
-                  pr_trace_msg(trace_channel, 3,
-                    "error deleting OCSP response from '%s' cache for "
-                    "fingerprint '%s': %s", tls_ocsp_cache->cache_name,
-                    fingerprint, strerror(errno));
-                }
+            /* If our previously cached response was stale, delete it so
+             * that we can cache our new one.
+             */
+            if (stale_cache == TRUE) {
+              int res;
 
-                OCSP_RESPONSE_free(cached_resp);
-                cached_resp = NULL;
+              res = (tls_ocsp_cache->delete)(tls_ocsp_cache, fingerprint);
+              if (res < 0) {
+                pr_trace_msg(trace_channel, 3,
+                  "error deleting OCSP response from '%s' cache for "
+                  "fingerprint '%s': %s", tls_ocsp_cache->cache_name,
+                  fingerprint, strerror(errno));
               }
-            }
 
-          } else {
-            pr_trace_msg(trace_channel, 5,
-              "no OCSP responder URL found in certificate (fingerprint '%s')",
-              fingerprint);
+              OCSP_RESPONSE_free(cached_resp);
+              cached_resp = NULL;
+            }
           }
 
         } else {
@@ -5348,9 +5392,11 @@ static OCSP_RESPONSE *ocsp_get_response(pool *p, SSL *ssl) {
   }
 
   /* If this response is not the one we just pulled from the cache, then
-   * add it.
+   * add it.  A fake response is not cached when the cached responses are
+   * being refreshed; it would only hide the missing response.
    */
-  if (resp != cached_resp) {
+  if (resp != cached_resp &&
+      (use_fake_trylater == FALSE || tls_stapling_prefetch == FALSE)) {
     if (ocsp_add_cached_response(p, fingerprint, resp) < 0) {
       if (errno != ENOSYS) {
         pr_trace_msg(trace_channel, 3,
@@ -5362,6 +5408,295 @@ static OCSP_RESPONSE *ocsp_get_response(pool *p, SSL *ssl) {
   return resp;
 }
 
+/* Refreshes the cached OCSP response for the given server certificate, if
+ * it is missing or stale.
+ */
+static int ocsp_refresh_cert(pool *p, X509 *cert, SSL *ssl) {
+  const char *fingerprint;
+  OCSP_RESPONSE *cached_resp, *resp;
+  int res, stale_cache = FALSE;
+
+  fingerprint = tls_get_fingerprint(p, cert);
+  if (fingerprint == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  cached_resp = ocsp_get_cached_response(p, fingerprint, cert, ssl,
+    &stale_cache);
+  if (cached_resp != NULL &&
+      stale_cache == FALSE) {
+    pr_trace_msg(trace_channel, 17,
+      "cached OCSP response for fingerprint '%s' does not need refreshing",
+      fingerprint);
+    OCSP_RESPONSE_free(cached_resp);
+    return 0;
+  }
+
+  resp = ocsp_fetch_response(p, cert, ssl, fingerprint);
+  if (resp == NULL) {
+    /* Any stale cached response is left as is, until it expires. */
+    pr_trace_msg(trace_channel, 3,
+      "unable to refresh OCSP response for fingerprint '%s'", fingerprint);
+
+    if (cached_resp != NULL) {
+      OCSP_RESPONSE_free(cached_resp);
+    }
+
+    errno = EPERM;
+    return -1;
+  }
+
+  if (cached_resp != NULL) {
+    res = (tls_ocsp_cache->delete)(tls_ocsp_cache, fingerprint);
+    if (res < 0) {
+      pr_trace_msg(trace_channel, 3,
+        "error deleting OCSP response from '%s' cache for "
+        "fingerprint '%s': %s", tls_ocsp_cache->cache_name, fingerprint,
+        strerror(errno));
+    }
+
+    OCSP_RESPONSE_free(cached_resp);
+  }
+
+  res = ocsp_add_cached_response(p, fingerprint, resp);
+  OCSP_RESPONSE_free(resp);
+
+  if (res == 0) {
+    pr_trace_msg(trace_channel, 8,
+      "refreshed cached OCSP response for fingerprint '%s'", fingerprint);
+  }
+
+  return res;
+}
+
+/* Refreshes the cached OCSP responses for the certificates of the given
+ * server.  Since the server certificates are only loaded by the session
+ * processes, we load them here into a scratch SSL_CTX, along with the
+ * CA certificates needed for finding their issuers.
+ */
+static void ocsp_refresh_server(pool *p, server_rec *s) {
+  register unsigned int i;
+  config_rec *c;
+  unsigned char *engine;
+  const char *ca_file, *ca_path, *chain_file, *cert_files[3];
+  X509 *certs[3];
+  SSL_CTX *ctx;
+  SSL *ssl;
+
+  engine = get_param_ptr(s->conf, "TLSEngine", FALSE);
+  if (engine == NULL ||
+      *engine != TRUE) {
+    return;
+  }
+
+  c = find_config(s->conf, CONF_PARAM, "TLSStapling", FALSE);
+  if (c != NULL &&
+      *((int *) c->argv[0]) == FALSE) {
+    return;
+  }
+
+  /* The OCSP request handling uses the same stapling settings as a session
+   * for this server would.
+   */
+  tls_stapling_opts = 0UL;
+  c = find_config(s->conf, CONF_PARAM, "TLSStaplingOptions", FALSE);
+  while (c != NULL) {
+    tls_stapling_opts |= *((unsigned long *) c->argv[0]);
+    c = find_config_next(c, c->next, CONF_PARAM, "TLSStaplingOptions", FALSE);
+  }
+
+  if (tls_stapling_opts & TLS_STAPLING_OPT_NO_PREFETCH) {
+    return;
+  }
+
+  tls_stapling_responder = get_param_ptr(s->conf, "TLSStaplingResponder",
+    FALSE);
+
+  tls_stapling_timeout = 10;
+  c = find_config(s->conf, CONF_PARAM, "TLSStaplingTimeout", FALSE);
+  if (c != NULL) {
+    tls_stapling_timeout = *((unsigned int *) c->argv[0]);
+  }
+
+  cert_files[0] = get_param_ptr(s->conf, "TLSRSACertificateFile", FALSE);
+  cert_files[1] = get_param_ptr(s->conf, "TLSDSACertificateFile", FALSE);
+#ifdef PR_USE_OPENSSL_ECC
+  cert_files[2] = get_param_ptr(s->conf, "TLSECCertificateFile", FALSE);
+#else
+  cert_files[2] = NULL;
+#endif /* PR_USE_OPENSSL_ECC */
+
+  if (cert_files[0] == NULL &&
+      cert_files[1] == NULL &&
+      cert_files[2] == NULL) {
+    return;
+  }
+
+  ctx = SSL_CTX_new(SSLv23_server_method());
+  if (ctx == NULL) {
+    pr_trace_msg(trace_channel, 3, "error allocating SSL context: %s",
+      tls_get_errors());
+    return;
+  }
+
+  ca_file = get_param_ptr(s->conf, "TLSCACertificateFile", FALSE);
+  ca_path = get_param_ptr(s->conf, "TLSCACertificatePath", FALSE);
+  chain_file = get_param_ptr(s->conf, "TLSCertificateChainFile", FALSE);
+
+  PRIVS_ROOT
+  if (ca_file != NULL ||
+      ca_path != NULL) {
+    if (SSL_CTX_load_verify_locations(ctx, ca_file, ca_path) != 1) {
+      pr_trace_msg(trace_channel, 3,
+        "unable to load CA certificates using file '%s' or directory '%s': "
+        "%s", ca_file ? ca_file : "(none)", ca_path ? ca_path : "(none)",
+        tls_get_errors());
+    }
+
+  } else {
+    if (SSL_CTX_set_default_verify_paths(ctx) != 1) {
+      pr_trace_msg(trace_channel, 3,
+        "error setting default verification locations: %s",
+        tls_get_errors());
+    }
+  }
+
+  if (chain_file != NULL) {
+    BIO *bio;
+
+    bio = BIO_new_file(chain_file, "r");
+    if (bio != NULL) {
+      X509 *cert;
+
+      cert = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+      while (cert != NULL) {
+        if (SSL_CTX_add_extra_chain_cert(ctx, cert) != 1) {
+          X509_free(cert);
+          break;
+        }
+
+        cert = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+      }
+
+      BIO_free(bio);
+
+    } else {
+      pr_trace_msg(trace_channel, 3,
+        "unable to read certificate chain '%s': %s", chain_file,
+        tls_get_errors());
+    }
+  }
+
+  for (i = 0; i < 3; i++) {
+    FILE *fh;
+
+    certs[i] = NULL;
+    if (cert_files[i] == NULL) {
+      continue;
+    }
+
+    fh = fopen(cert_files[i], "r");
+    if (fh == NULL) {
+      pr_trace_msg(trace_channel, 3, "error reading '%s': %s", cert_files[i],
+        strerror(errno));
+      continue;
+    }
+
+    certs[i] = PEM_read_X509(fh, NULL, NULL, NULL);
+    if (certs[i] == NULL) {
+      pr_trace_msg(trace_channel, 3, "error reading '%s': %s", cert_files[i],
+        tls_get_errors());
+    }
+
+    fclose(fh);
+  }
+  PRIVS_RELINQUISH
+
+  ssl = SSL_new(ctx);
+  if (ssl == NULL) {
+    pr_trace_msg(trace_channel, 3, "error allocating SSL session: %s",
+      tls_get_errors());
+  }
+
+  for (i = 0; i < 3; i++) {
+    if (certs[i] == NULL) {
+      continue;
+    }
+
+    if (ssl != NULL) {
+      (void) ocsp_refresh_cert(p, certs[i], ssl);
+    }
+
+    X509_free(certs[i]);
+  }
+
+  if (ssl != NULL) {
+    SSL_free(ssl);
+  }
+
+  SSL_CTX_free(ctx);
+}
+
+/* Forks a process which refreshes the cached OCSP responses for all of the
+ * configured servers, so that neither the daemon nor the sessions have to
+ * wait on the OCSP responders.
+ */
+static void ocsp_refresh_responses(void) {
+  pid_t pid;
+  server_rec *s;
+  pool *tmp_pool;
+
+  if (tls_ocsp_cache == NULL) {
+    return;
+  }
+
+  if (tls_stapling_refresh_pid > 0 &&
+      kill(tls_stapling_refresh_pid, 0) == 0) {
+    pr_trace_msg(trace_channel, 9,
+      "previous OCSP response refresh (PID %lu) still running, skipping",
+      (unsigned long) tls_stapling_refresh_pid);
+    return;
+  }
+
+  pid = fork();
+  if (pid < 0) {
+    pr_log_pri(PR_LOG_WARNING, MOD_TLS_VERSION
+      ": unable to fork OCSP response refresh: %s", strerror(errno));
+    return;
+  }
+
+  if (pid > 0) {
+    tls_stapling_refresh_pid = pid;
+    return;
+  }
+
+  /* Child process.  It should not act on the daemon's signals. */
+  session.pid = getpid();
+  signal(SIGHUP, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGCHLD, SIG_DFL);
+  signal(SIGUSR2, SIG_DFL);
+
+  pr_trace_msg(trace_channel, 9, "refreshing cached OCSP responses");
+
+  tmp_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(tmp_pool, "OCSP response refresh pool");
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    ocsp_refresh_server(tmp_pool, s);
+  }
+
+  _exit(0);
+}
+
+static int ocsp_refresh_timer_cb(CALLBACK_FRAME) {
+  ocsp_refresh_responses();
+
+  /* Always restart this timer. */
+  return 1;
+}
+
 static int tls_ocsp_cb(SSL *ssl, void *user_data) {
   OCSP_RESPONSE *resp;
   int resp_derlen, reused;
@@ -6097,8 +6432,8 @@ static int tls_init_ctx(void) {
           SSL_CTX_set_session_cache_mode(ssl_ctx, cache_mode);
           SSL_CTX_set_timeout(ssl_ctx, timeout);
 
-          SSL_CTX_sess_set_new_cb(ssl_ctx, tls_sess_cache_add_sess_cb);
-          SSL_CTX_sess_set_get_cb(ssl_ctx, tls_sess_cache_get_sess_cb);
+          SSL_CTX_sess_set_new_cb(ssl_ctx, tls_sess_new_cb);
+          SSL_CTX_sess_set_get_cb(ssl_ctx, tls_sess_get_cb);
           SSL_CTX_sess_set_remove_cb(ssl_ctx, tls_sess_cache_delete_sess_cb);
 
         } else {
@@ -6158,6 +6493,15 @@ static int tls_init_ctx(void) {
     SSL_CTX_set_timeout(ssl_ctx, timeout);
   }
 
+  if (tls_sess_cache == NULL &&
+      SSL_CTX_get_session_cache_mode(ssl_ctx) != SSL_SESS_CACHE_OFF) {
+    /* With only OpenSSL's internal cache, these callbacks just keep the
+     * control connection's sessions for the data connections.
+     */
+    SSL_CTX_sess_set_new_cb(ssl_ctx, tls_sess_new_cb);
+    SSL_CTX_sess_set_get_cb(ssl_ctx, tls_sess_get_cb);
+  }
+
   /* Set up OCSP response caching */
   c = find_config(main_server->conf, CONF_PARAM, "TLSStaplingCache", FALSE);
   if (c != NULL) {
@@ -7177,6 +7521,226 @@ static int tls_compare_session_ids(SSL_SESSION *ctrl_sess,
   return res;
 }
 
+/* Returns TRUE if data connections must resume the control connection's
+ * session; see the NoSessionReuseRequired TLSOption.
+ */
+static int tls_data_sess_reuse_required(void) {
+  if ((tls_opts & TLS_OPT_NO_SESSION_REUSE_REQUIRED) ||
+      (tls_flags & TLS_SESS_HAVE_CCC)) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static int tls_sess_has_id(SSL_SESSION *sess, const unsigned char *id,
+    unsigned int id_len) {
+  const unsigned char *sess_id;
+  unsigned int sess_id_len;
+
+  sess_id = (const unsigned char *) SSL_SESSION_get_id(sess, &sess_id_len);
+  if (sess_id_len != id_len ||
+      memcmp(sess_id, id, id_len) != 0) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Keeps a reference to a session established on the control connection.
+ * A TLSv1.3 handshake yields a session per ticket sent, and a client may
+ * resume any of them, thus the last few sessions are kept.
+ */
+static void tls_ctrl_sess_add(SSL_SESSION *sess) {
+  register unsigned int i;
+  unsigned int idx;
+
+  for (i = 0; i < TLS_CTRL_SESS_MAX; i++) {
+    if (tls_ctrl_sessions[i] == sess) {
+      return;
+    }
+  }
+
+  idx = tls_ctrl_sess_count++ % TLS_CTRL_SESS_MAX;
+  if (tls_ctrl_sessions[idx] != NULL) {
+    SSL_SESSION_free(tls_ctrl_sessions[idx]);
+  }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && \
+    !defined(HAVE_LIBRESSL)
+  SSL_SESSION_up_ref(sess);
+#else
+  CRYPTO_add(&sess->references, 1, CRYPTO_LOCK_SSL_SESSION);
+#endif
+  tls_ctrl_sessions[idx] = sess;
+
+  pr_trace_msg(trace_channel, 17,
+    "keeping control connection session #%u for data connections",
+    tls_ctrl_sess_count);
+}
+
+static SSL_SESSION *tls_ctrl_sess_get(const unsigned char *id,
+    unsigned int id_len) {
+  register unsigned int i;
+  SSL_SESSION *sess;
+
+  sess = SSL_get_session(ctrl_ssl);
+  if (sess != NULL &&
+      tls_sess_has_id(sess, id, id_len) == TRUE) {
+    return sess;
+  }
+
+  for (i = 0; i < TLS_CTRL_SESS_MAX; i++) {
+    sess = tls_ctrl_sessions[i];
+    if (sess != NULL &&
+        tls_sess_has_id(sess, id, id_len) == TRUE) {
+      return sess;
+    }
+  }
+
+  return NULL;
+}
+
+static void tls_ctrl_sess_clear(void) {
+  register unsigned int i;
+
+  for (i = 0; i < TLS_CTRL_SESS_MAX; i++) {
+    if (tls_ctrl_sessions[i] != NULL) {
+      SSL_SESSION_free(tls_ctrl_sessions[i]);
+      tls_ctrl_sessions[i] = NULL;
+    }
+  }
+
+  tls_ctrl_sess_count = 0;
+}
+
+/* OpenSSL calls this for every new session.  Sessions of the control
+ * connection are kept for its data connections (note that ctrl_ssl is not
+ * yet set during the control connection's handshake); all sessions are
+ * handed to the external TLSSessionCache, if any.
+ */
+static int tls_sess_new_cb(SSL *ssl, SSL_SESSION *sess) {
+  if (ctrl_ssl == NULL ||
+      ssl == ctrl_ssl) {
+    tls_ctrl_sess_add(sess);
+  }
+
+  if (tls_sess_cache != NULL) {
+    return tls_sess_cache_add_sess_cb(ssl, sess);
+  }
+
+  /* Return zero, so that OpenSSL releases its reference to the session. */
+  return 0;
+}
+
+/* OpenSSL calls this for sessions not found in its internal cache.  Data
+ * connections resuming one of the control connection's sessions are served
+ * here, without a round trip to the (possibly shared) external cache.
+ */
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && \
+    !defined(HAVE_LIBRESSL)
+static SSL_SESSION *tls_sess_get_cb(SSL *ssl, const unsigned char *id,
+    int id_len, int *do_copy) {
+#else
+static SSL_SESSION *tls_sess_get_cb(SSL *ssl, unsigned char *id,
+    int id_len, int *do_copy) {
+#endif
+  *do_copy = 0;
+
+  if (id_len <= 0) {
+    return NULL;
+  }
+
+  if (ctrl_ssl != NULL &&
+      ssl != ctrl_ssl) {
+    SSL_SESSION *sess;
+
+    sess = tls_ctrl_sess_get(id, (unsigned int) id_len);
+    if (sess != NULL) {
+      pr_trace_msg(trace_channel, 17, "%s",
+        "data connection resuming control connection session");
+      tls_data_resumed_ctrl_sess = TRUE;
+
+      /* Have OpenSSL take its own reference to our session. */
+      *do_copy = 1;
+      return sess;
+    }
+
+    if (tls_data_sess_reuse_required() == TRUE) {
+      /* No other session would be accepted for a data connection. */
+      return NULL;
+    }
+  }
+
+  if (tls_sess_cache != NULL) {
+    return tls_sess_cache_get_sess_cb(ssl, (unsigned char *) id, id_len,
+      do_copy);
+  }
+
+  return NULL;
+}
+
+/* If configured, asks OpenSSL to hand the record protection of a data
+ * connection over to the kernel (kTLS) once the handshake is done.
+ */
+static void tls_ktls_init(SSL *ssl) {
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+  if (tls_opts & TLS_OPT_ENABLE_KTLS) {
+    SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+  }
+#endif /* SSL_OP_ENABLE_KTLS */
+}
+
+/* Checks whether the kernel took over the encryption of the data
+ * connection's outgoing records; if so, the data write stream is marked, so
+ * that mod_xfer can send files using sendfile(2).  The kernel only supports
+ * some ciphers (e.g. AES-GCM); for others, or if the kernel lacks kTLS
+ * support, OpenSSL quietly continues to do the encryption itself.
+ */
+static void tls_ktls_check(SSL *ssl) {
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+  static unsigned char logged_ktls = FALSE;
+  int ktls_send, ktls_recv;
+
+  if (!(tls_opts & TLS_OPT_ENABLE_KTLS)) {
+    return;
+  }
+
+  ktls_send = BIO_get_ktls_send(SSL_get_wbio(ssl)) ? TRUE : FALSE;
+  ktls_recv = BIO_get_ktls_recv(SSL_get_rbio(ssl)) ? TRUE : FALSE;
+
+  pr_trace_msg(trace_channel, 9,
+    "kTLS for data connection using %s %s: send %s, receive %s",
+    SSL_get_version(ssl), SSL_get_cipher_name(ssl),
+    ktls_send ? "enabled" : "disabled", ktls_recv ? "enabled" : "disabled");
+
+  /* Only be verbose with the first TLS data connection. */
+  if (!logged_ktls) {
+    if (ktls_send) {
+      tls_log("using kTLS for data connections (send%s)",
+        ktls_recv ? " and receive" : "");
+
+    } else {
+      tls_log("kTLS not supported for %s %s data connection, using OpenSSL",
+        SSL_get_version(ssl), SSL_get_cipher_name(ssl));
+    }
+
+    logged_ktls = TRUE;
+  }
+
+  if (ktls_send) {
+    if (pr_table_add(tls_data_wr_nstrm->notes,
+        pstrdup(tls_data_wr_nstrm->strm_pool, PR_NETIO_NOTE_KERNEL_TX),
+        NULL, 0) < 0) {
+      if (errno != EEXIST) {
+        tls_log("error stashing '%s' note on data write stream: %s",
+          PR_NETIO_NOTE_KERNEL_TX, strerror(errno));
+      }
+    }
+  }
+#endif /* SSL_OP_ENABLE_KTLS */
+}
+
 static int tls_accept(conn_t *conn, unsigned char on_data) {
   static unsigned char logged_data = FALSE;
   int blocking, res = 0, xerrno = 0;
@@ -7242,6 +7806,8 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
         "error disabling TCP_CORK on data conn: %s", strerror(errno));
     }
 
+    tls_ktls_init(ssl);
+
     cache_mode = SSL_CTX_get_session_cache_mode(ssl_ctx);
     if (cache_mode != SSL_SESS_CACHE_OFF) {
       /* Disable STORING of any new session IDs in the session cache. We DO
@@ -7249,8 +7815,21 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
        */
       long data_cache_mode;
       data_cache_mode = SSL_SESS_CACHE_SERVER|SSL_SESS_CACHE_NO_INTERNAL_STORE;
+
+#if defined(SSL_SESS_CACHE_NO_INTERNAL_LOOKUP)
+      /* If only the control connection's sessions will do, skip the internal
+       * cache; tls_sess_get_cb() has those sessions at hand.
+       */
+      if (tls_data_sess_reuse_required() == TRUE &&
+          SSL_CTX_sess_get_get_cb(ssl_ctx) == tls_sess_get_cb) {
+        data_cache_mode |= SSL_SESS_CACHE_NO_INTERNAL_LOOKUP;
+      }
+#endif /* SSL_SESS_CACHE_NO_INTERNAL_LOOKUP */
+
       SSL_CTX_set_session_cache_mode(ssl_ctx, data_cache_mode);
     }
+
+    tls_data_resumed_ctrl_sess = FALSE;
   }
 
   retry:
@@ -7294,6 +7873,14 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
 
     pr_signals_handle();
 
+    if (on_data &&
+        cache_mode != SSL_SESS_CACHE_OFF &&
+        errcode != SSL_ERROR_WANT_READ &&
+        errcode != SSL_ERROR_WANT_WRITE) {
+      /* Restore the previous session cache mode. */
+      SSL_CTX_set_session_cache_mode(ssl_ctx, cache_mode);
+    }
+
     if (tls_handshake_timed_out) {
       tls_log("TLS negotiation timed out (%u seconds)", tls_handshake_timeout);
       tls_end_sess(ssl, on_data ? session.d : session.c, 0);
@@ -7470,6 +8057,17 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
       TLS_DATA_ADAPTIVE_WRITE_MIN_BUFFER_SIZE);
     tls_data_adaptive_bytes_written_ms = 0L;
     tls_data_adaptive_bytes_written_count = 0;
+
+    if (SSL_session_reused(ssl) == 1) {
+      tls_data_handshakes_resumed++;
+
+    } else {
+      tls_data_handshakes_full++;
+    }
+
+    pr_trace_msg(trace_channel, 9,
+      "data connection handshakes: %lu resumed, %lu full",
+      tls_data_handshakes_resumed, tls_data_handshakes_full);
   }
  
   /* Disable the handshake timer. */
@@ -7653,8 +8251,7 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
      * a) the NoSessionReuseRequired TLSOption has been configured, or
      * b) the CCC command has been used (Bug#3465).
      */
-    if (!(tls_opts & TLS_OPT_NO_SESSION_REUSE_REQUIRED) &&
-        !(tls_flags & TLS_SESS_HAVE_CCC)) {
+    if (tls_data_sess_reuse_required() == TRUE) {
       int reused;
       SSL_SESSION *ctrl_sess;
 
@@ -7691,7 +8288,18 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
         if (data_sess != NULL) {
           int matching_sess = -1;
 
-          matching_sess = tls_compare_session_ids(ctrl_sess, data_sess);
+          /* A TLSv1.3 data connection resumes one of the tickets issued on
+           * the control connection, rather than the control connection's
+           * own session; tls_sess_get_cb() notes when it handed out one
+           * of the control connection's sessions.
+           */
+          if (tls_data_resumed_ctrl_sess == TRUE) {
+            matching_sess = 0;
+
+          } else {
+            matching_sess = tls_compare_session_ids(ctrl_sess, data_sess);
+          }
+
           if (matching_sess != 0) {
             tls_log("Client did not reuse SSL session from control channel, "
               "rejecting data connection (see the NoSessionReuseRequired "
@@ -7771,6 +8379,8 @@ static int tls_accept(conn_t *conn, unsigned char on_data) {
         SSL_get_cipher_bits(ssl, NULL));
       logged_data = TRUE;
     }
+
+    tls_ktls_check(ssl);
   }
 
   return 0;
@@ -7804,6 +8414,8 @@ static int tls_connect(conn_t *conn) {
   wbio = BIO_new_socket(conn->rfd, FALSE);
   SSL_set_bio(ssl, rbio, wbio);
 
+  tls_ktls_init(ssl);
+
   /* If configured, set a timer for the handshake. */
   if (tls_handshake_timeout) {
     tls_handshake_timer_id = pr_timer_add(tls_handshake_timeout, -1,
@@ -7957,6 +8569,8 @@ static int tls_connect(conn_t *conn) {
       strm_buf->current = NULL;
       strm_buf->remaining = strm_buf->buflen;
     }
+
+    tls_ktls_check(ssl);
   }
 
 #if OPENSSL_VERSION_NUMBER == 0x009080cfL
@@ -11190,6 +11804,7 @@ static int tls_netio_close_cb(pr_netio_stream_t *nstrm) {
       tls_end_sess(ssl, session.d, 0);
       pr_table_remove(tls_data_rd_nstrm->notes, TLS_NETIO_NOTE, NULL);
       pr_table_remove(tls_data_wr_nstrm->notes, TLS_NETIO_NOTE, NULL);
+      pr_table_remove(tls_data_wr_nstrm->notes, PR_NETIO_NOTE_KERNEL_TX, NULL);
       tls_data_netio = NULL;
       tls_flags &= ~TLS_SESS_ON_DATA;
     }
@@ -11550,8 +12165,10 @@ static int tls_netio_write_cb(pr_netio_stream_t *nstrm, char *buf,
     wbio_wbytes = BIO_number_written(wbio);
 
 #if OPENSSL_VERSION_NUMBER > 0x000907000L
+    /* Note that the kernel cannot renegotiate kTLS sessions. */
     if (tls_data_renegotiate_limit &&
-        session.xfer.total_bytes >= tls_data_renegotiate_limit
+        session.xfer.total_bytes >= tls_data_renegotiate_limit &&
+        pr_table_exists(nstrm->notes, PR_NETIO_NOTE_KERNEL_TX) <= 0
 
 #if OPENSSL_VERSION_NUMBER >= 0x009080cfL
         /* In OpenSSL-0.9.8l and later, SSL session renegotiations
@@ -13207,6 +13824,15 @@ MODRET set_tlsoptions(cmd_rec *cmd) {
     } else if (strcmp(cmd->argv[i], "EnableDiags") == 0) {
       opts |= TLS_OPT_ENABLE_DIAGS;
 
+    } else if (strcmp(cmd->argv[i], "EnableKTLS") == 0) {
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+      opts |= TLS_OPT_ENABLE_KTLS;
+#else
+      pr_log_pri(PR_LOG_NOTICE, MOD_TLS_VERSION
+        ": TLSOption EnableKTLS not supported (OpenSSL version is too old, "
+        "or built without kTLS support)");
+#endif /* SSL_OP_ENABLE_KTLS and !OPENSSL_NO_KTLS */
+
     } else if (strcmp(cmd->argv[i], "ExportCertData") == 0) {
       opts |= TLS_OPT_EXPORT_CERT_DATA;
 
@@ -14043,6 +14669,9 @@ MODRET set_tlsstaplingoptions(cmd_rec *cmd) {
     } else if (strcmp(cmd->argv[i], "NoFakeTryLater") == 0) {
       opts |= TLS_STAPLING_OPT_NO_FAKE_TRY_LATER;
 
+    } else if (strcmp(cmd->argv[i], "NoPrefetch") == 0) {
+      opts |= TLS_STAPLING_OPT_NO_PREFETCH;
+
     } else {
       CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown TLSStaplingOption '",
         cmd->argv[i], "'", NULL));
@@ -14367,6 +14996,25 @@ static void tls_shutdown_ev(const void *event_data, void *user_data) {
   RAND_cleanup();
 }
 
+static void tls_startup_ev(const void *event_data, void *user_data) {
+#if defined(PR_USE_OPENSSL_OCSP)
+  /* Keep the cached OCSP responses fresh from the (standalone) daemon,
+   * starting now, so that handshakes need not wait on the OCSP responders.
+   */
+  if (ServerType == SERVER_STANDALONE &&
+      tls_ocsp_cache != NULL) {
+    tls_stapling_prefetch = TRUE;
+    ocsp_refresh_responses();
+
+    pr_log_debug(DEBUG9, MOD_TLS_VERSION
+      ": scheduling refresh of cached OCSP responses every %d secs",
+      TLS_STAPLING_REFRESH_INTERVAL);
+    pr_timer_add(TLS_STAPLING_REFRESH_INTERVAL, -1, NULL,
+      ocsp_refresh_timer_cb, "OCSP Response Refresh");
+  }
+#endif /* PR_USE_OPENSSL_OCSP */
+}
+
 static void tls_restart_ev(const void *event_data, void *user_data) {
 #ifdef PR_USE_CTRLS
   register unsigned int i;
@@ -14448,6 +15096,15 @@ static void tls_exit_ev(const void *event_data, void *user_data) {
     tls_log("[stat]: SSL session cache size exceeded: %ld", res);
   }
 
+  if (tls_data_handshakes_resumed > 0 ||
+      tls_data_handshakes_full > 0) {
+    tls_log("data connection handshakes: %lu resumed, %lu full",
+      tls_data_handshakes_resumed, tls_data_handshakes_full);
+    tls_data_handshakes_resumed = tls_data_handshakes_full = 0UL;
+  }
+
+  tls_ctrl_sess_clear();
+
   if (tls_pkey != NULL) {
     tls_scrub_pkey(tls_pkey);
     tls_pkey = NULL;
@@ -14947,6 +15604,7 @@ static int tls_init(void) {
   pr_event_register(&tls_module, "core.postparse", tls_postparse_ev, NULL);
   pr_event_register(&tls_module, "core.restart", tls_restart_ev, NULL);
   pr_event_register(&tls_module, "core.shutdown", tls_shutdown_ev, NULL);
+  pr_event_register(&tls_module, "core.startup", tls_startup_ev, NULL);
 
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
   OPENSSL_config(NULL);
@@ -15352,6 +16010,10 @@ static int tls_sess_init(void) {
     c = find_config_next(c, c->next, CONF_PARAM, "TLSStaplingOptions", FALSE);
   }
 
+  if (tls_stapling_opts & TLS_STAPLING_OPT_NO_PREFETCH) {
+    tls_stapling_prefetch = FALSE;
+  }
+
   c = find_config(main_server->conf, CONF_PARAM, "TLSStaplingResponder", FALSE);
   if (c != NULL) {
     tls_stapling_responder = c->argv[0];
@@ -43,7 +43,7 @@
 # define HAVE_LIBRESSL	1
 #endif
 
-#define MOD_TLS_SHMCACHE_VERSION		"mod_tls_shmcache/0.2"
+#define MOD_TLS_SHMCACHE_VERSION		"mod_tls_shmcache/0.3"
 
 /* Make sure the version of proftpd is as necessary. */
 #if PROFTPD_VERSION_NUMBER < 0x0001030602
@@ -74,10 +74,24 @@ module tls_shmcache_module;
  * bytes (500KB).
  */
 
+/* Sessions are stored in fixed-size slots, grouped into buckets of (at most)
+ * TLS_SHMCACHE_SESS_BUCKET_SLOTS slots; the hash of a session ID selects its
+ * bucket.  Each bucket has its own lock (see shmcache_lock_range()), so that
+ * processes adding or looking up sessions in different buckets do not wait
+ * on each other.
+ *
+ * Expired sessions are cleared from a bucket as it is searched.  When a
+ * session is added to a full bucket, the slot to reuse is picked using the
+ * "clock" algorithm: the bucket's hand sweeps over its slots, sparing once
+ * those whose sessions have been resumed since the hand last passed them.
+ */
+#define TLS_SHMCACHE_SESS_BUCKET_SLOTS		8
+
 struct sesscache_entry {
   time_t expires;
   unsigned int sess_id_len;
   unsigned char sess_id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+  unsigned char referenced;
   unsigned int sess_datalen;
   unsigned char sess_data[TLS_MAX_SSL_SESSION_SIZE];
 };
@@ -96,48 +110,60 @@ struct sesscache_large_entry {
   const unsigned char *sess_data;
 };
 
-/* The number of entries in the list is determined at run-time, based on
- * the maximum desired size of the shared memory segment.
- */
-struct sesscache_data {
-
-  /* Cache metadata. */
+/* Bucket metadata, protected by the bucket's lock. */
+struct sesscache_bucket {
   unsigned int nhits;
   unsigned int nmisses;
 
   unsigned int nstored;
   unsigned int ndeleted;
   unsigned int nexpired;
+  unsigned int nevicted;
   unsigned int nerrors;
 
+  /* The number of times the bucket's lock was held by another process. */
+  unsigned int ncontended;
+
+  /* The number of sessions in the bucket, and the position of its clock
+   * hand.
+   */
+  unsigned int listlen;
+  unsigned int hand;
+};
+
+/* The shm segment holds this header, followed by the buckets, followed by
+ * the slots of all of the buckets.  The number of buckets is determined at
+ * run-time, based on the maximum desired size of the shared memory segment.
+ */
+struct sesscache_data {
+
+  /* Cache metadata, protected by the header lock. */
+
   /* This tracks the number of sessions that could not be added because
    * they exceeded TLS_MAX_SSL_SESSION_SIZE.
    */
   unsigned int nexceeded;
   unsigned int exceeded_maxsz;
 
-  /* Track the timestamp of the next session to expire in the cache; used
-   * as an optimization when flushing the cache of expired sessions.
-   */
-  time_t next_expiring;
-
-  /* These listlen/listsz track the number of entries in the cache and total
-   * entries possible, and thus can be used for determining the fullness of
-   * the cache.
-   */
-  unsigned int sd_listlen, sd_listsz;
-
-  /* It is important that this field be the last in the struct! */
-  struct sesscache_entry *sd_entries;
+  /* The layout of the buckets, and the total number of slots. */
+  unsigned int sd_nbuckets, sd_bucketsz;
+  unsigned int sd_listsz;
 };
 
 static tls_sess_cache_t sess_cache;
 static struct sesscache_data *sesscache_data = NULL;
+static struct sesscache_bucket *sesscache_buckets = NULL;
+static struct sesscache_entry *sesscache_entries = NULL;
 static size_t sesscache_datasz = 0;
 static int sesscache_shmid = -1;
 static pr_fh_t *sesscache_fh = NULL;
 static array_header *sesscache_sess_list = NULL;
 
+/* Sessions are copied out of their slots, and deserialized once the bucket
+ * lock is released.
+ */
+static unsigned char sesscache_buf[TLS_MAX_SSL_SESSION_SIZE];
+
 #if defined(PR_USE_OPENSSL_OCSP)
 # define TLS_SHMCACHE_OCSP_PROJECT_ID		249
 
@@ -317,7 +343,8 @@ static int shmcache_lock_shm(pr_fh_t *fh, int lock_type) {
 
     pr_trace_msg(trace_channel, 3, "%s of shmcache fd %d failed: %s",
       lock_desc, fd, strerror(xerrno));
-    if (xerrno == EACCES) {
+    if (xerrno == EACCES ||
+        xerrno == EAGAIN) {
       struct flock locker;
 
       /* Get the PID of the process blocking this lock. */
@@ -353,6 +380,50 @@ static int shmcache_lock_shm(pr_fh_t *fh, int lock_type) {
   return 0;
 }
 
+/* Locks a single byte of the cache file: byte 0 for the session cache header,
+ * or byte 1 + N for bucket N of the session cache.  Locking the whole file,
+ * using shmcache_lock_shm(), excludes all of these.  If another process holds
+ * the lock, we wait for it.  Returns 1 if we had to wait, 0 if not, and -1 on
+ * error.
+ */
+static int shmcache_lock_range(pr_fh_t *fh, int lock_type, off_t start) {
+  int fd, contended = 0;
+  struct flock lock;
+
+  lock.l_type = lock_type;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = start;
+  lock.l_len = 1;
+
+  fd = PR_FH_FD(fh);
+
+  while (fcntl(fd, contended ? F_SETLKW : F_SETLK, &lock) < 0) {
+    int xerrno = errno;
+
+    if (xerrno == EINTR) {
+      pr_signals_handle();
+      continue;
+    }
+
+    if (contended == 0 &&
+        (xerrno == EACCES || xerrno == EAGAIN)) {
+      pr_trace_msg(trace_channel, 19,
+        "byte %lu of shmcache fd %d is locked, waiting for %s",
+        (unsigned long) start, fd, shmcache_get_lock_desc(lock_type));
+      contended = 1;
+      continue;
+    }
+
+    pr_trace_msg(trace_channel, 3, "%s of byte %lu of shmcache fd %d failed: %s",
+      shmcache_get_lock_desc(lock_type), (unsigned long) start, fd,
+      strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  return contended;
+}
+
 /* Use a hash function to hash the given lookup key to a slot in the entries
  * list.  This hash, module the number of entries, is the initial iteration
  * start point.  This will hopefully avoid having to do many linear scans for
@@ -365,12 +436,7 @@ static unsigned int shmcache_hash(const unsigned char *id, unsigned int len) {
   size_t sz = len;
 
   while (sz--) {
-    const unsigned char *k = id;
-    unsigned int c = *k;
-    k++;
-
-    /* Always handle signals in potentially long-running while loops. */
-    pr_signals_handle();
+    unsigned int c = *id++;
 
     i = (i * 33) + c;
   }
@@ -529,22 +595,44 @@ static void *shmcache_get_shm(pr_fh_t *fh, size_t *shm_size, int project_id,
   return data;
 }
 
+/* Returns the offset of the first slot in the session cache shm, given the
+ * number of buckets, rounded up to keep the slots properly aligned.
+ */
+static size_t sess_cache_get_entries_offset(unsigned int nbuckets) {
+  size_t offset, align;
+
+  align = sizeof(time_t);
+  offset = sizeof(struct sesscache_data) +
+    (nbuckets * sizeof(struct sesscache_bucket));
+
+  return ((offset + align - 1) / align) * align;
+}
+
 static struct sesscache_data *sess_cache_get_shm(pr_fh_t *fh,
     size_t requested_size) {
   int shmid, xerrno = 0;
   struct sesscache_data *data = NULL;
   size_t shm_size;
-  unsigned int shm_sess_max = 0;
+  unsigned int nbuckets, bucketsz;
 
-  /* Calculate the size to allocate.  First, calculate the maximum number
-   * of sessions we can cache, given the configured size.  Then
-   * calculate the shm segment size to allocate to hold that number of
-   * sessions.
+  /* Calculate the size to allocate.  First, calculate the number of buckets
+   * of sessions we can cache, given the configured size.  Then calculate the
+   * shm segment size to allocate to hold that number of buckets.
    */
-  shm_sess_max = (requested_size - sizeof(struct sesscache_data)) /
-    (sizeof(struct sesscache_entry));
-  shm_size = sizeof(struct sesscache_data) +
-    (shm_sess_max * sizeof(struct sesscache_entry));
+  bucketsz = TLS_SHMCACHE_SESS_BUCKET_SLOTS;
+  nbuckets = (requested_size - sess_cache_get_entries_offset(0)) /
+    (sizeof(struct sesscache_bucket) +
+     (bucketsz * sizeof(struct sesscache_entry)));
+
+  if (nbuckets == 0) {
+    /* Too small for a full bucket; use a single, smaller bucket. */
+    nbuckets = 1;
+    bucketsz = (requested_size - sess_cache_get_entries_offset(1)) /
+      sizeof(struct sesscache_entry);
+  }
+
+  shm_size = sess_cache_get_entries_offset(nbuckets) +
+    (nbuckets * bucketsz * sizeof(struct sesscache_entry));
 
   data = shmcache_get_shm(fh, &shm_size, TLS_SHMCACHE_SESS_PROJECT_ID, &shmid);
   if (data == NULL) {
@@ -561,11 +649,34 @@ static struct sesscache_data *sess_cache_get_shm(pr_fh_t *fh,
   sesscache_datasz = shm_size;
   sesscache_shmid = shmid;
   pr_trace_msg(trace_channel, 9,
-    "using shm ID %d for sesscache path '%s' (%u sessions)", sesscache_shmid,
-    fh->fh_path, shm_sess_max);
+    "using shm ID %d for sesscache path '%s' (%u buckets of %u sessions)",
+    sesscache_shmid, fh->fh_path, nbuckets, bucketsz);
+
+  sesscache_buckets = (struct sesscache_bucket *) ((char *) data +
+    sizeof(struct sesscache_data));
+  sesscache_entries = (struct sesscache_entry *) ((char *) data +
+    sess_cache_get_entries_offset(nbuckets));
+
+  if (data->sd_nbuckets != nbuckets ||
+      data->sd_bucketsz != bucketsz) {
+    /* A new segment, or one laid out differently (e.g. by an earlier
+     * version of this module); (re)initialize it.
+     */
+    if (shmcache_lock_shm(fh, F_WRLCK) < 0) {
+      pr_trace_msg(trace_channel, 1, "error write-locking shm: %s",
+        strerror(errno));
+    }
+
+    memset(data, 0, shm_size);
+    data->sd_nbuckets = nbuckets;
+    data->sd_bucketsz = bucketsz;
+    data->sd_listsz = nbuckets * bucketsz;
 
-  data->sd_entries = (struct sesscache_entry *) (data + sizeof(struct sesscache_data));
-  data->sd_listsz = shm_sess_max;
+    if (shmcache_lock_shm(fh, F_UNLCK) < 0) {
+      pr_trace_msg(trace_channel, 1, "error unlocking shm: %s",
+        strerror(errno));
+    }
+  }
 
   return data;
 }
@@ -616,85 +727,6 @@ static struct ocspcache_data *ocsp_cache_get_shm(pr_fh_t *fh,
 /* SSL session cache implementation callbacks.
  */
 
-/* Scan the entire list, clearing out expired sessions.  Logs the number
- * of sessions that expired and updates the header stat.
- *
- * NOTE: Callers are assumed to handle the locking of the shm before/after
- * calling this function!
- */
-static unsigned int sess_cache_flush(void) {
-  register unsigned int i;
-  unsigned int flushed = 0;
-  time_t now, next_expiring = 0;
-
-  now = time(NULL);
-
-  /* We always scan the in-memory large session entry list. */
-  if (sesscache_sess_list != NULL) {
-    struct sesscache_large_entry *entries;
-
-    entries = sesscache_sess_list->elts;
-    for (i = 0; i < sesscache_sess_list->nelts; i++) {
-      struct sesscache_large_entry *entry;
-
-      entry = &(entries[i]);
-
-      if (entry->expires > now) {
-        /* This entry has expired; clear its slot. */
-        entry->expires = 0;
-        pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
-      }
-    }
-  }
-
-  /* If now is earlier than the earliest expiring session in the cache,
-   * then a scan will be pointless.
-   */
-  if (now < sesscache_data->next_expiring) {
-    unsigned int secs;
-
-    secs = sesscache_data->next_expiring - now;
-    tls_log("shmcache: no expired sessions to flush; %u secs to next "
-      "expiration", secs);
-    return 0;
-  }
-
-  tls_log("shmcache: flushing session cache of expired sessions");
-
-  for (i = 0; i < sesscache_data->sd_listsz; i++) {
-    struct sesscache_entry *entry;
-
-    entry = &(sesscache_data->sd_entries[i]);
-    if (entry->expires > 0) {
-      if (entry->expires > now) {
-        if (entry->expires < next_expiring) {
-          next_expiring = entry->expires;
-        }
-
-      } else {
-        /* This entry has expired; clear its slot. */
-        entry->expires = 0;
-        pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
-
-        /* Don't forget to update the stats. */
-        sesscache_data->nexpired++;
-
-        if (sesscache_data->sd_listlen > 0) {
-          sesscache_data->sd_listlen--;
-        }
-
-        flushed++;
-      }
-    }
-
-    sesscache_data->next_expiring = next_expiring;
-  }
-
-  tls_log("shmcache: flushed %u expired %s from session cache", flushed,
-    flushed != 1 ? "sessions" : "session");
-  return flushed;
-}
-
 static int sess_cache_open(tls_sess_cache_t *cache, char *info, long timeout) {
   int fd, xerrno;
   char *ptr;
@@ -741,7 +773,7 @@ static int sess_cache_open(tls_sess_cache_t *cache, char *info, long timeout) {
         size_t min_size;
 
         /* The bare minimum size MUST be able to hold at least one session. */
-        min_size = sizeof(struct sesscache_data) +
+        min_size = sess_cache_get_entries_offset(1) +
           sizeof(struct sesscache_entry);
 
         if ((size_t) size < min_size) {
@@ -902,6 +934,7 @@ static int sess_cache_close(tls_sess_cache_t *cache) {
   if (cache != NULL &&
       cache->cache_pool != NULL) {
     destroy_pool(cache->cache_pool);
+    cache->cache_pool = NULL;
 
     if (sesscache_sess_list != NULL) {
       register unsigned int i;
@@ -940,6 +973,8 @@ static int sess_cache_close(tls_sess_cache_t *cache) {
     }
 
     sesscache_data = NULL;
+    sesscache_buckets = NULL;
+    sesscache_entries = NULL;
   }
 
   pr_fsio_close(sesscache_fh);
@@ -950,7 +985,9 @@ static int sess_cache_close(tls_sess_cache_t *cache) {
 static int sess_cache_add_large_sess(tls_sess_cache_t *cache,
     const unsigned char *sess_id, unsigned int sess_id_len, time_t expires,
     SSL_SESSION *sess, int sess_len) {
-  struct sesscache_large_entry *entry = NULL;
+  register unsigned int i;
+  struct sesscache_large_entry *entries, *entry = NULL;
+  time_t now;
 
   if (sess_len > TLS_MAX_SSL_SESSION_SIZE) {
     /* We may get sessions to add to the list which do not exceed the max
@@ -958,13 +995,13 @@ static int sess_cache_add_large_sess(tls_sess_cache_t *cache,
      * shmcache.  Don't track these in the 'exceeded' stats'.
      */
 
-    if (shmcache_lock_shm(sesscache_fh, F_WRLCK) == 0) {
+    if (shmcache_lock_range(sesscache_fh, F_WRLCK, 0) >= 0) {
       sesscache_data->nexceeded++;
       if ((size_t) sess_len > sesscache_data->exceeded_maxsz) {
         sesscache_data->exceeded_maxsz = sess_len;
       }
 
-      if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
+      if (shmcache_lock_range(sesscache_fh, F_UNLCK, 0) < 0) {
         tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
       }
 
@@ -973,36 +1010,29 @@ static int sess_cache_add_large_sess(tls_sess_cache_t *cache,
     }
   }
 
-  if (sesscache_sess_list != NULL) {
-    register unsigned int i;
-    struct sesscache_large_entry *entries;
-    time_t now;
+  if (sesscache_sess_list == NULL) {
+    sesscache_sess_list = make_array(cache->cache_pool, 1,
+      sizeof(struct sesscache_large_entry));
+  }
 
-    /* Look for any expired sessions in the list to overwrite/reuse. */
-    entries = sesscache_sess_list->elts;
-    now = time(NULL);
-    for (i = 0; i < sesscache_sess_list->nelts; i++) {
+  /* Look for any expired sessions in the list to overwrite/reuse. */
+  entries = sesscache_sess_list->elts;
+  now = time(NULL);
+  for (i = 0; i < sesscache_sess_list->nelts; i++) {
+    if (entries[i].expires <= now) {
+      /* This entry has expired; clear and reuse its slot. */
       entry = &(entries[i]);
-
-      if (entry->expires > now) {
-        /* This entry has expired; clear and reuse its slot. */
+      if (entry->expires > 0) {
         entry->expires = 0;
         pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
-
-        break;
       }
-    }
 
-  } else {
-    sesscache_sess_list = make_array(cache->cache_pool, 1,
-      sizeof(struct sesscache_large_entry));
-    entry = push_array(sesscache_sess_list);
+      break;
+    }
   }
 
-  /* Be defensive, and catch the case where entry might still be null here. */
   if (entry == NULL) {
-    errno = EPERM;
-    return -1;
+    entry = push_array(sesscache_sess_list);
   }
 
   entry->expires = expires;
@@ -1016,15 +1046,74 @@ static int sess_cache_add_large_sess(tls_sess_cache_t *cache,
   return 0;
 }
 
+/* Locks the bucket for the given session ID, and returns it, along with its
+ * slots.
+ */
+static struct sesscache_bucket *sess_cache_lock_bucket(
+    const unsigned char *sess_id, unsigned int sess_id_len,
+    struct sesscache_entry **entries) {
+  unsigned int idx;
+  int res;
+  struct sesscache_bucket *bucket;
+
+  idx = shmcache_hash(sess_id, sess_id_len) % sesscache_data->sd_nbuckets;
+
+  res = shmcache_lock_range(sesscache_fh, F_WRLCK, idx + 1);
+  if (res < 0) {
+    return NULL;
+  }
+
+  bucket = &(sesscache_buckets[idx]);
+  if (res == 1) {
+    bucket->ncontended++;
+  }
+
+  *entries = &(sesscache_entries[idx * sesscache_data->sd_bucketsz]);
+  return bucket;
+}
+
+static void sess_cache_unlock_bucket(struct sesscache_bucket *bucket) {
+  off_t idx;
+
+  idx = bucket - sesscache_buckets;
+  if (shmcache_lock_range(sesscache_fh, F_UNLCK, idx + 1) < 0) {
+    tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
+  }
+}
+
+/* Clears the slot of an expired session.
+ *
+ * NOTE: Callers are assumed to hold the lock of the slot's bucket!
+ */
+static void sess_cache_expire_entry(struct sesscache_bucket *bucket,
+    struct sesscache_entry *entry) {
+  entry->expires = 0;
+  pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
+
+  /* Don't forget to update the stats. */
+  bucket->nexpired++;
+  if (bucket->listlen > 0) {
+    bucket->listlen--;
+  }
+}
+
 static int sess_cache_add(tls_sess_cache_t *cache, const unsigned char *sess_id,
     unsigned int sess_id_len, time_t expires, SSL_SESSION *sess) {
   register unsigned int i;
-  unsigned int h, idx, last;
-  int found_slot = FALSE, need_lock = TRUE, res = 0, sess_len;
+  int sess_len;
+  time_t now;
+  unsigned char *ptr;
+  struct sesscache_bucket *bucket;
+  struct sesscache_entry *entries = NULL, *entry = NULL, *open_entry = NULL;
 
   pr_trace_msg(trace_channel, 9, "adding session to shmcache session cache %p",
     cache);
 
+  if (sesscache_data == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
   /* First we need to find out how much space is needed for the serialized
    * session data.  There is no known maximum size for SSL session data;
    * this module is currently designed to allow only up to a certain size.
@@ -1048,227 +1137,196 @@ static int sess_cache_add(tls_sess_cache_t *cache, const unsigned char *sess_id,
       sess, sess_len);
   }
 
-  if (sesscache_data->sd_listlen == sesscache_data->sd_listsz) {
-    /* It appears that the cache is full.  Try flushing any expired
-     * sessions.
-     */
-
-    if (shmcache_lock_shm(sesscache_fh, F_WRLCK) == 0) {
-      if (sess_cache_flush() > 0) {
-        /* If we made room, then do NOT release the lock; we keep the lock
-         * so that we can add the session.
-         */
-        need_lock = FALSE;
-
-      } else {
-        /* Release the lock, and use the "large session" list fallback. */
-        if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
-          tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
-        }
+  bucket = sess_cache_lock_bucket(sess_id, sess_id_len, &entries);
+  if (bucket == NULL) {
+    tls_log("shmcache: unable to add session to shm cache: error "
+      "write-locking shmcache: %s", strerror(errno));
 
-        return sess_cache_add_large_sess(cache, sess_id, sess_id_len, expires,
-          sess, sess_len);
-      }
+    /* Add this session to the "large session" list instead as a fallback. */
+    return sess_cache_add_large_sess(cache, sess_id, sess_id_len, expires,
+      sess, sess_len);
+  }
 
-    } else {
-      tls_log("shmcache: unable to flush shm cache: error write-locking "
-        "shmcache: %s", strerror(errno));
+  /* Look for the slot already holding this session, clearing out any expired
+   * sessions along the way.
+   */
+  now = time(NULL);
+  for (i = 0; i < sesscache_data->sd_bucketsz; i++) {
+    struct sesscache_entry *slot;
 
-      /* Add this session to the "large session" list instead as a fallback. */
-      return sess_cache_add_large_sess(cache, sess_id, sess_id_len, expires,
-        sess, sess_len);
+    slot = &(entries[i]);
+    if (slot->expires > 0 &&
+        slot->expires <= now) {
+      sess_cache_expire_entry(bucket, slot);
     }
-  }
 
-  /* Hash the key, start looking for an open slot. */
-  h = shmcache_hash(sess_id, sess_id_len);
-  idx = h % sesscache_data->sd_listsz;
+    if (slot->expires == 0) {
+      if (open_entry == NULL) {
+        open_entry = slot;
+      }
 
-  if (need_lock) {
-    if (shmcache_lock_shm(sesscache_fh, F_WRLCK) < 0) {
-      tls_log("shmcache: unable to add session to shm cache: error "
-        "write-locking shmcache: %s", strerror(errno));
+      continue;
+    }
 
-      /* Add this session to the "large session" list instead as a fallback. */
-      return sess_cache_add_large_sess(cache, sess_id, sess_id_len, expires,
-        sess, sess_len);
+    if (slot->sess_id_len == sess_id_len &&
+        memcmp(slot->sess_id, sess_id, sess_id_len) == 0) {
+      entry = slot;
+      break;
     }
   }
 
-  i = idx;
-  last = idx > 0 ? (idx - 1) : 0;
-
-  do {
-    struct sesscache_entry *entry;
-
-    pr_signals_handle();
-
-    /* Look for the first open slot (i.e. expires == 0). */
-    entry = &(sesscache_data->sd_entries[i]);
-    if (entry->expires == 0) {
-      unsigned char *ptr;
-
-      entry->expires = expires;
-      entry->sess_id_len = sess_id_len;
-      memcpy(entry->sess_id, sess_id, sess_id_len);
-      entry->sess_datalen = sess_len;
+  if (entry == NULL) {
+    entry = open_entry;
+  }
 
-      ptr = entry->sess_data;
-      i2d_SSL_SESSION(sess, &ptr);
+  if (entry == NULL) {
+    /* The bucket is full.  Sweep the clock hand over the slots, clearing
+     * their referenced flags, until it reaches an unreferenced one.
+     */
+    while (entry == NULL) {
+      struct sesscache_entry *slot;
 
-      sesscache_data->sd_listlen++;
-      sesscache_data->nstored++;
+      slot = &(entries[bucket->hand]);
+      bucket->hand = (bucket->hand + 1) % sesscache_data->sd_bucketsz;
 
-      if (sesscache_data->next_expiring > 0) {
-        if (expires < sesscache_data->next_expiring) {
-          sesscache_data->next_expiring = expires;
-        }
-
-      } else {
-        sesscache_data->next_expiring = expires;
+      if (slot->referenced) {
+        slot->referenced = FALSE;
+        continue;
       }
 
-      found_slot = TRUE;
-      break;
+      entry = slot;
     }
 
-    if (i < sesscache_data->sd_listsz) {
-      i++;
+    pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
+    entry->expires = 0;
+    bucket->nevicted++;
+    bucket->listlen--;
+  }
 
-    } else {
-      i = 0;
-    }
+  if (entry->expires == 0) {
+    bucket->listlen++;
+  }
 
-  } while (i != last);
+  entry->expires = expires;
+  entry->sess_id_len = sess_id_len;
+  memcpy(entry->sess_id, sess_id, sess_id_len);
+  entry->referenced = FALSE;
+  entry->sess_datalen = sess_len;
 
-  /* There is a race condition possible between the open slots check
-   * above and the scan through the slots.  So if we didn't actually find
-   * an open slot at this point, add it to the "large session" list.
-   */
-  if (!found_slot) {
-    res = sess_cache_add_large_sess(cache, sess_id, sess_id_len, expires, sess,
-      sess_len);
-  }
+  ptr = entry->sess_data;
+  i2d_SSL_SESSION(sess, &ptr);
 
-  if (need_lock) {
-    if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
-      tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
-    }
-  }
+  bucket->nstored++;
+  sess_cache_unlock_bucket(bucket);
 
-  return res;
+  return 0;
 }
 
 static SSL_SESSION *sess_cache_get(tls_sess_cache_t *cache,
     const unsigned char *sess_id, unsigned int sess_id_len) {
-  unsigned int h, idx;
+  register unsigned int i;
+  unsigned int sess_datalen = 0;
+  time_t now;
+  TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
+  struct sesscache_bucket *bucket;
+  struct sesscache_entry *entries = NULL;
   SSL_SESSION *sess = NULL;
 
   pr_trace_msg(trace_channel, 9,
     "getting session from shmcache session cache %p", cache);
 
+  if (sesscache_data == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  now = time(NULL);
+
   /* Look for the requested session in the "large session" list first. */
   if (sesscache_sess_list != NULL) {
-    register unsigned int i;
-    struct sesscache_large_entry *entries;
+    struct sesscache_large_entry *large_entries;
 
-    entries = sesscache_sess_list->elts;
+    large_entries = sesscache_sess_list->elts;
     for (i = 0; i < sesscache_sess_list->nelts; i++) {
       struct sesscache_large_entry *entry;
 
-      entry = &(entries[i]);
-      if (entry->expires > 0 &&
+      entry = &(large_entries[i]);
+      if (entry->expires > now &&
           entry->sess_id_len == sess_id_len &&
           memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
-        time_t now;
-
-        now = time(NULL);
-        if (entry->expires <= now) {
-          TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
-
-          ptr = entry->sess_data;
-          sess = d2i_SSL_SESSION(NULL, &ptr, entry->sess_datalen);
-          if (sess == NULL) {
-            tls_log("shmcache: error retrieving session from session cache: %s",
-              shmcache_get_errors());
+        ptr = entry->sess_data;
+        sess = d2i_SSL_SESSION(NULL, &ptr, entry->sess_datalen);
+        if (sess == NULL) {
+          tls_log("shmcache: error retrieving session from session cache: %s",
+            shmcache_get_errors());
 
-          } else {
-            break;
-          }
+        } else {
+          return sess;
         }
       }
     }
   }
 
-  if (sess) {
-    return sess;
-  }
-
-  h = shmcache_hash(sess_id, sess_id_len);
-  idx = h % sesscache_data->sd_listsz;
-
-  if (shmcache_lock_shm(sesscache_fh, F_WRLCK) == 0) {
-    register unsigned int i;
-    unsigned int last;
-
-    i = idx;
-    last = idx > 0 ? (idx -1) : 0;
-
-    do {
-      struct sesscache_entry *entry;
+  bucket = sess_cache_lock_bucket(sess_id, sess_id_len, &entries);
+  if (bucket == NULL) {
+    tls_log("shmcache: unable to retrieve session from session cache: error "
+      "write-locking shmcache: %s", strerror(errno));
 
-      pr_signals_handle();
+    errno = EPERM;
+    return NULL;
+  }
 
-      entry = &(sesscache_data->sd_entries[i]);
-      if (entry->expires > 0 &&
-          entry->sess_id_len == sess_id_len &&
-          memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
-        time_t now;
+  for (i = 0; i < sesscache_data->sd_bucketsz; i++) {
+    struct sesscache_entry *entry;
 
-        /* Don't forget to update the stats. */
-        now = time(NULL);
+    entry = &(entries[i]);
+    if (entry->expires > 0 &&
+        entry->sess_id_len == sess_id_len &&
+        memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
 
-        if (entry->expires > now) {
-          TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
+      if (entry->expires > now) {
+        /* Copy the session out, so as to deserialize it without holding
+         * the lock.
+         */
+        sess_datalen = entry->sess_datalen;
+        memcpy(sesscache_buf, entry->sess_data, sess_datalen);
+        entry->referenced = TRUE;
+        bucket->nhits++;
 
-          ptr = entry->sess_data;
-          sess = d2i_SSL_SESSION(NULL, &ptr, entry->sess_datalen);
-          if (sess != NULL) {
-            sesscache_data->nhits++;
+      } else {
+        sess_cache_expire_entry(bucket, entry);
+      }
 
-          } else {
-            tls_log("shmcache: error retrieving session from session cache: %s",
-              shmcache_get_errors());
-            sesscache_data->nerrors++;
-          }
-        }
+      break;
+    }
+  }
 
-        break;
-      }
+  if (sess_datalen == 0) {
+    bucket->nmisses++;
+  }
 
-      if (i < sesscache_data->sd_listsz) {
-        i++;
+  sess_cache_unlock_bucket(bucket);
 
-      } else {
-        i = 0;
-      }
+  if (sess_datalen == 0) {
+    errno = ENOENT;
+    return NULL;
+  }
 
-    } while (i != last);
+  ptr = sesscache_buf;
+  sess = d2i_SSL_SESSION(NULL, &ptr, sess_datalen);
+  pr_memscrub(sesscache_buf, sess_datalen);
 
-    if (sess == NULL) {
-      sesscache_data->nmisses++;
-      errno = ENOENT;
-    }
+  if (sess == NULL) {
+    tls_log("shmcache: error retrieving session from session cache: %s",
+      shmcache_get_errors());
 
-    if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
-      tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
+    bucket = sess_cache_lock_bucket(sess_id, sess_id_len, &entries);
+    if (bucket != NULL) {
+      bucket->nerrors++;
+      sess_cache_unlock_bucket(bucket);
     }
 
-  } else {
-    tls_log("shmcache: unable to retrieve session from session cache: error "
-      "write-locking shmcache: %s", strerror(errno));
-
-    errno = EPERM;
+    errno = ENOENT;
   }
 
   return sess;
@@ -1276,22 +1334,29 @@ static SSL_SESSION *sess_cache_get(tls_sess_cache_t *cache,
 
 static int sess_cache_delete(tls_sess_cache_t *cache,
     const unsigned char *sess_id, unsigned int sess_id_len) {
-  unsigned int h, idx;
-  int res;
+  register unsigned int i;
+  struct sesscache_bucket *bucket;
+  struct sesscache_entry *entries = NULL;
 
   pr_trace_msg(trace_channel, 9,
     "removing session from shmcache session cache %p", cache);
 
+  /* OpenSSL may still remove sessions, e.g. when freeing its context, after
+   * the cache has been closed; the cached entry will simply expire.
+   */
+  if (sesscache_data == NULL) {
+    return 0;
+  }
+
   /* Look for the requested session in the "large session" list first. */
   if (sesscache_sess_list != NULL) {
-    register unsigned int i;
-    struct sesscache_large_entry *entries;
+    struct sesscache_large_entry *large_entries;
 
-    entries = sesscache_sess_list->elts;
+    large_entries = sesscache_sess_list->elts;
     for (i = 0; i < sesscache_sess_list->nelts; i++) {
       struct sesscache_large_entry *entry;
 
-      entry = &(entries[i]);
+      entry = &(large_entries[i]);
       if (entry->sess_id_len == sess_id_len &&
           memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
 
@@ -1302,74 +1367,48 @@ static int sess_cache_delete(tls_sess_cache_t *cache,
     }
   }
 
-  h = shmcache_hash(sess_id, sess_id_len);
-  idx = h % sesscache_data->sd_listsz;
-
-  if (shmcache_lock_shm(sesscache_fh, F_WRLCK) == 0) {
-    register unsigned int i;
-    unsigned int last;
-
-    i = idx;
-    last = idx > 0 ? (idx - 1) : 0;
+  bucket = sess_cache_lock_bucket(sess_id, sess_id_len, &entries);
+  if (bucket == NULL) {
+    tls_log("shmcache: unable to delete session from session cache: error "
+      "write-locking shmcache: %s", strerror(errno));
 
-    do {
-      struct sesscache_entry *entry;
+    errno = EPERM;
+    return -1;
+  }
 
-      pr_signals_handle();
+  for (i = 0; i < sesscache_data->sd_bucketsz; i++) {
+    struct sesscache_entry *entry;
 
-      entry = &(sesscache_data->sd_entries[i]);
-      if (entry->sess_id_len == sess_id_len &&
-          memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
-        time_t now;
+    entry = &(entries[i]);
+    if (entry->expires > 0 &&
+        entry->sess_id_len == sess_id_len &&
+        memcmp(entry->sess_id, sess_id, entry->sess_id_len) == 0) {
 
+      if (entry->expires > time(NULL)) {
         pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
-
-        if (sesscache_data->sd_listlen > 0) {
-          sesscache_data->sd_listlen--;
-        }
+        entry->expires = 0;
 
         /* Don't forget to update the stats. */
-        now = time(NULL);
-        if (entry->expires > now) {
-          sesscache_data->ndeleted++;
-
-        } else {
-          sesscache_data->nexpired++;
+        bucket->ndeleted++;
+        if (bucket->listlen > 0) {
+          bucket->listlen--;
         }
 
-        entry->expires = 0;
-        break;
-      }
-
-      if (i < sesscache_data->sd_listsz) {
-        i++;
-
       } else {
-        i = 0;
+        sess_cache_expire_entry(bucket, entry);
       }
 
-    } while (i != last);
-
-    if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
-      tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
+      break;
     }
-
-    res = 0;
-
-  } else {
-    tls_log("shmcache: unable to delete session from session cache: error "
-      "write-locking shmcache: %s", strerror(errno));
-
-    errno = EPERM;
-    res = -1;
   }
 
-  return res;
+  sess_cache_unlock_bucket(bucket);
+  return 0;
 }
 
 static int sess_cache_clear(tls_sess_cache_t *cache) {
   register unsigned int i;
-  int res;
+  int res = 0;
 
   pr_trace_msg(trace_channel, 9, "clearing shmcache session cache %p", cache);
 
@@ -1400,14 +1439,16 @@ static int sess_cache_clear(tls_sess_cache_t *cache) {
   for (i = 0; i < sesscache_data->sd_listsz; i++) {
     struct sesscache_entry *entry;
 
-    entry = &(sesscache_data->sd_entries[i]);
+    entry = &(sesscache_entries[i]);
 
     entry->expires = 0;
     pr_memscrub((void *) entry->sess_data, entry->sess_datalen);
   }
 
-  res = sesscache_data->sd_listlen; 
-  sesscache_data->sd_listlen = 0;
+  for (i = 0; i < sesscache_data->sd_nbuckets; i++) {
+    res += sesscache_buckets[i].listlen;
+    sesscache_buckets[i].listlen = 0;
+  }
 
   if (shmcache_lock_shm(sesscache_fh, F_UNLCK) < 0) {
     tls_log("shmcache: error unlocking shmcache: %s", strerror(errno));
@@ -1464,8 +1505,10 @@ static int sess_cache_remove(tls_sess_cache_t *cache) {
 
 static int sess_cache_status(tls_sess_cache_t *cache,
     void (*statusf)(void *, const char *, ...), void *arg, int flags) {
+  register unsigned int i;
   int res, xerrno = 0;
   struct shmid_ds ds;
+  struct sesscache_bucket totals;
   pool *tmp_pool;
 
   pr_trace_msg(trace_channel, 9, "checking shmcache session cache %p", cache);
@@ -1501,19 +1544,40 @@ static int sess_cache_status(tls_sess_cache_t *cache,
       sesscache_shmid, strerror(xerrno));
   } 
 
+  /* Add up the bucket stats. */
+  memset(&totals, 0, sizeof(totals));
+  for (i = 0; i < sesscache_data->sd_nbuckets; i++) {
+    struct sesscache_bucket *bucket;
+
+    bucket = &(sesscache_buckets[i]);
+    totals.nhits += bucket->nhits;
+    totals.nmisses += bucket->nmisses;
+    totals.nstored += bucket->nstored;
+    totals.ndeleted += bucket->ndeleted;
+    totals.nexpired += bucket->nexpired;
+    totals.nevicted += bucket->nevicted;
+    totals.nerrors += bucket->nerrors;
+    totals.ncontended += bucket->ncontended;
+    totals.listlen += bucket->listlen;
+  }
+
   statusf(arg, "%s", "");
   statusf(arg, "Max session cache size: %u", sesscache_data->sd_listsz);
-  statusf(arg, "Current session cache size: %u", sesscache_data->sd_listlen);
+  statusf(arg, "Current session cache size: %u", totals.listlen);
+  statusf(arg, "Session cache buckets: %u (%u sessions each)",
+    sesscache_data->sd_nbuckets, sesscache_data->sd_bucketsz);
   statusf(arg, "%s", "");
-  statusf(arg, "Cache lifetime hits: %u", sesscache_data->nhits);
-  statusf(arg, "Cache lifetime misses: %u", sesscache_data->nmisses);
+  statusf(arg, "Cache lifetime hits: %u", totals.nhits);
+  statusf(arg, "Cache lifetime misses: %u", totals.nmisses);
+  statusf(arg, "Cache lifetime lock contentions: %u", totals.ncontended);
   statusf(arg, "%s", "");
-  statusf(arg, "Cache lifetime sessions stored: %u", sesscache_data->nstored);
-  statusf(arg, "Cache lifetime sessions deleted: %u", sesscache_data->ndeleted);
-  statusf(arg, "Cache lifetime sessions expired: %u", sesscache_data->nexpired);
+  statusf(arg, "Cache lifetime sessions stored: %u", totals.nstored);
+  statusf(arg, "Cache lifetime sessions deleted: %u", totals.ndeleted);
+  statusf(arg, "Cache lifetime sessions expired: %u", totals.nexpired);
+  statusf(arg, "Cache lifetime sessions evicted: %u", totals.nevicted);
   statusf(arg, "%s", "");
   statusf(arg, "Cache lifetime errors handling sessions in cache: %u",
-    sesscache_data->nerrors);
+    totals.nerrors);
   statusf(arg, "Cache lifetime sessions exceeding max entry size: %u",
     sesscache_data->nexceeded);
   if (sesscache_data->nexceeded > 0) {
@@ -1522,12 +1586,10 @@ static int sess_cache_status(tls_sess_cache_t *cache,
   }
 
   if (flags & TLS_SESS_CACHE_STATUS_FL_SHOW_SESSIONS) {
-    register unsigned int i;
-
     statusf(arg, "%s", "");
     statusf(arg, "%s", "Cached sessions:");
 
-    if (sesscache_data->sd_listlen == 0) {
+    if (totals.listlen == 0) {
       statusf(arg, "%s", "  (none)");
     }
 
@@ -1546,7 +1608,7 @@ static int sess_cache_status(tls_sess_cache_t *cache,
 
       pr_signals_handle();
 
-      entry = &(sesscache_data->sd_entries[i]);
+      entry = &(sesscache_entries[i]);
       if (entry->expires > 0) {
         SSL_SESSION *sess;
         TLS_D2I_SSL_SESSION_CONST unsigned char *ptr;
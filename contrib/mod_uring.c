@@ -0,0 +1,1582 @@
+/*
+ * ProFTPD: mod_uring -- a module which uses Linux io_uring for batched,
+ *                       asynchronous file reads and writes
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, the ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ *
+ * This is mod_uring, contrib software for proftpd 1.3.x.
+ */
+
+#include "conf.h"
+
+#define MOD_URING_VERSION		"mod_uring/0.1"
+
+/* Make sure the version of proftpd is as necessary. */
+#if PROFTPD_VERSION_NUMBER < 0x0001030701
+# error "ProFTPD 1.3.7rc1 or later required"
+#endif
+
+#if !defined(HAVE_LINUX_IO_URING_H)
+# error "mod_uring requires Linux io_uring support"
+#endif
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#if HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+#ifndef MAP_FAILED
+# define MAP_FAILED	((void *) -1)
+#endif
+
+/* Number of submission queue entries for the session's ring.  This bounds
+ * the total number of reads/writes in flight, across all open files.
+ */
+#define URING_RING_ENTRIES		64
+
+/* Default number of reads (readahead) or writes (write-behind) which may be
+ * in flight for a single file.
+ */
+#define URING_DEFAULT_QUEUE_DEPTH	4
+#define URING_MAX_QUEUE_DEPTH		32
+
+module uring_module;
+
+static int uring_engine = FALSE;
+static unsigned int uring_queue_depth = URING_DEFAULT_QUEUE_DEPTH;
+static int uring_stat_prefetch = FALSE;
+
+static const char *trace_channel = "uring";
+
+/* The session's ring. */
+static int uring_fd = -1;
+static unsigned int uring_inflight = 0;
+
+/* Whether the kernel supports the opcodes we use.  io_uring_setup(2) works
+ * on 5.1 and later kernels, but IORING_OP_READ, IORING_OP_WRITE and
+ * IORING_OP_STATX only appeared in 5.6; older kernels fail them, at
+ * completion time, with EINVAL.
+ */
+static int uring_have_rw = FALSE;
+static int uring_have_statx = FALSE;
+
+static struct {
+  unsigned int *head, *tail, *ring_mask, *ring_entries, *array;
+  struct io_uring_sqe *sqes;
+} uring_sq;
+
+static struct {
+  unsigned int *head, *tail, *ring_mask;
+  struct io_uring_cqe *cqes;
+} uring_cq;
+
+/* Counters for the queue depth seen by submissions, and for the latency of
+ * completions.  These are tracked for each file, and for the session.
+ */
+struct uring_stats {
+  uint64_t nreads;
+  uint64_t nwrites;
+  uint64_t nstats;
+  uint64_t depth_total;
+  unsigned int depth_max;
+  uint64_t latency_total_us;
+  uint64_t latency_max_us;
+  uint64_t ncompleted;
+};
+
+static struct uring_stats uring_sess_stats;
+
+/* Number of statx completions reaped, for waiting on a prefetch batch. */
+static unsigned int uring_nstatx_done = 0;
+
+#define URING_SLOT_FL_FREE		0
+#define URING_SLOT_FL_INFLIGHT		1
+#define URING_SLOT_FL_DONE		2
+
+struct uring_file;
+
+/* Slots are used for reads/writes of a file, and for the statx lookups of
+ * metadata prefetches, which have no file.
+ */
+struct uring_slot {
+  struct uring_file *file;
+  int state;
+  unsigned char opcode;
+  off_t offset;
+  char *buf;
+  size_t bufsz;
+  size_t len;
+  size_t consumed;
+  int res;
+  uint64_t submit_us;
+};
+
+/* Per-file state, stashed in the pr_fh_t's fh_data slot. */
+struct uring_file {
+  pr_fh_t *fh;
+  int fd;
+
+  /* The logical file position; reads and writes are done at explicit
+   * offsets, so the kernel's file position is not used.
+   */
+  off_t pos;
+
+  /* Ring of slots, in file offset order; head is the oldest. */
+  struct uring_slot *slots;
+  unsigned int nslots, head, count;
+
+  /* Offset of the next readahead to submit, and whether EOF was seen. */
+  off_t next_offset;
+  int eof;
+
+  /* Errors from write-behind completions are reported by the next write,
+   * or by the close.
+   */
+  int write_errno;
+
+  /* Set when the kernel rejected one of the file's reads/writes as
+   * unsupported; the file is then handed back to plain system calls.
+   */
+  int unsupported;
+
+  struct uring_stats stats;
+};
+
+static uint64_t uring_now_us(void) {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+    return 0;
+  }
+
+  return ((uint64_t) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static int uring_enter(unsigned int to_submit, unsigned int min_complete,
+    unsigned int flags) {
+  int res;
+
+  res = syscall(__NR_io_uring_enter, uring_fd, to_submit, min_complete, flags,
+    NULL, 0);
+  while (res < 0 &&
+         errno == EINTR) {
+    pr_signals_handle();
+    res = syscall(__NR_io_uring_enter, uring_fd, to_submit, min_complete,
+      flags, NULL, 0);
+  }
+
+  return res;
+}
+
+/* Ask the kernel which opcodes it supports.  Kernels older than 5.6 lack
+ * IORING_REGISTER_PROBE, as well as the opcodes themselves.
+ */
+static void uring_probe_ops(void) {
+  struct {
+    struct io_uring_probe probe;
+    struct io_uring_probe_op ops[64];
+  } probe;
+  int res;
+
+  memset(&probe, 0, sizeof(probe));
+  res = syscall(__NR_io_uring_register, uring_fd, IORING_REGISTER_PROBE,
+    &probe, 64);
+  if (res < 0) {
+    pr_trace_msg(trace_channel, 3, "error probing io_uring opcodes: %s",
+      strerror(errno));
+    uring_have_rw = uring_have_statx = FALSE;
+    return;
+  }
+
+  uring_have_rw = (probe.probe.last_op >= IORING_OP_WRITE &&
+    (probe.ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+    (probe.ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)) ?
+    TRUE : FALSE;
+  uring_have_statx = (probe.probe.last_op >= IORING_OP_STATX &&
+    (probe.ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED)) ?
+    TRUE : FALSE;
+
+  pr_trace_msg(trace_channel, 9, "io_uring opcodes supported: read/write %s, "
+    "statx %s", uring_have_rw ? "yes" : "no", uring_have_statx ? "yes" : "no");
+}
+
+/* Whether a completion error means the kernel does not support the
+ * operation, rather than that the operation failed.
+ */
+static int uring_res_unsupported(int res) {
+  return (res == -EINVAL || res == -EOPNOTSUPP) ? TRUE : FALSE;
+}
+
+static int uring_open_ring(void) {
+  struct io_uring_params params;
+  size_t sq_sz, cq_sz;
+  char *sq_ptr, *cq_ptr;
+  void *sqes;
+  int fd;
+
+  memset(&params, 0, sizeof(params));
+  fd = syscall(__NR_io_uring_setup, URING_RING_ENTRIES, &params);
+  if (fd < 0) {
+    return -1;
+  }
+
+  sq_sz = params.sq_off.array + (params.sq_entries * sizeof(unsigned int));
+  cq_sz = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cq_sz > sq_sz) {
+      sq_sz = cq_sz;
+    }
+
+    cq_sz = sq_sz;
+  }
+
+  sq_ptr = mmap(NULL, sq_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+    fd, IORING_OFF_SQ_RING);
+  if (sq_ptr == MAP_FAILED) {
+    int xerrno = errno;
+
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_ptr = sq_ptr;
+
+  } else {
+    cq_ptr = mmap(NULL, cq_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+      fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED) {
+      int xerrno = errno;
+
+      (void) munmap(sq_ptr, sq_sz);
+      (void) close(fd);
+      errno = xerrno;
+      return -1;
+    }
+  }
+
+  sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+    PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    int xerrno = errno;
+
+    if (cq_ptr != sq_ptr) {
+      (void) munmap(cq_ptr, cq_sz);
+    }
+    (void) munmap(sq_ptr, sq_sz);
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  uring_sq.head = (unsigned int *) (sq_ptr + params.sq_off.head);
+  uring_sq.tail = (unsigned int *) (sq_ptr + params.sq_off.tail);
+  uring_sq.ring_mask = (unsigned int *) (sq_ptr + params.sq_off.ring_mask);
+  uring_sq.ring_entries = (unsigned int *) (sq_ptr +
+    params.sq_off.ring_entries);
+  uring_sq.array = (unsigned int *) (sq_ptr + params.sq_off.array);
+  uring_sq.sqes = sqes;
+
+  uring_cq.head = (unsigned int *) (cq_ptr + params.cq_off.head);
+  uring_cq.tail = (unsigned int *) (cq_ptr + params.cq_off.tail);
+  uring_cq.ring_mask = (unsigned int *) (cq_ptr + params.cq_off.ring_mask);
+  uring_cq.cqes = (struct io_uring_cqe *) (cq_ptr + params.cq_off.cqes);
+
+  uring_fd = fd;
+  pr_trace_msg(trace_channel, 9, "opened io_uring (fd %d) with %u entries",
+    uring_fd, params.sq_entries);
+
+  uring_probe_ops();
+  return 0;
+}
+
+static void uring_stats_add_completion(struct uring_stats *stats,
+    uint64_t latency_us) {
+  stats->ncompleted++;
+  stats->latency_total_us += latency_us;
+  if (latency_us > stats->latency_max_us) {
+    stats->latency_max_us = latency_us;
+  }
+}
+
+static void uring_stats_add_submission(struct uring_stats *stats,
+    unsigned char opcode) {
+  if (opcode == IORING_OP_READ) {
+    stats->nreads++;
+
+  } else if (opcode == IORING_OP_STATX) {
+    stats->nstats++;
+
+  } else {
+    stats->nwrites++;
+  }
+
+  stats->depth_total += uring_inflight;
+  if (uring_inflight > stats->depth_max) {
+    stats->depth_max = uring_inflight;
+  }
+}
+
+/* Process all available completions, waiting for at least one if
+ * requested.
+ */
+static int uring_reap(int wait) {
+  unsigned int head;
+
+  if (wait &&
+      uring_inflight > 0) {
+    if (uring_enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+      return -1;
+    }
+  }
+
+  head = *uring_cq.head;
+  while (head != __atomic_load_n(uring_cq.tail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe *cqe;
+    struct uring_slot *slot;
+    uint64_t latency_us;
+
+    cqe = &(uring_cq.cqes[head & *uring_cq.ring_mask]);
+    slot = (struct uring_slot *) (uintptr_t) cqe->user_data;
+
+    slot->res = cqe->res;
+    slot->state = URING_SLOT_FL_DONE;
+    uring_inflight--;
+
+    latency_us = uring_now_us() - slot->submit_us;
+    if (slot->file != NULL) {
+      uring_stats_add_completion(&(slot->file->stats), latency_us);
+
+    } else if (slot->opcode == IORING_OP_STATX) {
+      uring_nstatx_done++;
+    }
+    uring_stats_add_completion(&uring_sess_stats, latency_us);
+
+    head++;
+  }
+
+  __atomic_store_n(uring_cq.head, head, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static int uring_submit(struct uring_slot *slot) {
+  struct io_uring_sqe *sqe;
+  unsigned int tail, idx;
+  int res;
+
+  /* Make room in the ring, if necessary. */
+  while (uring_inflight >= URING_RING_ENTRIES) {
+    if (uring_reap(TRUE) < 0) {
+      return -1;
+    }
+  }
+
+  tail = *uring_sq.tail;
+  idx = tail & *uring_sq.ring_mask;
+  sqe = &(uring_sq.sqes[idx]);
+
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode = slot->opcode;
+  sqe->fd = slot->file->fd;
+  sqe->off = (uint64_t) slot->offset;
+  sqe->addr = (uint64_t) (uintptr_t) slot->buf;
+  sqe->len = (uint32_t) slot->len;
+  sqe->user_data = (uint64_t) (uintptr_t) slot;
+
+  uring_sq.array[idx] = idx;
+  __atomic_store_n(uring_sq.tail, tail + 1, __ATOMIC_RELEASE);
+
+  slot->state = URING_SLOT_FL_INFLIGHT;
+  slot->res = 0;
+  slot->consumed = 0;
+  slot->submit_us = uring_now_us();
+
+  res = uring_enter(1, 0, 0);
+  if (res < 1) {
+    int xerrno = res < 0 ? errno : EAGAIN;
+
+    /* Take the entry back out of the ring. */
+    __atomic_store_n(uring_sq.tail, tail, __ATOMIC_RELEASE);
+    slot->state = URING_SLOT_FL_FREE;
+
+    errno = xerrno;
+    return -1;
+  }
+
+  uring_inflight++;
+  uring_stats_add_submission(&(slot->file->stats), slot->opcode);
+  uring_stats_add_submission(&uring_sess_stats, slot->opcode);
+  return 0;
+}
+
+static int uring_wait_slot(struct uring_slot *slot) {
+  while (slot->state == URING_SLOT_FL_INFLIGHT) {
+    if (uring_reap(TRUE) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* Handle a completed write; short writes are finished synchronously. */
+static void uring_complete_write(struct uring_file *uf,
+    struct uring_slot *slot) {
+  size_t written;
+
+  if (slot->res < 0) {
+    if (!uring_res_unsupported(slot->res)) {
+      if (uf->write_errno == 0) {
+        uf->write_errno = -(slot->res);
+      }
+
+      return;
+    }
+
+    /* The kernel would not do the write; do it ourselves, and stop using
+     * the ring for this file.
+     */
+    if (uf->unsupported == FALSE) {
+      pr_trace_msg(trace_channel, 3, "io_uring write for '%s' failed (%s), "
+        "falling back to pwrite(2)", uf->fh->fh_path, strerror(-(slot->res)));
+      uf->unsupported = TRUE;
+    }
+
+    slot->res = 0;
+  }
+
+  written = (size_t) slot->res;
+  while (written < slot->len) {
+    ssize_t res;
+
+    res = pwrite(uf->fd, slot->buf + written, slot->len - written,
+      slot->offset + written);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      if (uf->write_errno == 0) {
+        uf->write_errno = errno;
+      }
+
+      return;
+    }
+
+    if (res == 0) {
+      if (uf->write_errno == 0) {
+        uf->write_errno = EIO;
+      }
+
+      return;
+    }
+
+    written += res;
+  }
+}
+
+/* Wait for all of the file's reads/writes to complete, and release their
+ * slots.  Any pending readahead data is discarded.
+ */
+static int uring_file_drain(struct uring_file *uf) {
+  while (uf->count > 0) {
+    struct uring_slot *slot;
+
+    slot = &(uf->slots[uf->head]);
+    if (uring_wait_slot(slot) < 0) {
+      return -1;
+    }
+
+    if (slot->opcode == IORING_OP_WRITE) {
+      uring_complete_write(uf, slot);
+    }
+
+    slot->state = URING_SLOT_FL_FREE;
+    uf->head = (uf->head + 1) % uf->nslots;
+    uf->count--;
+  }
+
+  uf->head = 0;
+  uf->eof = FALSE;
+  return 0;
+}
+
+static struct uring_slot *uring_file_next_slot(struct uring_file *uf,
+    size_t bufsz) {
+  struct uring_slot *slot;
+
+  slot = &(uf->slots[(uf->head + uf->count) % uf->nslots]);
+  slot->file = uf;
+  if (slot->bufsz < bufsz) {
+    slot->buf = palloc(uf->fh->fh_pool, bufsz);
+    slot->bufsz = bufsz;
+  }
+
+  return slot;
+}
+
+/* Keep the file's readahead queue full. */
+static void uring_file_readahead(struct uring_file *uf, size_t chunksz) {
+  while (uf->eof == FALSE &&
+         uf->count < uf->nslots) {
+    struct uring_slot *slot;
+
+    slot = uring_file_next_slot(uf, chunksz);
+    slot->opcode = IORING_OP_READ;
+    slot->offset = uf->next_offset;
+    slot->len = chunksz;
+
+    if (uring_submit(slot) < 0) {
+      pr_trace_msg(trace_channel, 3, "error submitting read for '%s': %s",
+        uf->fh->fh_path, strerror(errno));
+      break;
+    }
+
+    uf->count++;
+    uf->next_offset += chunksz;
+  }
+}
+
+static void uring_log_stats(const char *what, struct uring_stats *stats) {
+  uint64_t nsubmitted;
+
+  nsubmitted = stats->nreads + stats->nwrites + stats->nstats;
+  if (nsubmitted == 0) {
+    return;
+  }
+
+  pr_trace_msg(trace_channel, 8,
+    "%s: %lu reads, %lu writes, %lu stats, queue depth avg %0.2f max %u, "
+    "completion latency avg %lu usec max %lu usec", what,
+    (unsigned long) stats->nreads, (unsigned long) stats->nwrites,
+    (unsigned long) stats->nstats,
+    (double) stats->depth_total / nsubmitted, stats->depth_max,
+    stats->ncompleted ?
+      (unsigned long) (stats->latency_total_us / stats->ncompleted) : 0UL,
+    (unsigned long) stats->latency_max_us);
+}
+
+/* Stop using the ring for the file, leaving its reads/writes to the FS below
+ * ours.  The kernel's file position is synced to our logical position, as
+ * those will use it.
+ */
+static int uring_file_detach(struct uring_file *uf) {
+  if (uring_file_drain(uf) < 0) {
+    return -1;
+  }
+
+  if (lseek(uf->fd, uf->pos, SEEK_SET) == (off_t) -1) {
+    return -1;
+  }
+
+  uring_log_stats(uf->fh->fh_path, &(uf->stats));
+  uf->fh->fh_data = NULL;
+
+  if (uf->write_errno != 0) {
+    errno = uf->write_errno;
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Metadata prefetching
+ */
+
+static void uring_statx2stat(const struct statx *stx, struct stat *st) {
+  memset(st, 0, sizeof(struct stat));
+
+  st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+  st->st_ino = stx->stx_ino;
+  st->st_mode = stx->stx_mode;
+  st->st_nlink = stx->stx_nlink;
+  st->st_uid = stx->stx_uid;
+  st->st_gid = stx->stx_gid;
+  st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+  st->st_size = stx->stx_size;
+  st->st_blksize = stx->stx_blksize;
+  st->st_blocks = stx->stx_blocks;
+  st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+  st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+  st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+  st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+  st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+  st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+/* Waits until the given number of statx requests, of the current prefetch,
+ * have completed.  Their buffers belong to the caller, so we cannot return
+ * while any are still in flight; if the completions cannot be reaped, the
+ * session is ended instead.
+ */
+static void uring_drain_statx(unsigned int nsubmitted) {
+  while (uring_nstatx_done < nsubmitted) {
+    if (uring_reap(TRUE) < 0) {
+      int xerrno = errno;
+
+      if (xerrno == EAGAIN ||
+          xerrno == EBUSY) {
+        /* Make room in the completion ring, then try again. */
+        (void) uring_reap(FALSE);
+        continue;
+      }
+
+      pr_log_pri(PR_LOG_ERR, MOD_URING_VERSION
+        ": error waiting for io_uring completions: %s", strerror(xerrno));
+      pr_session_disconnect(&uring_module, PR_SESS_DISCONNECT_BY_APPLICATION,
+        "io_uring failure");
+    }
+  }
+}
+
+/* Statcache prefetch handler: submits a statx for each path, keeping as many
+ * in flight as the ring allows, so that the lookups (e.g. NFS round trips)
+ * are done in parallel by the kernel's io_uring workers.
+ */
+static int uring_stat_prefetch_paths(pool *p, unsigned int count,
+    const char **paths, struct stat *sts, int *errnos) {
+  register unsigned int i;
+  struct uring_slot *slots;
+  struct statx *stxs;
+  unsigned int next = 0, ndone = 0;
+
+  if (uring_fd < 0) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  slots = pcalloc(p, count * sizeof(struct uring_slot));
+  stxs = pcalloc(p, count * sizeof(struct statx));
+
+  uring_nstatx_done = 0;
+
+  while (ndone < count) {
+    unsigned int nqueued = 0, tail;
+
+    pr_signals_handle();
+
+    tail = *uring_sq.tail;
+    while (next < count &&
+           uring_inflight + nqueued < URING_RING_ENTRIES) {
+      struct io_uring_sqe *sqe;
+      struct uring_slot *slot;
+      unsigned int idx;
+
+      idx = (tail + nqueued) & *uring_sq.ring_mask;
+      sqe = &(uring_sq.sqes[idx]);
+      slot = &(slots[next]);
+
+      memset(sqe, 0, sizeof(struct io_uring_sqe));
+      sqe->opcode = IORING_OP_STATX;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = (uint64_t) (uintptr_t) paths[next];
+      sqe->len = STATX_BASIC_STATS;
+      sqe->off = (uint64_t) (uintptr_t) &(stxs[next]);
+      sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+      sqe->user_data = (uint64_t) (uintptr_t) slot;
+      uring_sq.array[idx] = idx;
+
+      slot->opcode = IORING_OP_STATX;
+      slot->state = URING_SLOT_FL_INFLIGHT;
+      slot->submit_us = uring_now_us();
+
+      nqueued++;
+      next++;
+    }
+
+    if (nqueued > 0) {
+      unsigned int nsubmitted = 0;
+      int res = 0;
+
+      __atomic_store_n(uring_sq.tail, tail + nqueued, __ATOMIC_RELEASE);
+
+      /* The kernel may take fewer entries than given, e.g. when short of
+       * memory; the rest stay queued in the ring for the next call.
+       */
+      while (nsubmitted < nqueued) {
+        res = uring_enter(nqueued - nsubmitted, 0, 0);
+        if (res <= 0) {
+          if (res == 0) {
+            errno = EAGAIN;
+          }
+
+          break;
+        }
+
+        for (i = 0; i < (unsigned int) res; i++) {
+          uring_inflight++;
+          uring_stats_add_submission(&uring_sess_stats, IORING_OP_STATX);
+        }
+
+        nsubmitted += res;
+      }
+
+      if (nsubmitted < nqueued) {
+        int xerrno = errno;
+
+        /* Take the unsubmitted entries back out of the ring, and wait for
+         * the submitted ones, whose buffers are about to be freed.
+         */
+        __atomic_store_n(uring_sq.tail, tail + nsubmitted, __ATOMIC_RELEASE);
+        next -= (nqueued - nsubmitted);
+        uring_drain_statx(next);
+
+        errno = xerrno;
+        return -1;
+      }
+    }
+
+    if (uring_reap(TRUE) < 0) {
+      int xerrno = errno;
+
+      uring_drain_statx(next);
+
+      errno = xerrno;
+      return -1;
+    }
+
+    ndone = uring_nstatx_done;
+  }
+
+  for (i = 0; i < count; i++) {
+    if (slots[i].res < 0) {
+      memset(&(sts[i]), 0, sizeof(struct stat));
+      errnos[i] = -slots[i].res;
+
+    } else {
+      uring_statx2stat(&(stxs[i]), &(sts[i]));
+      errnos[i] = 0;
+    }
+  }
+
+  pr_trace_msg(trace_channel, 17, "prefetched metadata for %u %s", count,
+    count != 1 ? "paths" : "path");
+  return 0;
+}
+
+/* FSIO callbacks
+ */
+
+static int uring_fsio_open(pr_fh_t *fh, const char *path, int flags);
+
+/* Find the FS below ours in the stack, for passing calls through. */
+static pr_fs_t *uring_next_fs(pr_fh_t *fh) {
+  pr_fs_t *fs;
+
+  fs = fh->fh_fs;
+  while (fs != NULL &&
+         fs->open != uring_fsio_open) {
+    fs = fs->fs_next;
+  }
+
+  return fs != NULL ? fs->fs_next : NULL;
+}
+
+static int uring_fsio_open(pr_fh_t *fh, const char *path, int flags) {
+  int fd;
+  struct stat st;
+  struct uring_file *uf;
+  pr_fs_t *fs, *next_fs;
+
+  next_fs = uring_next_fs(fh);
+
+  fs = next_fs;
+  while (fs && fs->fs_next && !fs->open) {
+    fs = fs->fs_next;
+  }
+
+  fd = (fs->open)(fh, path, flags);
+  if (fd < 0) {
+    return fd;
+  }
+
+  /* Only regular files, written at explicit offsets, are handled using the
+   * ring; anything else uses plain system calls.  If some other module's FS
+   * below us wants to see the file data (e.g. mod_quotatab), leave the file
+   * to it.
+   */
+  if (uring_fd < 0 ||
+      uring_have_rw == FALSE ||
+      (flags & O_APPEND) ||
+      fstat(fd, &st) < 0 ||
+      !S_ISREG(st.st_mode)) {
+    return fd;
+  }
+
+  for (fs = next_fs; fs != NULL && fs->fs_next != NULL; fs = fs->fs_next) {
+    if (fs->read != NULL ||
+        fs->write != NULL) {
+      pr_trace_msg(trace_channel, 15, "not using io_uring for '%s': '%s' FS "
+        "handles reads/writes", path, fs->fs_name);
+      return fd;
+    }
+  }
+
+  uf = pcalloc(fh->fh_pool, sizeof(struct uring_file));
+  uf->fh = fh;
+  uf->fd = fd;
+  uf->nslots = uring_queue_depth;
+  uf->slots = pcalloc(fh->fh_pool, sizeof(struct uring_slot) * uf->nslots);
+  fh->fh_data = uf;
+
+  pr_trace_msg(trace_channel, 15, "using io_uring for '%s' (fd %d)", path, fd);
+  return fd;
+}
+
+static int uring_fsio_close(pr_fh_t *fh, int fd) {
+  struct uring_file *uf;
+  pr_fs_t *fs;
+  int res, xerrno = 0;
+
+  uf = fh->fh_data;
+  if (uf != NULL) {
+    if (uring_file_drain(uf) < 0) {
+      xerrno = errno;
+    }
+
+    if (uf->write_errno != 0) {
+      xerrno = uf->write_errno;
+    }
+
+    uring_log_stats(fh->fh_path, &(uf->stats));
+    fh->fh_data = NULL;
+  }
+
+  fs = uring_next_fs(fh);
+  while (fs && fs->fs_next && !fs->close) {
+    fs = fs->fs_next;
+  }
+
+  res = (fs->close)(fh, fd);
+  if (res == 0 &&
+      xerrno != 0) {
+    errno = xerrno;
+    return -1;
+  }
+
+  return res;
+}
+
+static int uring_fsio_read(pr_fh_t *fh, int fd, char *buf, size_t size) {
+  struct uring_file *uf;
+  struct uring_slot *slot;
+  size_t len;
+
+  uf = fh->fh_data;
+  if (uf == NULL) {
+    pr_fs_t *fs;
+
+    fs = uring_next_fs(fh);
+    while (fs && fs->fs_next && !fs->read) {
+      fs = fs->fs_next;
+    }
+
+    return (fs->read)(fh, fd, buf, size);
+  }
+
+  /* Switching from writing to reading, or a seek, means starting the
+   * readahead over at the current position.
+   */
+  if (uf->count > 0) {
+    slot = &(uf->slots[uf->head]);
+
+    if (slot->opcode != IORING_OP_READ ||
+        uf->pos != (off_t) (slot->offset + slot->consumed)) {
+      if (uring_file_drain(uf) < 0) {
+        return -1;
+      }
+    }
+  }
+
+  if (uf->count == 0) {
+    uf->next_offset = uf->pos;
+  }
+
+  uring_file_readahead(uf, size);
+  if (uf->count == 0) {
+    /* Could not submit anything; read directly. */
+    int res;
+
+    res = pread(fd, buf, size, uf->pos);
+    if (res > 0) {
+      uf->pos += res;
+    }
+
+    return res;
+  }
+
+  slot = &(uf->slots[uf->head]);
+  if (uring_wait_slot(slot) < 0) {
+    return -1;
+  }
+
+  if (slot->res < 0) {
+    int xerrno = -(slot->res);
+
+    if (uring_res_unsupported(slot->res)) {
+      pr_trace_msg(trace_channel, 3, "io_uring read for '%s' failed (%s), "
+        "falling back to read(2)", fh->fh_path, strerror(xerrno));
+
+      if (uring_file_detach(uf) < 0) {
+        return -1;
+      }
+
+      return uring_fsio_read(fh, fd, buf, size);
+    }
+
+    (void) uring_file_drain(uf);
+    errno = xerrno;
+    return -1;
+  }
+
+  if ((size_t) slot->res < slot->len) {
+    /* Short read, most likely EOF; stop reading ahead past this point. */
+    uf->eof = TRUE;
+  }
+
+  len = (size_t) slot->res - slot->consumed;
+  if (len > size) {
+    len = size;
+  }
+
+  if (len > 0) {
+    memcpy(buf, slot->buf + slot->consumed, len);
+    slot->consumed += len;
+    uf->pos += len;
+  }
+
+  if (slot->consumed == (size_t) slot->res) {
+    slot->state = URING_SLOT_FL_FREE;
+    uf->head = (uf->head + 1) % uf->nslots;
+    uf->count--;
+
+    if (uf->eof == TRUE) {
+      /* Anything queued after a short read is stale. */
+      if (uring_file_drain(uf) < 0) {
+        return -1;
+      }
+
+      uf->eof = TRUE;
+
+    } else {
+      uring_file_readahead(uf, size);
+    }
+  }
+
+  return (int) len;
+}
+
+static int uring_fsio_write(pr_fh_t *fh, int fd, const char *buf,
+    size_t size) {
+  struct uring_file *uf;
+  struct uring_slot *slot;
+
+  uf = fh->fh_data;
+  if (uf == NULL) {
+    pr_fs_t *fs;
+
+    fs = uring_next_fs(fh);
+    while (fs && fs->fs_next && !fs->write) {
+      fs = fs->fs_next;
+    }
+
+    return (fs->write)(fh, fd, buf, size);
+  }
+
+  if (uf->count > 0 &&
+      uf->slots[uf->head].opcode != IORING_OP_WRITE) {
+    /* Discard any readahead. */
+    if (uring_file_drain(uf) < 0) {
+      return -1;
+    }
+  }
+
+  /* Retire completed writes, waiting for the oldest if the queue is full. */
+  while (uf->count > 0) {
+    slot = &(uf->slots[uf->head]);
+
+    if (slot->state == URING_SLOT_FL_INFLIGHT) {
+      if (uf->count < uf->nslots) {
+        break;
+      }
+
+      if (uring_wait_slot(slot) < 0) {
+        return -1;
+      }
+    }
+
+    uring_complete_write(uf, slot);
+    slot->state = URING_SLOT_FL_FREE;
+    uf->head = (uf->head + 1) % uf->nslots;
+    uf->count--;
+  }
+
+  if (uf->write_errno != 0) {
+    errno = uf->write_errno;
+    return -1;
+  }
+
+  if (uf->unsupported == TRUE) {
+    if (uring_file_detach(uf) < 0) {
+      return -1;
+    }
+
+    return uring_fsio_write(fh, fd, buf, size);
+  }
+
+  slot = uring_file_next_slot(uf, size);
+  memcpy(slot->buf, buf, size);
+  slot->opcode = IORING_OP_WRITE;
+  slot->offset = uf->pos;
+  slot->len = size;
+
+  if (uring_submit(slot) < 0) {
+    int res;
+
+    pr_trace_msg(trace_channel, 3, "error submitting write for '%s': %s",
+      fh->fh_path, strerror(errno));
+
+    res = pwrite(fd, buf, size, uf->pos);
+    if (res > 0) {
+      uf->pos += res;
+    }
+
+    return res;
+  }
+
+  uf->count++;
+  uf->pos += size;
+  return (int) size;
+}
+
+static off_t uring_fsio_lseek(pr_fh_t *fh, int fd, off_t offset, int whence) {
+  struct uring_file *uf;
+  off_t pos;
+
+  uf = fh->fh_data;
+  if (uf == NULL) {
+    pr_fs_t *fs;
+
+    fs = uring_next_fs(fh);
+    while (fs && fs->fs_next && !fs->lseek) {
+      fs = fs->fs_next;
+    }
+
+    return (fs->lseek)(fh, fd, offset, whence);
+  }
+
+  switch (whence) {
+    case SEEK_SET:
+      pos = offset;
+      break;
+
+    case SEEK_CUR:
+      pos = uf->pos + offset;
+      break;
+
+    case SEEK_END: {
+      struct stat st;
+
+      if (uring_file_drain(uf) < 0 ||
+          fstat(fd, &st) < 0) {
+        return (off_t) -1;
+      }
+
+      pos = st.st_size + offset;
+      break;
+    }
+
+    default:
+      errno = EINVAL;
+      return (off_t) -1;
+  }
+
+  if (pos < 0) {
+    errno = EINVAL;
+    return (off_t) -1;
+  }
+
+  /* Pending writes must land before the caller can observe the new
+   * position; readahead is kept only if it still covers the new position.
+   */
+  if (uf->count > 0 &&
+      uf->slots[uf->head].opcode == IORING_OP_WRITE) {
+    if (uring_file_drain(uf) < 0) {
+      return (off_t) -1;
+    }
+  }
+
+  /* Keep the kernel's notion of the position in sync, for any callers
+   * using the descriptor directly (e.g. sendfile(2)).
+   */
+  if (lseek(fd, pos, SEEK_SET) == (off_t) -1) {
+    return (off_t) -1;
+  }
+
+  if (uf->pos != pos) {
+    uf->pos = pos;
+    uf->eof = FALSE;
+  }
+
+  return pos;
+}
+
+static int uring_fsio_fstat(pr_fh_t *fh, int fd, struct stat *st) {
+  struct uring_file *uf;
+
+  uf = fh->fh_data;
+  if (uf != NULL &&
+      uf->count > 0 &&
+      uf->slots[uf->head].opcode == IORING_OP_WRITE) {
+    if (uring_file_drain(uf) < 0) {
+      return -1;
+    }
+  }
+
+  return fstat(fd, st);
+}
+
+static int uring_fsio_ftruncate(pr_fh_t *fh, int fd, off_t len) {
+  struct uring_file *uf;
+
+  uf = fh->fh_data;
+  if (uf != NULL) {
+    if (uring_file_drain(uf) < 0) {
+      return -1;
+    }
+  }
+
+  return ftruncate(fd, len);
+}
+
+static int uring_fsio_fsync(pr_fh_t *fh, int fd) {
+  struct uring_file *uf;
+
+  uf = fh->fh_data;
+  if (uf != NULL) {
+    if (uring_file_drain(uf) < 0) {
+      return -1;
+    }
+
+    if (uf->write_errno != 0) {
+      errno = uf->write_errno;
+      return -1;
+    }
+  }
+
+  return fsync(fd);
+}
+
+/* Registers our FS at the given path if engine is TRUE, otherwise a FS
+ * which only passes everything through.  Operations we do not handle are
+ * passed to the given FS, which is whatever was used for the path before
+ * any of ours were registered.
+ */
+static int uring_register_fs(const char *path, int engine, pr_fs_t *next) {
+  pr_fs_t *fs;
+  const char *name;
+
+  name = engine ? "uring" : "system";
+
+  fs = pr_register_fs(session.pool, name, path);
+  if (fs == NULL) {
+    pr_log_debug(DEBUG3, MOD_URING_VERSION
+      ": error registering '%s' fs at '%s': %s", name, path, strerror(errno));
+    return -1;
+  }
+
+  fs->fs_next = next;
+
+  if (engine == FALSE) {
+    pr_trace_msg(trace_channel, 9, "registered 'system' fs at '%s'", path);
+    return 0;
+  }
+
+  fs->open = uring_fsio_open;
+  fs->close = uring_fsio_close;
+  fs->read = uring_fsio_read;
+  fs->write = uring_fsio_write;
+  fs->lseek = uring_fsio_lseek;
+  fs->fstat = uring_fsio_fstat;
+  fs->ftruncate = uring_fsio_ftruncate;
+  fs->fsync = uring_fsio_fsync;
+
+  pr_trace_msg(trace_channel, 9, "registered 'uring' fs at '%s'", path);
+  return 0;
+}
+
+/* A path at which UringEngine is set, for registering FSs. */
+struct uring_dir {
+  const char *path;
+  int engine;
+  pr_fs_t *next;
+};
+
+/* Collects the paths of the <Directory> sections in the given set which set
+ * UringEngine.  Nested <Directory> sections are kept in the subsets of their
+ * parents.
+ */
+static void uring_get_dirs(pool *p, xaset_t *set, struct uring_dir *root,
+    array_header *dirs, unsigned int *engine_dirs) {
+  config_rec *c;
+
+  if (set == NULL) {
+    return;
+  }
+
+  for (c = (config_rec *) set->xas_list; c != NULL; c = c->next) {
+    config_rec *engine_config;
+    const char *path;
+
+    pr_signals_handle();
+
+    if (c->config_type != CONF_DIR) {
+      continue;
+    }
+
+    uring_get_dirs(p, c->subset, root, dirs, engine_dirs);
+
+    engine_config = find_config(c->subset, CONF_PARAM, "UringEngine", FALSE);
+    if (engine_config == NULL) {
+      continue;
+    }
+
+    path = c->name;
+
+    if (session.chroot_path != NULL &&
+        strcmp(session.chroot_path, "/") != 0) {
+      size_t chroot_len;
+
+      chroot_len = strlen(session.chroot_path);
+      if (strncmp(path, session.chroot_path, chroot_len) != 0 ||
+          (path[chroot_len] != '\0' && path[chroot_len] != '/')) {
+        continue;
+      }
+
+      path = path[chroot_len] != '\0' ? path + chroot_len : "/";
+    }
+
+    if (pr_str_is_fnmatch(path) == TRUE) {
+      pr_log_debug(DEBUG5, MOD_URING_VERSION
+        ": UringEngine not supported for wildcard <Directory> '%s'", path);
+
+    } else if (strcmp(path, "/") == 0) {
+      root->engine = *((int *) engine_config->argv[0]);
+
+    } else {
+      struct uring_dir *dir;
+
+      /* The FSIO API only treats paths ending in a slash as directory
+       * prefixes.
+       */
+      if (path[strlen(path)-1] != '/') {
+        path = pstrcat(p, path, "/", NULL);
+      }
+
+      dir = push_array(dirs);
+      dir->path = path;
+      dir->engine = *((int *) engine_config->argv[0]);
+      dir->next = NULL;
+
+      if (dir->engine == TRUE) {
+        (*engine_dirs)++;
+      }
+    }
+  }
+}
+
+/* Configuration handlers
+ */
+
+/* usage: UringEngine on|off */
+MODRET set_uringengine(cmd_rec *cmd) {
+  int engine = -1;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL|CONF_ANON|CONF_DIR);
+
+  engine = get_boolean(cmd, 1);
+  if (engine == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = engine;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: UringQueueDepth depth */
+MODRET set_uringqueuedepth(cmd_rec *cmd) {
+  int depth;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  depth = atoi(cmd->argv[1]);
+  if (depth < 1 ||
+      depth > URING_MAX_QUEUE_DEPTH) {
+    CONF_ERROR(cmd, "depth must be between 1 and 32");
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = depth;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: UringStatPrefetch on|off */
+MODRET set_uringstatprefetch(cmd_rec *cmd) {
+  int prefetch = -1;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL|CONF_ANON);
+
+  prefetch = get_boolean(cmd, 1);
+  if (prefetch == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = prefetch;
+
+  return PR_HANDLED(cmd);
+}
+
+/* Command handlers
+ */
+
+MODRET uring_post_pass(cmd_rec *cmd) {
+  config_rec *c;
+  int nregistered = 0;
+  unsigned int engine_dirs = 0;
+  struct uring_dir root;
+  array_header *dirs;
+
+  c = find_config(CURRENT_CONF, CONF_PARAM, "UringStatPrefetch", FALSE);
+  if (c != NULL) {
+    uring_stat_prefetch = *((int *) c->argv[0]);
+  }
+
+  if (uring_engine == FALSE &&
+      uring_stat_prefetch == FALSE) {
+    return PR_DECLINED(cmd);
+  }
+
+  if (uring_open_ring() < 0) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_URING_VERSION
+      ": unable to set up io_uring: %s", strerror(errno));
+    uring_engine = uring_stat_prefetch = FALSE;
+    return PR_DECLINED(cmd);
+  }
+
+  if (uring_engine == TRUE &&
+      uring_have_rw == FALSE) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_URING_VERSION
+      ": kernel does not support io_uring reads/writes, ignoring UringEngine");
+    uring_engine = FALSE;
+  }
+
+  if (uring_stat_prefetch == TRUE &&
+      uring_have_statx == FALSE) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_URING_VERSION
+      ": kernel does not support io_uring statx, ignoring UringStatPrefetch");
+    uring_stat_prefetch = FALSE;
+  }
+
+  if (uring_engine == FALSE &&
+      uring_stat_prefetch == FALSE) {
+    (void) close(uring_fd);
+    uring_fd = -1;
+    return PR_DECLINED(cmd);
+  }
+
+  if (uring_stat_prefetch == TRUE) {
+    pr_fs_statcache_set_prefetch(uring_stat_prefetch_paths);
+  }
+
+  if (uring_engine == FALSE) {
+    return PR_DECLINED(cmd);
+  }
+
+  /* UringEngine is resolved the way <Directory> sections are matched: the
+   * setting of the session's <Anonymous> section (or else of the server)
+   * applies to "/", and each <Directory> section which sets it applies to
+   * the files below that directory.
+   */
+  c = find_config(TOPLEVEL_CONF, CONF_PARAM, "UringEngine", FALSE);
+  if (c == NULL &&
+      session.anon_config != NULL) {
+    c = find_config(main_server->conf, CONF_PARAM, "UringEngine", FALSE);
+  }
+
+  root.path = "/";
+  root.engine = c != NULL ? *((int *) c->argv[0]) : FALSE;
+  root.next = NULL;
+
+  dirs = make_array(cmd->tmp_pool, 0, sizeof(struct uring_dir));
+
+  uring_get_dirs(cmd->tmp_pool, TOPLEVEL_CONF, &root, dirs, &engine_dirs);
+
+  if (root.engine == TRUE ||
+      engine_dirs > 0) {
+    register unsigned int i;
+    struct uring_dir *elts;
+
+    /* Look up what each path uses now, before any of ours are registered,
+     * so that disabled directories below enabled ones get the original FS.
+     */
+    elts = dirs->elts;
+    root.next = pr_get_fs(root.path, NULL);
+    for (i = 0; i < dirs->nelts; i++) {
+      elts[i].next = pr_get_fs(elts[i].path, NULL);
+    }
+
+    if (root.engine == TRUE &&
+        uring_register_fs(root.path, TRUE, root.next) == 0) {
+      nregistered++;
+    }
+
+    for (i = 0; i < dirs->nelts; i++) {
+      if (uring_register_fs(elts[i].path, elts[i].engine,
+          elts[i].next) == 0 &&
+          elts[i].engine == TRUE) {
+        nregistered++;
+      }
+    }
+  }
+
+  if (nregistered == 0) {
+    uring_engine = FALSE;
+
+    if (uring_stat_prefetch == FALSE) {
+      (void) close(uring_fd);
+      uring_fd = -1;
+    }
+
+    return PR_DECLINED(cmd);
+  }
+
+  pr_fs_setcwd(pr_fs_getvwd());
+  pr_fs_clear_cache();
+
+  return PR_DECLINED(cmd);
+}
+
+/* Event listeners
+ */
+
+static void uring_exit_ev(const void *event_data, void *user_data) {
+  if (uring_fd >= 0) {
+    uring_log_stats("session", &uring_sess_stats);
+  }
+}
+
+/* Initialization routines
+ */
+
+static int uring_sess_init(void) {
+  config_rec *c;
+
+  /* Look for UringEngine anywhere in the server config; it may only be
+   * enabled for some <Directory> sections.
+   */
+  c = find_config(main_server->conf, CONF_PARAM, "UringEngine", TRUE);
+  while (c != NULL) {
+    if (*((int *) c->argv[0]) == TRUE) {
+      uring_engine = TRUE;
+      break;
+    }
+
+    c = find_config_next(c, c->next, CONF_PARAM, "UringEngine", TRUE);
+  }
+
+  if (uring_engine == FALSE &&
+      find_config(main_server->conf, CONF_PARAM, "UringStatPrefetch",
+        TRUE) == NULL) {
+    return 0;
+  }
+
+  c = find_config(main_server->conf, CONF_PARAM, "UringQueueDepth", FALSE);
+  if (c != NULL) {
+    uring_queue_depth = *((unsigned int *) c->argv[0]);
+  }
+
+  memset(&uring_sess_stats, 0, sizeof(uring_sess_stats));
+  pr_event_register(&uring_module, "core.exit", uring_exit_ev, NULL);
+
+  return 0;
+}
+
+/* Module API tables
+ */
+
+static conftable uring_conftab[] = {
+  { "UringEngine",	set_uringengine,	NULL },
+  { "UringQueueDepth",	set_uringqueuedepth,	NULL },
+  { "UringStatPrefetch",	set_uringstatprefetch,	NULL },
+  { NULL }
+};
+
+static cmdtable uring_cmdtab[] = {
+  { POST_CMD,	C_PASS,	G_NONE,	uring_post_pass,	FALSE,	FALSE },
+  { 0, NULL }
+};
+
+module uring_module = {
+  NULL, NULL,
+
+  /* Module API version 2.0 */
+  0x20,
+
+  /* Module name */
+  "uring",
+
+  /* Module configuration handler table */
+  uring_conftab,
+
+  /* Module command handler table */
+  uring_cmdtab,
+
+  /* Module authentication handler table */
+  NULL,
+
+  /* Module initialization function */
+  NULL,
+
+  /* Session initialization function */
+  uring_sess_init,
+
+  /* Module version */
+  MOD_URING_VERSION
+};
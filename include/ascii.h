@@ -42,6 +42,17 @@
 /* For FTP's ASCII conversion rules. */
 void pr_ascii_ftp_reset(void);
 
+/* Selects how buffers are scanned for CRs and LFs during the conversions:
+ * the default PR_ASCII_IMPL_AUTO uses the fastest implementation which the
+ * CPU supports.  Returns -1, with errno set to ENOSYS, if the requested
+ * implementation is not supported.  Mainly of use for testing.
+ */
+int pr_ascii_ftp_set_impl(int impl);
+#define PR_ASCII_IMPL_AUTO		0
+#define PR_ASCII_IMPL_SCALAR		1
+#define PR_ASCII_IMPL_SSE2		2
+#define PR_ASCII_IMPL_AVX2		3
+
 /* Converts the given `in' buffer, character by character, writing the data into
  * the given `out' buffer, converting any CRLF sequences found into LF
  * sequences.  The amount of data written into the `out' buffer is returned
@@ -0,0 +1,70 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* ASCII translation cache */
+
+#ifndef PR_ASCIICACHE_H
+#define PR_ASCIICACHE_H
+
+/* The ASCII cache stores CRLF-translated copies of downloaded files in
+ * files under a cache directory, so that later ASCII downloads of the same
+ * file can be sent from the translated copy, via sendfile(2) where
+ * possible, and so that a REST offset, which counts translated bytes, can
+ * be honored.
+ *
+ * A translated copy is captured while a whole file is downloaded in ASCII
+ * mode, and is used only while the original file's device, inode, size,
+ * mtime and ctime are unchanged.  Translated copies are kept in a cache
+ * directory (see cachedir.h), and are only shared among sessions running as
+ * the same UID.
+ */
+
+/* Clears and opens the given cache directory, as pr_cachedir_clear() and
+ * pr_cachedir_open() do.
+ */
+int pr_asciicache_clear(const char *path);
+int pr_asciicache_open(const char *path);
+int pr_asciicache_close(void);
+
+/* Opens the translated copy of the file with the given stat(2) info.
+ * Returns a file descriptor, to be closed by the caller, with offset set to
+ * the position at which the translated bytes start, and len to their
+ * length.  Otherwise -1 is returned, with errno set to ENOENT.
+ */
+int pr_asciicache_get(const struct stat *st, off_t *offset, off_t *len);
+
+/* Starts capturing the translated copy of the given file; the translated
+ * bytes are handed to pr_asciicache_write() as they are sent.
+ * pr_asciicache_commit(), given the file's current stat(2) info once all of
+ * it has been sent, makes the copy available to other sessions, and
+ * pr_asciicache_discard() throws it away.  Returns -1, with errno set to
+ * EPERM, if the file changed too recently for a copy of it to be safely
+ * cached.
+ */
+int pr_asciicache_capture(const char *path, const struct stat *st);
+int pr_asciicache_write(const char *buf, size_t buflen);
+int pr_asciicache_commit(const struct stat *st);
+void pr_asciicache_discard(void);
+
+#endif /* PR_ASCIICACHE_H */
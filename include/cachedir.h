@@ -0,0 +1,85 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Cache directories */
+
+#ifndef PR_CACHEDIR_H
+#define PR_CACHEDIR_H
+
+/* A cache directory holds files which a session writes on behalf of later
+ * sessions, e.g. cached listings or translated copies of files.
+ *
+ * Once logged in, a session usually cannot regain root privs (e.g. when
+ * mod_cap is used), so cached files are read and written with the privs of
+ * the logged-in user.  The cache directory is thus sticky and
+ * world-writable; each UID has its own subdirectory ("u<uid>"), which must
+ * be owned by that UID and not accessible to anyone else.
+ *
+ * Cached files are named in hex (and '-'); files being written are named
+ * with the PR_CACHEDIR_TMP_PREFIX prefix, and renamed once complete.  Only
+ * names like these are ever removed, in case the cache directory is
+ * misconfigured as a directory holding other files.
+ */
+
+#define PR_CACHEDIR_TMP_PREFIX		".tmp."
+
+typedef struct {
+
+  /* The cache directory */
+  int dirfd;
+
+  /* The subdirectory for the current UID, if opened, and that UID */
+  int userfd;
+  uid_t uid;
+
+} pr_cachedir_t;
+
+/* Prepares the given directory for use as a cache directory, creating it
+ * (sticky, and writable by all) if necessary, and removes any cached files
+ * in it.
+ */
+int pr_cachedir_clear(const char *path);
+
+/* Opens the given cache directory.  This needs to happen before any
+ * chroot(2).  Returns -1, with errno set to ENOSYS, if the platform does not
+ * support the *at(2) functions used, or EPERM if the directory is writable
+ * by others but not sticky.
+ */
+int pr_cachedir_open(pr_cachedir_t *cd, const char *path);
+int pr_cachedir_close(pr_cachedir_t *cd);
+
+/* Returns the subdirectory for the current UID, creating it if requested.
+ * The descriptor belongs to the cache directory; callers must not close it.
+ * Returns -1, with errno set to EPERM, if the subdirectory is not owned by
+ * the UID, or is accessible by others.
+ */
+int pr_cachedir_get_userfd(pr_cachedir_t *cd, int create);
+
+/* Returns TRUE if the given name is that of a cached file. */
+int pr_cachedir_is_cache_name(const char *name);
+
+/* Writes all of the given buffer, retrying on interrupts. */
+int pr_cachedir_write(int fd, const char *buf, size_t buflen);
+
+#endif /* PR_CACHEDIR_H */
@@ -464,6 +464,9 @@ typedef struct {
 #include "json.h"
 #include "memcache.h"
 #include "redis.h"
+#include "cachedir.h"
+#include "listcache.h"
+#include "asciicache.h"
 
 # ifdef HAVE_SETPASSENT
 #  define setpwent()	setpassent(1)
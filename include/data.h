@@ -34,6 +34,14 @@
  */
 int pr_data_ignore_ascii(int);
 
+/* Toggles whether the transfer buffer size is adjusted during the data
+ * transfer, based on the measured bandwidth-delay product of the data
+ * connection.  When enabled, session.xfer.bufsize may change between calls
+ * to pr_data_xfer(); callers should size their own buffers to match.
+ * Returns the previous setting.
+ */
+int pr_data_adaptive_bufsz(int);
+
 void pr_data_init(char *, int);
 void pr_data_cleanup(void);
 int pr_data_open(char *, char *, int, off_t);
@@ -73,4 +81,15 @@ typedef ssize_t pr_sendfile_t;
 
 pr_sendfile_t pr_data_sendfile(int retr_fd, off_t *offset, off_t count);
 
+/* Receives up to count bytes from the data connection directly into the
+ * given file descriptor, using splice(2) where supported.  Returns -1 with
+ * errno set to ENOSYS if the caller should use pr_data_xfer() instead.
+ */
+ssize_t pr_data_recvfile(int stor_fd, size_t count);
+
+/* Provides the number of bytes received, and the number of splice(2) calls
+ * made, by pr_data_recvfile() for the current/last transfer.
+ */
+int pr_data_get_recvfile_stats(off_t *nbytes, unsigned long *ncalls);
+
 #endif /* PR_DATA_H */
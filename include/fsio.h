@@ -342,14 +342,51 @@ void pr_fs_statcache_reset(void);
 
 /* Tune the statcache policy: max number of items in the cache at any
  * one time, the max age (in seconds) for items in the cache, and the policy
- * flags.
+ * flags.  When the cache is full, the least recently used item is evicted.
  *
  * Note that setting a size of zero, OR setting a max age of zero, effectively
- * disables the statcache.
+ * disables the statcache.  Setting the policy also sets the max age for
+ * negative (ENOENT) items to the given max age.
  */
 int pr_fs_statcache_set_policy(unsigned int size, unsigned int max_age,
   unsigned int flags);
 
+/* Set the max age (in seconds) for cached lookups which failed with ENOENT.
+ * A max age of zero disables the caching of such lookups.
+ */
+int pr_fs_statcache_set_negative_max_age(unsigned int max_age);
+
+/* Counters for the statcache, for the current process. */
+typedef struct {
+  unsigned long hits;
+  unsigned long negative_hits;
+  unsigned long misses;
+  unsigned long evictions;
+  unsigned long expirations;
+} pr_fs_statcache_stats_t;
+
+int pr_fs_statcache_get_stats(pr_fs_statcache_stats_t *stats);
+
+/* Register a handler for looking up the lstat(2) data for many paths at
+ * once, e.g. in parallel.  The handler is given the number of paths, the
+ * (absolute) paths, and arrays in which to store the stat data and the errno
+ * (zero on success) for each path.  It returns 0 if the arrays were filled
+ * in, or -1 if the lookups could not be done.  A NULL handler unregisters
+ * any handler.
+ */
+int pr_fs_statcache_set_prefetch(int (*prefetch)(pool *p, unsigned int count,
+  const char **paths, struct stat *sts, int *errnos));
+
+/* Prefetch the lstat(2) data for the given names, relative to the given
+ * directory (or the current directory, if NULL), into the statcache, using
+ * the registered prefetch handler.  At most as many names as the statcache
+ * can hold are looked up; the number of names handled is returned.  Returns
+ * -1, with errno set to ENOSYS, if there is no handler or the statcache is
+ * disabled.
+ */
+int pr_fs_statcache_prefetch(pool *p, const char *dir, const char **names,
+  unsigned int count);
+
 /* Copy a file from the given source path to the destination path. */
 int pr_fs_copy_file(const char *src, const char *dst);
 
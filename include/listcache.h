@@ -0,0 +1,98 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Directory listing cache */
+
+#ifndef PR_LISTCACHE_H
+#define PR_LISTCACHE_H
+
+/* The listing cache stores the formatted bytes of a directory listing (e.g.
+ * LIST or MLSD output) in files under a cache directory, so that the next
+ * session asking for the same listing can be sent the file, via sendfile(2)
+ * where possible, rather than having each entry looked up and formatted
+ * again.
+ *
+ * A cached listing is keyed by the directory being listed, plus a
+ * caller-provided string describing everything else which affects the
+ * output (e.g. the listing options).  The session's server, client
+ * address, user, group, class, chroot and encoding are always part of the
+ * key, since they determine which entries are hidden, and how names are
+ * encoded.  A cached
+ * listing is used only while the directory's device, inode, mtime and ctime
+ * are unchanged, and it is no older than the configured max age.
+ *
+ * Listings are kept in a cache directory (see cachedir.h), and are only
+ * shared among sessions running as the same UID (e.g. all anonymous
+ * sessions).
+ *
+ * Changes made through the FSIO API to existing files (e.g. writes,
+ * chmod(2)), which do not change the directory itself, are noted via
+ * pr_listcache_invalidate(); pr_listcache_flush() then marks the listings
+ * of the affected directories, for all UIDs, as stale.
+ */
+
+/* Clears the given cache directory, as pr_cachedir_clear() does.  Called by
+ * the daemon at startup and restart, so that no listings made under a
+ * previous configuration are used.
+ */
+int pr_listcache_clear(const char *path);
+
+/* Opens the given cache directory for use by this session, as
+ * pr_cachedir_open() does.
+ */
+int pr_listcache_open(const char *path);
+int pr_listcache_close(void);
+
+/* Sets the max age, in seconds, of cached listings used by this session. */
+int pr_listcache_set_max_age(unsigned int max_age);
+
+/* Sends the cached listing of the given directory, for the given key, on
+ * the already opened data connection.  Returns 0 if the listing was sent;
+ * if the transfer failed partway, SF_ABORT is set in the session flags.
+ * Otherwise, -1 is returned, with errno set to ENOENT if there is no usable
+ * cached listing, or EPERM if there is no data connection, and nothing has
+ * been sent.
+ */
+int pr_listcache_send(pool *p, const char *dir, const char *key);
+
+/* Starts capturing a listing of the given directory for the given key.
+ * The listing bytes are handed to pr_listcache_write() as they are sent;
+ * pr_listcache_commit() then makes the listing available to other sessions,
+ * and pr_listcache_discard() throws it away (e.g. on error or abort).
+ * Returns -1, with errno set to EPERM, if the directory changed too
+ * recently for a listing of it to be safely cached.
+ */
+int pr_listcache_capture(pool *p, const char *dir, const char *key);
+int pr_listcache_write(const char *buf, size_t buflen);
+int pr_listcache_commit(void);
+void pr_listcache_discard(void);
+
+/* Notes that the given path was modified, such that the listing of its
+ * parent directory may be stale, and flushes those noted listings,
+ * respectively.
+ */
+int pr_listcache_invalidate(const char *path);
+int pr_listcache_flush(void);
+
+#endif /* PR_LISTCACHE_H */
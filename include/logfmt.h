@@ -79,5 +79,6 @@
 #define LOGFMT_META_XFER_TYPE		49
 #define LOGFMT_META_REMOTE_PORT		50
 #define LOGFMT_META_EPOCH		51
+#define LOGFMT_META_XFER_BUFSZ		52
 
 #endif /* PR_LOGFMT_H */
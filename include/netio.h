@@ -123,6 +123,12 @@ typedef struct {
 #define PR_NETIO_ERRNO(s)	((s)->strm_errno)
 #define PR_NETIO_FD(s)		((s)->strm_fd)
 
+/* Stream note set by a NetIO whose protection of the outgoing data has been
+ * handed off to the kernel (e.g. kernel TLS), such that data may be written
+ * directly to the stream's fd, as via sendfile(2).
+ */
+#define PR_NETIO_NOTE_KERNEL_TX	"core.netio.kernel-tx"
+
 typedef struct {
   /* Memory pool for this object. */
   struct pool_rec *pool;
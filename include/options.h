@@ -39,6 +39,13 @@
 
 #define PR_TUNABLE_SELECT_TIMEOUT	30
 
+/* Upper limit on the number of idle pre-forked workers which the standalone
+ * daemon will keep (see MaxSpareServers).
+ */
+#ifndef PR_TUNABLE_PREFORK_MAX_SPARE
+# define PR_TUNABLE_PREFORK_MAX_SPARE	256
+#endif
+
 /* Hash table size is the number of items in the module hash tables.
  */
 
@@ -102,6 +109,28 @@
 # define PR_TUNABLE_XFER_BUFFER_SIZE	PR_TUNABLE_BUFFER_SIZE
 #endif
 
+/* Bounds for the transfer buffer size when adaptive buffer sizing is
+ * enabled (see the AdaptiveBufferSize TransferOption).  The buffer size
+ * chosen is a power of two within these bounds.
+ */
+#ifndef PR_TUNABLE_XFER_ADAPTIVE_MIN_BUFSZ
+# define PR_TUNABLE_XFER_ADAPTIVE_MIN_BUFSZ	8192
+#endif
+
+#ifndef PR_TUNABLE_XFER_ADAPTIVE_MAX_BUFSZ
+# define PR_TUNABLE_XFER_ADAPTIVE_MAX_BUFSZ	(4 * 1024 * 1024)
+#endif
+
+/* When reading files for downloads, this many transfer buffers' worth of
+ * data beyond the current file position are requested from the kernel,
+ * via posix_fadvise(2), so that the disk read for the next buffers overlaps
+ * the network write of the current buffer.  The TransferReadahead directive
+ * overrides this at runtime; a value of zero disables the readahead.
+ */
+#ifndef PR_TUNABLE_XFER_READAHEAD
+# define PR_TUNABLE_XFER_READAHEAD	4
+#endif
+
 /* Maximum FTP command size.  For details on this size of 512KB, see
  * the Bug#4014 discussion.
  */
@@ -167,6 +196,42 @@
 # define PR_TUNABLE_NEW_POOL_SIZE	512
 #endif
 
+/* Number of bytes in the arena from which each command read from the
+ * control connection is allocated.  The arena is cleared, rather than
+ * destroyed, once the command has been handled; commands needing more
+ * memory than this spill into additional blocks.
+ */
+
+#ifndef PR_TUNABLE_CMD_ARENA_SIZE
+# define PR_TUNABLE_CMD_ARENA_SIZE	4096
+#endif
+
+/* Number of size-classed lists on which freed pool blocks are kept for
+ * reuse, one per multiple of PR_TUNABLE_NEW_POOL_SIZE; larger blocks share
+ * the last list.
+ */
+
+#ifndef PR_TUNABLE_POOL_FREELISTS
+# define PR_TUNABLE_POOL_FREELISTS	32
+#endif
+
+/* Maximum number of bytes held in freed pool blocks, per process.  Blocks
+ * freed beyond this are returned to the system.
+ */
+
+#ifndef PR_TUNABLE_POOL_FREELIST_MAX
+# define PR_TUNABLE_POOL_FREELIST_MAX	(4 * 1024 * 1024)
+#endif
+
+/* Number of recently matched paths, and the <Directory> section each
+ * resolved to, remembered per session by dir_match_path().  Set to zero
+ * to disable the cache.
+ */
+
+#ifndef PR_TUNABLE_DIR_MATCH_CACHE_SIZE
+# define PR_TUNABLE_DIR_MATCH_CACHE_SIZE	64
+#endif
+
 /* Number of bytes in certain scoreboard fields, usually for reporting
  * the full command received from the connected client, or the current
  * working directory for the session.
@@ -184,6 +249,24 @@
 # define PR_TUNABLE_SCOREBOARD_SCRUB_TIMER	30
 #endif
 
+/* The scoreboard file is mapped into memory, and grown by this many slots
+ * at a time when no free slot is available.
+ */
+
+#ifndef PR_TUNABLE_SCOREBOARD_GROW_SLOTS
+# define PR_TUNABLE_SCOREBOARD_GROW_SLOTS	32
+#endif
+
+/* Number of records in the scoreboard's table of per-server, per-host,
+ * per-user, and per-class session counters.  Each session uses up to seven
+ * records, most of which are shared with other sessions; the table is only
+ * filled to three quarters of its size.
+ */
+
+#ifndef PR_TUNABLE_SCOREBOARD_COUNTERS
+# define PR_TUNABLE_SCOREBOARD_COUNTERS	8192
+#endif
+
 /* Maximum number of attempted updates to the scoreboard during a
  * file transfer before an actual write is done.  This is to allow
  * an optimization where the scoreboard is not updated on every loop
@@ -254,4 +337,26 @@
 # define PR_TUNABLE_FS_STATCACHE_MAX_AGE	30
 #endif
 
+/* Max age, in seconds, of cached lookups of paths which do not exist. */
+#ifndef PR_TUNABLE_FS_STATCACHE_NEGATIVE_MAX_AGE
+# define PR_TUNABLE_FS_STATCACHE_NEGATIVE_MAX_AGE	30
+#endif
+
+/* Default max age, in seconds, of cached directory listings. */
+#ifndef PR_TUNABLE_LISTCACHE_MAX_AGE
+# define PR_TUNABLE_LISTCACHE_MAX_AGE		300
+#endif
+
+/* Listings larger than this many bytes are not cached. */
+#ifndef PR_TUNABLE_LISTCACHE_MAX_SIZE
+# define PR_TUNABLE_LISTCACHE_MAX_SIZE		(16 * 1024 * 1024)
+#endif
+
+/* Default minimum size, in bytes, of files whose ASCII translations are
+ * cached.
+ */
+#ifndef PR_TUNABLE_ASCIICACHE_MIN_SIZE
+# define PR_TUNABLE_ASCIICACHE_MIN_SIZE		(64 * 1024)
+#endif
+
 #endif /* PR_OPTIONS_H */
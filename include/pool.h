@@ -44,6 +44,11 @@ pool *pr_pool_create_sz(pool *parent_pool, size_t sz);
 /* Clears out _everything_ in a pool, destroying any sub-pools */
 void destroy_pool(struct pool_rec *);
 
+/* Runs the cleanups and destroys the sub-pools of a pool, and releases all
+ * of its memory except its first block, leaving the pool itself for reuse.
+ */
+void pr_pool_clear(struct pool_rec *);
+
 /* Allocate memory from a pool */
 void *palloc(struct pool_rec *, size_t);
 void *pallocsz(struct pool_rec *, size_t);
@@ -51,6 +56,24 @@ void *pcalloc(struct pool_rec *, size_t);
 void *pcallocsz(struct pool_rec *, size_t);
 void pr_pool_tag(struct pool_rec *, const char *);
 
+/* Counters for the pool allocator, for the current process. */
+typedef struct {
+  unsigned long blocks_allocated;	/* Blocks obtained via malloc(3) */
+  unsigned long bytes_allocated;	/* Bytes currently held in blocks */
+  unsigned long blocks_reused;		/* Blocks taken from the free lists */
+  unsigned long blocks_released;	/* Free blocks returned via free(3) */
+  unsigned long freelist_len;		/* Blocks on the free lists */
+  unsigned long freelist_bytes;		/* Bytes in the free blocks */
+} pr_pool_stats_t;
+
+int pr_pool_get_stats(pr_pool_stats_t *stats);
+
+/* Set the maximum number of bytes held in free blocks, for later reuse;
+ * blocks freed beyond this are returned to the system.  Any free blocks
+ * already held beyond the new maximum are released.
+ */
+int pr_pool_set_freelist_max(size_t max_bytes);
+
 #ifdef PR_USE_DEVEL
 void pr_pool_debug_memory(void (*)(const char *, ...));
 
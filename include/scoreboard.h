@@ -29,7 +29,7 @@
 
 /* PR_SCOREBOARD_VERSION is used for checking for scoreboard compatibility
  */
-#define PR_SCOREBOARD_VERSION        		0x01040003
+#define PR_SCOREBOARD_VERSION        		0x01040007
 
 /* Structure used as a header for scoreboard files.
  */
@@ -55,6 +55,13 @@ typedef struct {
  */
 
 typedef struct {
+
+  /* Sequence number for lock-free readers: odd while the slot is being
+   * written.  Readers copy the slot, and retry if the number was odd or
+   * changed during the copy.
+   */
+  unsigned int sce_seqno;
+
   pid_t	sce_pid;
   uid_t sce_uid;
   gid_t sce_gid;
@@ -97,8 +104,60 @@ typedef struct {
   off_t sce_xfer_len;
   unsigned long sce_xfer_elapsed;
 
+  /* The session's FS statcache counters, as of its last command. */
+  unsigned long sce_statcache_hits;
+  unsigned long sce_statcache_misses;
+  unsigned long sce_statcache_evictions;
+
+  /* The session's pool allocator counters, as of its last command. */
+  unsigned long sce_pool_bytes;
+  unsigned long sce_pool_reused;
+  unsigned long sce_pool_freelist_len;
+
 } pr_scoreboard_entry_t;
 
+/* Structures used for the table of session counters, which sits between the
+ * header and the entries of a scoreboard file.  The table is an open-addressed
+ * hash, keyed by counter type, server address, and user/class name and/or
+ * client address; records with a zero count are free.
+ */
+typedef struct {
+
+  /* Sequence number for lock-free readers: odd while the table is being
+   * written.
+   */
+  unsigned int scc_seqno;
+
+  /* Number of records in use */
+  unsigned int scc_nused;
+
+  /* Set when the counts cannot be trusted, e.g. because the table filled up,
+   * until the table is next rebuilt from the entries.
+   */
+  unsigned int scc_stale;
+
+} pr_scoreboard_counter_header_t;
+
+typedef struct {
+  unsigned int scc_hash;
+  unsigned int scc_count;
+  int scc_type;
+
+  char scc_server_addr[80];
+  char scc_name[32];
+
+#ifdef PR_USE_IPV6
+  char scc_client_addr[INET6_ADDRSTRLEN];
+#else
+  char scc_client_addr[INET_ADDRSTRLEN];
+#endif /* PR_USE_IPV6 */
+
+} pr_scoreboard_counter_t;
+
+#define PR_SCOREBOARD_COUNTERS_SIZE \
+  (sizeof(pr_scoreboard_counter_header_t) + \
+   (PR_TUNABLE_SCOREBOARD_COUNTERS * sizeof(pr_scoreboard_counter_t)))
+
 /* Scoreboard mode */
 #define PR_SCOREBOARD_MODE		0644
 
@@ -120,6 +179,24 @@ typedef struct {
 #define PR_SCORE_XFER_LEN	15
 #define PR_SCORE_XFER_ELAPSED	16
 #define PR_SCORE_PROTOCOL	17
+#define PR_SCORE_STATCACHE_HITS		18
+#define PR_SCORE_STATCACHE_MISSES	19
+#define PR_SCORE_STATCACHE_EVICTIONS	20
+#define PR_SCORE_POOL_BYTES		21
+#define PR_SCORE_POOL_REUSED		22
+#define PR_SCORE_POOL_FREELIST_LEN	23
+
+/* Scoreboard counter types.  All counters are per server address; the
+ * AUTH, USER, USER_HOST, and CLASS counters only count authenticated
+ * sessions.
+ */
+#define PR_SCORE_COUNT_SERVER		1	/* All sessions */
+#define PR_SCORE_COUNT_HOST		2	/* All sessions from a client */
+#define PR_SCORE_COUNT_AUTH		3	/* Authenticated sessions */
+#define PR_SCORE_COUNT_AUTH_HOST	4	/* Ditto, from a client */
+#define PR_SCORE_COUNT_USER		5	/* Sessions of a user */
+#define PR_SCORE_COUNT_USER_HOST	6	/* Ditto, from a client */
+#define PR_SCORE_COUNT_CLASS		7	/* Sessions in a class */
 
 /* Scoreboard error values */
 #define PR_SCORE_ERR_BAD_MAGIC		-2
@@ -151,4 +228,17 @@ int pr_scoreboard_entry_kill(pr_scoreboard_entry_t *, int);
 int pr_scoreboard_entry_update(pid_t, ...);
 int pr_scoreboard_entry_lock(int, int);
 
+/* Look up the number of sessions for the given counter type and server
+ * address ("addr:port", as in the sce_server_addr field).  The name is the
+ * user name for the USER/USER_HOST types, and the class name for the CLASS
+ * type; the client address is used for the HOST/AUTH_HOST/USER_HOST types.
+ * Unused keys should be NULL.
+ *
+ * This is a constant-time lookup.  Returns -1, with errno set to EAGAIN,
+ * if the counters are not currently usable; callers should then fall back
+ * to scanning the entries.
+ */
+int pr_scoreboard_count_get(int type, const char *server_addr,
+  const char *name, const char *client_addr, unsigned int *count);
+
 #endif /* PR_SCOREBOARD_H */
@@ -120,4 +120,25 @@ int pr_session_set_idle(void);
 /* Sets the current protocol name. */
 int pr_session_set_protocol(const char *);
 
+/* Registers a check to be performed by the daemon process, for each
+ * newly accepted control connection, before a session process is forked to
+ * handle it.  The callback is given the server_rec which will handle the
+ * connection, and the client's address; if it returns -1, the client is
+ * sent a 421 response and the connection is closed, without forking.
+ * These checks must be cheap, and must not block.
+ */
+int pr_session_register_precheck(module *m, const char *name,
+  int (*cb)(pool *, server_rec *, const pr_netaddr_t *));
+
+/* Removes the precheck registered by the given module under the given name.
+ * A NULL name removes all of the module's prechecks.
+ */
+int pr_session_unregister_precheck(module *m, const char *name);
+
+/* Runs the registered prechecks for the connection on the given socket.
+ * Returns 0 if the connection should be handled, or -1 (with errno set to
+ * EACCES) if a precheck rejected it.
+ */
+int pr_session_precheck(int fd);
+
 #endif /* PR_SESSION_H */
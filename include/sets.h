@@ -42,6 +42,11 @@ struct XAset {
   xasetmember_t *xas_list;
   struct pool_rec *pool;
   XASET_COMPARE xas_compare;
+
+  /* Optional lookup index over the members, built by the set's owner.  It
+   * is discarded whenever a member is inserted or removed.
+   */
+  void *xas_index;
 };
 
 /* Prototypes */
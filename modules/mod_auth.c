@@ -1887,6 +1887,21 @@ auth_failure:
   return 0;
 }
 
+/* Look up one of the scoreboard's session counters; returns -1 if they are
+ * unavailable, in which case the caller scans the scoreboard instead.
+ */
+static int auth_get_count(int type, const char *server_addr, const char *name,
+    const char *client_addr, unsigned int *count) {
+  if (pr_scoreboard_count_get(type, server_addr, name, client_addr,
+      count) < 0) {
+    pr_trace_msg("auth", 9, "unable to use scoreboard counters (%s), "
+      "scanning scoreboard", strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
 /* This function counts the number of connected users. It only fills in the
  * Class-based counters and an estimate for the number of clients. The primary
  * purpose is to make it so that the %N/%y escapes work in a DisplayConnect
@@ -1906,36 +1921,48 @@ static int auth_scan_scoreboard(void) {
     pr_netaddr_get_ipstr(session.c->local_addr), main_server->ServerPort);
   curr_server_addr[sizeof(curr_server_addr)-1] = '\0';
 
-  /* Determine how many users are currently connected */
-  if (pr_rewind_scoreboard() < 0) {
-    pr_log_pri(PR_LOG_NOTICE, "error rewinding scoreboard: %s",
-      strerror(errno));
-  }
+  /* Determine how many users are currently connected, preferably using the
+   * scoreboard's counters.
+   */
+  if (auth_get_count(PR_SCORE_COUNT_SERVER, curr_server_addr, NULL, NULL,
+        &cur) < 0 ||
+      auth_get_count(PR_SCORE_COUNT_HOST, curr_server_addr, NULL, client_addr,
+        &hcur) < 0 ||
+      (session.conn_class != NULL &&
+       auth_get_count(PR_SCORE_COUNT_CLASS, curr_server_addr,
+         session.conn_class->cls_name, NULL, &ccur) < 0)) {
+    cur = ccur = hcur = 0;
 
-  while ((score = pr_scoreboard_entry_read()) != NULL) {
-    pr_signals_handle();
+    if (pr_rewind_scoreboard() < 0) {
+      pr_log_pri(PR_LOG_NOTICE, "error rewinding scoreboard: %s",
+        strerror(errno));
+    }
 
-    /* Make sure it matches our current server */
-    if (strcmp(score->sce_server_addr, curr_server_addr) == 0) {
-      cur++;
+    while ((score = pr_scoreboard_entry_read()) != NULL) {
+      pr_signals_handle();
+
+      /* Make sure it matches our current server */
+      if (strcmp(score->sce_server_addr, curr_server_addr) == 0) {
+        cur++;
 
-      if (strcmp(score->sce_client_addr, client_addr) == 0)
-        hcur++;
+        if (strcmp(score->sce_client_addr, client_addr) == 0)
+          hcur++;
 
-      /* Only count up authenticated clients, as per the documentation. */
-      if (strncmp(score->sce_user, "(none)", 7) == 0)
-        continue;
+        /* Only count up authenticated clients, as per the documentation. */
+        if (strncmp(score->sce_user, "(none)", 7) == 0)
+          continue;
 
-      /* Note: the class member of the scoreboard entry will never be
-       * NULL.  At most, it may be the empty string.
-       */
-      if (session.conn_class != NULL &&
-          strcasecmp(score->sce_class, session.conn_class->cls_name) == 0) {
-        ccur++;
+        /* Note: the class member of the scoreboard entry will never be
+         * NULL.  At most, it may be the empty string.
+         */
+        if (session.conn_class != NULL &&
+            strcasecmp(score->sce_class, session.conn_class->cls_name) == 0) {
+          ccur++;
+        }
       }
     }
+    pr_restore_scoreboard();
   }
-  pr_restore_scoreboard();
 
   key = "client-count";
   (void) pr_table_remove(session.notes, key, NULL);
@@ -2046,81 +2073,127 @@ static int auth_count_scoreboard(cmd_rec *cmd, const char *user) {
   /* Gather our statistics. */
   if (user != NULL) {
     char curr_server_addr[80] = {'\0'};
+    const char *client_addr = pr_netaddr_get_ipstr(session.c->remote_addr);
+    unsigned int nclients = 0, nhost = 0, nuser = 0, nuserhost = 0, nclass = 0;
+    int anon = FALSE;
 
     snprintf(curr_server_addr, sizeof(curr_server_addr), "%s:%d",
       pr_netaddr_get_ipstr(session.c->local_addr), main_server->ServerPort);
     curr_server_addr[sizeof(curr_server_addr)-1] = '\0';
 
-    if (pr_rewind_scoreboard() < 0) {
-      pr_log_pri(PR_LOG_NOTICE, "error rewinding scoreboard: %s",
-        strerror(errno));
+    if (c != NULL &&
+        c->config_type == CONF_ANON) {
+      anon = TRUE;
     }
 
-    while ((score = pr_scoreboard_entry_read()) != NULL) {
-      unsigned char same_host = FALSE;
+    /* For anonymous logins, only the sessions of the anonymous user count
+     * towards the MaxClients/MaxClientsPerHost limits.  Prefer the
+     * scoreboard's counters, falling back to scanning the scoreboard.
+     */
+    if (auth_get_count(anon ? PR_SCORE_COUNT_USER : PR_SCORE_COUNT_AUTH,
+          curr_server_addr, anon ? user : NULL, NULL, &nclients) == 0 &&
+        auth_get_count(anon ? PR_SCORE_COUNT_USER_HOST :
+          PR_SCORE_COUNT_AUTH_HOST, curr_server_addr, anon ? user : NULL,
+          client_addr, &nhost) == 0 &&
+        auth_get_count(PR_SCORE_COUNT_USER, curr_server_addr, user, NULL,
+          &nuser) == 0 &&
+        auth_get_count(PR_SCORE_COUNT_USER_HOST, curr_server_addr, user,
+          client_addr, &nuserhost) == 0 &&
+        (session.conn_class == NULL ||
+         auth_get_count(PR_SCORE_COUNT_CLASS, curr_server_addr,
+           session.conn_class->cls_name, NULL, &nclass) == 0)) {
+      cur = nclients;
+      hcur = nhost;
+
+      /* Same as the anonymous login hacks in the scan, below. */
+      if (anon) {
+        if (cur > 0) {
+          cur++;
+        }
 
-      pr_signals_handle();
+        if (hcur > 0) {
+          hcur++;
+        }
+      }
 
-      /* Make sure it matches our current server. */
-      if (strcmp(score->sce_server_addr, curr_server_addr) == 0) {
+      usersessions = nuser;
+      if (nuser > nuserhost) {
+        hostsperuser += (nuser - nuserhost);
+      }
+      ccur = nclass;
 
-        if ((c != NULL && c->config_type == CONF_ANON &&
-            !strcmp(score->sce_user, user)) || c == NULL) {
-
-          /* This small hack makes sure that cur is incremented properly
-           * when dealing with anonymous logins (the timing of anonymous
-           * login updates to the scoreboard makes this...odd).
-           */
-          if (c != NULL &&
-              c->config_type == CONF_ANON &&
-              cur == 0) {
-              cur = 1;
-          }
+    } else {
+      if (pr_rewind_scoreboard() < 0) {
+        pr_log_pri(PR_LOG_NOTICE, "error rewinding scoreboard: %s",
+          strerror(errno));
+      }
 
-          /* Only count authenticated clients, as per the documentation. */
-          if (strncmp(score->sce_user, "(none)", 7) == 0) {
-            continue;
-          }
+      while ((score = pr_scoreboard_entry_read()) != NULL) {
+        unsigned char same_host = FALSE;
 
-          cur++;
+        pr_signals_handle();
 
-          /* Count up sessions on a per-host basis. */
+        /* Make sure it matches our current server. */
+        if (strcmp(score->sce_server_addr, curr_server_addr) == 0) {
 
-          if (!strcmp(score->sce_client_addr,
-              pr_netaddr_get_ipstr(session.c->remote_addr))) {
-            same_host = TRUE;
+          if ((c != NULL && c->config_type == CONF_ANON &&
+              !strcmp(score->sce_user, user)) || c == NULL) {
 
-            /* This small hack makes sure that hcur is incremented properly
+            /* This small hack makes sure that cur is incremented properly
              * when dealing with anonymous logins (the timing of anonymous
              * login updates to the scoreboard makes this...odd).
              */
             if (c != NULL &&
                 c->config_type == CONF_ANON &&
-                hcur == 0) {
-              hcur = 1;
+                cur == 0) {
+                cur = 1;
             }
 
-            hcur++;
-          }
+            /* Only count authenticated clients, as per the documentation. */
+            if (strncmp(score->sce_user, "(none)", 7) == 0) {
+              continue;
+            }
+
+            cur++;
+
+            /* Count up sessions on a per-host basis. */
+
+            if (!strcmp(score->sce_client_addr,
+                pr_netaddr_get_ipstr(session.c->remote_addr))) {
+              same_host = TRUE;
+
+              /* This small hack makes sure that hcur is incremented properly
+               * when dealing with anonymous logins (the timing of anonymous
+               * login updates to the scoreboard makes this...odd).
+               */
+              if (c != NULL &&
+                  c->config_type == CONF_ANON &&
+                  hcur == 0) {
+                hcur = 1;
+              }
+
+              hcur++;
+            }
 
-          /* Take a per-user count of connections. */
-          if (strcmp(score->sce_user, user) == 0) {
-            usersessions++;
+            /* Take a per-user count of connections. */
+            if (strcmp(score->sce_user, user) == 0) {
+              usersessions++;
 
-            /* Count up unique hosts. */
-            if (!same_host) {
-              hostsperuser++;
+              /* Count up unique hosts. */
+              if (!same_host) {
+                hostsperuser++;
+              }
             }
           }
-        }
 
-        if (session.conn_class != NULL &&
-            strcasecmp(score->sce_class, session.conn_class->cls_name) == 0) {
-          ccur++;
+          if (session.conn_class != NULL &&
+              strcasecmp(score->sce_class, session.conn_class->cls_name) == 0) {
+            ccur++;
+          }
         }
       }
+      pr_restore_scoreboard();
     }
-    pr_restore_scoreboard();
     PRIVS_RELINQUISH
   }
 
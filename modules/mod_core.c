@@ -38,6 +38,8 @@ extern xaset_t *server_list;
 /* From src/main.c */
 extern unsigned long max_connects;
 extern unsigned int max_connect_interval;
+extern unsigned int prefork_min_spare;
+extern unsigned int prefork_max_spare;
 
 /* From modules/mod_site.c */
 extern modret_t *site_dispatch(cmd_rec*);
@@ -973,6 +975,58 @@ MODRET set_maxinstances(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* Returns an error message if the count is not valid, NULL otherwise. */
+static const char *get_spare_servers(cmd_rec *cmd, unsigned int *nspare) {
+  long count;
+  char *endp = NULL;
+
+  count = strtol(cmd->argv[1], &endp, 10);
+  if ((endp && *endp) ||
+      count < 0 ||
+      count > PR_TUNABLE_PREFORK_MAX_SPARE) {
+    char limit[32];
+
+    memset(limit, '\0', sizeof(limit));
+    snprintf(limit, sizeof(limit)-1, "%u",
+      (unsigned int) PR_TUNABLE_PREFORK_MAX_SPARE);
+    return pstrcat(cmd->tmp_pool, "argument must be a number between 0 and ",
+      limit, NULL);
+  }
+
+  *nspare = (unsigned int) count;
+  return NULL;
+}
+
+/* usage: MaxSpareServers count */
+MODRET set_maxspareservers(cmd_rec *cmd) {
+  const char *errstr;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  errstr = get_spare_servers(cmd, &prefork_max_spare);
+  if (errstr != NULL) {
+    CONF_ERROR(cmd, errstr);
+  }
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: MinSpareServers count */
+MODRET set_minspareservers(cmd_rec *cmd) {
+  const char *errstr;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  errstr = get_spare_servers(cmd, &prefork_min_spare);
+  if (errstr != NULL) {
+    CONF_ERROR(cmd, errstr);
+  }
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: MaxCommandRate rate [interval] */
 MODRET set_maxcommandrate(cmd_rec *cmd) {
   config_rec *c;
@@ -1409,13 +1463,15 @@ MODRET add_from(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
-/* usage: FSCachePolicy on|off|size {count} [maxAge {age}] */
+/* usage: FSCachePolicy on|off|size {count} [maxAge {age}]
+ *          [negativeMaxAge {age}]
+ */
 MODRET set_fscachepolicy(cmd_rec *cmd) {
   register unsigned int i;
   config_rec *c;
 
-  if (cmd->argc != 2 &&
-      cmd->argc != 5) {
+  if (cmd->argc < 2 ||
+      (cmd->argc > 2 && (cmd->argc % 2) == 0)) {
     CONF_ERROR(cmd, "wrong number of parameters");
   }
 
@@ -1427,30 +1483,34 @@ MODRET set_fscachepolicy(cmd_rec *cmd) {
       CONF_ERROR(cmd, "expected Boolean parameter");
     }
 
-    c = add_config_param(cmd->argv[0], 3, NULL, NULL, NULL);
+    c = add_config_param(cmd->argv[0], 4, NULL, NULL, NULL, NULL);
     c->argv[0] = palloc(c->pool, sizeof(int));
     *((int *) c->argv[0]) = engine;
     c->argv[1] = palloc(c->pool, sizeof(unsigned int));
     *((unsigned int *) c->argv[1]) = PR_TUNABLE_FS_STATCACHE_SIZE;
     c->argv[2] = palloc(c->pool, sizeof(unsigned int));
     *((unsigned int *) c->argv[2]) = PR_TUNABLE_FS_STATCACHE_MAX_AGE;
+    c->argv[3] = palloc(c->pool, sizeof(unsigned int));
+    *((unsigned int *) c->argv[3]) = PR_TUNABLE_FS_STATCACHE_NEGATIVE_MAX_AGE;
 
     return PR_HANDLED(cmd);
   }
 
-  c = add_config_param_str(cmd->argv[0], 3, NULL, NULL, NULL);
+  c = add_config_param_str(cmd->argv[0], 4, NULL, NULL, NULL, NULL);
   c->argv[0] = palloc(c->pool, sizeof(int));
   *((int *) c->argv[0]) = TRUE;
   c->argv[1] = palloc(c->pool, sizeof(unsigned int));
   *((unsigned int *) c->argv[1]) = PR_TUNABLE_FS_STATCACHE_SIZE;
   c->argv[2] = palloc(c->pool, sizeof(unsigned int));
   *((unsigned int *) c->argv[2]) = PR_TUNABLE_FS_STATCACHE_MAX_AGE;
+  c->argv[3] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[3]) = PR_TUNABLE_FS_STATCACHE_NEGATIVE_MAX_AGE;
 
   for (i = 1; i < cmd->argc; i++) {
     if (strncasecmp(cmd->argv[i], "size", 5) == 0) {
       int size;
 
-      size = atoi(cmd->argv[i++]);
+      size = atoi(cmd->argv[++i]);
       if (size < 1) {
         CONF_ERROR(cmd, "size parameter must be greater than 1");
       }
@@ -1460,13 +1520,23 @@ MODRET set_fscachepolicy(cmd_rec *cmd) {
     } else if (strncasecmp(cmd->argv[i], "maxAge", 7) == 0) {
       int max_age;
 
-      max_age = atoi(cmd->argv[i++]);
+      max_age = atoi(cmd->argv[++i]);
       if (max_age < 1) {
         CONF_ERROR(cmd, "maxAge parameter must be greater than 1");
       }
 
       *((unsigned int *) c->argv[2]) = max_age;
 
+    } else if (strncasecmp(cmd->argv[i], "negativeMaxAge", 15) == 0) {
+      int max_age;
+
+      max_age = atoi(cmd->argv[++i]);
+      if (max_age < 0) {
+        CONF_ERROR(cmd, "negativeMaxAge parameter must be 0 or greater");
+      }
+
+      *((unsigned int *) c->argv[3]) = max_age;
+
     } else {
       CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown FSCachePolicy: ",
         cmd->argv[i], NULL));
@@ -6294,14 +6364,16 @@ MODRET core_post_pass(cmd_rec *cmd) {
   c = find_config(main_server->conf, CONF_PARAM, "FSCachePolicy", FALSE);
   if (c != NULL) {
     int engine;
-    unsigned int size, max_age;
+    unsigned int size, max_age, neg_max_age;
 
     engine = *((int *) c->argv[0]);
     size = *((unsigned int *) c->argv[1]);
     max_age = *((unsigned int *) c->argv[2]);
+    neg_max_age = *((unsigned int *) c->argv[3]);
 
     if (engine) {
       pr_fs_statcache_set_policy(size, max_age, 0);
+      pr_fs_statcache_set_negative_max_age(neg_max_age);
 
     } else {
       pr_fs_statcache_set_policy(0, 0, 0);
@@ -6311,6 +6383,8 @@ MODRET core_post_pass(cmd_rec *cmd) {
     /* Set the default statcache policy. */
     pr_fs_statcache_set_policy(PR_TUNABLE_FS_STATCACHE_SIZE,
       PR_TUNABLE_FS_STATCACHE_MAX_AGE, 0);
+    pr_fs_statcache_set_negative_max_age(
+      PR_TUNABLE_FS_STATCACHE_NEGATIVE_MAX_AGE);
   }
 
   /* Register an exit handler here, for clearing the statcache. */
@@ -6384,6 +6458,15 @@ static const char *core_get_xfer_bytes_str(void *data, size_t datasz) {
  */
 
 static void core_exit_ev(const void *event_data, void *user_data) {
+  pr_fs_statcache_stats_t stats;
+
+  if (pr_fs_statcache_get_stats(&stats) == 0 &&
+      (stats.hits > 0 || stats.misses > 0)) {
+    pr_trace_msg("fs.statcache", 8, "session: %lu hits (%lu negative), "
+      "%lu misses, %lu evictions, %lu expirations", stats.hits,
+      stats.negative_hits, stats.misses, stats.evictions, stats.expirations);
+  }
+
   pr_fs_statcache_free();
 }
 
@@ -6954,6 +7037,8 @@ static conftable core_conftab[] = {
   { "MaxCommandRate",		set_maxcommandrate,		NULL },
   { "MaxConnectionRate",	set_maxconnrate,		NULL },
   { "MaxInstances",		set_maxinstances,		NULL },
+  { "MaxSpareServers",		set_maxspareservers,		NULL },
+  { "MinSpareServers",		set_minspareservers,		NULL },
   { "MultilineRFC2228",		set_multilinerfc2228,		NULL },
   { "Order",			set_order,			NULL },
   { "PassivePorts",		set_passiveports,		NULL },
@@ -53,6 +53,12 @@ static unsigned long facts_mlinfo_opts = 0;
 #define FACTS_MLINFO_FL_APPEND_CRLF			0x00008
 #define FACTS_MLINFO_FL_NO_ADJUSTED_SYMLINKS		0x00010
 #define FACTS_MLINFO_FL_NO_NAMES			0x00020
+#define FACTS_MLINFO_FL_PREFETCHED			0x00040
+
+/* Number of directory entries read, and their metadata prefetched, at a
+ * time for MLSD.
+ */
+#define FACTS_MLSD_BATCH_SIZE		64
 
 struct mlinfo {
   pool *pool;
@@ -409,6 +415,7 @@ static void facts_mlinfobuf_flush(void) {
      */
     session.sf_flags &= ~SF_ASCII_OVERRIDE;
 
+    (void) pr_listcache_write(mlinfo_buf, mlinfo_buflen);
     res = pr_data_xfer(mlinfo_buf, mlinfo_buflen);
     if (res < 0 &&
         errno != 0) {
@@ -428,7 +435,10 @@ static int facts_mlinfo_get(struct mlinfo *info, const char *path,
   char *perm = "";
   int res;
 
-  pr_fs_clear_cache2(path);
+  if (!(flags & FACTS_MLINFO_FL_PREFETCHED)) {
+    pr_fs_clear_cache2(path);
+  }
+
   res = pr_fsio_lstat(path, &(info->st));
   if (res < 0) {
     int xerrno = errno;
@@ -1310,6 +1320,9 @@ MODRET facts_mlsd(cmd_rec *cmd) {
   int flags = 0;
   DIR *dirh;
   struct dirent *dent;
+  char **batch_names, cache_settings[128];
+  const char *cache_key;
+  int capturing;
 
   if (cmd->argc != 1) {
     path = pstrdup(cmd->tmp_pool, cmd->arg);
@@ -1475,70 +1488,163 @@ MODRET facts_mlsd(cmd_rec *cmd) {
 
   facts_mlinfobuf_init();
 
-  while ((dent = pr_fsio_readdir(dirh)) != NULL) {
-    int hidden = FALSE, res;
-    char *rel_path, *abs_path;
+  /* Everything, other than the directory and the session's identity, which
+   * affects the listing goes into the listing cache key.
+   */
+  memset(cache_settings, '\0', sizeof(cache_settings));
+  snprintf(cache_settings, sizeof(cache_settings)-1, "%lx %lx %x %s.%s %o",
+    facts_opts, facts_mlinfo_opts, flags,
+    pr_uid2str(cmd->tmp_pool, fake_uid), pr_gid2str(cmd->tmp_pool, fake_gid),
+    fake_mode ? (unsigned int) *fake_mode : 0);
+  cache_key = pstrcat(cmd->tmp_pool, "MLSD ", cache_settings,
+    "\nDirFakeUser=", fake_user ? fake_user : "",
+    "\nDirFakeGroup=", fake_group ? fake_group : "", NULL);
+
+  if (pr_listcache_send(cmd->tmp_pool, best_path, cache_key) == 0) {
+    pr_fsio_closedir(dirh);
 
-    pr_signals_handle();
+    if (XFER_ABORTED) {
+      pr_data_abort(0, 0);
+      pr_data_close(TRUE);
 
-    rel_path = pdircat(cmd->tmp_pool, best_path, dent->d_name, NULL);
-    res = dir_check(cmd->tmp_pool, cmd, cmd->group, rel_path, &hidden);
-    if (!res || hidden) {
-      continue;
+    } else {
+      pr_data_close(FALSE);
     }
 
-    /* Check that the file can be listed. */
-    abs_path = dir_realpath(cmd->tmp_pool, rel_path);
-    if (abs_path) {
-      res = dir_check(cmd->tmp_pool, cmd, cmd->group, abs_path, &hidden);
-      
-    } else {
-      abs_path = dir_canonical_path(cmd->tmp_pool, rel_path);
-      if (abs_path == NULL) {
-        abs_path = rel_path;
-      }
+    return PR_HANDLED(cmd);
+  }
 
-      res = dir_check_canon(cmd->tmp_pool, cmd, cmd->group, abs_path, &hidden);
+  capturing = (pr_listcache_capture(cmd->tmp_pool, best_path,
+    cache_key) == 0);
+
+  /* Directory entries are read in batches, so that their metadata can be
+   * prefetched (where supported) before the entries are formatted.
+   */
+  batch_names = pcalloc(cmd->tmp_pool, FACTS_MLSD_BATCH_SIZE * sizeof(char *));
+
+  while (!XFER_ABORTED) {
+    register unsigned int i;
+    unsigned int batch_count = 0, prefetched = 0;
+    pool *batch_pool;
+
+    batch_pool = make_sub_pool(cmd->tmp_pool);
+    pr_pool_tag(batch_pool, "MLSD batch pool");
+
+    while (batch_count < FACTS_MLSD_BATCH_SIZE &&
+           (dent = pr_fsio_readdir(dirh)) != NULL) {
+      batch_names[batch_count++] = pstrdup(batch_pool, dent->d_name);
     }
 
-    if (!res || hidden) {
-      continue;
+    if (batch_count == 0) {
+      destroy_pool(batch_pool);
+      break;
     }
 
-    memset(&info, 0, sizeof(struct mlinfo));
+    while (prefetched < batch_count) {
+      int res;
 
-    info.pool = make_sub_pool(cmd->tmp_pool);
-    pr_pool_tag(info.pool, "MLSD facts pool");
-    if (facts_mlinfo_get(&info, rel_path, dent->d_name, flags,
-        fake_user, fake_uid, fake_group, fake_gid, fake_mode) < 0) {
-      pr_log_debug(DEBUG3, MOD_FACTS_VERSION
-        ": MLSD: unable to get info for '%s': %s", abs_path, strerror(errno));
-      continue;
+      res = pr_fs_statcache_prefetch(batch_pool, best_path,
+        (const char **) (batch_names + prefetched), batch_count - prefetched);
+      if (res <= 0) {
+        break;
+      }
+
+      prefetched += res;
     }
 
-    /* As per RFC3659, the directory being listed should not appear as a
-     * component in the paths of the directory contents.
-     */
-    info.path = pr_fs_encode_path(info.pool, dent->d_name);
+    for (i = 0; i < batch_count; i++) {
+      int hidden = FALSE, res, mlinfo_flags;
+      char *rel_path, *abs_path;
+      const char *name;
 
-    facts_mlinfobuf_add(&info, FACTS_MLINFO_FL_APPEND_CRLF);
+      pr_signals_handle();
 
-    destroy_pool(info.pool);
-    info.pool = NULL;
+      name = batch_names[i];
 
-    if (XFER_ABORTED) {
-      pr_data_abort(0, 0);
-      break;
+      /* Everything allocated for this entry comes from its own pool, rather
+       * than cmd->tmp_pool, so that the memory used does not grow with the
+       * number of entries in the directory.
+       */
+      memset(&info, 0, sizeof(struct mlinfo));
+
+      info.pool = make_sub_pool(batch_pool);
+      pr_pool_tag(info.pool, "MLSD facts pool");
+
+      rel_path = pdircat(info.pool, best_path, name, NULL);
+      res = dir_check(info.pool, cmd, cmd->group, rel_path, &hidden);
+      if (!res || hidden) {
+        destroy_pool(info.pool);
+        continue;
+      }
+
+      /* Check that the file can be listed. */
+      abs_path = dir_realpath(info.pool, rel_path);
+      if (abs_path) {
+        res = dir_check(info.pool, cmd, cmd->group, abs_path, &hidden);
+
+      } else {
+        abs_path = dir_canonical_path(info.pool, rel_path);
+        if (abs_path == NULL) {
+          abs_path = rel_path;
+        }
+
+        res = dir_check_canon(info.pool, cmd, cmd->group, abs_path, &hidden);
+      }
+
+      if (!res || hidden) {
+        destroy_pool(info.pool);
+        continue;
+      }
+
+      mlinfo_flags = flags;
+      if (i < prefetched) {
+        mlinfo_flags |= FACTS_MLINFO_FL_PREFETCHED;
+      }
+
+      if (facts_mlinfo_get(&info, rel_path, name, mlinfo_flags,
+          fake_user, fake_uid, fake_group, fake_gid, fake_mode) < 0) {
+        pr_log_debug(DEBUG3, MOD_FACTS_VERSION
+          ": MLSD: unable to get info for '%s': %s", abs_path,
+          strerror(errno));
+        destroy_pool(info.pool);
+        continue;
+      }
+
+      /* As per RFC3659, the directory being listed should not appear as a
+       * component in the paths of the directory contents.
+       */
+      info.path = pr_fs_encode_path(info.pool, name);
+
+      facts_mlinfobuf_add(&info, FACTS_MLINFO_FL_APPEND_CRLF);
+
+      destroy_pool(info.pool);
+      info.pool = NULL;
+
+      if (XFER_ABORTED) {
+        pr_data_abort(0, 0);
+        break;
+      }
     }
+
+    destroy_pool(batch_pool);
   }
 
   pr_fsio_closedir(dirh);
 
   if (XFER_ABORTED) {
+    if (capturing) {
+      pr_listcache_discard();
+    }
+
     pr_data_close(TRUE);
 
   } else {
     facts_mlinfobuf_flush();
+
+    if (capturing) {
+      (void) pr_listcache_commit();
+    }
+
     pr_data_close(FALSE);
   }
 
@@ -125,6 +125,7 @@ static xaset_t *log_set = NULL;
    %{protocol}          - Current protocol (e.g. "ftp", "sftp", etc)
    %{uid}               - UID of logged-in user
    %{gid}               - Primary GID of logged-in user
+   %{transfer-buffer-size} - Size of data transfer buffer, in bytes
    %{transfer-failure}  - reason, or "-"
    %{transfer-millisecs}- Time taken to transfer file, in milliseconds
    %{transfer-status}   - "success", "failed", "cancelled", "timeout", or "-"
@@ -271,6 +272,12 @@ static void logformat(const char *directive, char *nickname, char *fmts) {
           continue;
         }
 
+        if (strncmp(tmp, "{transfer-buffer-size}", 22) == 0) {
+          add_meta(&outs, LOGFMT_META_XFER_BUFSZ, 0);
+          tmp += 22;
+          continue;
+        }
+
         if (strncmp(tmp, "{transfer-failure}", 18) == 0) {
           add_meta(&outs, LOGFMT_META_XFER_FAILURE, 0);
           tmp += 18;
@@ -1924,6 +1931,28 @@ static char *get_next_meta(pool *p, cmd_rec *cmd, unsigned char **f,
       break;
     }
 
+    case LOGFMT_META_XFER_BUFSZ: {
+      const size_t *bufsz;
+
+      argp = arg;
+
+      bufsz = pr_table_get(cmd->notes, "mod_xfer.buffer-size", NULL);
+      if (bufsz != NULL) {
+        char bufsz_str[1024];
+
+        memset(bufsz_str, '\0', sizeof(bufsz_str));
+        snprintf(bufsz_str, sizeof(bufsz_str)-1, "%lu",
+          (unsigned long) *bufsz);
+        len = sstrncpy(argp, bufsz_str, sizeof(arg));
+
+      } else {
+        len = sstrncpy(argp, "-", sizeof(arg));
+      }
+
+      m++;
+      break;
+    }
+
     case LOGFMT_META_VERSION:
       argp = arg;
       len = sstrncpy(argp, PROFTPD_VERSION_TEXT, sizeof(arg));
@@ -28,6 +28,10 @@
 
 #include "conf.h"
 
+extern xaset_t *server_list;
+
+module ls_module;
+
 #ifndef GLOB_ABORTED
 #define GLOB_ABORTED GLOB_ABEND
 #endif
@@ -74,8 +78,16 @@ static unsigned char have_fake_mode = FALSE;
 static int ls_errno = 0;
 static time_t ls_curtime = 0;
 
+/* Set while listing entries whose lstat(2) data was just prefetched into
+ * the statcache, so that listfile() uses it rather than clearing it.
+ */
+static unsigned char ls_prefetched = FALSE;
+
 static unsigned char use_globbing = TRUE;
 
+/* Whether LIST output may be served from, and stored in, the ListCache. */
+static unsigned char use_listcache = FALSE;
+
 /* Directory listing limits */
 struct list_limit_rec {
   unsigned int curr, max;
@@ -345,6 +357,7 @@ static int sendline(int flags, char *fmt, ...) {
       session.sf_flags &= ~SF_ASCII;
       session.sf_flags &= ~SF_ASCII_OVERRIDE;
 
+      (void) pr_listcache_write(listbuf, listbuflen);
       res = pr_data_xfer(listbuf, listbuflen);
       if (res < 0 &&
           errno != 0) {
@@ -390,6 +403,7 @@ static int sendline(int flags, char *fmt, ...) {
      */
     session.sf_flags &= ~SF_ASCII_OVERRIDE;
 
+    (void) pr_listcache_write(listbuf, listbuflen);
     res = pr_data_xfer(listbuf, listbuflen);
     if (res < 0 &&
         errno != 0) {
@@ -505,7 +519,10 @@ static int listfile(cmd_rec *cmd, pool *p, const char *resp_code,
     p = cmd->tmp_pool;
   }
 
-  pr_fs_clear_cache2(name);
+  if (ls_prefetched == FALSE) {
+    pr_fs_clear_cache2(name);
+  }
+
   if (pr_fsio_lstat(name, &st) == 0) {
     char *display_name = NULL;
 
@@ -1164,14 +1181,143 @@ static int dircmp(const void *a, const void *b) {
 #endif /* !PR_USE_NLS or !HAVE_STRCOLL */
 }
 
+/* Returns TRUE if directory entries are sorted by plain byte order, i.e.
+ * if dircmp() is equivalent to strcmp(3).
+ */
+static int dircmp_is_bytewise(void) {
+#if defined(PR_USE_NLS) && defined(HAVE_STRCOLL) && defined(HAVE_LOCALE_H)
+  const char *collate;
+
+  collate = setlocale(LC_COLLATE, NULL);
+  if (collate != NULL &&
+      (strcmp(collate, "C") == 0 ||
+       strcmp(collate, "POSIX") == 0)) {
+    return TRUE;
+  }
+
+  return FALSE;
+#elif defined(PR_USE_NLS) && defined(HAVE_STRCOLL)
+  return FALSE;
+#else
+  return TRUE;
+#endif
+}
+
+static void dirsort_swap(char **a, size_t i, size_t j) {
+  char *tmp;
+
+  tmp = a[i];
+  a[i] = a[j];
+  a[j] = tmp;
+}
+
+/* Sorts the given names in byte order, using a multikey (three-way radix)
+ * quicksort: names are partitioned on one character at a time, so common
+ * prefixes are only compared once.  The largest partition is handled by
+ * iteration, the others by recursion, which bounds the recursion depth to
+ * log2(n).
+ */
+static void dirsort_bytewise(char **a, size_t n, size_t depth) {
+  while (n > 1) {
+    size_t lt, gt, i, nparts[3];
+    unsigned char v;
+
+    if (n < 16) {
+      register size_t j;
+
+      for (i = 1; i < n; i++) {
+        for (j = i; j > 0 &&
+             strcmp(a[j-1] + depth, a[j] + depth) > 0; j--) {
+          dirsort_swap(a, j-1, j);
+        }
+      }
+
+      return;
+    }
+
+    v = (unsigned char) a[n/2][depth];
+    lt = i = 0;
+    gt = n;
+
+    while (i < gt) {
+      unsigned char ch;
+
+      ch = (unsigned char) a[i][depth];
+      if (ch < v) {
+        dirsort_swap(a, lt++, i++);
+
+      } else if (ch > v) {
+        dirsort_swap(a, i, --gt);
+
+      } else {
+        i++;
+      }
+    }
+
+    /* The names in a[lt..gt) share the same character at this depth; if
+     * that character is the terminating NUL, they are identical.
+     */
+    nparts[0] = lt;
+    nparts[1] = (v != '\0' ? gt - lt : 0);
+    nparts[2] = n - gt;
+
+    if (nparts[1] >= nparts[0] &&
+        nparts[1] >= nparts[2]) {
+      dirsort_bytewise(a, nparts[0], depth);
+      dirsort_bytewise(a + gt, nparts[2], depth);
+      a += lt;
+      n = nparts[1];
+      depth++;
+
+    } else if (nparts[0] >= nparts[2]) {
+      dirsort_bytewise(a + lt, nparts[1], depth + 1);
+      dirsort_bytewise(a + gt, nparts[2], depth);
+      n = nparts[0];
+
+    } else {
+      dirsort_bytewise(a, nparts[0], depth);
+      dirsort_bytewise(a + lt, nparts[1], depth + 1);
+      a += gt;
+      n = nparts[2];
+    }
+  }
+}
+
+/* The names returned by sreaddir() are copied into large chunks, rather than
+ * allocated one by one.  The list of chunks is kept in the slot just before
+ * the returned array; use sreaddir_free() to release everything.
+ */
+#define LS_NAME_CHUNK_SIZE		(64 * 1024)
+
+struct ls_name_chunk {
+  struct ls_name_chunk *next;
+  size_t used;
+  char names[LS_NAME_CHUNK_SIZE];
+};
+
+static void sreaddir_free(char **names) {
+  struct ls_name_chunk *chunk, *next;
+
+  if (names == NULL) {
+    return;
+  }
+
+  for (chunk = (struct ls_name_chunk *) names[-1]; chunk; chunk = next) {
+    next = chunk->next;
+    free(chunk);
+  }
+
+  free(names - 1);
+}
+
 static char **sreaddir(const char *dirname, const int sort) {
   DIR *d;
   struct dirent *de;
   struct stat st;
-  int i, dir_fd;
+  int i;
   char **p;
-  long ssize;
   size_t dsize;
+  struct ls_name_chunk *chunk = NULL;
 
   pr_fs_clear_cache2(dirname);
   if (pr_fsio_stat(dirname, &st) < 0) {
@@ -1188,12 +1334,11 @@ static char **sreaddir(const char *dirname, const int sort) {
     return NULL;
   }
 
-  /* It doesn't matter if the following guesses are wrong, but it slows
-   * the system a bit and wastes some memory if they are wrong, so
+  /* It doesn't matter if the following guess is wrong, but it slows
+   * the system a bit and wastes some memory if it is wrong, so
    * don't guess *too* naively!
    *
    * 'dsize' must be greater than zero or we loop forever.
-   * 'ssize' must be at least big enough to hold a maximum-length name.
    */
 
   /* Guess the number of entries in the directory. */
@@ -1202,49 +1347,31 @@ static char **sreaddir(const char *dirname, const int sort) {
     dsize = LS_MAX_DSIZE;
   }
 
-  /* The directory has been opened already, but portably accessing the file
-   * descriptor inside the DIR struct isn't easy.  Some systems use "dd_fd" or
-   * "__dd_fd" rather than "d_fd".  Still others work really hard at opacity.
-   */
-#if defined(HAVE_DIRFD) 
-  dir_fd = dirfd(d);
-#elif defined(HAVE_STRUCT_DIR_D_FD)
-  dir_fd = d->d_fd;
-#elif defined(HAVE_STRUCT_DIR_DD_FD)
-  dir_fd = d->dd_fd;
-#elif defined(HAVE_STRUCT_DIR___DD_FD)
-  dir_fd = d->__dd_fd;
-#else
-  dir_fd = 0;
-#endif
-
-  ssize = get_name_max((char *) dirname, dir_fd);
-  if (ssize < 1) {
-    pr_log_debug(DEBUG1, "get_name_max(%s, %d) = %lu, using %d", dirname,
-      dir_fd, (unsigned long) ssize, NAME_MAX_GUESS);
-    ssize = NAME_MAX_GUESS;
-  }
-
-  ssize *= ((dsize / 4) + 1);
-
-  /* Allocate first block for holding filenames.  Yes, we are explicitly using
-   * malloc (and realloc, and calloc, later) rather than the memory pools.
+  /* Allocate the array of pointers to filenames.  Yes, we are explicitly
+   * using malloc (and realloc, later) rather than the memory pools.
    * Recursive directory listings would eat up a lot of pool memory that is
    * only freed when the _entire_ directory structure has been parsed.  Also,
    * this helps to keep the memory footprint a little smaller.
+   *
+   * The first slot holds the list of name chunks; it is hidden from the
+   * caller.
    */
   pr_trace_msg("data", 8, "allocating readdir buffer of %lu bytes",
-    (unsigned long) (dsize * sizeof(char *)));
+    (unsigned long) ((dsize + 1) * sizeof(char *)));
 
-  p = malloc(dsize * sizeof(char *));
+  p = malloc((dsize + 1) * sizeof(char *));
   if (p == NULL) {
     pr_log_pri(PR_LOG_ALERT, "Out of memory!");
     exit(1);
   }
 
+  p[0] = NULL;
+  p++;
   i = 0;
 
   while ((de = pr_fsio_readdir(d)) != NULL) {
+    size_t namelen;
+
     pr_signals_handle();
 
     if ((size_t) i >= dsize - 1) {
@@ -1259,24 +1386,40 @@ static char **sreaddir(const char *dirname, const int sort) {
 
       /* Allocate bigger array for pointers to filenames */
       pr_trace_msg("data", 8, "allocating readdir buffer of %lu bytes",
-        (unsigned long) (2 * dsize * sizeof(char *)));
+        (unsigned long) ((2 * dsize + 1) * sizeof(char *)));
 
-      newp = (char **) realloc(p, 2 * dsize * sizeof(char *));
+      newp = (char **) realloc(p - 1, (2 * dsize + 1) * sizeof(char *));
       if (newp == NULL) {
         pr_log_pri(PR_LOG_ALERT, "Out of memory!");
         exit(1);
       }
-      p = newp;
+      p = newp + 1;
       dsize *= 2;
     }
 
-    /* Append the filename to the block. */
-    p[i] = (char *) calloc(strlen(de->d_name) + 1, sizeof(char));
-    if (p[i] == NULL) {
-      pr_log_pri(PR_LOG_ALERT, "Out of memory!");
-      exit(1);
+    /* Append the filename to the current chunk, starting a new chunk if
+     * there is not enough room left.
+     */
+    namelen = strlen(de->d_name) + 1;
+    if (chunk == NULL ||
+        chunk->used + namelen > sizeof(chunk->names)) {
+      struct ls_name_chunk *new_chunk;
+
+      new_chunk = malloc(sizeof(struct ls_name_chunk));
+      if (new_chunk == NULL) {
+        pr_log_pri(PR_LOG_ALERT, "Out of memory!");
+        exit(1);
+      }
+
+      new_chunk->next = chunk;
+      new_chunk->used = 0;
+      chunk = new_chunk;
+      p[-1] = (char *) chunk;
     }
-    sstrncpy(p[i++], de->d_name, strlen(de->d_name) + 1);
+
+    p[i] = chunk->names + chunk->used;
+    memcpy(p[i++], de->d_name, namelen);
+    chunk->used += namelen;
   }
 
   pr_fsio_closedir(d);
@@ -1286,18 +1429,75 @@ static char **sreaddir(const char *dirname, const int sort) {
   p[i] = NULL;
 
   if (sort) {
-    PR_DEVEL_CLOCK(qsort(p, i, sizeof(char *), dircmp));
+    if (dircmp_is_bytewise()) {
+      PR_DEVEL_CLOCK(dirsort_bytewise(p, i, 0));
+
+    } else {
+      PR_DEVEL_CLOCK(qsort(p, i, sizeof(char *), dircmp));
+    }
   }
 
   return p;
 }
 
+/* Lists the current directory as its entries are read, rather than reading
+ * the whole directory first.  Only used for unsorted (-U), non-recursive
+ * listings, where nothing needs to be buffered: addfile() sends each line
+ * immediately.  Every entry gets its own pool, which also stands in for
+ * cmd->tmp_pool while the entry is listed, so that memory use does not grow
+ * with the size of the directory.
+ */
+static int listdir_stream(cmd_rec *cmd, pool *workp, const char *resp_code) {
+  DIR *dirh;
+  struct dirent *de;
+  pool *tmp_pool;
+
+  dirh = pr_fsio_opendir(".");
+  if (dirh == NULL) {
+    pr_trace_msg("fsio", 9,
+      "opendir() error on '.': %s", strerror(errno));
+    return 0;
+  }
+
+  tmp_pool = cmd->tmp_pool;
+
+  while ((de = pr_fsio_readdir(dirh)) != NULL) {
+    pool *iter_pool;
+    int res;
+
+    pr_signals_handle();
+
+    if (*de->d_name == '.' &&
+        !opt_a &&
+        (!opt_A || is_dotdir(de->d_name))) {
+      continue;
+    }
+
+    iter_pool = make_sub_pool(workp);
+    pr_pool_tag(iter_pool, "mod_ls: listdir_stream(): entry pool");
+
+    cmd->tmp_pool = iter_pool;
+    res = listfile(cmd, iter_pool, resp_code, de->d_name);
+    cmd->tmp_pool = tmp_pool;
+
+    destroy_pool(iter_pool);
+
+    if (res == 2 ||
+        XFER_ABORTED) {
+      break;
+    }
+  }
+
+  pr_fsio_closedir(dirh);
+
+  return outputfiles(cmd);
+}
+
 /* This listdir() requires a chdir() first. */
 static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
     const char *name) {
   char **dir;
   int dest_workp = 0;
-  register unsigned int i = 0;
 
   if (list_ndepth.curr && list_ndepth.max &&
       list_ndepth.curr >= list_ndepth.max) {
@@ -1339,15 +1539,52 @@ static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
     dest_workp++;
   }
 
+  if (opt_U &&
+      !opt_R &&
+      !opt_STAT) {
+    int res;
+
+    res = listdir_stream(cmd, workp, resp_code);
+
+    if (dest_workp) {
+      destroy_pool(workp);
+    }
+
+    return (res < 0 ? -1 : 0);
+  }
+
   PR_DEVEL_CLOCK(dir = sreaddir(".", opt_U ? FALSE : TRUE));
   if (dir) {
     char **s;
-    char **r;
+    char **r, **prefetch_end;
+    unsigned int count = 0;
+    int d = 0, prefetch = TRUE;
 
-    int d = 0;
+    for (s = dir; *s; s++) {
+      count++;
+    }
 
-    s = dir;
+    s = prefetch_end = dir;
     while (*s) {
+      /* Look up the metadata for the next batch of entries all at once,
+       * where supported, rather than one entry at a time.
+       */
+      if (prefetch == TRUE &&
+          s == prefetch_end) {
+        int res;
+
+        res = pr_fs_statcache_prefetch(workp, NULL, (const char **) s,
+          count - (s - dir));
+        if (res > 0) {
+          prefetch_end = s + res;
+
+        } else {
+          prefetch = FALSE;
+        }
+      }
+
+      ls_prefetched = (s < prefetch_end);
+
       if (**s == '.') {
         if (!opt_a && (!opt_A || is_dotdir(*s))) {
           d = 0;
@@ -1377,6 +1614,8 @@ static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
       s++;
     }
 
+    ls_prefetched = FALSE;
+
     if (outputfiles(cmd) < 0) {
       if (dest_workp) {
         destroy_pool(workp);
@@ -1385,11 +1624,7 @@ static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
       /* Explicitly free the memory allocated for containing the list of
        * filenames.
        */
-      i = 0;
-      while (dir[i] != NULL) {
-        free(dir[i++]);
-      }
-      free(dir);
+      sreaddir_free(dir);
 
       return -1;
     }
@@ -1464,11 +1699,7 @@ static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
           /* Explicitly free the memory allocated for containing the list of
            * filenames.
            */
-          i = 0;
-          while (dir[i] != NULL) {
-            free(dir[i++]);
-          }
-          free(dir);
+          sreaddir_free(dir);
 
           return -1;
         }
@@ -1489,11 +1720,7 @@ static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
           /* Explicitly free the memory allocated for containing the list of
            * filenames.
            */
-          i = 0;
-          while (dir[i] != NULL) {
-            free(dir[i++]);
-          }
-          free(dir);
+          sreaddir_free(dir);
 
           return -1;
         }
@@ -1514,16 +1741,82 @@ static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
    * filenames.
    */
   if (dir) {
-    i = 0;
-    while (dir[i] != NULL) {
-      free(dir[i++]);
-    }
-    free(dir);
+    sreaddir_free(dir);
   }
 
   return 0;
 }
 
+/* Everything, other than the directory and the session's identity, which
+ * affects the listdir() output.
+ */
+static const char *listcache_get_key(pool *p) {
+  char opts[32], settings[128];
+
+  memset(opts, '\0', sizeof(opts));
+  snprintf(opts, sizeof(opts)-1, "%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d",
+    opt_1, opt_a, opt_A, opt_B, opt_C, opt_c, opt_F, opt_h, opt_l, opt_L,
+    opt_n, opt_r, opt_S, opt_t, opt_U, opt_u, ls_sort_by);
+
+  memset(settings, '\0', sizeof(settings));
+  snprintf(settings, sizeof(settings)-1, "%lx %u %u %o",
+    list_flags, list_show_symlinks, list_times_gmt,
+    have_fake_mode ? (unsigned int) fakemode : 0);
+
+  return pstrcat(p, "LIST ", opts, " ", settings,
+    "\nDirFakeUser=", fakeuser ? fakeuser : "",
+    "\nDirFakeGroup=", fakegroup ? fakegroup : "", NULL);
+}
+
+/* Lists the current directory, as listdir() does, sending the listing from
+ * the ListCache if possible, and storing it there otherwise.  Recursive
+ * listings, and listings cut short by ListOptions maxfiles/maxdirs, are
+ * never cached.
+ */
+static int listdir_cached(cmd_rec *cmd, pool *workp, const char *resp_code,
+    const char *name) {
+  const char *dir, *key;
+  int res;
+
+  if (use_listcache == FALSE ||
+      opt_STAT ||
+      opt_R ||
+      list_nfiles.max > 0 ||
+      list_ndirs.max > 0) {
+    return listdir(cmd, workp, resp_code, name);
+  }
+
+  dir = pr_fs_getcwd();
+  key = listcache_get_key(cmd->tmp_pool);
+
+  /* The listing must be cached, and sent, apart from any output buffered
+   * before it (e.g. the name of the previous directory listed).
+   */
+  if (sendline(LS_SENDLINE_FL_FLUSH, " ") < 0) {
+    return -1;
+  }
+
+  if (pr_listcache_send(cmd->tmp_pool, dir, key) == 0) {
+    return (XFER_ABORTED ? -1 : 0);
+  }
+
+  if (pr_listcache_capture(cmd->tmp_pool, dir, key) < 0) {
+    return listdir(cmd, workp, resp_code, name);
+  }
+
+  res = listdir(cmd, workp, resp_code, name);
+  if (res == 0 &&
+      !XFER_ABORTED &&
+      sendline(LS_SENDLINE_FL_FLUSH, " ") == 0) {
+    (void) pr_listcache_commit();
+
+  } else {
+    pr_listcache_discard();
+  }
+
+  return res;
+}
+
 static void ls_terminate(void) {
   if (!opt_STAT) {
     discard_output();
@@ -2135,7 +2428,7 @@ static int dolist(cmd_rec *cmd, const char *opt, const char *resp_code,
             int res = 0;
 
             list_ndepth.curr++;
-            res = listdir(cmd, cmd->tmp_pool, resp_code, *path);
+            res = listdir_cached(cmd, cmd->tmp_pool, resp_code, *path);
             list_ndepth.curr--;
 
             pop_cwd(cwd_buf, &symhold);
@@ -2224,7 +2517,7 @@ static int dolist(cmd_rec *cmd, const char *opt, const char *resp_code,
 
       } else {
         list_ndepth.curr++;
-        if (listdir(cmd, NULL, resp_code, ".") < 0) {
+        if (listdir_cached(cmd, NULL, resp_code, ".") < 0) {
           ls_terminate();
           return -1;
         }
@@ -2332,18 +2625,101 @@ static int nlstfile(cmd_rec *cmd, const char *file) {
   return 1;
 }
 
+/* Sends the NLST line for one entry, p, of the current directory.  Returns 1
+ * if the entry was sent, 2 if it was sent and the ListOptions maxfiles limit
+ * has now been reached, 0 if it was skipped, and -1 on error.
+ */
+static int nlstentry(cmd_rec *cmd, pool *workp, const char *dir, char *p,
+    int curdir, unsigned char ignore_hidden) {
+  char *f, file[PR_TUNABLE_PATH_MAX + 1] = {'\0'};
+  char *str = NULL;
+  int i, hidden = 0;
+  mode_t mode;
+
+  if (*p == '.') {
+    if (!opt_a && (!opt_A || is_dotdir(p))) {
+      return 0;
+
+    /* Make sure IgnoreHidden is properly honored. */
+    } else if (ignore_hidden) {
+      return 0;
+    }
+  }
+
+  if (list_flags & LS_FL_NO_ADJUSTED_SYMLINKS) {
+    i = pr_fsio_readlink(p, file, sizeof(file) - 1);
+
+  } else {
+    i = dir_readlink(cmd->tmp_pool, p, file, sizeof(file) - 1,
+      PR_DIR_READLINK_FL_HANDLE_REL_PATH);
+  }
+
+  if (i > 0) {
+    if ((size_t) i >= sizeof(file)) {
+      return 0;
+    }
+
+    file[i] = '\0';
+    f = file;
+
+  } else {
+    f = p;
+  }
+
+  if (!ls_perms(workp, cmd, dir_best_path(cmd->tmp_pool, f), &hidden)) {
+    return 0;
+  }
+
+  if (hidden) {
+    return 0;
+  }
+
+  mode = file_mode2(cmd->tmp_pool, f);
+  if (mode == 0) {
+    return 0;
+  }
+
+  if (!curdir &&
+      !opt_1) {
+    str = pr_fs_encode_path(cmd->tmp_pool,
+      pdircat(cmd->tmp_pool, dir, p, NULL));
+
+  } else {
+    /* Send just the file name, not the path. */
+    str = pr_fs_encode_path(cmd->tmp_pool, p);
+  }
+
+  if (sendline(0, "%s\r\n", str) < 0) {
+    return -1;
+  }
+
+  if (list_nfiles.curr > 0 &&
+      list_nfiles.max > 0 &&
+      list_nfiles.curr >= list_nfiles.max) {
+
+    if (!list_nfiles.logged) {
+      pr_log_debug(DEBUG8, "ListOptions maxfiles (%u) reached",
+        list_nfiles.max);
+      list_nfiles.logged = TRUE;
+    }
+
+    return 2;
+  }
+  list_nfiles.curr++;
+
+  return 1;
+}
+
 /* Display listing of a directory, ACL checks performed on each entry,
  * sent in NLST fashion.  Files which are inaccessible via ACL are skipped,
  * error returned if data conn cannot be opened or is aborted.
  */
 static int nlstdir(cmd_rec *cmd, const char *dir) {
-  char **list, *p, *f,
-       file[PR_TUNABLE_PATH_MAX + 1] = {'\0'};
+  char **list;
   char cwd_buf[PR_TUNABLE_PATH_MAX + 1] = {'\0'};
   pool *workp;
   unsigned char symhold;
-  int curdir = FALSE, i, j, count = 0, hidden = 0, use_sorting = FALSE;
-  mode_t mode;
+  int curdir = FALSE, j, res, count = 0, use_sorting = FALSE;
   config_rec *c = NULL;
   unsigned char ignore_hidden = FALSE;
 
@@ -2399,19 +2775,6 @@ static int nlstdir(cmd_rec *cmd, const char *dir) {
     use_sorting = TRUE;
   }
 
-  PR_DEVEL_CLOCK(list = sreaddir(".", use_sorting));
-  if (list == NULL) {
-    pr_trace_msg("fsio", 9,
-      "sreaddir() error on '.': %s", strerror(errno));
-
-    if (!curdir) {
-      pop_cwd(cwd_buf, &symhold);
-    }
-
-    destroy_pool(workp);
-    return 0;
-  }
-
   /* Search for relevant <Limit>'s to this NLST command.  If found,
    * check to see whether hidden files should be ignored.
    */
@@ -2425,108 +2788,91 @@ static int nlstdir(cmd_rec *cmd, const char *dir) {
     }
   }
 
-  j = 0;
-  while (list[j] && count >= 0) {
-    p = list[j++];
-
-    pr_signals_handle();
-
-    if (*p == '.') {
-      if (!opt_a && (!opt_A || is_dotdir(p))) {
-        continue;
-
-      /* Make sure IgnoreHidden is properly honored. */
-      } else if (ignore_hidden) {
-        continue;
-      }
-    }
-
-    if (list_flags & LS_FL_NO_ADJUSTED_SYMLINKS) {
-      i = pr_fsio_readlink(p, file, sizeof(file) - 1);
+  if (use_sorting == FALSE) {
+    DIR *dirh;
+    struct dirent *de;
+    pool *tmp_pool;
 
-    } else {
-      i = dir_readlink(cmd->tmp_pool, p, file, sizeof(file) - 1,
-        PR_DIR_READLINK_FL_HANDLE_REL_PATH);
-    }
+    /* Without sorting, there is no need to read the whole directory before
+     * sending the first name.  As in listdir_stream(), each entry gets its
+     * own pool, so that memory use does not grow with the directory size.
+     */
+    dirh = pr_fsio_opendir(".");
+    if (dirh == NULL) {
+      pr_trace_msg("fsio", 9,
+        "opendir() error on '.': %s", strerror(errno));
 
-    if (i > 0) {
-      if ((size_t) i >= sizeof(file)) {
-        continue;
+      if (!curdir) {
+        pop_cwd(cwd_buf, &symhold);
       }
 
-      file[i] = '\0';
-      f = file;
-
-    } else {
-      f = p;
+      destroy_pool(workp);
+      return 0;
     }
 
-    if (ls_perms(workp, cmd, dir_best_path(cmd->tmp_pool, f), &hidden)) {
-      if (hidden) {
-        continue;
-      }
+    tmp_pool = cmd->tmp_pool;
 
-      mode = file_mode2(cmd->tmp_pool, f);
-      if (mode == 0) {
-        continue;
-      }
+    while ((de = pr_fsio_readdir(dirh)) != NULL) {
+      pool *iter_pool;
 
-      if (!curdir) {
-        char *str = NULL;
+      pr_signals_handle();
 
-        if (opt_1) {
-          /* Send just the file name, not the path. */
-          str = pr_fs_encode_path(cmd->tmp_pool, p);
+      iter_pool = make_sub_pool(workp);
+      pr_pool_tag(iter_pool, "mod_ls: nlstdir(): entry pool");
 
-        } else {
-          str = pr_fs_encode_path(cmd->tmp_pool,
-            pdircat(cmd->tmp_pool, dir, p, NULL));
-        }
+      cmd->tmp_pool = iter_pool;
+      res = nlstentry(cmd, iter_pool, dir, de->d_name, curdir, ignore_hidden);
+      cmd->tmp_pool = tmp_pool;
 
-        if (sendline(0, "%s\r\n", str) < 0) {
-          count = -1;
+      destroy_pool(iter_pool);
 
-        } else {
-          count++;
+      if (res < 0) {
+        count = -1;
+        break;
+      }
 
-          if (list_nfiles.curr > 0 &&
-              list_nfiles.max > 0 &&
-              list_nfiles.curr >= list_nfiles.max) {
+      count += (res > 0 ? 1 : 0);
+      if (res == 2) {
+        break;
+      }
+    }
 
-            if (!list_nfiles.logged) {
-              pr_log_debug(DEBUG8, "ListOptions maxfiles (%u) reached",
-                list_nfiles.max);
-              list_nfiles.logged = TRUE;
-            }
+    pr_fsio_closedir(dirh);
 
-            break;
-          }
-          list_nfiles.curr++;
-        }
+  } else {
+    PR_DEVEL_CLOCK(list = sreaddir(".", use_sorting));
+    if (list == NULL) {
+      pr_trace_msg("fsio", 9,
+        "sreaddir() error on '.': %s", strerror(errno));
 
-      } else {
-        if (sendline(0, "%s\r\n", pr_fs_encode_path(cmd->tmp_pool, p)) < 0) {
-          count = -1;
+      if (!curdir) {
+        pop_cwd(cwd_buf, &symhold);
+      }
 
-        } else {
-          count++;
+      destroy_pool(workp);
+      return 0;
+    }
 
-          if (list_nfiles.curr > 0 &&
-              list_nfiles.max > 0 &&
-              list_nfiles.curr >= list_nfiles.max) {
+    j = 0;
+    while (list[j]) {
+      pr_signals_handle();
 
-            if (!list_nfiles.logged) {
-              pr_log_debug(DEBUG8, "ListOptions maxfiles (%u) reached",
-                list_nfiles.max);
-              list_nfiles.logged = TRUE;
-            }
+      res = nlstentry(cmd, workp, dir, list[j++], curdir, ignore_hidden);
+      if (res < 0) {
+        count = -1;
+        break;
+      }
 
-            break;
-          }
-          list_nfiles.curr++;
-        }
+      count += (res > 0 ? 1 : 0);
+      if (res == 2) {
+        break;
       }
     }
+
+    /* Explicitly free the memory allocated for containing the list of
+     * filenames.
+     */
+    sreaddir_free(list);
   }
 
   sendline(LS_SENDLINE_FL_FLUSH, " ");
@@ -2536,15 +2882,6 @@ static int nlstdir(cmd_rec *cmd, const char *dir) {
   }
   destroy_pool(workp);
 
-  /* Explicitly free the memory allocated for containing the list of
-   * filenames.
-   */
-  i = 0;
-  while (list[i] != NULL) {
-    free(list[i++]);
-  }
-  free(list);
-
   return count;
 }
 
@@ -3417,6 +3754,17 @@ MODRET ls_post_pass(cmd_rec *cmd) {
   return PR_DECLINED(cmd);
 }
 
+/* Removes any cached listings made stale by this command (e.g. an upload
+ * overwriting an existing file).
+ */
+MODRET ls_log_any(cmd_rec *cmd) {
+  if (use_listcache == TRUE) {
+    (void) pr_listcache_flush();
+  }
+
+  return PR_DECLINED(cmd);
+}
+
 /* Configuration handlers
  */
 
@@ -3478,6 +3826,43 @@ MODRET set_dirfakemode(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: ListCache path [max-age] */
+MODRET set_listcache(cmd_rec *cmd) {
+  config_rec *c;
+  unsigned int max_age = PR_TUNABLE_LISTCACHE_MAX_AGE;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  if (pr_fs_valid_path(cmd->argv[1]) < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "'", cmd->argv[1],
+      "' is not a valid path", NULL));
+  }
+
+  if (cmd->argc == 3) {
+    int secs;
+
+    secs = atoi(cmd->argv[2]);
+    if (secs <= 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "max-age must be greater "
+        "than zero: ", cmd->argv[2], NULL));
+    }
+
+    max_age = secs;
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pstrdup(c->pool, cmd->argv[1]);
+  c->argv[1] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = max_age;
+
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_listoptions(cmd_rec *cmd) {
   config_rec *c = NULL;
   unsigned long flags = 0;
@@ -3622,6 +4007,38 @@ MODRET set_useglobbing(cmd_rec *cmd) {
 /* Initialization routines
  */
 
+/* Event handlers
+ */
+
+static void ls_exit_ev(const void *event_data, void *user_data) {
+  (void) pr_listcache_flush();
+}
+
+/* Listings cached under the previous configuration may no longer be valid,
+ * e.g. because of changed HideFiles rules.
+ */
+static void ls_postparse_ev(const void *event_data, void *user_data) {
+  server_rec *s;
+
+  if (ServerType == SERVER_INETD) {
+    return;
+  }
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    config_rec *c;
+
+    c = find_config(s->conf, CONF_PARAM, "ListCache", FALSE);
+    if (c == NULL) {
+      continue;
+    }
+
+    if (pr_listcache_clear(c->argv[0]) < 0) {
+      pr_log_pri(PR_LOG_WARNING, "ListCache: unable to prepare '%s': %s",
+        (char *) c->argv[0], strerror(errno));
+    }
+  }
+}
+
 static int ls_init(void) {
 
   /* Add the commands handled by this module to the HELP list. */
@@ -3629,6 +4046,30 @@ static int ls_init(void) {
   pr_help_add(C_NLST, _("[<sp> (pathname)]"), TRUE);
   pr_help_add(C_STAT, _("[<sp> pathname]"), TRUE);
 
+  pr_event_register(&ls_module, "core.postparse", ls_postparse_ev, NULL);
+
+  return 0;
+}
+
+static int ls_sess_init(void) {
+  config_rec *c;
+
+  c = find_config(main_server->conf, CONF_PARAM, "ListCache", FALSE);
+  if (c == NULL) {
+    return 0;
+  }
+
+  /* The cache directory needs to be opened now, before any chroot(2). */
+  if (pr_listcache_open(c->argv[0]) < 0) {
+    pr_log_debug(DEBUG2, "ListCache: unable to use '%s': %s",
+      (char *) c->argv[0], strerror(errno));
+    return 0;
+  }
+
+  pr_listcache_set_max_age(*((unsigned int *) c->argv[1]));
+  use_listcache = TRUE;
+
+  pr_event_register(&ls_module, "core.exit", ls_exit_ev, NULL);
   return 0;
 }
 
@@ -3639,6 +4080,7 @@ static conftable ls_conftab[] = {
   { "DirFakeUser",	set_dirfakeusergroup,			NULL },
   { "DirFakeGroup",	set_dirfakeusergroup,			NULL },
   { "DirFakeMode",	set_dirfakemode,			NULL },
+  { "ListCache",	set_listcache,				NULL },
   { "ListOptions",	set_listoptions,			NULL },
   { "ShowSymlinks",	set_showsymlinks,			NULL },
   { "UseGlobbing",	set_useglobbing,			NULL },
@@ -3654,6 +4096,8 @@ static cmdtable ls_cmdtab[] = {
   { LOG_CMD,	C_NLST, G_NONE,	ls_log_nlst,	FALSE, FALSE },
   { LOG_CMD_ERR,C_LIST, G_NONE, ls_err_nlst,   FALSE, FALSE },
   { LOG_CMD_ERR,C_NLST, G_NONE, ls_err_nlst,   FALSE, FALSE },
+  { LOG_CMD,	C_ANY,	G_NONE,	ls_log_any,	FALSE, FALSE },
+  { LOG_CMD_ERR,C_ANY,	G_NONE,	ls_log_any,	FALSE, FALSE },
   { 0, NULL }
 };
 
@@ -3679,5 +4123,5 @@ module ls_module = {
   ls_init,
 
   /* Session initialization */
-  NULL
+  ls_sess_init
 };
@@ -45,6 +45,7 @@
 
 extern module auth_module;
 extern pid_t mpid;
+extern xaset_t *server_list;
 
 /* Variables for this module */
 static pr_fh_t *retr_fh = NULL;
@@ -58,11 +59,32 @@ static unsigned char use_sendfile = TRUE;
 static off_t use_sendfile_len = 0;
 static float use_sendfile_pct = -1.0;
 
+/* TransferReadahead */
+static unsigned int xfer_readahead = PR_TUNABLE_XFER_READAHEAD;
+static off_t retr_read_pos = 0;
+static off_t retr_readahead_end = 0;
+
+/* ASCIICache */
+static int use_asciicache = FALSE;
+static off_t asciicache_min_size = PR_TUNABLE_ASCIICACHE_MIN_SIZE;
+
+/* For an ASCII download sent from a cached translated copy, the copy's
+ * file descriptor, and the offset at which its translated bytes start.
+ * While a download is captured into the cache, the data transfer layer's
+ * own ASCII translation is suspended; the previous setting is restored
+ * afterwards.
+ */
+static int retr_ascii_fd = -1;
+static off_t retr_ascii_offset = 0;
+static int retr_ascii_capture = FALSE;
+static int retr_ascii_ignored = -1;
+
 static int xfer_check_limit(cmd_rec *);
 
 /* TransferOptions */
 #define PR_XFER_OPT_HANDLE_ALLO		0x0001
 #define PR_XFER_OPT_IGNORE_ASCII	0x0002
+#define PR_XFER_OPT_ADAPTIVE_BUFSZ	0x0004
 static unsigned long xfer_opts = PR_XFER_OPT_HANDLE_ALLO;
 
 /* Transfer priority */
@@ -577,6 +599,118 @@ static int xfer_parse_cmdlist(const char *name, config_rec *c,
   return 0;
 }
 
+/* Ask the kernel to start reading the next few buffers' worth of the file
+ * being downloaded, so that the disk I/O for those buffers overlaps the
+ * network write of the current buffer.  New advice is only issued once half
+ * of the advised window has been consumed, to avoid one extra syscall per
+ * buffer.
+ */
+static void transmit_readahead(size_t bufsz) {
+  int fd;
+  off_t window, len;
+
+  if (xfer_readahead == 0 ||
+      retr_fh == NULL) {
+    return;
+  }
+
+  fd = retr_ascii_fd >= 0 ? retr_ascii_fd : PR_FH_FD(retr_fh);
+  if (fd < 0) {
+    return;
+  }
+
+  window = (off_t) xfer_readahead * bufsz;
+  if (retr_readahead_end - retr_read_pos > (window / 2)) {
+    return;
+  }
+
+  if (retr_readahead_end < retr_read_pos) {
+    retr_readahead_end = retr_read_pos;
+  }
+
+  len = (retr_read_pos + window) - retr_readahead_end;
+  if (session.xfer.file_size > 0 &&
+      retr_readahead_end + len > session.xfer.file_size) {
+    len = session.xfer.file_size - retr_readahead_end;
+  }
+
+  if (len <= 0) {
+    return;
+  }
+
+  pr_trace_msg(trace_channel, 19, "advising readahead of %" PR_LU
+    " bytes at offset %" PR_LU " for '%s'", (pr_off_t) len,
+    (pr_off_t) retr_readahead_end, retr_fh->fh_path);
+  pr_fs_fadvise(fd, retr_ascii_offset + retr_readahead_end, len,
+    PR_FS_FADVISE_WILLNEED);
+  retr_readahead_end += len;
+}
+
+/* With the AdaptiveBufferSize TransferOption, the data transfer layer may
+ * change its buffer size during a transfer; keep our buffer the same size.
+ */
+static char *xfer_adapt_buf(pool *p, pool **buf_pool, char *buf,
+    long *bufsz) {
+
+  if (!(xfer_opts & PR_XFER_OPT_ADAPTIVE_BUFSZ) ||
+      session.range_len > 0 ||
+      session.xfer.bufsize == (size_t) *bufsz) {
+    return buf;
+  }
+
+  if (*buf_pool != NULL) {
+    destroy_pool(*buf_pool);
+  }
+
+  *buf_pool = make_sub_pool(p);
+  pr_pool_tag(*buf_pool, "transfer buffer pool");
+
+  *bufsz = session.xfer.bufsize;
+  buf = palloc(*buf_pool, *bufsz);
+  pr_trace_msg("data", 8, "reallocated transfer buffer of %lu bytes",
+    (unsigned long) *bufsz);
+
+  return buf;
+}
+
+/* Translates the data read for an ASCII download ourselves, so that the
+ * translated bytes can be captured into the ASCIICache as they are sent.
+ * As pr_data_xfer() does when it translates, the number of bytes of the
+ * file consumed is returned.
+ */
+static int transmit_ascii_capture(pool *p, char *buf, size_t buflen) {
+  pool *tmp_pool;
+  char *out = NULL;
+  size_t outlen = 0;
+  int res, xerrno;
+
+  tmp_pool = make_sub_pool(p);
+  pr_pool_tag(tmp_pool, "ASCII capture pool");
+
+  res = pr_ascii_ftp_to_crlf(tmp_pool, buf, buflen, &out, &outlen);
+  if (res < 0) {
+    xerrno = errno;
+
+    destroy_pool(tmp_pool);
+    errno = xerrno;
+    return -1;
+  }
+
+  (void) pr_asciicache_write(out, outlen);
+
+  res = pr_data_xfer(out, outlen);
+  xerrno = errno;
+
+  destroy_pool(tmp_pool);
+
+  if (res < 0) {
+    errno = xerrno;
+    return -1;
+  }
+
+  return (int) buflen;
+}
+
 static int transmit_normal(pool *p, char *buf, size_t bufsz) {
   long nread;
   size_t read_len;
@@ -588,7 +722,15 @@ static int transmit_normal(pool *p, char *buf, size_t bufsz) {
     }
   }
 
-  nread = pr_fsio_read(retr_fh, buf, read_len);
+  transmit_readahead(bufsz);
+
+  if (retr_ascii_fd >= 0) {
+    nread = read(retr_ascii_fd, buf, read_len);
+
+  } else {
+    nread = pr_fsio_read(retr_fh, buf, read_len);
+  }
+
   if (nread < 0) {
     int xerrno = errno;
 
@@ -605,26 +747,50 @@ static int transmit_normal(pool *p, char *buf, size_t bufsz) {
     return 0;
   }
 
+  retr_read_pos += nread;
+
+  if (retr_ascii_capture == TRUE) {
+    return transmit_ascii_capture(p, buf, nread);
+  }
+
   return pr_data_xfer(buf, nread);
 }
 
 #ifdef HAVE_SENDFILE
+/* Returns TRUE if the data channel protection (e.g. TLS) is done by the
+ * kernel, such that sendfile(2) can still be used.
+ */
+static int xfer_have_kernel_tx(void) {
+  if (session.d == NULL ||
+      session.d->outstrm == NULL) {
+    return FALSE;
+  }
+
+  if (pr_table_exists(session.d->outstrm->notes,
+      PR_NETIO_NOTE_KERNEL_TX) > 0) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
 static int transmit_sendfile(off_t data_len, off_t *data_offset,
     pr_sendfile_t *sent_len) {
   off_t send_len;
 
   /* We don't use sendfile() if:
    * - We're using bandwidth throttling.
-   * - We're transmitting an ASCII file.
-   * - We're using RFC2228 data channel protection
+   * - We're transmitting an ASCII file, other than from the ASCIICache.
+   * - We're using RFC2228 data channel protection, other than kernel TLS
    * - We're using MODE Z compression
    * - There's no data left to transmit.
    * - UseSendfile is set to off.
    */
   if (pr_throttle_have_rate() ||
      !(session.xfer.file_size - data_len) ||
-     (session.sf_flags & (SF_ASCII|SF_ASCII_OVERRIDE)) ||
-     have_rfc2228_data || have_zmode ||
+     ((session.sf_flags & (SF_ASCII|SF_ASCII_OVERRIDE)) &&
+      retr_ascii_fd < 0) ||
+     (have_rfc2228_data && !xfer_have_kernel_tx()) || have_zmode ||
      !use_sendfile) {
 
     if (!xfer_logged_sendfile_decline_msg) {
@@ -636,10 +802,12 @@ static int transmit_sendfile(off_t data_len, off_t *data_offset,
         pr_log_debug(DEBUG10, "declining use of sendfile due to TransferRate "
           "restrictions");
     
-      } else if (session.sf_flags & (SF_ASCII|SF_ASCII_OVERRIDE)) {
+      } else if ((session.sf_flags & (SF_ASCII|SF_ASCII_OVERRIDE)) &&
+                 retr_ascii_fd < 0) {
         pr_log_debug(DEBUG10, "declining use of sendfile for ASCII data");
 
-      } else if (have_rfc2228_data) {
+      } else if (have_rfc2228_data &&
+                 !xfer_have_kernel_tx()) {
         pr_log_debug(DEBUG10, "declining use of sendfile due to RFC2228 data "
           "channel protections");
 
@@ -694,7 +862,9 @@ static int transmit_sendfile(off_t data_len, off_t *data_offset,
   }
 
  retry:
-  *sent_len = pr_data_sendfile(PR_FH_FD(retr_fh), data_offset, send_len);
+  *sent_len = pr_data_sendfile(
+    retr_ascii_fd >= 0 ? retr_ascii_fd : PR_FH_FD(retr_fh), data_offset,
+    send_len);
 
   if (*sent_len == -1) {
     int xerrno = errno;
@@ -820,6 +990,58 @@ static long transmit_data(pool *p, off_t data_len, off_t *data_offset,
   return res;
 }
 
+/* Determine whether we can receive uploaded data directly into the file,
+ * via pr_data_recvfile(), rather than copying it through userspace.  We
+ * don't do so if:
+ * - UseSendfile is set to off.
+ * - We're receiving an ASCII file.
+ * - We're using RFC2228 data channel protection, or MODE Z compression.
+ * - Some other module has registered a NetIO for the data connection, or
+ *   is listening for data read events.
+ * - The file is handled by a module-provided FSIO.
+ * - MaxStoreFileSize is in effect; the limit is checked before writing.
+ */
+static int stor_use_recvfile(cmd_rec *cmd, int have_limit) {
+  config_rec *c;
+  const char *reason = NULL;
+
+  c = find_config(CURRENT_CONF, CONF_PARAM, "UseSendfile", FALSE);
+  if (c != NULL &&
+      *((unsigned char *) c->argv[0]) == FALSE) {
+    reason = "UseSendfile configuration setting";
+
+  } else if (session.sf_flags & (SF_ASCII|SF_ASCII_OVERRIDE)) {
+    reason = "ASCII data";
+
+  } else if (have_rfc2228_data) {
+    reason = "RFC2228 data channel protections";
+
+  } else if (have_zmode) {
+    reason = "MODE Z restrictions";
+
+  } else if (pr_get_netio(PR_NETIO_STRM_DATA) != NULL ||
+             pr_event_listening("core.data-read") > 0) {
+    reason = "data connection NetIO/event handlers";
+
+  } else if (stor_fh->fh_fs != NULL &&
+             strcmp(stor_fh->fh_fs->fs_name, "system") != 0) {
+    reason = pstrcat(cmd->tmp_pool, "'", stor_fh->fh_fs->fs_name,
+      "' FSIO handler", NULL);
+
+  } else if (have_limit) {
+    reason = "MaxStoreFileSize restrictions";
+  }
+
+  if (reason != NULL) {
+    pr_log_debug(DEBUG10, "declining use of splice for receiving data due "
+      "to %s", reason);
+    return FALSE;
+  }
+
+  pr_log_debug(DEBUG10, "using splice capability for receiving data");
+  return TRUE;
+}
+
 static void stor_chown(pool *p) {
   struct stat st;
   const char *xfer_path = NULL;
@@ -952,9 +1174,30 @@ static void stor_chown(pool *p) {
   }
 }
 
+static void retr_ascii_reset(void) {
+  if (retr_ascii_fd >= 0) {
+    (void) close(retr_ascii_fd);
+    retr_ascii_fd = -1;
+  }
+
+  if (retr_ascii_capture == TRUE) {
+    pr_asciicache_discard();
+    retr_ascii_capture = FALSE;
+  }
+
+  if (retr_ascii_ignored >= 0) {
+    pr_data_ignore_ascii(retr_ascii_ignored);
+    retr_ascii_ignored = -1;
+  }
+
+  retr_ascii_offset = 0;
+}
+
 static void retr_abort(void) {
   /* Isn't necessary to send anything here, just cleanup */
 
+  retr_ascii_reset();
+
   if (retr_fh) {
     pr_fsio_close(retr_fh);
     retr_fh = NULL;
@@ -964,6 +1207,24 @@ static void retr_abort(void) {
 }
 
 static void retr_complete(void) {
+  if (retr_ascii_capture == TRUE) {
+    struct stat st;
+
+    /* Only a copy of the whole, unchanged file is kept. */
+    if (retr_read_pos == session.xfer.file_size &&
+        pr_fsio_fstat(retr_fh, &st) == 0) {
+      if (pr_asciicache_commit(&st) == 0) {
+        pr_log_debug(DEBUG8, "ASCIICache: cached translated copy of '%s'",
+          retr_fh->fh_path);
+      }
+
+      retr_ascii_capture = FALSE;
+    }
+  }
+
+  /* Any capture not committed above is discarded here. */
+  retr_ascii_reset();
+
   pr_fsio_close(retr_fh);
   retr_fh = NULL;
 }
@@ -1379,6 +1640,24 @@ MODRET xfer_pre_stor(cmd_rec *cmd) {
     return PR_ERROR(cmd);
   }
 
+  /* A REST position accepted in ASCII mode (see xfer_rest()) counts
+   * translated bytes, which cannot be mapped onto an upload.
+   */
+  if (use_asciicache == TRUE &&
+      (session.sf_flags & SF_ASCII) &&
+      session.restart_pos > 0 &&
+      !(xfer_opts & PR_XFER_OPT_IGNORE_ASCII)) {
+    pr_log_debug(DEBUG5, "%s not allowed in ASCII mode", C_REST);
+    pr_response_add_err(R_501,
+      _("%s: Resuming transfers not allowed in ASCII mode"), C_REST);
+    session.restart_pos = 0L;
+    session.xfer.xfer_type = STOR_DEFAULT;
+
+    pr_cmd_set_errno(cmd, EPERM);
+    errno = EPERM;
+    return PR_ERROR(cmd);
+  }
+
   /* Reject APPE preceded by RANG. */
   if (session.xfer.xfer_type == STOR_APPEND &&
       session.range_len > 0) {
@@ -1719,12 +1998,16 @@ MODRET xfer_pre_appe(cmd_rec *cmd) {
 MODRET xfer_stor(cmd_rec *cmd) {
   const char *path;
   char *lbuf;
-  int bufsz, len, xerrno = 0, res;
+  int len, xerrno = 0, res;
+  long bufsz;
+  size_t *xfer_bufsz;
+  pool *lbuf_pool = NULL;
   off_t nbytes_stored, nbytes_max_store = 0;
   unsigned char have_limit = FALSE;
   struct stat st;
   off_t start_offset = 0, upload_len = 0;
   off_t curr_offset, curr_pos = 0;
+  int use_recvfile;
 
   memset(&st, 0, sizeof(st));
 
@@ -1992,7 +2275,47 @@ MODRET xfer_stor(cmd_rec *cmd) {
   pr_trace_msg("data", 8, "allocated upload buffer of %lu bytes",
     (unsigned long) bufsz);
 
-  while ((len = pr_data_xfer(lbuf, bufsz)) > 0) {
+  xfer_bufsz = palloc(cmd->pool, sizeof(size_t));
+  *xfer_bufsz = bufsz;
+  (void) pr_table_add(cmd->notes, "mod_xfer.buffer-size", xfer_bufsz,
+    sizeof(size_t));
+
+  use_recvfile = stor_use_recvfile(cmd, have_limit);
+
+  while (TRUE) {
+    int spliced = FALSE;
+
+    lbuf = xfer_adapt_buf(cmd->tmp_pool, &lbuf_pool, lbuf, &bufsz);
+    *xfer_bufsz = bufsz;
+
+    if (use_recvfile) {
+      size_t recv_len;
+
+      recv_len = bufsz;
+      if (session.range_len > 0 &&
+          (off_t) recv_len > (upload_len - nbytes_stored)) {
+        recv_len = (size_t) (upload_len - nbytes_stored);
+      }
+
+      len = pr_data_recvfile(PR_FH_FD(stor_fh), recv_len);
+      if (len < 0 &&
+          errno == ENOSYS) {
+        pr_log_debug(DEBUG10, "splice unavailable for receiving data, "
+          "falling back to normal data transmission");
+        use_recvfile = FALSE;
+        continue;
+      }
+
+      spliced = TRUE;
+
+    } else {
+      len = pr_data_xfer(lbuf, bufsz);
+    }
+
+    if (len <= 0) {
+      break;
+    }
+
     pr_signals_handle();
 
     if (XFER_ABORTED) {
@@ -2033,7 +2356,7 @@ MODRET xfer_stor(cmd_rec *cmd) {
      * be doing short writes, and we ideally should be more resilient/graceful
      * in the face of such things.
      */
-    res = pr_fsio_write(stor_fh, lbuf, len);
+    res = spliced ? len : pr_fsio_write(stor_fh, lbuf, len);
     if (res != len) {
       xerrno = EIO;
 
@@ -2195,6 +2518,30 @@ MODRET xfer_stor(cmd_rec *cmd) {
     session.xfer.path_hidden = NULL;
   }
 
+  if (use_recvfile) {
+    off_t recv_nbytes = 0;
+    unsigned long recv_ncalls = 0;
+
+    if (pr_data_get_recvfile_stats(&recv_nbytes, &recv_ncalls) == 0) {
+      off_t *splice_bytes;
+      unsigned long *splice_calls;
+
+      pr_log_debug(DEBUG10, "received %" PR_LU " bytes using %lu splice "
+        "calls", (pr_off_t) recv_nbytes, recv_ncalls);
+
+      /* Stash these counters for any interested logging modules. */
+      splice_bytes = palloc(cmd->pool, sizeof(off_t));
+      *splice_bytes = recv_nbytes;
+      (void) pr_table_add(cmd->notes, "mod_xfer.splice-bytes", splice_bytes,
+        sizeof(off_t));
+
+      splice_calls = palloc(cmd->pool, sizeof(unsigned long));
+      *splice_calls = recv_ncalls;
+      (void) pr_table_add(cmd->notes, "mod_xfer.splice-calls", splice_calls,
+        sizeof(unsigned long));
+    }
+  }
+
   xfer_displayfile();
   pr_data_close(FALSE);
 
@@ -2261,10 +2608,15 @@ MODRET xfer_rest(cmd_rec *cmd) {
    * server by sending "REST 0" to see if the server supports REST, without
    * regard to the transfer type.  This, then, is a hack to handle such
    * clients.
+   *
+   * With an ASCIICache, a nonzero position is accepted, as an offset into
+   * the translated file; RETR refuses it if there is no cached translated
+   * copy, and uploads refuse it always.
    */
   if ((session.sf_flags & SF_ASCII) &&
       pos != 0 &&
-      !(xfer_opts & PR_XFER_OPT_IGNORE_ASCII)) {
+      !(xfer_opts & PR_XFER_OPT_IGNORE_ASCII) &&
+      use_asciicache == FALSE) {
     pr_log_debug(DEBUG5, "%s not allowed in ASCII mode", (char *) cmd->argv[0]);
     pr_response_add_err(R_501,
       _("%s: Resuming transfers not allowed in ASCII mode"),
@@ -2470,6 +2822,14 @@ MODRET xfer_pre_retr(cmd_rec *cmd) {
     use_sendfile_pct = *((float *) c->argv[2]);
   }
 
+  /* Check for TransferReadahead. */
+  xfer_readahead = PR_TUNABLE_XFER_READAHEAD;
+
+  c = find_config(CURRENT_CONF, CONF_PARAM, "TransferReadahead", FALSE);
+  if (c != NULL) {
+    xfer_readahead = *((unsigned int *) c->argv[0]);
+  }
+
   if (xfer_check_limit(cmd) < 0) {
     pr_response_add_err(R_451, _("%s: Too many transfers"), cmd->arg);
 
@@ -2558,7 +2918,9 @@ MODRET xfer_retr(cmd_rec *cmd) {
   off_t nbytes_max_retrieve = 0;
   unsigned char have_limit = FALSE;
   long bufsz, len = 0;
-  off_t start_offset = 0, download_len = 0;
+  size_t *xfer_bufsz;
+  pool *lbuf_pool = NULL;
+  off_t start_offset = 0, download_len = 0, file_size = 0;
   off_t curr_offset, curr_pos = 0, nbytes_sent = 0, cnt_steps = 0, cnt_next = 0;
 
   /* Prepare for any potential throttling. */
@@ -2609,6 +2971,61 @@ MODRET xfer_retr(cmd_rec *cmd) {
     start_offset = session.range_start;
   }
 
+  /* For an ASCII download, use the cached translated copy of the file, if
+   * there is one; a REST offset then counts translated bytes.  Otherwise,
+   * a translated copy of the whole file is captured as it is sent.
+   */
+  file_size = st.st_size;
+  if (use_asciicache == TRUE &&
+      (session.sf_flags & SF_ASCII) &&
+      !(xfer_opts & PR_XFER_OPT_IGNORE_ASCII) &&
+      session.range_start == 0 &&
+      session.range_len == 0) {
+    off_t ascii_len = 0;
+
+    retr_ascii_fd = pr_asciicache_get(&st, &retr_ascii_offset, &ascii_len);
+    if (retr_ascii_fd >= 0 &&
+        start_offset <= ascii_len &&
+        lseek(retr_ascii_fd, retr_ascii_offset + start_offset,
+          SEEK_SET) == (off_t) -1) {
+      pr_log_debug(DEBUG3, "ASCIICache: error seeking translated copy of "
+        "'%s': %s", dir, strerror(errno));
+      retr_ascii_reset();
+    }
+
+    if (retr_ascii_fd >= 0) {
+      pr_log_debug(DEBUG8, "ASCIICache: using translated copy of '%s'", dir);
+      file_size = ascii_len;
+      retr_ascii_ignored = pr_data_ignore_ascii(TRUE);
+
+    } else if (start_offset == 0 &&
+               st.st_size >= asciicache_min_size &&
+               pr_asciicache_capture(dir, &st) == 0) {
+      retr_ascii_capture = TRUE;
+      retr_ascii_ignored = pr_data_ignore_ascii(TRUE);
+    }
+
+    /* Without a translated copy, a REST offset, given in translated bytes,
+     * cannot be mapped onto the file.
+     */
+    if (retr_ascii_fd < 0 &&
+        session.restart_pos > 0) {
+      pr_log_debug(DEBUG5, "%s not allowed in ASCII mode without a cached "
+        "translated copy of '%s'", C_REST, dir);
+      pr_response_add_err(R_554,
+        _("%s: Resuming transfers not allowed in ASCII mode"), C_REST);
+      session.restart_pos = 0L;
+
+      retr_ascii_reset();
+      pr_fsio_close(retr_fh);
+      retr_fh = NULL;
+
+      pr_cmd_set_errno(cmd, EPERM);
+      errno = EPERM;
+      return PR_ERROR(cmd);
+    }
+  }
+
   if (start_offset > 0) {
     char *offset_cmd;
 
@@ -2621,12 +3038,13 @@ MODRET xfer_retr(cmd_rec *cmd) {
      * file being resumed).
      */
 
-    if (start_offset > st.st_size) {
+    if (start_offset > file_size) {
       pr_trace_msg(trace_channel, 4,
         "%s offset %" PR_LU " exceeds file size (%" PR_LU " bytes)",
-        offset_cmd, (pr_off_t) start_offset, (pr_off_t) st.st_size);
+        offset_cmd, (pr_off_t) start_offset, (pr_off_t) file_size);
       pr_response_add_err(R_554, _("%s: invalid %s argument"), offset_cmd,
         cmd->arg);
+      retr_ascii_reset();
       pr_fsio_close(retr_fh);
       retr_fh = NULL;
 
@@ -2649,12 +3067,13 @@ MODRET xfer_retr(cmd_rec *cmd) {
      * experience.  So instead, we return an error in this case.
      */
 
-    if ((start_offset + session.range_len) > st.st_size) {
+    if ((start_offset + session.range_len) > file_size) {
       pr_trace_msg(trace_channel, 4,
         "%s offset %" PR_LU " exceeds file size (%" PR_LU " bytes)",
         offset_cmd, (pr_off_t) (start_offset + session.range_len),
-        (pr_off_t) st.st_size);
+        (pr_off_t) file_size);
       pr_response_add_err(R_554, _("%s: invalid RANG argument"), cmd->arg);
+      retr_ascii_reset();
       pr_fsio_close(retr_fh);
       retr_fh = NULL;
 
@@ -2663,7 +3082,9 @@ MODRET xfer_retr(cmd_rec *cmd) {
       return PR_ERROR(cmd);
     }
 
-    if (pr_fsio_lseek(retr_fh, start_offset, SEEK_SET) == (off_t) -1) {
+    /* A cached translated copy has already been positioned. */
+    if (retr_ascii_fd < 0 &&
+        pr_fsio_lseek(retr_fh, start_offset, SEEK_SET) == (off_t) -1) {
       int xerrno = errno;
       pr_fsio_close(retr_fh);
       errno = xerrno;
@@ -2696,7 +3117,13 @@ MODRET xfer_retr(cmd_rec *cmd) {
   }
 
   /* Stash the offset at which we're writing from this file. */
-  curr_offset = pr_fsio_lseek(retr_fh, (off_t) 0, SEEK_CUR);
+  if (retr_ascii_fd >= 0) {
+    curr_offset = start_offset;
+
+  } else {
+    curr_offset = pr_fsio_lseek(retr_fh, (off_t) 0, SEEK_CUR);
+  }
+
   if (curr_offset != (off_t) -1) {
     off_t *file_offset;
 
@@ -2704,6 +3131,11 @@ MODRET xfer_retr(cmd_rec *cmd) {
     *file_offset = (off_t) curr_offset;
     (void) pr_table_add(cmd->notes, "mod_xfer.file-offset", file_offset,
       sizeof(off_t));
+
+    retr_read_pos = retr_readahead_end = curr_offset;
+
+  } else {
+    retr_read_pos = retr_readahead_end = 0;
   }
 
   /* Block any timers for this section, where we want to prepare the
@@ -2717,7 +3149,7 @@ MODRET xfer_retr(cmd_rec *cmd) {
   pr_data_init(cmd->arg, PR_NETIO_IO_WR);
 
   session.xfer.path = dir;
-  session.xfer.file_size = st.st_size;
+  session.xfer.file_size = file_size;
 
   pr_alarms_unblock();
 
@@ -2727,20 +3159,23 @@ MODRET xfer_retr(cmd_rec *cmd) {
   }
 
   if (session.range_len > 0) {
-    if (curr_pos + session.range_len > st.st_size) {
+    if (curr_pos + session.range_len > file_size) {
       /* If the RANG end point is past the end of our file, ignore it and
        * treat this as the remainder of the file, from the starting offset.
        */
-      download_len = st.st_size - curr_pos;
+      download_len = file_size - curr_pos;
 
     } else {
       download_len = session.range_len;
     }
 
   } else {
-    download_len = st.st_size - curr_pos;
+    download_len = file_size - curr_pos;
   }
 
+  /* The sendfile(2) offset into a translated copy is past its header. */
+  curr_pos += retr_ascii_offset;
+
   if (pr_data_open(cmd->arg, NULL, PR_NETIO_IO_WR, download_len) < 0) {
     int xerrno = errno;
 
@@ -2799,6 +3234,11 @@ MODRET xfer_retr(cmd_rec *cmd) {
     }
   }
 
+  xfer_bufsz = palloc(cmd->pool, sizeof(size_t));
+  *xfer_bufsz = bufsz;
+  (void) pr_table_add(cmd->notes, "mod_xfer.buffer-size", xfer_bufsz,
+    sizeof(size_t));
+
   while (nbytes_sent != download_len) {
     pr_signals_handle();
 
@@ -2806,6 +3246,9 @@ MODRET xfer_retr(cmd_rec *cmd) {
       break;
     }
 
+    lbuf = xfer_adapt_buf(cmd->tmp_pool, &lbuf_pool, lbuf, &bufsz);
+    *xfer_bufsz = bufsz;
+
     len = transmit_data(cmd->pool, curr_offset, &curr_pos, lbuf, bufsz);
     if (len == 0) {
       break;
@@ -3345,6 +3788,12 @@ MODRET xfer_post_pass(cmd_rec *cmd) {
     pr_data_ignore_ascii(TRUE);
   }
 
+  if (xfer_opts & PR_XFER_OPT_ADAPTIVE_BUFSZ) {
+    pr_log_debug(DEBUG8, "Using adaptive transfer buffer sizes for this "
+      "session");
+    pr_data_adaptive_bufsz(TRUE);
+  }
+
   /* Check for TransferPriority. */
   c = find_config(TOPLEVEL_CONF, CONF_PARAM, "TransferPriority", FALSE);
   if (c) {
@@ -3405,6 +3854,40 @@ MODRET set_allowrestart(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: ASCIICache path [min-size [units]] */
+MODRET set_asciicache(cmd_rec *cmd) {
+  config_rec *c;
+  off_t min_size = PR_TUNABLE_ASCIICACHE_MIN_SIZE;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 4) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  if (pr_fs_valid_path(cmd->argv[1]) < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "'", cmd->argv[1],
+      "' is not a valid path", NULL));
+  }
+
+  if (cmd->argc > 2) {
+    if (pr_str_get_nbytes(cmd->argv[2], cmd->argc == 4 ? cmd->argv[3] : NULL,
+        &min_size) < 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unable to parse: ",
+        cmd->argv[2], " ", cmd->argc == 4 ? cmd->argv[3] : "", ": ",
+        strerror(errno), NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pstrdup(c->pool, cmd->argv[1]);
+  c->argv[1] = pcalloc(c->pool, sizeof(off_t));
+  *((off_t *) c->argv[1]) = min_size;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: DefaultTransferMode ascii|binary */
 MODRET set_defaulttransfermode(cmd_rec *cmd) {
   char *default_mode;
@@ -3801,6 +4284,9 @@ MODRET set_transferoptions(cmd_rec *cmd) {
     if (strcasecmp(cmd->argv[i], "IgnoreASCII") == 0) {
       opts |= PR_XFER_OPT_IGNORE_ASCII;
 
+    } else if (strcasecmp(cmd->argv[i], "AdaptiveBufferSize") == 0) {
+      opts |= PR_XFER_OPT_ADAPTIVE_BUFSZ;
+
     } else {
       CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown TransferOption '",
         cmd->argv[i], "'", NULL));
@@ -4029,6 +4515,45 @@ MODRET set_transferrate(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: TransferReadahead count|"off" */
+MODRET set_transferreadahead(cmd_rec *cmd) {
+  int bool;
+  unsigned int count = 0;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL|CONF_ANON|CONF_DIR);
+
+  bool = get_boolean(cmd, 1);
+  if (bool == -1) {
+    char *ptr = NULL;
+    long res;
+
+    res = strtol(cmd->argv[1], &ptr, 10);
+    if (ptr && *ptr) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid count '",
+        cmd->argv[1], "'", NULL));
+    }
+
+    if (res < 0 ||
+        res > 256) {
+      CONF_ERROR(cmd, "count must be between 0 and 256");
+    }
+
+    count = (unsigned int) res;
+
+  } else if (bool == TRUE) {
+    count = PR_TUNABLE_XFER_READAHEAD;
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = count;
+  c->flags |= CF_MERGEDOWN;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: UseSendfile on|off|"len units"|percentage"%" */
 MODRET set_usesendfile(cmd_rec *cmd) {
   int bool = -1;
@@ -4218,6 +4743,31 @@ static void xfer_timeout_stalled_ev(const void *event_data, void *user_data) {
   }
 }
 
+/* Translated copies cached under the previous configuration may no longer
+ * be valid, e.g. because of changed paths.
+ */
+static void xfer_postparse_ev(const void *event_data, void *user_data) {
+  server_rec *s;
+
+  if (ServerType == SERVER_INETD) {
+    return;
+  }
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    config_rec *c;
+
+    c = find_config(s->conf, CONF_PARAM, "ASCIICache", FALSE);
+    if (c == NULL) {
+      continue;
+    }
+
+    if (pr_asciicache_clear(c->argv[0]) < 0) {
+      pr_log_pri(PR_LOG_WARNING, "ASCIICache: unable to prepare '%s': %s",
+        (char *) c->argv[0], strerror(errno));
+    }
+  }
+}
+
 /* Initialization routines
  */
 
@@ -4240,10 +4790,13 @@ static int xfer_init(void) {
    */
   pr_feat_add(C_RANG " STREAM");
 
+  pr_event_register(&xfer_module, "core.postparse", xfer_postparse_ev, NULL);
+
   return 0;
 }
 
 static int xfer_sess_init(void) {
+  config_rec *c;
   char *displayfilexfer = NULL;
 
   /* Exit handlers for HiddenStores cleanup */
@@ -4259,6 +4812,24 @@ static int xfer_sess_init(void) {
 
   have_type = FALSE;
 
+  /* The ASCIICache directory needs to be opened now, before any chroot(2). */
+  if (use_asciicache == TRUE) {
+    (void) pr_asciicache_close();
+    use_asciicache = FALSE;
+  }
+
+  c = find_config(main_server->conf, CONF_PARAM, "ASCIICache", FALSE);
+  if (c != NULL) {
+    if (pr_asciicache_open(c->argv[0]) < 0) {
+      pr_log_debug(DEBUG2, "ASCIICache: unable to use '%s': %s",
+        (char *) c->argv[0], strerror(errno));
+
+    } else {
+      asciicache_min_size = *((off_t *) c->argv[1]);
+      use_asciicache = TRUE;
+    }
+  }
+
   /* Look for a DisplayFileTransfer file which has an absolute path.  If we
    * find one, open a filehandle, such that that file can be displayed
    * even if the session is chrooted.  DisplayFileTransfer files with
@@ -4316,6 +4887,7 @@ static conftable xfer_conftab[] = {
   { "AllowOverwrite",		set_allowoverwrite,		NULL },
   { "AllowRetrieveRestart",	set_allowrestart,		NULL },
   { "AllowStoreRestart",	set_allowrestart,		NULL },
+  { "ASCIICache",		set_asciicache,			NULL },
   { "DefaultTransferMode",	set_defaulttransfermode,	NULL },
   { "DeleteAbortedStores",	set_deleteabortedstores,	NULL },
   { "DisplayFileTransfer",	set_displayfiletransfer,	NULL },
@@ -4329,6 +4901,7 @@ static conftable xfer_conftab[] = {
   { "TimeoutStalled",		set_timeoutstalled,		NULL },
   { "TransferOptions",		set_transferoptions,		NULL },
   { "TransferPriority",		set_transferpriority,		NULL },
+  { "TransferReadahead",	set_transferreadahead,		NULL },
   { "TransferRate",		set_transferrate,		NULL },
   { "UseSendfile",		set_usesendfile,		NULL },
 
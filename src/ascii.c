@@ -26,10 +26,220 @@
 
 #include "conf.h"
 
+/* On x86, the buffers are scanned using SSE2 or AVX2 compares, if the CPU
+ * supports them; the target attributes let these functions be compiled
+ * without changing the flags used for the rest of the server.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+# define PR_ASCII_USE_X86_SIMD
+# include <immintrin.h>
+#endif
+
+static int ascii_impl = PR_ASCII_IMPL_AUTO;
+
+/* Returns the offset of the first CR in the buffer, or the buffer length if
+ * there is none.
+ */
+static size_t (*ascii_find_cr)(const char *buf, size_t len) = NULL;
+
+/* Returns the offset, at or after the given start (which must be at least
+ * 1), of the first LF which is not preceded by a CR, or the buffer length if
+ * there is none.
+ */
+static size_t (*ascii_find_bare_lf)(const char *buf, size_t start,
+  size_t len) = NULL;
+
+static size_t ascii_find_cr_scalar(const char *buf, size_t len) {
+  const char *ptr;
+
+  ptr = memchr(buf, '\r', len);
+  return (ptr != NULL ? (size_t) (ptr - buf) : len);
+}
+
+static size_t ascii_find_bare_lf_scalar(const char *buf, size_t start,
+    size_t len) {
+  register size_t i;
+
+  for (i = start; i < len; i++) {
+    if (buf[i] == '\n' &&
+        buf[i-1] != '\r') {
+      return i;
+    }
+  }
+
+  return len;
+}
+
+#ifdef PR_ASCII_USE_X86_SIMD
+__attribute__((target("sse2")))
+static size_t ascii_find_cr_sse2(const char *buf, size_t len) {
+  const __m128i cr = _mm_set1_epi8('\r');
+  size_t i = 0;
+
+  while (i + 16 <= len) {
+    __m128i v;
+    unsigned int mask;
+
+    v = _mm_loadu_si128((const __m128i *) (buf + i));
+    mask = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, cr));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+
+    i += 16;
+  }
+
+  return i + ascii_find_cr_scalar(buf + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static size_t ascii_find_bare_lf_sse2(const char *buf, size_t start,
+    size_t len) {
+  const __m128i cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n');
+  size_t i = start;
+
+  /* Each LF is compared against the byte before it, via a second load
+   * offset by one byte.
+   */
+  while (i + 16 <= len) {
+    __m128i v, prev;
+    unsigned int mask;
+
+    v = _mm_loadu_si128((const __m128i *) (buf + i));
+    prev = _mm_loadu_si128((const __m128i *) (buf + i - 1));
+    mask = (unsigned int) _mm_movemask_epi8(
+      _mm_andnot_si128(_mm_cmpeq_epi8(prev, cr), _mm_cmpeq_epi8(v, lf)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+
+    i += 16;
+  }
+
+  return ascii_find_bare_lf_scalar(buf, i, len);
+}
+
+__attribute__((target("avx2")))
+static size_t ascii_find_cr_avx2(const char *buf, size_t len) {
+  const __m256i cr = _mm256_set1_epi8('\r');
+  size_t i = 0;
+
+  while (i + 32 <= len) {
+    __m256i v;
+    unsigned int mask;
+
+    v = _mm256_loadu_si256((const __m256i *) (buf + i));
+    mask = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, cr));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+
+    i += 32;
+  }
+
+  return i + ascii_find_cr_scalar(buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t ascii_find_bare_lf_avx2(const char *buf, size_t start,
+    size_t len) {
+  const __m256i cr = _mm256_set1_epi8('\r'), lf = _mm256_set1_epi8('\n');
+  size_t i = start;
+
+  while (i + 32 <= len) {
+    __m256i v, prev;
+    unsigned int mask;
+
+    v = _mm256_loadu_si256((const __m256i *) (buf + i));
+    prev = _mm256_loadu_si256((const __m256i *) (buf + i - 1));
+    mask = (unsigned int) _mm256_movemask_epi8(
+      _mm256_andnot_si256(_mm256_cmpeq_epi8(prev, cr),
+        _mm256_cmpeq_epi8(v, lf)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+
+    i += 32;
+  }
+
+  return ascii_find_bare_lf_scalar(buf, i, len);
+}
+#endif /* PR_ASCII_USE_X86_SIMD */
+
+static int ascii_impl_supported(int impl) {
+  switch (impl) {
+    case PR_ASCII_IMPL_AUTO:
+    case PR_ASCII_IMPL_SCALAR:
+      return TRUE;
+
+#ifdef PR_ASCII_USE_X86_SIMD
+    case PR_ASCII_IMPL_SSE2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse2") ? TRUE : FALSE;
+
+    case PR_ASCII_IMPL_AVX2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+#endif /* PR_ASCII_USE_X86_SIMD */
+
+    default:
+      break;
+  }
+
+  return FALSE;
+}
+
+static void ascii_init_impl(void) {
+  int impl;
+
+  impl = ascii_impl;
+  if (impl == PR_ASCII_IMPL_AUTO) {
+    if (ascii_impl_supported(PR_ASCII_IMPL_AVX2)) {
+      impl = PR_ASCII_IMPL_AVX2;
+
+    } else if (ascii_impl_supported(PR_ASCII_IMPL_SSE2)) {
+      impl = PR_ASCII_IMPL_SSE2;
+
+    } else {
+      impl = PR_ASCII_IMPL_SCALAR;
+    }
+  }
+
+  switch (impl) {
+#ifdef PR_ASCII_USE_X86_SIMD
+    case PR_ASCII_IMPL_AVX2:
+      ascii_find_cr = ascii_find_cr_avx2;
+      ascii_find_bare_lf = ascii_find_bare_lf_avx2;
+      break;
+
+    case PR_ASCII_IMPL_SSE2:
+      ascii_find_cr = ascii_find_cr_sse2;
+      ascii_find_bare_lf = ascii_find_bare_lf_sse2;
+      break;
+#endif /* PR_ASCII_USE_X86_SIMD */
+
+    default:
+      ascii_find_cr = ascii_find_cr_scalar;
+      ascii_find_bare_lf = ascii_find_bare_lf_scalar;
+      break;
+  }
+}
+
+int pr_ascii_ftp_set_impl(int impl) {
+  if (ascii_impl_supported(impl) == FALSE) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  ascii_impl = impl;
+  ascii_init_impl();
+  return 0;
+}
+
 int pr_ascii_ftp_from_crlf(pool *p, char *in, size_t inlen, char **out,
     size_t *outlen) {
-  char *src, *dst;
-  size_t rem;
+  char *src, *dst, *end;
   int adj;
 
   (void) p;
@@ -46,32 +256,48 @@ int pr_ascii_ftp_from_crlf(pool *p, char *in, size_t inlen, char **out,
     return 0;
   }
 
+  if (ascii_find_cr == NULL) {
+    ascii_init_impl();
+  }
+
   src = in;
-  rem = inlen;
+  end = in + inlen;
   dst = *out;
   adj = 0;
 
-  while (rem--) {
-    if (*src != '\r') {
+  /* Copy the runs of bytes between CRs in bulk; the output may be the input
+   * buffer itself, hence memmove(3).
+   */
+  while (src < end) {
+    size_t run;
+
+    run = ascii_find_cr(src, end - src);
+    if (run > 0) {
+      if (dst != src) {
+        memmove(dst, src, run);
+      }
+
+      dst += run;
+      src += run;
+      *outlen += run;
+
+      if (src == end) {
+        break;
+      }
+    }
+
+    if (src + 1 == end) {
+      /* copy, but save it for later */
+      adj++;
       *dst++ = *src++;
-      (*outlen)++;
+
+    } else if (*(src+1) == '\n') {
+      /* Skip the CR. */
+      src++;
 
     } else {
-      if (rem == 0) {
-        /* copy, but save it for later */
-        adj++;
-        *dst++ = *src++;
-
-      } else {
-        if (*(src+1) == '\n') {
-          /* Skip the CR. */
-          src++;
-
-        } else {
-          *dst++ = *src++;
-          (*outlen)++;
-        }
-      }
+      *dst++ = *src++;
+      (*outlen)++;
     }
   }
 
@@ -85,9 +311,8 @@ static int have_dangling_cr = FALSE;
  */
 int pr_ascii_ftp_to_crlf(pool *p, char *in, size_t inlen, char **out,
     size_t *outlen) {
-  register unsigned int i = 0, j = 0;
   char *dst = NULL, *src;
-  size_t src_len, lf_pos;
+  size_t src_len, lf_pos, pos, i, j;
 
   if (p == NULL ||
       in == NULL ||
@@ -102,25 +327,22 @@ int pr_ascii_ftp_to_crlf(pool *p, char *in, size_t inlen, char **out,
     return 0;
   }
 
+  if (ascii_find_bare_lf == NULL) {
+    ascii_init_impl();
+  }
+
   src = in;
-  src_len = lf_pos = inlen;
+  src_len = inlen;
 
   /* First, determine the position of the first bare LF. */
   if (have_dangling_cr == FALSE &&
       src[0] == '\n') {
     lf_pos = 0;
-    goto found_lf;
-  }
 
-  for (i = 1; i < src_len; i++) {
-    if (src[i] == '\n' &&
-        src[i-1] != '\r') {
-      lf_pos = i;
-      break;
-    }
+  } else {
+    lf_pos = ascii_find_bare_lf(src, 1, src_len);
   }
 
-found_lf:
   /* If the last character in the buffer is CR, then we have a dangling CR.
    * The first character in the next buffer could be an LF, and without
    * this flag, that LF would be treated as a bare LF, thus resulting in
@@ -136,43 +358,29 @@ found_lf:
   }
 
   /* Assume the worst: a block containing only LF characters, needing twice
-   * the size for holding the corresponding CRs.
+   * the size for holding the corresponding CRs.  The caller's pool is
+   * expected to be short-lived.
    */
-  dst = malloc(src_len * 2);
-  if (dst == NULL) {
-    pr_log_pri(PR_LOG_ALERT, "Out of memory!");
-    exit(1);
-  }
+  dst = palloc(p, src_len * 2);
 
-  if (lf_pos > 0) {
-    memcpy(dst, src, lf_pos);
-    i = j = lf_pos;
-
-  } else {
-    dst[0] = '\r';
-    dst[1] = '\n';
-    i = 2;
-    j = 1;
+  /* Copy the runs between bare LFs in bulk, adding a CR before each LF. */
+  i = j = 0;
+  for (pos = lf_pos; pos < src_len;
+       pos = ascii_find_bare_lf(src, pos + 1, src_len)) {
+    memcpy(dst + i, src + j, pos - j);
+    i += (pos - j);
+    dst[i++] = '\r';
+    j = pos;
   }
 
-  while (j < src_len) {
-    if (src[j] == '\n' &&
-        src[j-1] != '\r') {
-      dst[i++] = '\r';
-    }
-
-    dst[i++] = src[j++];
-  }
+  memcpy(dst + i, src + j, src_len - j);
+  i += (src_len - j);
   pr_signals_handle();
 
+  *out = dst;
   *outlen = i;
-  *out = pcalloc(p, *outlen);
-  memcpy(*out, dst, i);
-
-  free(dst);
-  dst = NULL;
 
-  return i - j;
+  return (int) (i - src_len);
 }
 
 void pr_ascii_ftp_reset(void) {
@@ -0,0 +1,428 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* ASCII translation cache */
+
+#include "conf.h"
+
+#if defined(AT_FDCWD)
+
+#ifndef O_NOFOLLOW
+# define O_NOFOLLOW	0
+#endif
+
+/* A translated copy is a file in the UID's subdirectory of the cache
+ * directory (see cachedir.h), named for the device and inode numbers of the
+ * original file ("dev-ino", in hex), starting with this header, followed by
+ * the translated bytes.
+ */
+struct asciicache_header {
+  uint32_t magic;
+  uint32_t hdrlen;
+  uint64_t dev;
+  uint64_t ino;
+  int64_t size;
+  int64_t mtime;
+  int64_t ctime;
+  uint64_t datalen;
+};
+
+#define ASCIICACHE_MAGIC	0x70414331
+
+static pool *asciicache_pool = NULL;
+static pr_cachedir_t asciicache_dir = { -1, -1, (uid_t) -1 };
+
+/* The translated copy currently being captured, if any. */
+static int capture_fd = -1, capture_userfd = -1, capture_failed = FALSE;
+static char capture_tmp_name[64], capture_name[64];
+static const char *capture_path = NULL;
+static struct asciicache_header capture_hdr;
+
+static const char *trace_channel = "asciicache";
+
+static void asciicache_get_name(char *buf, size_t bufsz, dev_t dev,
+    ino_t ino) {
+  memset(buf, '\0', bufsz);
+  snprintf(buf, bufsz-1, "%llx-%llx", (unsigned long long) dev,
+    (unsigned long long) ino);
+}
+
+int pr_asciicache_clear(const char *path) {
+  if (pr_cachedir_clear(path) < 0) {
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9, "cleared ASCII cache '%s'", path);
+  return 0;
+}
+
+int pr_asciicache_open(const char *path) {
+  pr_cachedir_t dir;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (pr_cachedir_open(&dir, path) < 0) {
+    int xerrno = errno;
+
+    if (xerrno == EPERM) {
+      pr_log_pri(PR_LOG_WARNING, "unable to use ASCII cache '%s': "
+        "directory is writable by others, but not sticky", path);
+    }
+
+    errno = xerrno;
+    return -1;
+  }
+
+  if (asciicache_dir.dirfd >= 0) {
+    (void) pr_asciicache_close();
+  }
+
+  asciicache_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(asciicache_pool, "ASCII Cache Pool");
+  asciicache_dir = dir;
+
+  pr_trace_msg(trace_channel, 9, "using ASCII cache '%s'", path);
+  return 0;
+}
+
+int pr_asciicache_close(void) {
+  if (asciicache_dir.dirfd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pr_asciicache_discard();
+  (void) pr_cachedir_close(&asciicache_dir);
+
+  destroy_pool(asciicache_pool);
+  asciicache_pool = NULL;
+
+  return 0;
+}
+
+int pr_asciicache_get(const struct stat *st, off_t *offset, off_t *len) {
+  int fd, userfd;
+  char name[64];
+  struct stat cst;
+  struct asciicache_header hdr;
+
+  if (st == NULL ||
+      offset == NULL ||
+      len == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (asciicache_dir.dirfd < 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  userfd = pr_cachedir_get_userfd(&asciicache_dir, FALSE);
+  if (userfd < 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  asciicache_get_name(name, sizeof(name), st->st_dev, st->st_ino);
+
+  fd = openat(userfd, name, O_RDONLY|O_NOFOLLOW);
+  if (fd < 0) {
+    pr_trace_msg(trace_channel, 8, "no translated copy '%s' (%s)", name,
+      strerror(errno));
+    errno = ENOENT;
+    return -1;
+  }
+
+  (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+      hdr.magic != ASCIICACHE_MAGIC ||
+      hdr.hdrlen != sizeof(hdr)) {
+    pr_trace_msg(trace_channel, 3, "translated copy '%s' has bad header, "
+      "ignoring", name);
+    (void) close(fd);
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (hdr.dev != (uint64_t) st->st_dev ||
+      hdr.ino != (uint64_t) st->st_ino ||
+      hdr.size != (int64_t) st->st_size ||
+      hdr.mtime != (int64_t) st->st_mtime ||
+      hdr.ctime != (int64_t) st->st_ctime) {
+    pr_trace_msg(trace_channel, 8, "translated copy '%s' is stale: "
+      "file has changed", name);
+    (void) close(fd);
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (fstat(fd, &cst) < 0 ||
+      cst.st_size != (off_t) (hdr.hdrlen + hdr.datalen)) {
+    pr_trace_msg(trace_channel, 3, "translated copy '%s' is truncated, "
+      "ignoring", name);
+    (void) close(fd);
+    errno = ENOENT;
+    return -1;
+  }
+
+  *offset = (off_t) hdr.hdrlen;
+  *len = (off_t) hdr.datalen;
+
+  pr_trace_msg(trace_channel, 8, "using translated copy '%s' (%" PR_LU
+    " bytes)", name, (pr_off_t) hdr.datalen);
+  return fd;
+}
+
+int pr_asciicache_capture(const char *path, const struct stat *st) {
+  int xerrno;
+  time_t now;
+
+  if (path == NULL ||
+      st == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (asciicache_dir.dirfd < 0) {
+    errno = EPERM;
+    return -1;
+  }
+
+  pr_asciicache_discard();
+
+  /* If the file changed within this second, another change could follow
+   * in the same second without changing its mtime/ctime.
+   */
+  now = time(NULL);
+  if (st->st_mtime >= now ||
+      st->st_ctime >= now) {
+    pr_trace_msg(trace_channel, 9, "not caching translated copy of '%s': "
+      "file changed too recently", path);
+    errno = EPERM;
+    return -1;
+  }
+
+  capture_userfd = pr_cachedir_get_userfd(&asciicache_dir, TRUE);
+  if (capture_userfd < 0) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error opening ASCII cache for "
+      "UID %lu: %s", (unsigned long) geteuid(), strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  asciicache_get_name(capture_name, sizeof(capture_name), st->st_dev,
+    st->st_ino);
+
+  memset(capture_tmp_name, '\0', sizeof(capture_tmp_name));
+  snprintf(capture_tmp_name, sizeof(capture_tmp_name)-1, "%s%lu",
+    PR_CACHEDIR_TMP_PREFIX, (unsigned long) session.pid);
+
+  capture_fd = openat(capture_userfd, capture_tmp_name,
+    O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW, 0600);
+  if (capture_fd < 0) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error creating translated copy of '%s': "
+      "%s", path, strerror(xerrno));
+    pr_asciicache_discard();
+    errno = xerrno;
+    return -1;
+  }
+
+  (void) fcntl(capture_fd, F_SETFD, FD_CLOEXEC);
+
+  memset(&capture_hdr, 0, sizeof(capture_hdr));
+  capture_hdr.magic = ASCIICACHE_MAGIC;
+  capture_hdr.hdrlen = sizeof(capture_hdr);
+  capture_hdr.dev = st->st_dev;
+  capture_hdr.ino = st->st_ino;
+  capture_hdr.size = st->st_size;
+  capture_hdr.mtime = st->st_mtime;
+  capture_hdr.ctime = st->st_ctime;
+
+  /* The header is rewritten, with the translated length, on commit. */
+  if (pr_cachedir_write(capture_fd, (char *) &capture_hdr,
+      sizeof(capture_hdr)) < 0) {
+    xerrno = errno;
+
+    pr_asciicache_discard();
+    errno = xerrno;
+    return -1;
+  }
+
+  capture_path = pstrdup(asciicache_pool, path);
+  capture_failed = FALSE;
+
+  pr_trace_msg(trace_channel, 9, "capturing translated copy of '%s'", path);
+  return 0;
+}
+
+int pr_asciicache_write(const char *buf, size_t buflen) {
+  if (capture_fd < 0 ||
+      capture_failed == TRUE) {
+    return 0;
+  }
+
+  if (buf == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (pr_cachedir_write(capture_fd, buf, buflen) < 0) {
+    pr_trace_msg(trace_channel, 3, "error writing translated copy of '%s': "
+      "%s", capture_path, strerror(errno));
+    capture_failed = TRUE;
+    return 0;
+  }
+
+  capture_hdr.datalen += buflen;
+  return 0;
+}
+
+int pr_asciicache_commit(const struct stat *st) {
+  int xerrno;
+
+  if (capture_fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (st == NULL) {
+    pr_asciicache_discard();
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (capture_failed == TRUE) {
+    pr_asciicache_discard();
+    errno = EIO;
+    return -1;
+  }
+
+  /* A file changed while being read makes for an inconsistent copy. */
+  if (capture_hdr.dev != (uint64_t) st->st_dev ||
+      capture_hdr.ino != (uint64_t) st->st_ino ||
+      capture_hdr.size != (int64_t) st->st_size ||
+      capture_hdr.mtime != (int64_t) st->st_mtime ||
+      capture_hdr.ctime != (int64_t) st->st_ctime) {
+    pr_trace_msg(trace_channel, 9, "not caching translated copy of '%s': "
+      "file changed while being read", capture_path);
+    pr_asciicache_discard();
+    errno = EPERM;
+    return -1;
+  }
+
+  if (pwrite(capture_fd, &capture_hdr, sizeof(capture_hdr), 0) !=
+      sizeof(capture_hdr)) {
+    xerrno = errno;
+
+    pr_asciicache_discard();
+    errno = xerrno;
+    return -1;
+  }
+
+  if (renameat(capture_userfd, capture_tmp_name, capture_userfd,
+      capture_name) < 0) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error committing translated copy of "
+      "'%s': %s", capture_path, strerror(xerrno));
+    pr_asciicache_discard();
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 8, "cached translated copy of '%s' (%" PR_LU
+    " bytes)", capture_path, (pr_off_t) capture_hdr.datalen);
+
+  (void) close(capture_fd);
+  capture_fd = capture_userfd = -1;
+  capture_path = NULL;
+
+  return 0;
+}
+
+void pr_asciicache_discard(void) {
+  if (capture_fd >= 0) {
+    (void) close(capture_fd);
+    capture_fd = -1;
+
+    (void) unlinkat(capture_userfd, capture_tmp_name, 0);
+  }
+
+  /* Note that capture_userfd belongs to asciicache_dir; it is not ours to
+   * close.
+   */
+  capture_userfd = -1;
+  capture_path = NULL;
+  capture_failed = FALSE;
+}
+
+#else
+
+int pr_asciicache_clear(const char *path) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_asciicache_open(const char *path) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_asciicache_close(void) {
+  errno = EINVAL;
+  return -1;
+}
+
+int pr_asciicache_get(const struct stat *st, off_t *offset, off_t *len) {
+  errno = ENOENT;
+  return -1;
+}
+
+int pr_asciicache_capture(const char *path, const struct stat *st) {
+  errno = EPERM;
+  return -1;
+}
+
+int pr_asciicache_write(const char *buf, size_t buflen) {
+  return 0;
+}
+
+int pr_asciicache_commit(const struct stat *st) {
+  errno = EINVAL;
+  return -1;
+}
+
+void pr_asciicache_discard(void) {
+}
+
+#endif /* AT_FDCWD */
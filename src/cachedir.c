@@ -0,0 +1,388 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Cache directories */
+
+#include "conf.h"
+#include "privs.h"
+
+#if defined(AT_FDCWD)
+
+#ifndef O_DIRECTORY
+# define O_DIRECTORY	0
+#endif
+
+#ifndef O_NOFOLLOW
+# define O_NOFOLLOW	0
+#endif
+
+#define CACHEDIR_MODE		01733
+
+static const char *trace_channel = "cachedir";
+
+static int cachedir_open_dir(int dirfd, const char *path, struct stat *st) {
+  int fd, xerrno;
+
+  fd = openat(dirfd, path, O_RDONLY|O_DIRECTORY|O_NOFOLLOW);
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (fstat(fd, st) < 0) {
+    xerrno = errno;
+
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  if (!S_ISDIR(st->st_mode)) {
+    (void) close(fd);
+    errno = ENOTDIR;
+    return -1;
+  }
+
+  (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+int pr_cachedir_is_cache_name(const char *name) {
+  register size_t i;
+  size_t len;
+
+  if (name == NULL) {
+    return FALSE;
+  }
+
+  if (strncmp(name, PR_CACHEDIR_TMP_PREFIX,
+      sizeof(PR_CACHEDIR_TMP_PREFIX)-1) == 0) {
+    return TRUE;
+  }
+
+  len = strlen(name);
+  if (len == 0) {
+    return FALSE;
+  }
+
+  for (i = 0; i < len; i++) {
+    if (!PR_ISXDIGIT(name[i]) &&
+        name[i] != '-') {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static int cachedir_is_user_name(const char *name) {
+  const char *ptr;
+
+  if (*name != 'u' ||
+      *(name + 1) == '\0') {
+    return FALSE;
+  }
+
+  for (ptr = name + 1; *ptr; ptr++) {
+    if (!PR_ISDIGIT(*ptr)) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static int cachedir_remove_userdir(int dirfd, const char *name) {
+  int fd, res;
+  struct stat st;
+  DIR *dirh;
+  struct dirent *dent;
+
+  fd = cachedir_open_dir(dirfd, name, &st);
+  if (fd < 0) {
+    return -1;
+  }
+
+  dirh = fdopendir(fd);
+  if (dirh == NULL) {
+    int xerrno = errno;
+
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  while ((dent = readdir(dirh)) != NULL) {
+    pr_signals_handle();
+
+    if (pr_cachedir_is_cache_name(dent->d_name)) {
+      (void) unlinkat(fd, dent->d_name, 0);
+    }
+  }
+
+  closedir(dirh);
+
+  res = unlinkat(dirfd, name, AT_REMOVEDIR);
+  if (res < 0) {
+    pr_trace_msg(trace_channel, 3, "error removing '%s': %s", name,
+      strerror(errno));
+  }
+
+  return res;
+}
+
+int pr_cachedir_clear(const char *path) {
+  int dirfd, fd, res, xerrno;
+  struct stat st;
+  DIR *dirh;
+  struct dirent *dent;
+
+  if (path == NULL ||
+      *path != '/') {
+    errno = EINVAL;
+    return -1;
+  }
+
+  PRIVS_ROOT
+  res = mkdir(path, 0700);
+  xerrno = errno;
+
+  /* Set the mode explicitly, lest the umask interfere. */
+  if (res == 0) {
+    res = chmod(path, CACHEDIR_MODE);
+    xerrno = errno;
+
+  } else if (xerrno == EEXIST) {
+    res = 0;
+  }
+
+  if (res == 0) {
+    dirfd = cachedir_open_dir(AT_FDCWD, path, &st);
+    xerrno = errno;
+
+  } else {
+    dirfd = -1;
+  }
+  PRIVS_RELINQUISH
+
+  if (dirfd < 0) {
+    errno = xerrno;
+    return -1;
+  }
+
+  fd = dup(dirfd);
+  dirh = fd >= 0 ? fdopendir(fd) : NULL;
+  if (dirh == NULL) {
+    xerrno = errno;
+
+    if (fd >= 0) {
+      (void) close(fd);
+    }
+
+    (void) close(dirfd);
+    errno = xerrno;
+    return -1;
+  }
+
+  PRIVS_ROOT
+  while ((dent = readdir(dirh)) != NULL) {
+    pr_signals_handle();
+
+    if (cachedir_is_user_name(dent->d_name)) {
+      (void) cachedir_remove_userdir(dirfd, dent->d_name);
+
+    } else if (pr_cachedir_is_cache_name(dent->d_name)) {
+      (void) unlinkat(dirfd, dent->d_name, 0);
+    }
+  }
+  PRIVS_RELINQUISH
+
+  closedir(dirh);
+  (void) close(dirfd);
+
+  pr_trace_msg(trace_channel, 9, "cleared cache directory '%s'", path);
+  return 0;
+}
+
+int pr_cachedir_open(pr_cachedir_t *cd, const char *path) {
+  int fd, xerrno;
+  struct stat st;
+
+  if (cd == NULL ||
+      path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  PRIVS_ROOT
+  fd = cachedir_open_dir(AT_FDCWD, path, &st);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (fd < 0) {
+    pr_trace_msg(trace_channel, 3, "error opening cache directory '%s': %s",
+      path, strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  /* Without the sticky bit, anyone could replace another UID's files. */
+  if ((st.st_mode & (S_IWGRP|S_IWOTH)) &&
+      !(st.st_mode & S_ISVTX)) {
+    (void) close(fd);
+    errno = EPERM;
+    return -1;
+  }
+
+  cd->dirfd = fd;
+  cd->userfd = -1;
+  cd->uid = (uid_t) -1;
+
+  return 0;
+}
+
+int pr_cachedir_close(pr_cachedir_t *cd) {
+  if (cd == NULL ||
+      cd->dirfd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (cd->userfd >= 0) {
+    (void) close(cd->userfd);
+    cd->userfd = -1;
+    cd->uid = (uid_t) -1;
+  }
+
+  (void) close(cd->dirfd);
+  cd->dirfd = -1;
+
+  return 0;
+}
+
+int pr_cachedir_get_userfd(pr_cachedir_t *cd, int create) {
+  uid_t uid;
+  char name[32];
+  struct stat st;
+  int fd;
+
+  if (cd == NULL ||
+      cd->dirfd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  uid = geteuid();
+  if (cd->userfd >= 0 &&
+      cd->uid == uid) {
+    return cd->userfd;
+  }
+
+  if (cd->userfd >= 0) {
+    (void) close(cd->userfd);
+    cd->userfd = -1;
+  }
+
+  memset(name, '\0', sizeof(name));
+  snprintf(name, sizeof(name)-1, "u%lu", (unsigned long) uid);
+
+  if (create &&
+      mkdirat(cd->dirfd, name, 0700) < 0 &&
+      errno != EEXIST) {
+    return -1;
+  }
+
+  fd = cachedir_open_dir(cd->dirfd, name, &st);
+  if (fd < 0) {
+    return -1;
+  }
+
+  /* Someone else could have created this UID's subdirectory first. */
+  if (st.st_uid != uid ||
+      (st.st_mode & (S_IRWXG|S_IRWXO))) {
+    pr_trace_msg(trace_channel, 1, "refusing to use '%s': not owned by "
+      "UID %lu, or accessible by others", name, (unsigned long) uid);
+    (void) close(fd);
+    errno = EPERM;
+    return -1;
+  }
+
+  cd->userfd = fd;
+  cd->uid = uid;
+
+  return fd;
+}
+
+int pr_cachedir_write(int fd, const char *buf, size_t buflen) {
+  while (buflen > 0) {
+    ssize_t res;
+
+    res = write(fd, buf, buflen);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      return -1;
+    }
+
+    buf += res;
+    buflen -= res;
+  }
+
+  return 0;
+}
+
+#else
+
+int pr_cachedir_clear(const char *path) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_cachedir_open(pr_cachedir_t *cd, const char *path) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_cachedir_close(pr_cachedir_t *cd) {
+  errno = EINVAL;
+  return -1;
+}
+
+int pr_cachedir_get_userfd(pr_cachedir_t *cd, int create) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_cachedir_is_cache_name(const char *name) {
+  return FALSE;
+}
+
+int pr_cachedir_write(int fd, const char *buf, size_t buflen) {
+  errno = ENOSYS;
+  return -1;
+}
+
+#endif /* AT_FDCWD */
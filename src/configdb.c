@@ -47,6 +47,107 @@ static unsigned int config_id = 0;
 
 static const char *trace_channel = "config";
 
+/* Index of the CONF_PARAM config_recs in a set, keyed by config ID, so that
+ * non-recursive lookups need not walk the whole set.  Only the first
+ * config_rec for each ID is indexed, preserving find_config() ordering.
+ * Indices are built by pr_config_merge_down(), and are dropped (by sets.c)
+ * as soon as the set is modified.
+ */
+struct config_index_ent {
+  unsigned int config_id;
+  config_rec *c;
+};
+
+struct config_index {
+  unsigned int mask;
+  struct config_index_ent *ents;
+};
+
+static void config_index_build(xaset_t *s) {
+  config_rec *c;
+  struct config_index *idx;
+  unsigned int count = 0, nents = 8;
+
+  if (s == NULL ||
+      s->xas_list == NULL ||
+      s->xas_index != NULL) {
+    return;
+  }
+
+  for (c = (config_rec *) s->xas_list; c; c = c->next) {
+    if (c->config_type != CONF_PARAM) {
+      continue;
+    }
+
+    /* Without an ID, a config_rec can only be found by name. */
+    if (c->config_id == 0) {
+      return;
+    }
+
+    count++;
+  }
+
+  while (nents < (count * 2)) {
+    nents <<= 1;
+  }
+
+  idx = palloc(s->pool, sizeof(struct config_index));
+  idx->mask = nents - 1;
+  idx->ents = pcalloc(s->pool, nents * sizeof(struct config_index_ent));
+
+  for (c = (config_rec *) s->xas_list; c; c = c->next) {
+    unsigned int i;
+
+    if (c->config_type != CONF_PARAM) {
+      continue;
+    }
+
+    i = c->config_id & idx->mask;
+    while (idx->ents[i].c != NULL &&
+           idx->ents[i].config_id != c->config_id) {
+      i = (i + 1) & idx->mask;
+    }
+
+    if (idx->ents[i].c == NULL) {
+      idx->ents[i].config_id = c->config_id;
+      idx->ents[i].c = c;
+    }
+  }
+
+  s->xas_index = idx;
+}
+
+/* Looks up the first CONF_PARAM config_rec with the given ID in the set
+ * headed by top.  Returns 0 if the set is indexed (with *res set to the
+ * match, or NULL if there is none), and -1 if the set must be scanned.
+ */
+static int config_index_lookup(config_rec *top, unsigned int cid,
+    config_rec **res) {
+  struct config_index *idx;
+  unsigned int i;
+
+  if (top->set == NULL ||
+      top->set->xas_index == NULL ||
+      top->set->xas_list != (xasetmember_t *) top) {
+    return -1;
+  }
+
+  idx = top->set->xas_index;
+  *res = NULL;
+
+  i = cid & idx->mask;
+  while (idx->ents[i].c != NULL) {
+    if (idx->ents[i].config_id == cid) {
+      *res = idx->ents[i].c;
+      break;
+    }
+
+    i = (i + 1) & idx->mask;
+  }
+
+  return 0;
+}
+
 /* Adds a config_rec to the specified set */
 config_rec *pr_config_add_set(xaset_t **set, const char *name, int flags) {
   pool *conf_pool = NULL, *set_pool = NULL;
@@ -453,6 +554,8 @@ void pr_config_merge_down(xaset_t *s, int dynamic) {
       pr_config_merge_down(c->subset, dynamic);
     }
   }
+
+  config_index_build(s);
 }
 
 config_rec *find_config_next2(config_rec *prev, config_rec *c, int type,
@@ -554,7 +657,23 @@ config_rec *find_config_next2(config_rec *prev, config_rec *c, int type,
 
     /* Recurse: If deep recursion yielded no match try the current subset.
      *
-     * NOTE: the string comparison here is specifically case-sensitive.
+     * If the whole set is to be searched for a CONF_PARAM, and the set
+     * has been indexed, use the index instead.  Every CONF_PARAM in an
+     * indexed set has a config ID, so a miss in the index is a miss.
+     */
+    if (recurse <= 1 &&
+        type == CONF_PARAM &&
+        cid != 0 &&
+        config_index_lookup(top, cid, &c) == 0) {
+      if (c != NULL) {
+        return c;
+      }
+
+      /* Skip the scan below. */
+      top = NULL;
+    }
+
+    /* NOTE: the string comparison here is specifically case-sensitive.
      * The config_rec names are supplied by the modules and intentionally
      * case sensitive (they shouldn't be verbatim from the config file)
      * Do NOT change this to strcasecmp(), no matter how tempted you are
@@ -575,7 +694,13 @@ config_rec *find_config_next2(config_rec *prev, config_rec *c, int type,
           return c;
         }
 
-        if (strncmp(name, c->name, namelen + 1) == 0) {
+        /* Config IDs are assigned by name, so two CONF_PARAMs with
+         * different IDs cannot have the same name.
+         */
+        if ((cid == 0 ||
+             c->config_id == 0 ||
+             c->config_type != CONF_PARAM) &&
+            strncmp(name, c->name, namelen + 1) == 0) {
           return c;
         }
       }
@@ -40,6 +40,7 @@ static const char *trace_channel = "data";
 static const char *timing_channel = "timing";
 
 #define PR_DATA_OPT_IGNORE_ASCII	0x0001
+#define PR_DATA_OPT_ADAPTIVE_BUFSZ	0x0002
 static unsigned long data_opts = 0UL;
 static uint64_t data_start_ms = 0L;
 static int data_first_byte_read = FALSE;
@@ -55,6 +56,32 @@ static int data_first_byte_written = FALSE;
  */
 static pr_netio_stream_t *nstrm = NULL;
 
+#if defined(HAVE_SPLICE) && defined(SPLICE_F_MOVE)
+/* Per-transfer state for the splice(2)-based receive path: the pipe used to
+ * move data from the socket to the file, and counters for how much data was
+ * received that way.
+ */
+static int recvfile_fds[2] = { -1, -1 };
+static int recvfile_disabled = FALSE;
+static off_t recvfile_nbytes = 0;
+static unsigned long recvfile_ncalls = 0;
+#endif /* HAVE_SPLICE */
+
+/* Per-transfer state for adaptive buffer sizing: when the throughput was
+ * last sampled, and the pool holding the current (resized) transfer buffer.
+ */
+#define PR_DATA_ADAPT_INTERVAL_MS	250
+static uint64_t adapt_last_ms = 0;
+static off_t adapt_last_bytes = 0;
+static pool *adapt_buf_pool = NULL;
+
+/* ASCII-translated download data, which session.xfer.buf points to after
+ * pr_data_xfer() returns, is kept until the next write (or the end of the
+ * transfer); session.xfer.buf is then pointed back at the transfer buffer.
+ */
+static pool *ascii_out_pool = NULL;
+static char *ascii_out_buf = NULL, *ascii_xfer_buf = NULL;
+
 static long timeout_linger = PR_TUNABLE_TIMEOUTLINGER;
 
 static int timeout_idle = PR_TUNABLE_TIMEOUTIDLE;
@@ -105,6 +132,188 @@ static void data_new_xfer(char *filename, int direction) {
     (unsigned long) session.xfer.bufsize);
   session.xfer.buf++;	/* leave room for ascii translation */
   session.xfer.buflen = 0;
+
+#if defined(HAVE_SPLICE) && defined(SPLICE_F_MOVE)
+  recvfile_nbytes = 0;
+  recvfile_ncalls = 0;
+#endif /* HAVE_SPLICE */
+
+  adapt_last_ms = 0;
+  adapt_last_bytes = 0;
+  adapt_buf_pool = NULL;
+}
+
+/* Replaces the transfer buffer with one of the given size, preserving any
+ * data (e.g. from ASCII translation) still pending in the current buffer.
+ */
+static int data_resize_xfer_buf(size_t bufsz) {
+  pool *buf_pool;
+  char *buf;
+  size_t pending = 0;
+
+  /* Only uploads carry data over in the buffer between calls. */
+  if (session.xfer.direction == PR_NETIO_IO_RD) {
+    pending = session.xfer.buflen;
+  }
+
+  if (pending > bufsz) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  buf_pool = make_sub_pool(session.xfer.p);
+  pr_pool_tag(buf_pool, "Data Transfer buffer pool");
+
+  buf = pcalloc(buf_pool, bufsz + 1);
+  buf++;	/* leave room for ascii translation */
+
+  if (pending > 0) {
+    memcpy(buf, session.xfer.buf, pending);
+  }
+
+  if (adapt_buf_pool != NULL) {
+    destroy_pool(adapt_buf_pool);
+  }
+
+  adapt_buf_pool = buf_pool;
+  session.xfer.buf = buf;
+  session.xfer.bufsize = bufsz;
+
+#if defined(HAVE_SPLICE) && defined(SPLICE_F_MOVE) && defined(F_SETPIPE_SZ)
+  if (recvfile_fds[1] >= 0) {
+    (void) fcntl(recvfile_fds[1], F_SETPIPE_SZ, bufsz);
+  }
+#endif /* HAVE_SPLICE and F_SETPIPE_SZ */
+
+  return 0;
+}
+
+/* When adaptive buffer sizing is enabled, periodically estimate the
+ * bandwidth-delay product of the data connection, from the measured
+ * throughput and the kernel's RTT and congestion window (via TCP_INFO), and
+ * resize the transfer buffer to twice that.  The socket buffer is only ever
+ * grown, never shrunk, as the kernel may be autotuning it as well.
+ */
+static void data_adapt_xfer_bufsz(void) {
+#if defined(__linux__) && defined(TCP_INFO)
+  int fd, optname;
+  struct tcp_info tcpi;
+  socklen_t optlen;
+  uint64_t now_ms, elapsed_ms, rtt_us;
+  off_t nbytes;
+  size_t bdp, window, bufsz;
+  int sockbufsz = 0;
+  const char *optstr;
+
+  if (!(data_opts & PR_DATA_OPT_ADAPTIVE_BUFSZ) ||
+      session.d == NULL) {
+    return;
+  }
+
+  pr_gettimeofday_millis(&now_ms);
+  if (adapt_last_ms == 0) {
+    adapt_last_ms = now_ms;
+    adapt_last_bytes = session.xfer.total_bytes;
+    return;
+  }
+
+  elapsed_ms = now_ms - adapt_last_ms;
+  if (elapsed_ms < PR_DATA_ADAPT_INTERVAL_MS) {
+    return;
+  }
+
+  nbytes = session.xfer.total_bytes - adapt_last_bytes;
+  adapt_last_ms = now_ms;
+  adapt_last_bytes = session.xfer.total_bytes;
+
+  if (session.xfer.direction == PR_NETIO_IO_RD) {
+    fd = PR_NETIO_FD(session.d->instrm);
+
+  } else {
+    fd = PR_NETIO_FD(session.d->outstrm);
+  }
+
+  memset(&tcpi, 0, sizeof(tcpi));
+  optlen = sizeof(tcpi);
+  if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &tcpi, &optlen) < 0) {
+    pr_trace_msg(trace_channel, 9, "error obtaining TCP_INFO for fd %d: %s",
+      fd, strerror(errno));
+    return;
+  }
+
+  /* The kernel's own idea of how much data it wants in flight, per RTT. */
+  if (session.xfer.direction == PR_NETIO_IO_RD) {
+    rtt_us = tcpi.tcpi_rcv_rtt > 0 ? tcpi.tcpi_rcv_rtt : tcpi.tcpi_rtt;
+    window = tcpi.tcpi_rcv_space;
+
+  } else {
+    rtt_us = tcpi.tcpi_rtt;
+    window = (size_t) tcpi.tcpi_snd_cwnd * tcpi.tcpi_snd_mss;
+  }
+
+  if (rtt_us == 0) {
+    return;
+  }
+
+  bdp = (size_t) (((uint64_t) nbytes * rtt_us) / (elapsed_ms * 1000));
+  if (window > bdp) {
+    bdp = window;
+  }
+
+  bufsz = PR_TUNABLE_XFER_ADAPTIVE_MIN_BUFSZ;
+  while (bufsz < (bdp * 2) &&
+         bufsz < PR_TUNABLE_XFER_ADAPTIVE_MAX_BUFSZ) {
+    bufsz *= 2;
+  }
+
+  if (bufsz > PR_TUNABLE_XFER_ADAPTIVE_MAX_BUFSZ) {
+    bufsz = PR_TUNABLE_XFER_ADAPTIVE_MAX_BUFSZ;
+  }
+
+  pr_trace_msg(trace_channel, 19, "measured %" PR_LU " bytes in %lu ms, "
+    "RTT %lu us, kernel window %lu bytes: estimated BDP %lu bytes",
+    (pr_off_t) nbytes, (unsigned long) elapsed_ms, (unsigned long) rtt_us,
+    (unsigned long) window, (unsigned long) bdp);
+
+  /* Grow eagerly, but only shrink when well oversized, to avoid flapping. */
+  if (bufsz == session.xfer.bufsize ||
+      (bufsz < session.xfer.bufsize &&
+       bufsz > (session.xfer.bufsize / 4))) {
+    return;
+  }
+
+  if (data_resize_xfer_buf(bufsz) < 0) {
+    return;
+  }
+
+  pr_trace_msg(trace_channel, 8, "adjusted data transfer buffer to %lu bytes",
+    (unsigned long) bufsz);
+
+  if (session.xfer.direction == PR_NETIO_IO_RD) {
+    optname = SO_RCVBUF;
+    optstr = "SO_RCVBUF";
+
+  } else {
+    optname = SO_SNDBUF;
+    optstr = "SO_SNDBUF";
+  }
+
+  optlen = sizeof(sockbufsz);
+  if (getsockopt(fd, SOL_SOCKET, optname, &sockbufsz, &optlen) == 0 &&
+      (size_t) sockbufsz < bufsz) {
+    sockbufsz = (int) bufsz;
+
+    if (setsockopt(fd, SOL_SOCKET, optname, &sockbufsz,
+        sizeof(sockbufsz)) < 0) {
+      pr_trace_msg(trace_channel, 3, "error setting %s %d on fd %d: %s",
+        optstr, sockbufsz, fd, strerror(errno));
+
+    } else {
+      pr_trace_msg(trace_channel, 8, "set %s of %d bytes on fd %d", optstr,
+        sockbufsz, fd);
+    }
+  }
+#endif /* __linux__ and TCP_INFO */
 }
 
 static int data_passive_open(const char *reason, off_t size) {
@@ -456,6 +665,30 @@ void pr_data_clear_xfer_pool(void) {
   session.xfer.xfer_type = xfer_type;  
 }
 
+/* The ASCII translation pool is a subpool of the transfer pool, which may be
+ * destroyed (by other modules, too) while it is still held.
+ */
+static void data_ascii_out_cleanup(void *data) {
+  ascii_out_pool = NULL;
+  ascii_out_buf = ascii_xfer_buf = NULL;
+}
+
+static void data_release_ascii_out(void) {
+  if (ascii_out_pool == NULL) {
+    return;
+  }
+
+  /* Unless someone else has replaced it since, point session.xfer.buf back
+   * at the transfer buffer.
+   */
+  if (session.xfer.buf == ascii_out_buf) {
+    session.xfer.buf = ascii_xfer_buf;
+  }
+
+  /* The pool cleanup resets the other fields. */
+  destroy_pool(ascii_out_pool);
+}
+
 void pr_data_reset(void) {
   if (session.d &&
       session.d->pool) {
@@ -496,6 +729,27 @@ int pr_data_ignore_ascii(int ignore_ascii) {
   return res;
 }
 
+int pr_data_adaptive_bufsz(int adaptive) {
+  int res;
+
+  if (adaptive != TRUE &&
+      adaptive != FALSE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  res = (data_opts & PR_DATA_OPT_ADAPTIVE_BUFSZ) ? TRUE : FALSE;
+
+  if (adaptive) {
+    data_opts |= PR_DATA_OPT_ADAPTIVE_BUFSZ;
+
+  } else {
+    data_opts &= ~PR_DATA_OPT_ADAPTIVE_BUFSZ;
+  }
+
+  return res;
+}
+
 void pr_data_init(char *filename, int direction) {
   if (session.xfer.p == NULL) {
     data_new_xfer(filename, direction);
@@ -1113,6 +1367,8 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
     return -1;
   }
 
+  data_adapt_xfer_bufsz();
+
   if (session.xfer.direction == PR_NETIO_IO_RD) {
     char *buf;
 
@@ -1305,10 +1561,21 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
       int bwrote = 0;
       int buflen = cl_size;
       unsigned int xferbuflen;
+      char *xferbuf;
 
       pr_signals_handle();
 
-      if (buflen > pr_config_get_server_xfer_bufsz(PR_NETIO_IO_WR)) {
+      data_release_ascii_out();
+
+      /* The transfer buffer may have been resized since it was allocated;
+       * a buffer not allocated via pr_data_init() is of the configured size.
+       */
+      if (session.xfer.bufsize > 0) {
+        if ((size_t) buflen > session.xfer.bufsize) {
+          buflen = session.xfer.bufsize;
+        }
+
+      } else if (buflen > pr_config_get_server_xfer_bufsz(PR_NETIO_IO_WR)) {
         buflen = pr_config_get_server_xfer_bufsz(PR_NETIO_IO_WR);
       }
 
@@ -1316,6 +1583,7 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
 
       /* Fill up our internal buffer. */
       memcpy(session.xfer.buf, cl_buf, buflen);
+      xferbuf = session.xfer.buf;
 
       /* We use ASCII translation if:
        *
@@ -1328,31 +1596,36 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
         char *out = NULL;
         size_t outlen = 0;
 
-        /* Use a temporary pool for the CRLF conversion, lest the
+        /* Use a separate pool for the CRLF conversion, lest the
          * session.xfer.p pool grow quite large while downloading a large
          * file for ASCII conversion (Bug#4277).
          */
-        tmp_pool = make_sub_pool(session.xfer.p);
-        pr_pool_tag(tmp_pool, "ASCII upload");
+        ascii_out_pool = make_sub_pool(session.xfer.p);
+        pr_pool_tag(ascii_out_pool, "ASCII upload");
+        register_cleanup(ascii_out_pool, NULL, data_ascii_out_cleanup,
+          data_ascii_out_cleanup);
 
         /* Scan the internal buffer, looking for LFs with no preceding CRs.
          * Add CRs (and expand the internal buffer) as necessary. xferbuflen
          * will be adjusted so that it contains the length of data in
          * the internal buffer, including any added CRs.
          */
-        res = pr_ascii_ftp_to_crlf(tmp_pool, session.xfer.buf, xferbuflen,
-          &out, &outlen);
+        res = pr_ascii_ftp_to_crlf(ascii_out_pool, session.xfer.buf,
+          xferbuflen, &out, &outlen);
         if (res < 0) {
           pr_trace_msg(trace_channel, 1, "error writing ASCII data: %s",
             strerror(errno));
 
         } else {
-          session.xfer.buf = out;
+          ascii_xfer_buf = session.xfer.buf;
+          ascii_out_buf = out;
+
+          session.xfer.buf = xferbuf = out;
           session.xfer.buflen = xferbuflen = outlen;
         }
       }
 
-      bwrote = pr_netio_write(session.d->outstrm, session.xfer.buf, xferbuflen);
+      bwrote = pr_netio_write(session.d->outstrm, xferbuf, xferbuflen);
       while (bwrote < 0) {
         int xerrno = errno;
 
@@ -1364,8 +1637,7 @@ int pr_data_xfer(char *cl_buf, size_t cl_size) {
           errno = EINTR;
           pr_signals_handle();
              
-          bwrote = pr_netio_write(session.d->outstrm, session.xfer.buf,
-            xferbuflen);
+          bwrote = pr_netio_write(session.d->outstrm, xferbuf, xferbuflen);
           continue;
         }
 
@@ -1700,3 +1972,300 @@ pr_sendfile_t pr_data_sendfile(int retr_fd, off_t *offset, off_t count) {
   return -1;
 }
 #endif /* HAVE_SENDFILE */
+
+#if defined(HAVE_SPLICE) && defined(SPLICE_F_MOVE)
+static void recvfile_cleanup_cb(void *user_data) {
+  if (recvfile_fds[0] >= 0) {
+    (void) close(recvfile_fds[0]);
+    recvfile_fds[0] = -1;
+  }
+
+  if (recvfile_fds[1] >= 0) {
+    (void) close(recvfile_fds[1]);
+    recvfile_fds[1] = -1;
+  }
+}
+
+static int recvfile_open_pipe(void) {
+  if (pipe(recvfile_fds) < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3,
+      "error opening pipe for splice(2) receive: %s", strerror(xerrno));
+    recvfile_fds[0] = recvfile_fds[1] = -1;
+
+    errno = xerrno;
+    return -1;
+  }
+
+  (void) fcntl(recvfile_fds[0], F_SETFD, FD_CLOEXEC);
+  (void) fcntl(recvfile_fds[1], F_SETFD, FD_CLOEXEC);
+
+# if defined(F_SETPIPE_SZ)
+  /* Try to make the pipe large enough to hold a full transfer buffer's
+   * worth of data; failure here only means more splice(2) calls.
+   */
+  if (fcntl(recvfile_fds[1], F_SETPIPE_SZ, session.xfer.bufsize) < 0) {
+    pr_trace_msg(trace_channel, 14,
+      "unable to set pipe size to %lu bytes: %s",
+      (unsigned long) session.xfer.bufsize, strerror(errno));
+  }
+# endif /* F_SETPIPE_SZ */
+
+  /* Tie the lifetime of the pipe to that of the transfer. */
+  register_cleanup(session.xfer.p, NULL, recvfile_cleanup_cb,
+    recvfile_cleanup_cb);
+
+  pr_trace_msg(trace_channel, 9,
+    "using splice(2) via pipe (fds %d, %d) for receiving data",
+    recvfile_fds[0], recvfile_fds[1]);
+  return 0;
+}
+
+/* Move the given number of bytes, already spliced into our pipe, out to
+ * the file.  Some filesystems do not support splice(2) writes; for those we
+ * copy the pending data out of the pipe the old-fashioned way, and disable
+ * the splice path for the remainder of the session.
+ */
+static int recvfile_drain(int stor_fd, size_t len) {
+  while (len > 0) {
+    ssize_t res;
+
+    res = splice(recvfile_fds[0], NULL, stor_fd, NULL, len,
+      SPLICE_F_MOVE|SPLICE_F_MORE);
+    recvfile_ncalls++;
+
+    if (res < 0) {
+      int xerrno = errno;
+
+      if (xerrno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      if (xerrno != EINVAL) {
+        errno = xerrno;
+        return -1;
+      }
+
+      pr_trace_msg(trace_channel, 3, "splice(2) to fd %d not supported (%s), "
+        "disabling splice(2) receives for this session", stor_fd,
+        strerror(xerrno));
+      recvfile_disabled = TRUE;
+
+      while (len > 0) {
+        ssize_t nread, nwritten;
+        size_t readsz;
+
+        readsz = len;
+        if (readsz > session.xfer.bufsize) {
+          readsz = session.xfer.bufsize;
+        }
+
+        nread = read(recvfile_fds[0], session.xfer.buf, readsz);
+        if (nread <= 0) {
+          if (nread < 0 &&
+              errno == EINTR) {
+            pr_signals_handle();
+            continue;
+          }
+
+          errno = EIO;
+          return -1;
+        }
+
+        nwritten = write(stor_fd, session.xfer.buf, nread);
+        if (nwritten != nread) {
+          if (nwritten >= 0) {
+            errno = EIO;
+          }
+
+          return -1;
+        }
+
+        len -= nread;
+      }
+
+      break;
+    }
+
+    len -= res;
+  }
+
+  return 0;
+}
+
+/* pr_data_recvfile() receives data on the data connection, writing it
+ * directly to the given file descriptor without copying it through
+ * userspace.  ASCII translation is not performed, and the caller is
+ * responsible for ensuring that no NetIO or FSIO module needs to see the
+ * data.  Returns the number of bytes received, 0 if the data connection
+ * closed, or -1 on error.  If splice(2) cannot be used, -1 is returned with
+ * errno set to ENOSYS, and the caller should use pr_data_xfer() instead.
+ */
+ssize_t pr_data_recvfile(int stor_fd, size_t count) {
+  int sockfd;
+  ssize_t len;
+
+  if (stor_fd < 0 ||
+      count == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (session.xfer.direction != PR_NETIO_IO_RD) {
+    errno = EPERM;
+    return -1;
+  }
+
+  if (recvfile_disabled == TRUE) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  /* Poll the control channel for any commands we should handle, like
+   * QUIT or ABOR.
+   */
+  poll_ctrl();
+
+  if (session.d == NULL) {
+#if defined(ECONNABORTED)
+    errno = ECONNABORTED;
+#elif defined(ENOTCONN)
+    errno = ENOTCONN;
+#else
+    errno = EIO;
+#endif
+    return -1;
+  }
+
+  data_adapt_xfer_bufsz();
+
+  if (recvfile_fds[0] < 0) {
+    if (recvfile_open_pipe() < 0) {
+      errno = ENOSYS;
+      return -1;
+    }
+  }
+
+  /* The pipe can only hold so much; splice(2) will move what fits. */
+  if (count > session.xfer.bufsize) {
+    count = session.xfer.bufsize;
+  }
+
+  sockfd = PR_NETIO_FD(session.d->instrm);
+
+  while (TRUE) {
+    int xerrno;
+
+    switch (pr_netio_poll(session.d->instrm)) {
+      case 1:
+        errno = session.d->instrm->strm_errno = ECONNABORTED;
+        return -1;
+
+      case -1:
+        return -1;
+
+      default:
+        break;
+    }
+
+    len = splice(sockfd, NULL, recvfile_fds[1], NULL, count,
+      SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+    recvfile_ncalls++;
+
+    if (len >= 0) {
+      break;
+    }
+
+    xerrno = errno;
+    if (xerrno == EAGAIN ||
+        xerrno == EINTR) {
+      errno = EINTR;
+      pr_signals_handle();
+      continue;
+    }
+
+    if (recvfile_nbytes == 0 &&
+        (xerrno == EINVAL ||
+         xerrno == ENOSYS)) {
+      /* Nothing has been received this way yet, so the caller can safely
+       * fall back to the normal receive path.
+       */
+      pr_trace_msg(trace_channel, 3, "splice(2) from socket fd %d failed "
+        "(%s), disabling splice(2) receives for this session", sockfd,
+        strerror(xerrno));
+      recvfile_disabled = TRUE;
+      errno = ENOSYS;
+      return -1;
+    }
+
+    errno = session.d->instrm->strm_errno = xerrno;
+    return -1;
+  }
+
+  /* EOF */
+  if (len == 0) {
+    return 0;
+  }
+
+  if (recvfile_drain(stor_fd, len) < 0) {
+    return -1;
+  }
+
+  if (data_first_byte_read == FALSE) {
+    if (pr_trace_get_level(timing_channel)) {
+      unsigned long elapsed_ms;
+      uint64_t read_ms;
+
+      pr_gettimeofday_millis(&read_ms);
+      elapsed_ms = (unsigned long) (read_ms - data_start_ms);
+
+      pr_trace_msg(timing_channel, 7,
+        "Time for first data byte read: %lu ms", elapsed_ms);
+    }
+
+    data_first_byte_read = TRUE;
+  }
+
+  if (timeout_stalled) {
+    pr_timer_reset(PR_TIMER_STALLED, ANY_MODULE);
+  }
+
+  if (timeout_idle) {
+    pr_timer_reset(PR_TIMER_IDLE, ANY_MODULE);
+  }
+
+  recvfile_nbytes += len;
+
+  session.xfer.total_bytes += len;
+  session.total_bytes += len;
+  session.total_bytes_in += len;
+  session.total_raw_in += len;
+
+  return len;
+}
+
+int pr_data_get_recvfile_stats(off_t *nbytes, unsigned long *ncalls) {
+  if (nbytes == NULL ||
+      ncalls == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *nbytes = recvfile_nbytes;
+  *ncalls = recvfile_ncalls;
+  return 0;
+}
+
+#else
+ssize_t pr_data_recvfile(int stor_fd, size_t count) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_data_get_recvfile_stats(off_t *nbytes, unsigned long *ncalls) {
+  errno = ENOSYS;
+  return -1;
+}
+#endif /* HAVE_SPLICE */
@@ -424,6 +424,152 @@ void kludge_enable_umask(void) {
 
 /* Per-directory configuration */
 
+/* Per-session cache of the most recently matched paths, and the <Directory>
+ * section (or lack of one) which dir_match_path() resolved each to.  The
+ * cache is flushed whenever the <Directory> tree is changed, and whenever
+ * the session's <Anonymous> or chroot(2) state changes.
+ */
+struct dir_match_entry {
+  unsigned int hash;
+  unsigned long last_used;
+  char *path;
+  size_t pathsz;
+  config_rec *dir;
+};
+
+#if PR_TUNABLE_DIR_MATCH_CACHE_SIZE > 0
+static pool *dir_match_pool = NULL;
+static struct dir_match_entry dir_match_cache[PR_TUNABLE_DIR_MATCH_CACHE_SIZE];
+static unsigned long dir_match_tick = 0;
+static server_rec *dir_match_server = NULL;
+static config_rec *dir_match_anon = NULL;
+static const char *dir_match_chroot = NULL;
+#endif /* PR_TUNABLE_DIR_MATCH_CACHE_SIZE */
+
+static void dir_match_cache_clear(void) {
+#if PR_TUNABLE_DIR_MATCH_CACHE_SIZE > 0
+  if (dir_match_pool != NULL) {
+    destroy_pool(dir_match_pool);
+    dir_match_pool = NULL;
+  }
+
+  memset(dir_match_cache, 0, sizeof(dir_match_cache));
+  dir_match_tick = 0;
+#endif /* PR_TUNABLE_DIR_MATCH_CACHE_SIZE */
+}
+
+static unsigned int dir_match_hash(const char *path) {
+  register unsigned int h = 5381;
+
+  while (*path) {
+    h = ((h << 5) + h) + (unsigned char) *path++;
+  }
+
+  return h;
+}
+
+/* Returns the cache entry for the given path; if there is no such entry,
+ * NULL is returned and the least recently used entry is provided via
+ * the victim argument.
+ */
+static struct dir_match_entry *dir_match_cache_get(const char *path,
+    unsigned int hash, struct dir_match_entry **victim) {
+#if PR_TUNABLE_DIR_MATCH_CACHE_SIZE > 0
+  register unsigned int i;
+  struct dir_match_entry *lru = NULL;
+
+  if (dir_match_server != main_server ||
+      dir_match_anon != session.anon_config ||
+      dir_match_chroot != session.chroot_path) {
+    dir_match_cache_clear();
+    dir_match_server = main_server;
+    dir_match_anon = session.anon_config;
+    dir_match_chroot = session.chroot_path;
+  }
+
+  for (i = 0; i < PR_TUNABLE_DIR_MATCH_CACHE_SIZE; i++) {
+    struct dir_match_entry *dme;
+
+    dme = &(dir_match_cache[i]);
+    if (dme->path == NULL) {
+      if (lru == NULL ||
+          lru->path != NULL) {
+        lru = dme;
+      }
+
+      continue;
+    }
+
+    if (dme->hash == hash &&
+        strcmp(dme->path, path) == 0) {
+      dme->last_used = ++dir_match_tick;
+      return dme;
+    }
+
+    if (lru == NULL ||
+        (lru->path != NULL &&
+         dme->last_used < lru->last_used)) {
+      lru = dme;
+    }
+  }
+
+  *victim = lru;
+#else
+  *victim = NULL;
+#endif /* PR_TUNABLE_DIR_MATCH_CACHE_SIZE */
+
+  return NULL;
+}
+
+static void dir_match_cache_set(struct dir_match_entry *dme, const char *path,
+    unsigned int hash, config_rec *dir) {
+#if PR_TUNABLE_DIR_MATCH_CACHE_SIZE > 0
+  size_t pathlen;
+
+  if (dme == NULL) {
+    return;
+  }
+
+  if (dir_match_pool == NULL) {
+    dir_match_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(dir_match_pool, "Directory match cache pool");
+  }
+
+  /* Reuse the entry's path buffer if it is large enough. */
+  pathlen = strlen(path);
+  if (dme->pathsz <= pathlen) {
+    dme->pathsz = pathlen + 1;
+    dme->path = palloc(dir_match_pool, dme->pathsz);
+  }
+
+  memcpy(dme->path, path, pathlen + 1);
+  dme->hash = hash;
+  dme->dir = dir;
+  dme->last_used = ++dir_match_tick;
+#endif /* PR_TUNABLE_DIR_MATCH_CACHE_SIZE */
+}
+
+/* Returns TRUE if the given suffixed <Directory> pattern, which always ends
+ * in '*', matches the given path.  Patterns whose only wildcard is that
+ * trailing '*' are matched with a plain prefix comparison, which is far
+ * cheaper than pr_fnmatch() when there are many <Directory> sections.
+ */
+static int dir_suffix_match(const char *pattern, const char *path) {
+  size_t prefix_len;
+
+  prefix_len = strlen(pattern);
+  if (prefix_len > 0 &&
+      pattern[prefix_len-1] == '*') {
+    prefix_len--;
+
+    if (strcspn(pattern, "*?[\\") == prefix_len) {
+      return strncmp(pattern, path, prefix_len) == 0 ? TRUE : FALSE;
+    }
+  }
+
+  return pr_fnmatch(pattern, path, 0) == 0 ? TRUE : FALSE;
+}
+
 static size_t _strmatch(register char *s1, register char *s2) {
   register size_t len = 0;
 
@@ -515,7 +661,7 @@ static config_rec *recur_match_path(pool *p, xaset_t *s, char *path) {
        * OR if b) the given path, as is, is a pattern match.
        */
 
-      if (pr_fnmatch(suffixed_path, path, 0) == 0 ||
+      if (dir_suffix_match(suffixed_path, path) ||
           (pr_str_is_fnmatch(tmp_path) &&
            pr_fnmatch(tmp_path, path, 0) == 0)) {
         pr_trace_msg("directory", 8,
@@ -549,6 +695,8 @@ config_rec *dir_match_path(pool *p, char *path) {
   config_rec *res = NULL;
   char *tmp = NULL;
   size_t tmplen;
+  unsigned int hash;
+  struct dir_match_entry *dme, *victim = NULL;
 
   if (p == NULL ||
       path == NULL ||
@@ -569,12 +717,28 @@ config_rec *dir_match_path(pool *p, char *path) {
     *(tmp + tmplen - 1) = '\0';
   }
 
+  hash = dir_match_hash(tmp);
+  dme = dir_match_cache_get(tmp, hash, &victim);
+  if (dme != NULL) {
+    if (dme->dir != NULL) {
+      pr_trace_msg("directory", 3,
+        "matched <Directory %s> for path '%s' (cached)", dme->dir->name, tmp);
+      return dme->dir;
+    }
+
+    pr_trace_msg("directory", 3,
+      "no matching <Directory> found for '%s' (cached)", tmp);
+    errno = ENOENT;
+    return NULL;
+  }
+
   if (session.anon_config) {
     res = recur_match_path(p, session.anon_config->subset, tmp);
 
     if (!res) {
       if (session.chroot_path &&
           !strncmp(session.chroot_path, tmp, strlen(session.chroot_path))) {
+        dir_match_cache_set(victim, tmp, hash, NULL);
         return NULL;
       }
     }
@@ -584,13 +748,18 @@ config_rec *dir_match_path(pool *p, char *path) {
     res = recur_match_path(p, main_server->conf, tmp);
   }
 
+  dir_match_cache_set(victim, tmp, hash, res);
+
   if (res) {
     pr_trace_msg("directory", 3, "matched <Directory %s> for path '%s'",
       res->name, tmp);
 
   } else {
+    int xerrno = errno;
+
     pr_trace_msg("directory", 3, "no matching <Directory> found for '%s': %s",
-      tmp, strerror(errno));
+      tmp, strerror(xerrno));
+    errno = xerrno;
   }
 
   return res;
@@ -1597,6 +1766,7 @@ void build_dyn_config(pool *p, const char *_path, struct stat *stp,
       d->config_type = CONF_DIR;
       d->argc = 1;
       d->argv = pcalloc(d->pool, 2 * sizeof (void *));
+      dir_match_cache_clear();
 
     } else if (d) {
       config_rec *newd, *dnext;
@@ -1613,6 +1783,7 @@ void build_dyn_config(pool *p, const char *_path, struct stat *stp,
         newd->argc = 1;
         newd->argv = pcalloc(newd->pool, 2 * sizeof(void *));
 	newd->parent = d;
+        dir_match_cache_clear();
 
         d = newd;
 
@@ -1649,6 +1820,10 @@ void build_dyn_config(pool *p, const char *_path, struct stat *stp,
             xaset_remove(*set, (xasetmember_t *) d);
           }
         }
+
+        if (removed > 0) {
+          dir_match_cache_clear();
+        }
       }
     }
 
@@ -2300,6 +2475,8 @@ void resolve_anonymous_dirs(xaset_t *clist) {
     return;
   }
 
+  dir_match_cache_clear();
+
   for (c = (config_rec *) clist->xas_list; c; c = c->next) {
     if (c->config_type == CONF_DIR) {
       if (c->argv[1]) {
@@ -2331,6 +2508,8 @@ void resolve_deferred_dirs(server_rec *s) {
     return;
   }
 
+  dir_match_cache_clear();
+
   for (c = (config_rec *) s->conf->xas_list; c; c = c->next) {
     if (c->config_type == CONF_DIR &&
         (c->flags & CF_DEFER)) {
@@ -2471,6 +2650,9 @@ void fixup_dirs(server_rec *s, int flags) {
     return;
   }
 
+  /* The <Directory> tree may be about to change. */
+  dir_match_cache_clear();
+
   if (s->conf == NULL) {
     if (!(flags & CF_SILENT)) {
       pr_log_debug(DEBUG5, "%s", "");
@@ -1128,19 +1128,30 @@ struct fs_statcache {
   int sc_errno;
   int sc_retval;
   time_t sc_cached_ts;
+
+  /* The cache key, and the links of the cache's LRU list. */
+  const char *sc_path;
+  struct fs_statcache *sc_prev, *sc_next;
 };
 
-struct fs_statcache_evict_data {
-  time_t now;
-  time_t max_age;
-  pr_table_t *cache_tab;
+/* Each cache keeps its entries in a list in order of use, most recently
+ * used first, so that the least recently used entry can be evicted without
+ * scanning the table.
+ */
+struct fs_statcache_lru {
+  struct fs_statcache *head, *tail;
 };
 
+/* The tables use this many chains, or one per entry for larger caches. */
+#define FS_STATCACHE_MIN_NCHAINS	256
+
 static const char *statcache_channel = "fs.statcache";
 static pool *statcache_pool = NULL;
 static unsigned int statcache_size = 0;
 static unsigned int statcache_max_age = 0;
+static unsigned int statcache_neg_max_age = 0;
 static unsigned int statcache_flags = 0;
+static pr_fs_statcache_stats_t statcache_stats;
 
 /* We need to maintain two different caches: one for stat(2) data, and one
  * for lstat(2) data.  For some files (e.g. symlinks), the struct stat data
@@ -1148,117 +1159,128 @@ static unsigned int statcache_flags = 0;
  */
 static pr_table_t *stat_statcache_tab = NULL;
 static pr_table_t *lstat_statcache_tab = NULL;
+static struct fs_statcache_lru stat_statcache_lru;
+static struct fs_statcache_lru lstat_statcache_lru;
+
+/* Optional handler, registered by a module, for looking up the lstat(2) data
+ * for many paths at once.
+ */
+static int (*statcache_prefetch)(pool *, unsigned int, const char **,
+  struct stat *, int *) = NULL;
 
 #define fs_cache_lstat(f, p, s) cache_stat((f), (p), (s), FSIO_FILE_LSTAT)
 #define fs_cache_stat(f, p, s) cache_stat((f), (p), (s), FSIO_FILE_STAT)
 
-static const struct fs_statcache *fs_statcache_get(pr_table_t *cache_tab,
-    const char *path, size_t path_len, time_t now) {
-  const struct fs_statcache *sc = NULL;
+static struct fs_statcache_lru *fs_statcache_get_lru(pr_table_t *cache_tab) {
+  return (cache_tab == stat_statcache_tab ? &stat_statcache_lru :
+    &lstat_statcache_lru);
+}
 
-  if (pr_table_count(cache_tab) == 0) {
-    errno = EPERM;
-    return NULL;
+/* Entries for paths which do not exist may be kept for a different length
+ * of time than other entries.
+ */
+static unsigned int fs_statcache_max_age(const struct fs_statcache *sc) {
+  if (sc->sc_retval < 0 &&
+      sc->sc_errno == ENOENT) {
+    return statcache_neg_max_age;
   }
 
-  sc = pr_table_get(cache_tab, path, NULL);
-  if (sc != NULL) {
-    time_t age;
+  return statcache_max_age;
+}
 
-    /* If this item hasn't expired yet, return it, otherwise, remove it. */
-    age = now - sc->sc_cached_ts;
-    if (age <= statcache_max_age) {
-      pr_trace_msg(statcache_channel, 19,
-        "using cached entry for '%s' (age %lu %s)", path,
-        (unsigned long) age, age != 1 ? "secs" : "sec");
-      return sc;
-    }
+static void fs_statcache_unlink(struct fs_statcache_lru *lru,
+    struct fs_statcache *sc) {
+  if (sc->sc_prev != NULL) {
+    sc->sc_prev->sc_next = sc->sc_next;
 
-    pr_trace_msg(statcache_channel, 14,
-      "entry for '%s' expired (age %lu %s > max age %lu), removing", path,
-      (unsigned long) age, age != 1 ? "secs" : "sec",
-      (unsigned long) statcache_max_age);
-    (void) pr_table_remove(cache_tab, path, NULL);
-    destroy_pool(sc->sc_pool);
+  } else {
+    lru->head = sc->sc_next;
   }
 
-  errno = ENOENT;
-  return NULL;
+  if (sc->sc_next != NULL) {
+    sc->sc_next->sc_prev = sc->sc_prev;
+
+  } else {
+    lru->tail = sc->sc_prev;
+  }
+
+  sc->sc_prev = sc->sc_next = NULL;
 }
 
-static int fs_statcache_evict_expired(const void *key_data, size_t key_datasz,
-    const void *value_data, size_t value_datasz, void *user_data) {
-  const struct fs_statcache *sc;
-  struct fs_statcache_evict_data *evict_data;
-  time_t age;
-  pr_table_t *cache_tab = NULL;
+static void fs_statcache_link(struct fs_statcache_lru *lru,
+    struct fs_statcache *sc) {
+  sc->sc_prev = NULL;
+  sc->sc_next = lru->head;
 
-  sc = value_data;
-  evict_data = user_data;
+  if (lru->head != NULL) {
+    lru->head->sc_prev = sc;
 
-  cache_tab = evict_data->cache_tab;
-  age = evict_data->now - sc->sc_cached_ts;
-  if (age > evict_data->max_age) {
-    pr_trace_msg(statcache_channel, 14,
-      "entry for '%s' expired (age %lu %s > max age %lu), evicting",
-      (char *) key_data, (unsigned long) age, age != 1 ? "secs" : "sec",
-      (unsigned long) evict_data->max_age);
-    (void) pr_table_kremove(cache_tab, key_data, key_datasz, NULL);
-    destroy_pool(sc->sc_pool);
+  } else {
+    lru->tail = sc;
   }
 
-  return 0;
+  lru->head = sc;
 }
 
-static int fs_statcache_evict(pr_table_t *cache_tab, time_t now) {
-  int res, table_count;
-  struct fs_statcache_evict_data evict_data;
+static void fs_statcache_remove(pr_table_t *cache_tab,
+    struct fs_statcache *sc) {
+  fs_statcache_unlink(fs_statcache_get_lru(cache_tab), sc);
+  (void) pr_table_remove(cache_tab, sc->sc_path, NULL);
+  destroy_pool(sc->sc_pool);
+}
 
-  /* We try to make room in two passes.  First, evict any item that has
-   * exceeded the maximum age.  After that, if we are still not low enough,
-   * lower the maximum age, and try again.  If not enough room by then, then
-   * we'll try again on the next stat.
-   */
+static const struct fs_statcache *fs_statcache_get(pr_table_t *cache_tab,
+    const char *path, size_t path_len, time_t now) {
+  struct fs_statcache *sc = NULL;
 
-  evict_data.now = now;
-  evict_data.max_age = statcache_max_age;
-  evict_data.cache_tab = cache_tab;
+  if (pr_table_count(cache_tab) == 0) {
+    if (statcache_size > 0) {
+      statcache_stats.misses++;
+    }
 
-  res = pr_table_do(cache_tab, fs_statcache_evict_expired, &evict_data,
-    PR_TABLE_DO_FL_ALL);
-  if (res < 0) {
-    pr_trace_msg(statcache_channel, 4,
-      "error evicting expired items: %s", strerror(errno));
+    errno = EPERM;
+    return NULL;
   }
 
-  table_count = pr_table_count(cache_tab);
-  if (table_count < 0 ||
-      (unsigned int) table_count < statcache_size) {
-    return 0;
-  }
+  sc = (struct fs_statcache *) pr_table_get(cache_tab, path, NULL);
+  if (sc != NULL) {
+    time_t age;
+    unsigned int max_age;
 
-  /* Try for a shorter max age. */
-  if (statcache_max_age > 10) {
-    evict_data.max_age = (statcache_max_age - 10);
-    res = pr_table_do(cache_tab, fs_statcache_evict_expired, &evict_data,
-      PR_TABLE_DO_FL_ALL);
-    if (res < 0) {
-      pr_trace_msg(statcache_channel, 4,
-        "error evicting expired items: %s", strerror(errno));
+    /* If this item hasn't expired yet, return it, otherwise, remove it. */
+    age = now - sc->sc_cached_ts;
+    max_age = fs_statcache_max_age(sc);
+    if (age <= max_age) {
+      pr_trace_msg(statcache_channel, 19,
+        "using cached entry for '%s' (age %lu %s)", path,
+        (unsigned long) age, age != 1 ? "secs" : "sec");
+
+      if (sc->sc_prev != NULL) {
+        struct fs_statcache_lru *lru;
+
+        lru = fs_statcache_get_lru(cache_tab);
+        fs_statcache_unlink(lru, sc);
+        fs_statcache_link(lru, sc);
+      }
+
+      statcache_stats.hits++;
+      if (sc->sc_retval < 0) {
+        statcache_stats.negative_hits++;
+      }
+
+      return sc;
     }
-  }
 
-  table_count = pr_table_count(cache_tab);
-  if (table_count < 0 ||
-      (unsigned int) table_count < statcache_size) {
-    return 0;
+    pr_trace_msg(statcache_channel, 14,
+      "entry for '%s' expired (age %lu %s > max age %lu), removing", path,
+      (unsigned long) age, age != 1 ? "secs" : "sec", (unsigned long) max_age);
+    fs_statcache_remove(cache_tab, sc);
+    statcache_stats.expirations++;
   }
 
-  pr_trace_msg(statcache_channel, 14,
-    "still not enough room in cache (size %d >= max %d)",
-    pr_table_count(cache_tab), statcache_size);
-  errno = EPERM;
-  return -1;
+  statcache_stats.misses++;
+  errno = ENOENT;
+  return NULL;
 }
 
 /* Returns 1 if we successfully added a cache entry, 0 if not, and -1 if
@@ -1269,6 +1291,7 @@ static int fs_statcache_add(pr_table_t *cache_tab, const char *path,
   int res, table_count;
   pool *sc_pool;
   struct fs_statcache *sc;
+  struct fs_statcache_lru *lru;
 
   if (statcache_size == 0 ||
       statcache_max_age == 0) {
@@ -1276,14 +1299,29 @@ static int fs_statcache_add(pr_table_t *cache_tab, const char *path,
     return 0;
   }
 
+  if (retval < 0 &&
+      xerrno == ENOENT &&
+      statcache_neg_max_age == 0) {
+    /* Negative caching disabled. */
+    return 0;
+  }
+
+  lru = fs_statcache_get_lru(cache_tab);
+
+  /* If we've reached capacity, evict the least recently used entries to
+   * make room.
+   */
   table_count = pr_table_count(cache_tab);
-  if (table_count > 0 &&
-      (unsigned int) table_count >= statcache_size) {
-    /* We've reached capacity, and need to evict some items to make room. */
-    if (fs_statcache_evict(cache_tab, now) < 0) {
-      pr_trace_msg(statcache_channel, 8,
-        "unable to evict enough items from the cache: %s", strerror(errno));
-    }
+  while (table_count > 0 &&
+         (unsigned int) table_count >= statcache_size &&
+         lru->tail != NULL) {
+    pr_trace_msg(statcache_channel, 14,
+      "cache full (size %d >= max %u), evicting entry for '%s'", table_count,
+      statcache_size, lru->tail->sc_path);
+    fs_statcache_remove(cache_tab, lru->tail);
+    statcache_stats.evictions++;
+
+    table_count = pr_table_count(cache_tab);
   }
 
   sc_pool = make_sub_pool(statcache_pool);
@@ -1294,8 +1332,9 @@ static int fs_statcache_add(pr_table_t *cache_tab, const char *path,
   sc->sc_errno = xerrno;
   sc->sc_retval = retval;
   sc->sc_cached_ts = now;
+  sc->sc_path = pstrndup(sc_pool, path, path_len);
 
-  res = pr_table_add(cache_tab, pstrndup(sc_pool, path, path_len), sc,
+  res = pr_table_add(cache_tab, sc->sc_path, sc,
     sizeof(struct fs_statcache *));
   if (res < 0) {
     int tmp_errno = errno;
@@ -1306,15 +1345,57 @@ static int fs_statcache_add(pr_table_t *cache_tab, const char *path,
 
     destroy_pool(sc->sc_pool);
     errno = tmp_errno;
+    return res;
+  }
+
+  fs_statcache_link(lru, sc);
+  return 1;
+}
+
+/* Constructs the key used in the statcache for the given path, for
+ * filesystems using standard paths.
+ */
+static void fs_statcache_path(const char *path, char *cleaned_path,
+    size_t cleaned_pathsz) {
+  char pathbuf[PR_TUNABLE_PATH_MAX+1];
+
+  memset(pathbuf, '\0', sizeof(pathbuf));
+
+  /* Use only absolute path names.  Construct them, if given a relative
+   * path, based on cwd.  This obviates the need for something like
+   * realpath(3), which only introduces more stat(2) system calls.
+   */
+  if (*path != '/') {
+    size_t pathbuf_len;
+
+    sstrcat(pathbuf, cwd, sizeof(pathbuf)-1);
+    pathbuf_len = cwd_len;
+
+    /* If the cwd is "/", we don't need to duplicate the path separator.
+     * On some systems (e.g. Cygwin), this duplication can cause problems,
+     * as the path may then have different semantics.
+     */
+    if (strncmp(cwd, "/", 2) != 0) {
+      sstrcat(pathbuf + pathbuf_len, "/", sizeof(pathbuf) - pathbuf_len - 1);
+      pathbuf_len++;
+    }
+
+    /* If the given directory is ".", then we don't need to append it. */
+    if (strncmp(path, ".", 2) != 0) {
+      sstrcat(pathbuf + pathbuf_len, path, sizeof(pathbuf)- pathbuf_len - 1);
+    }
+
+  } else {
+    sstrncpy(pathbuf, path, sizeof(pathbuf)-1);
   }
 
-  return (res == 0 ? 1 : res);
+  pr_fs_clean_path2(pathbuf, cleaned_path, cleaned_pathsz, 0);
 }
 
 static int cache_stat(pr_fs_t *fs, const char *path, struct stat *st,
     unsigned int op) {
   int res = -1, retval, xerrno = 0;
-  char cleaned_path[PR_TUNABLE_PATH_MAX+1], pathbuf[PR_TUNABLE_PATH_MAX+1];
+  char cleaned_path[PR_TUNABLE_PATH_MAX+1];
   int (*mystat)(pr_fs_t *, const char *, struct stat *) = NULL;
   size_t path_len;
   pr_table_t *cache_tab = NULL;
@@ -1323,38 +1404,9 @@ static int cache_stat(pr_fs_t *fs, const char *path, struct stat *st,
 
   now = time(NULL);
   memset(cleaned_path, '\0', sizeof(cleaned_path));
-  memset(pathbuf, '\0', sizeof(pathbuf));
 
   if (fs->non_std_path == FALSE) {
-    /* Use only absolute path names.  Construct them, if given a relative
-     * path, based on cwd.  This obviates the need for something like
-     * realpath(3), which only introduces more stat(2) system calls.
-     */
-    if (*path != '/') {
-      size_t pathbuf_len;
-
-      sstrcat(pathbuf, cwd, sizeof(pathbuf)-1);
-      pathbuf_len = cwd_len;
-
-      /* If the cwd is "/", we don't need to duplicate the path separator.
-       * On some systems (e.g. Cygwin), this duplication can cause problems,
-       * as the path may then have different semantics.
-       */
-      if (strncmp(cwd, "/", 2) != 0) {
-        sstrcat(pathbuf + pathbuf_len, "/", sizeof(pathbuf) - pathbuf_len - 1);
-        pathbuf_len++;
-      }
-
-      /* If the given directory is ".", then we don't need to append it. */
-      if (strncmp(path, ".", 2) != 0) {
-        sstrcat(pathbuf + pathbuf_len, path, sizeof(pathbuf)- pathbuf_len - 1);
-      }
-
-    } else {
-      sstrncpy(pathbuf, path, sizeof(pathbuf)-1);
-    }
-
-    pr_fs_clean_path2(pathbuf, cleaned_path, sizeof(cleaned_path)-1, 0);
+    fs_statcache_path(path, cleaned_path, sizeof(cleaned_path)-1);
 
   } else {
     sstrncpy(cleaned_path, path, sizeof(cleaned_path)-1);
@@ -1596,6 +1648,35 @@ static void statcache_dumpf(const char *fmt, ...) {
 void pr_fs_statcache_dump(void) {
   pr_table_dump(statcache_dumpf, stat_statcache_tab);
   pr_table_dump(statcache_dumpf, lstat_statcache_tab);
+
+  statcache_dumpf("hits: %lu (negative: %lu), misses: %lu, evictions: %lu, "
+    "expirations: %lu", statcache_stats.hits, statcache_stats.negative_hits,
+    statcache_stats.misses, statcache_stats.evictions,
+    statcache_stats.expirations);
+}
+
+/* Sizes the cache's table for the configured number of entries, so that
+ * lookups stay short, and so that the table does not refuse entries before
+ * the cache is full.
+ */
+static void fs_statcache_size_tab(pr_table_t *cache_tab) {
+  unsigned int nmaxents;
+
+  if (cache_tab == NULL ||
+      statcache_size == 0) {
+    return;
+  }
+
+  if (statcache_size > FS_STATCACHE_MIN_NCHAINS &&
+      pr_table_count(cache_tab) == 0) {
+    unsigned int nchains;
+
+    nchains = statcache_size;
+    (void) pr_table_ctl(cache_tab, PR_TABLE_CTL_SET_NCHAINS, &nchains);
+  }
+
+  nmaxents = statcache_size + 1;
+  (void) pr_table_ctl(cache_tab, PR_TABLE_CTL_SET_MAX_ENTS, &nmaxents);
 }
 
 void pr_fs_statcache_free(void) {
@@ -1623,6 +1704,9 @@ void pr_fs_statcache_free(void) {
     lstat_statcache_tab = NULL;
   }
 
+  memset(&stat_statcache_lru, 0, sizeof(stat_statcache_lru));
+  memset(&lstat_statcache_lru, 0, sizeof(lstat_statcache_lru));
+
   /* Note: we do not need to explicitly destroy each entry in the statcache
    * tables, since ALL entries are allocated out of this statcache_pool.
    * And we destroy this pool here.  Much easier cleanup that way.
@@ -1643,6 +1727,9 @@ void pr_fs_statcache_reset(void) {
 
   stat_statcache_tab = pr_table_alloc(statcache_pool, 0);
   lstat_statcache_tab = pr_table_alloc(statcache_pool, 0);
+
+  fs_statcache_size_tab(stat_statcache_tab);
+  fs_statcache_size_tab(lstat_statcache_tab);
 }
 
 int pr_fs_statcache_set_policy(unsigned int size, unsigned int max_age,
@@ -1650,77 +1737,184 @@ int pr_fs_statcache_set_policy(unsigned int size, unsigned int max_age,
 
   statcache_size = size;
   statcache_max_age = max_age;
+  statcache_neg_max_age = max_age;
   statcache_flags = flags;
 
+  fs_statcache_size_tab(stat_statcache_tab);
+  fs_statcache_size_tab(lstat_statcache_tab);
+
   return 0;
 }
 
-int pr_fs_clear_cache2(const char *path) {
-  int res;
+int pr_fs_statcache_set_negative_max_age(unsigned int max_age) {
+  statcache_neg_max_age = max_age;
+  return 0;
+}
 
-  (void) pr_event_generate("fs.statcache.clear", path);
+int pr_fs_statcache_get_stats(pr_fs_statcache_stats_t *stats) {
+  if (stats == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
 
-  if (pr_table_count(stat_statcache_tab) == 0 &&
-      pr_table_count(lstat_statcache_tab) == 0) {
+  memcpy(stats, &statcache_stats, sizeof(pr_fs_statcache_stats_t));
+  return 0;
+}
+
+int pr_fs_statcache_set_prefetch(int (*prefetch)(pool *, unsigned int,
+    const char **, struct stat *, int *)) {
+  statcache_prefetch = prefetch;
+  return 0;
+}
+
+int pr_fs_statcache_prefetch(pool *p, const char *dir, const char **names,
+    unsigned int count) {
+  register unsigned int i;
+  unsigned int npaths = 0;
+  const char **paths;
+  struct stat *sts;
+  int res, *errnos;
+  pool *tmp_pool;
+  time_t now;
+
+  if (p == NULL ||
+      names == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (statcache_prefetch == NULL ||
+      statcache_size == 0 ||
+      statcache_max_age == 0 ||
+      lstat_statcache_tab == NULL) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  /* Do not prefetch more than the cache can hold; the earlier entries would
+   * only be evicted by the later ones.
+   */
+  if (count > statcache_size) {
+    count = statcache_size;
+  }
+
+  if (count == 0) {
     return 0;
   }
 
-  if (path != NULL) {
-    char cleaned_path[PR_TUNABLE_PATH_MAX+1], pathbuf[PR_TUNABLE_PATH_MAX+1];
-    int lstat_count, stat_count;
+  tmp_pool = make_sub_pool(p);
+  pr_pool_tag(tmp_pool, "FS statcache prefetch pool");
 
-    if (*path != '/') {
-      size_t pathbuf_len;
+  paths = pcalloc(tmp_pool, count * sizeof(char *));
+  for (i = 0; i < count; i++) {
+    char cleaned_path[PR_TUNABLE_PATH_MAX+1];
+    const char *path;
+    pr_fs_t *fs;
 
-      memset(cleaned_path, '\0', sizeof(cleaned_path));
-      memset(pathbuf, '\0', sizeof(pathbuf));
+    path = names[i];
+    if (dir != NULL) {
+      path = pdircat(tmp_pool, dir, names[i], NULL);
+    }
 
-      sstrcat(pathbuf, cwd, sizeof(pathbuf)-1);
-      pathbuf_len = cwd_len;
+    /* Only paths which would be handled by the system lstat(2) can be
+     * prefetched; a module's custom lstat() handler must see every lookup.
+     */
+    fs = lookup_file_fs(path, NULL, FSIO_FILE_LSTAT);
+    while (fs && fs->fs_next && !fs->lstat) {
+      fs = fs->fs_next;
+    }
 
-      if (strncmp(cwd, "/", 2) != 0) {
-        sstrcat(pathbuf + pathbuf_len, "/", sizeof(pathbuf) - pathbuf_len - 1);
-        pathbuf_len++;
-      }
+    if (fs == NULL ||
+        fs->non_std_path == TRUE ||
+        (fs->lstat != NULL && fs->lstat != sys_lstat)) {
+      continue;
+    }
 
-      if (strncmp(path, ".", 2) != 0) {
-        sstrcat(pathbuf + pathbuf_len, path, sizeof(pathbuf)- pathbuf_len - 1);
-      }
+    memset(cleaned_path, '\0', sizeof(cleaned_path));
+    fs_statcache_path(path, cleaned_path, sizeof(cleaned_path)-1);
+    paths[npaths++] = pstrdup(tmp_pool, cleaned_path);
+  }
 
-    } else {
-      sstrncpy(pathbuf, path, sizeof(pathbuf)-1);
+  if (npaths == 0) {
+    destroy_pool(tmp_pool);
+    return count;
+  }
+
+  sts = pcalloc(tmp_pool, npaths * sizeof(struct stat));
+  errnos = pcalloc(tmp_pool, npaths * sizeof(int));
+
+  res = (statcache_prefetch)(tmp_pool, npaths, paths, sts, errnos);
+  if (res < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(statcache_channel, 8,
+      "error prefetching %u lstat() %s: %s", npaths,
+      npaths != 1 ? "entries" : "entry", strerror(xerrno));
+    destroy_pool(tmp_pool);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  now = time(NULL);
+  for (i = 0; i < npaths; i++) {
+    struct fs_statcache *sc;
+    size_t path_len;
+
+    /* Replace any older entry for this path with the fresh data. */
+    sc = (struct fs_statcache *) pr_table_get(lstat_statcache_tab, paths[i],
+      NULL);
+    if (sc != NULL) {
+      fs_statcache_remove(lstat_statcache_tab, sc);
     }
 
-    pr_fs_clean_path2(pathbuf, cleaned_path, sizeof(cleaned_path)-1, 0);
+    path_len = strlen(paths[i]);
+    (void) fs_statcache_add(lstat_statcache_tab, paths[i], path_len, &(sts[i]),
+      errnos[i], errnos[i] != 0 ? -1 : 0, now);
+  }
 
-    res = 0;
+  pr_trace_msg(statcache_channel, 14, "prefetched %u lstat() %s", npaths,
+    npaths != 1 ? "entries" : "entry");
 
-    stat_count = pr_table_exists(stat_statcache_tab, cleaned_path);
-    if (stat_count > 0) {
-      const struct fs_statcache *sc;
+  destroy_pool(tmp_pool);
+  return count;
+}
 
-      sc = pr_table_remove(stat_statcache_tab, cleaned_path, NULL);
-      if (sc != NULL) {
-        destroy_pool(sc->sc_pool);
-      }
+int pr_fs_clear_cache2(const char *path) {
+  int res;
+
+  (void) pr_event_generate("fs.statcache.clear", path);
+
+  if (pr_table_count(stat_statcache_tab) == 0 &&
+      pr_table_count(lstat_statcache_tab) == 0) {
+    return 0;
+  }
+
+  if (path != NULL) {
+    char cleaned_path[PR_TUNABLE_PATH_MAX+1];
+    struct fs_statcache *sc;
 
+    memset(cleaned_path, '\0', sizeof(cleaned_path));
+    fs_statcache_path(path, cleaned_path, sizeof(cleaned_path)-1);
+
+    res = 0;
+
+    sc = (struct fs_statcache *) pr_table_get(stat_statcache_tab, cleaned_path,
+      NULL);
+    if (sc != NULL) {
+      fs_statcache_remove(stat_statcache_tab, sc);
       pr_trace_msg(statcache_channel, 17, "cleared stat(2) entry for '%s'",
         path);
-      res += stat_count;
+      res++;
     }
 
-    lstat_count = pr_table_exists(lstat_statcache_tab, cleaned_path);
-    if (lstat_count > 0) {
-      const struct fs_statcache *sc;
-
-      sc = pr_table_remove(lstat_statcache_tab, cleaned_path, NULL);
-      if (sc != NULL) {
-        destroy_pool(sc->sc_pool);
-      }
-
+    sc = (struct fs_statcache *) pr_table_get(lstat_statcache_tab,
+      cleaned_path, NULL);
+    if (sc != NULL) {
+      fs_statcache_remove(lstat_statcache_tab, sc);
       pr_trace_msg(statcache_channel, 17, "cleared lstat(2) entry for '%s'",
         path);
-      res += lstat_count;
+      res++;
     }
 
   } else {
@@ -4774,6 +4968,10 @@ pr_fh_t *pr_fsio_open_canon(const char *name, int flags) {
     pr_fs_clear_cache2(name);
   }
 
+  if (flags & (O_WRONLY|O_RDWR)) {
+    (void) pr_listcache_invalidate(name);
+  }
+
   if (fcntl(fh->fh_fd, F_SETFD, FD_CLOEXEC) < 0) {
     if (errno != EBADF) {
       pr_trace_msg(trace_channel, 1, "error setting CLOEXEC on file fd %d: %s",
@@ -4835,6 +5033,10 @@ pr_fh_t *pr_fsio_open(const char *name, int flags) {
     pr_fs_clear_cache2(name);
   }
 
+  if (flags & (O_WRONLY|O_RDWR)) {
+    (void) pr_listcache_invalidate(name);
+  }
+
   if (fcntl(fh->fh_fd, F_SETFD, FD_CLOEXEC) < 0) {
     if (errno != EBADF) {
       pr_trace_msg(trace_channel, 1, "error setting CLOEXEC on file fd %d: %s",
@@ -5005,6 +5207,7 @@ int pr_fsio_link(const char *target_path, const char *link_path) {
   res = (fs->link)(fs, target_path, link_path);
   if (res == 0) {
     pr_fs_clear_cache2(link_path);
+    (void) pr_listcache_invalidate(target_path);
   }
 
   return res;
@@ -5064,6 +5267,7 @@ int pr_fsio_ftruncate(pr_fh_t *fh, off_t len) {
   res = (fs->ftruncate)(fh, fh->fh_fd, len);
   if (res == 0) {
     pr_fs_clear_cache2(fh->fh_path);
+    (void) pr_listcache_invalidate(fh->fh_path);
 
     /* Clear any read buffer. */
     if (fh->fh_buf != NULL) {
@@ -5101,6 +5305,7 @@ int pr_fsio_truncate(const char *path, off_t len) {
   res = (fs->truncate)(fs, path, len);
   if (res == 0) {
     pr_fs_clear_cache2(path);
+    (void) pr_listcache_invalidate(path);
   }
   
   return res;
@@ -5132,6 +5337,7 @@ int pr_fsio_chmod(const char *name, mode_t mode) {
   res = (fs->chmod)(fs, name, mode);
   if (res == 0) {
     pr_fs_clear_cache2(name);
+    (void) pr_listcache_invalidate(name);
   }
 
   return res;
@@ -5159,6 +5365,7 @@ int pr_fsio_fchmod(pr_fh_t *fh, mode_t mode) {
   res = (fs->fchmod)(fh, fh->fh_fd, mode);
   if (res == 0) {
     pr_fs_clear_cache2(fh->fh_path);
+    (void) pr_listcache_invalidate(fh->fh_path);
   }
 
   return res;
@@ -5190,6 +5397,7 @@ int pr_fsio_chown(const char *name, uid_t uid, gid_t gid) {
   res = (fs->chown)(fs, name, uid, gid);
   if (res == 0) {
     pr_fs_clear_cache2(name);
+    (void) pr_listcache_invalidate(name);
   }
 
   return res;
@@ -5217,6 +5425,7 @@ int pr_fsio_fchown(pr_fh_t *fh, uid_t uid, gid_t gid) {
   res = (fs->fchown)(fh, fh->fh_fd, uid, gid);
   if (res == 0) {
     pr_fs_clear_cache2(fh->fh_path);
+    (void) pr_listcache_invalidate(fh->fh_path);
   }
 
   return res;
@@ -5248,6 +5457,7 @@ int pr_fsio_lchown(const char *name, uid_t uid, gid_t gid) {
   res = (fs->lchown)(fs, name, uid, gid);
   if (res == 0) {
     pr_fs_clear_cache2(name);
+    (void) pr_listcache_invalidate(name);
   }
 
   return res;
@@ -5328,6 +5538,7 @@ int pr_fsio_utimes(const char *path, struct timeval *tvs) {
   res = (fs->utimes)(fs, path, tvs);
   if (res == 0) {
     pr_fs_clear_cache2(path);
+    (void) pr_listcache_invalidate(path);
   }
 
   return res;
@@ -5423,6 +5634,7 @@ int pr_fsio_futimes(pr_fh_t *fh, struct timeval *tvs) {
   res = (fs->futimes)(fh, fh->fh_fd, tvs);
   if (res == 0) {
     pr_fs_clear_cache2(fh->fh_path);
+    (void) pr_listcache_invalidate(fh->fh_path);
   }
 
   return res;
@@ -6495,7 +6707,7 @@ int pr_fs_fgetsize(int fd, off_t *fs_size) {
 }
 
 void pr_fs_fadvise(int fd, off_t offset, off_t len, int advice) {
-#if defined(HAVE_POSIX_ADVISE)
+#if defined(HAVE_POSIX_FADVISE)
   int res, posix_advice;
   const char *advice_str;
 
@@ -6539,12 +6751,15 @@ void pr_fs_fadvise(int fd, off_t offset, off_t len, int advice) {
       return;
   }
 
+  /* Note that posix_fadvise(3) returns the error number directly, rather
+   * than setting errno.
+   */
   res = posix_fadvise(fd, offset, len, posix_advice);
-  if (res < 0) {
+  if (res != 0) {
     pr_trace_msg(trace_channel, 9,
       "posix_fadvise() error on fd %d (off %" PR_LU ", len %" PR_LU ", "
       "advice %s): %s", fd, (pr_off_t) offset, (pr_off_t) len, advice_str,
-      strerror(errno));
+      strerror(res));
   }
 #endif
 
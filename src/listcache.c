@@ -0,0 +1,802 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Directory listing cache */
+
+#include "conf.h"
+
+#if defined(AT_FDCWD)
+
+#ifndef O_NOFOLLOW
+# define O_NOFOLLOW	0
+#endif
+
+/* A cached listing is a file in the UID's subdirectory of the cache
+ * directory (see cachedir.h), named for the device and inode numbers of the
+ * listed directory, and the hash of the listing key ("dev-ino-hash", in
+ * hex).  Each file starts with this header, followed by the full key, then
+ * the listing bytes.
+ */
+struct listcache_header {
+  uint32_t magic;
+  uint32_t keylen;
+  uint64_t dev;
+  uint64_t ino;
+  int64_t mtime;
+  int64_t ctime;
+  int64_t created;
+  uint64_t datalen;
+};
+
+#define LISTCACHE_MAGIC		0x704c4331
+
+/* A session can only remove its own UID's listings.  To invalidate the
+ * listings of a directory for all UIDs, a world-writable marker file, named
+ * for the directory ("dev-ino"), is written to; listings created no later
+ * than the marker's mtime are not used.  At worst, someone else can thus
+ * cause listings not to be used, but they cannot change their contents.
+ */
+#define LISTCACHE_MARKER_MODE	0666
+
+struct listcache_dirid {
+  dev_t dev;
+  ino_t ino;
+};
+
+static pool *listcache_pool = NULL;
+static pr_cachedir_t listcache_dir = { -1, -1, (uid_t) -1 };
+static unsigned int listcache_max_age = PR_TUNABLE_LISTCACHE_MAX_AGE;
+
+/* Directories whose listings have been invalidated, but not yet flushed. */
+static array_header *listcache_pending = NULL;
+
+/* The listing currently being captured, if any. */
+static int capture_fd = -1, capture_userfd = -1, capture_failed = FALSE;
+static char capture_tmp_name[64], capture_name[80];
+static const char *capture_dir = NULL;
+static struct listcache_header capture_hdr;
+
+static const char *trace_channel = "listcache";
+
+static const char *listcache_get_key(pool *p, const char *dir,
+    const char *key) {
+  char sid[32];
+  const char *class_name = NULL, *encoding = NULL, *addr = NULL;
+
+  memset(sid, '\0', sizeof(sid));
+  snprintf(sid, sizeof(sid)-1, "%u", main_server ? main_server->sid : 0);
+
+  if (session.conn_class != NULL) {
+    class_name = session.conn_class->cls_name;
+  }
+
+  /* <Limit> Allow/Deny rules, with HideNoAccess/IgnoreHidden, can hide
+   * entries based on the client's address, so listings are not shared
+   * between clients.
+   */
+  if (session.c != NULL &&
+      session.c->remote_addr != NULL) {
+    addr = pr_netaddr_get_ipstr(session.c->remote_addr);
+  }
+
+#ifdef PR_USE_NLS
+  encoding = pr_encode_get_encoding();
+#endif /* PR_USE_NLS */
+
+  return pstrcat(p, "sid=", sid,
+    "\naddr=", addr ? addr : "",
+    "\nuser=", session.user ? session.user : "",
+    "\ngroup=", session.group ? session.group : "",
+    "\nclass=", class_name ? class_name : "",
+    "\nchroot=", session.chroot_path ? session.chroot_path : "",
+    "\nencoding=", encoding ? encoding : "",
+    "\ndir=", dir, "\n", key, NULL);
+}
+
+/* FNV-1a */
+static uint64_t listcache_hash(const char *key, size_t keylen) {
+  register size_t i;
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  for (i = 0; i < keylen; i++) {
+    h ^= (unsigned char) key[i];
+    h *= 0x100000001b3ULL;
+  }
+
+  return h;
+}
+
+static void listcache_get_marker(char *buf, size_t bufsz, dev_t dev,
+    ino_t ino) {
+  memset(buf, '\0', bufsz);
+  snprintf(buf, bufsz-1, "%llx-%llx", (unsigned long long) dev,
+    (unsigned long long) ino);
+}
+
+static void listcache_get_name(char *buf, size_t bufsz, dev_t dev,
+    ino_t ino, const char *key, size_t keylen) {
+  memset(buf, '\0', bufsz);
+  snprintf(buf, bufsz-1, "%llx-%llx-%016llx", (unsigned long long) dev,
+    (unsigned long long) ino,
+    (unsigned long long) listcache_hash(key, keylen));
+}
+
+static int listcache_stat_dir(const char *dir, struct stat *st) {
+  pr_fs_clear_cache2(dir);
+  if (pr_fsio_stat(dir, st) < 0) {
+    return -1;
+  }
+
+  if (!S_ISDIR(st->st_mode)) {
+    errno = ENOTDIR;
+    return -1;
+  }
+
+  return 0;
+}
+
+int pr_listcache_clear(const char *path) {
+  if (pr_cachedir_clear(path) < 0) {
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9, "cleared listing cache '%s'", path);
+  return 0;
+}
+
+int pr_listcache_open(const char *path) {
+  pr_cachedir_t dir;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (pr_cachedir_open(&dir, path) < 0) {
+    int xerrno = errno;
+
+    if (xerrno == EPERM) {
+      pr_log_pri(PR_LOG_WARNING, "unable to use listing cache '%s': "
+        "directory is writable by others, but not sticky", path);
+    }
+
+    errno = xerrno;
+    return -1;
+  }
+
+  if (listcache_dir.dirfd >= 0) {
+    (void) pr_listcache_close();
+  }
+
+  listcache_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(listcache_pool, "Listing Cache Pool");
+
+  listcache_pending = make_array(listcache_pool, 4,
+    sizeof(struct listcache_dirid));
+  listcache_dir = dir;
+
+  pr_trace_msg(trace_channel, 9, "using listing cache '%s'", path);
+  return 0;
+}
+
+int pr_listcache_close(void) {
+  if (listcache_dir.dirfd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pr_listcache_discard();
+  (void) pr_cachedir_close(&listcache_dir);
+
+  destroy_pool(listcache_pool);
+  listcache_pool = NULL;
+  listcache_pending = NULL;
+
+  return 0;
+}
+
+int pr_listcache_set_max_age(unsigned int max_age) {
+  listcache_max_age = max_age;
+  return 0;
+}
+
+#ifdef HAVE_SENDFILE
+static int listcache_sendfile(int fd, off_t offset, off_t len) {
+  off_t end;
+
+  end = offset + len;
+  while (offset < end) {
+    pr_sendfile_t res;
+
+    pr_signals_handle();
+
+    res = pr_data_sendfile(fd, &offset, end - offset);
+    if (res < 0) {
+      if (errno == EINTR ||
+          errno == EAGAIN) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (res == 0) {
+      errno = EPIPE;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+#endif /* HAVE_SENDFILE */
+
+static int listcache_sendbuf(pool *p, int fd, off_t len) {
+  char *buf;
+  size_t bufsz;
+  int res = 0, ascii_flags;
+
+  bufsz = pr_config_get_server_xfer_bufsz(PR_NETIO_IO_WR);
+  buf = palloc(p, bufsz);
+
+  /* The cached bytes are already in their network form; make sure that
+   * pr_data_xfer() does not translate them again.
+   */
+  ascii_flags = session.sf_flags & (SF_ASCII|SF_ASCII_OVERRIDE);
+  session.sf_flags &= ~(SF_ASCII|SF_ASCII_OVERRIDE);
+
+  while (len > 0) {
+    ssize_t nread;
+
+    pr_signals_handle();
+
+    nread = read(fd, buf, len < (off_t) bufsz ? (size_t) len : bufsz);
+    if (nread < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      res = -1;
+      break;
+    }
+
+    if (nread == 0) {
+      errno = EIO;
+      res = -1;
+      break;
+    }
+
+    if (pr_data_xfer(buf, nread) < 0) {
+      res = -1;
+      break;
+    }
+
+    len -= nread;
+  }
+
+  session.sf_flags |= ascii_flags;
+  return res;
+}
+
+int pr_listcache_send(pool *p, const char *dir, const char *key) {
+  int fd, userfd, xerrno, res;
+  const char *full_key;
+  char marker[64], name[80], *buf;
+  size_t keylen;
+  struct stat st;
+  struct listcache_header hdr;
+  off_t offset;
+  time_t now;
+
+  if (p == NULL ||
+      dir == NULL ||
+      key == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (listcache_dir.dirfd < 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  userfd = pr_cachedir_get_userfd(&listcache_dir, FALSE);
+  if (userfd < 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (listcache_stat_dir(dir, &st) < 0) {
+    return -1;
+  }
+
+  full_key = listcache_get_key(p, dir, key);
+  keylen = strlen(full_key);
+
+  listcache_get_marker(marker, sizeof(marker), st.st_dev, st.st_ino);
+  listcache_get_name(name, sizeof(name), st.st_dev, st.st_ino, full_key,
+    keylen);
+
+  fd = openat(userfd, name, O_RDONLY|O_NOFOLLOW);
+  if (fd < 0) {
+    pr_trace_msg(trace_channel, 8, "no cached listing for '%s' (%s)", dir,
+      strerror(errno));
+    errno = ENOENT;
+    return -1;
+  }
+
+  (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  now = time(NULL);
+  buf = palloc(p, keylen);
+
+  if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+      hdr.magic != LISTCACHE_MAGIC ||
+      hdr.keylen != keylen ||
+      read(fd, buf, keylen) != (ssize_t) keylen ||
+      memcmp(buf, full_key, keylen) != 0) {
+    pr_trace_msg(trace_channel, 8, "cached listing for '%s' has "
+      "different key, ignoring", dir);
+    (void) close(fd);
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (hdr.dev != (uint64_t) st.st_dev ||
+      hdr.ino != (uint64_t) st.st_ino ||
+      hdr.mtime != (int64_t) st.st_mtime ||
+      hdr.ctime != (int64_t) st.st_ctime) {
+    pr_trace_msg(trace_channel, 8, "cached listing for '%s' is stale: "
+      "directory has changed", dir);
+    (void) close(fd);
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (hdr.created > (int64_t) now ||
+      (int64_t) now - hdr.created > (int64_t) listcache_max_age) {
+    pr_trace_msg(trace_channel, 8, "cached listing for '%s' is stale: "
+      "older than %u secs", dir, listcache_max_age);
+    (void) close(fd);
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (fstatat(listcache_dir.dirfd, marker, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+      (int64_t) st.st_mtime >= hdr.created) {
+    pr_trace_msg(trace_channel, 8, "cached listing for '%s' is stale: "
+      "directory entries have changed", dir);
+    (void) close(fd);
+    errno = ENOENT;
+    return -1;
+  }
+
+  offset = (off_t) (sizeof(hdr) + keylen);
+  if (fstat(fd, &st) < 0 ||
+      st.st_size != offset + (off_t) hdr.datalen) {
+    pr_trace_msg(trace_channel, 3, "cached listing for '%s' is truncated, "
+      "ignoring", dir);
+    (void) close(fd);
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (session.d == NULL) {
+    (void) close(fd);
+    errno = EPERM;
+    return -1;
+  }
+
+  res = 0;
+  if (hdr.datalen > 0) {
+#ifdef HAVE_SENDFILE
+    /* Data channel NetIO handlers (e.g. for TLS, or MODE Z) need to see the
+     * data, so sendfile(2) can only be used without them.
+     */
+    if (pr_get_netio(PR_NETIO_STRM_DATA) == NULL) {
+      res = listcache_sendfile(fd, offset, (off_t) hdr.datalen);
+
+    } else {
+      res = listcache_sendbuf(p, fd, (off_t) hdr.datalen);
+    }
+#else
+    res = listcache_sendbuf(p, fd, (off_t) hdr.datalen);
+#endif /* HAVE_SENDFILE */
+  }
+  xerrno = errno;
+
+  (void) close(fd);
+
+  if (res < 0) {
+    pr_trace_msg(trace_channel, 3, "error sending cached listing for '%s': "
+      "%s", dir, strerror(xerrno));
+    session.sf_flags |= SF_ABORT;
+    return 0;
+  }
+
+  pr_trace_msg(trace_channel, 8, "sent cached listing for '%s' (%" PR_LU
+    " bytes)", dir, (pr_off_t) hdr.datalen);
+  return 0;
+}
+
+int pr_listcache_capture(pool *p, const char *dir, const char *key) {
+  int xerrno;
+  const char *full_key;
+  size_t keylen;
+  struct stat st;
+  time_t now;
+
+  if (p == NULL ||
+      dir == NULL ||
+      key == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (listcache_dir.dirfd < 0) {
+    errno = EPERM;
+    return -1;
+  }
+
+  pr_listcache_discard();
+
+  if (listcache_stat_dir(dir, &st) < 0) {
+    return -1;
+  }
+
+  /* If the directory changed within this second, another change could
+   * follow in the same second without changing its mtime/ctime.
+   */
+  now = time(NULL);
+  if (st.st_mtime >= now ||
+      st.st_ctime >= now) {
+    pr_trace_msg(trace_channel, 9, "not caching listing for '%s': "
+      "directory changed too recently", dir);
+    errno = EPERM;
+    return -1;
+  }
+
+  capture_userfd = pr_cachedir_get_userfd(&listcache_dir, TRUE);
+  if (capture_userfd < 0) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error opening listing cache for "
+      "UID %lu: %s", (unsigned long) geteuid(), strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  full_key = listcache_get_key(p, dir, key);
+  keylen = strlen(full_key);
+
+  listcache_get_name(capture_name, sizeof(capture_name), st.st_dev,
+    st.st_ino, full_key, keylen);
+
+  memset(capture_tmp_name, '\0', sizeof(capture_tmp_name));
+  snprintf(capture_tmp_name, sizeof(capture_tmp_name)-1, "%s%lu",
+    PR_CACHEDIR_TMP_PREFIX, (unsigned long) session.pid);
+
+  capture_fd = openat(capture_userfd, capture_tmp_name,
+    O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW, 0600);
+  if (capture_fd < 0) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error creating cached listing for '%s': "
+      "%s", dir, strerror(xerrno));
+    pr_listcache_discard();
+    errno = xerrno;
+    return -1;
+  }
+
+  (void) fcntl(capture_fd, F_SETFD, FD_CLOEXEC);
+
+  memset(&capture_hdr, 0, sizeof(capture_hdr));
+  capture_hdr.magic = LISTCACHE_MAGIC;
+  capture_hdr.keylen = keylen;
+  capture_hdr.dev = st.st_dev;
+  capture_hdr.ino = st.st_ino;
+  capture_hdr.mtime = st.st_mtime;
+  capture_hdr.ctime = st.st_ctime;
+  capture_hdr.created = now;
+
+  /* The header is rewritten, with the listing length, on commit. */
+  if (pr_cachedir_write(capture_fd, (char *) &capture_hdr,
+      sizeof(capture_hdr)) < 0 ||
+      pr_cachedir_write(capture_fd, full_key, keylen) < 0) {
+    xerrno = errno;
+
+    pr_listcache_discard();
+    errno = xerrno;
+    return -1;
+  }
+
+  capture_dir = pstrdup(listcache_pool, dir);
+  capture_failed = FALSE;
+
+  pr_trace_msg(trace_channel, 9, "capturing listing for '%s'", dir);
+  return 0;
+}
+
+int pr_listcache_write(const char *buf, size_t buflen) {
+  if (capture_fd < 0 ||
+      capture_failed == TRUE) {
+    return 0;
+  }
+
+  if (buf == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (capture_hdr.datalen + buflen > PR_TUNABLE_LISTCACHE_MAX_SIZE) {
+    pr_trace_msg(trace_channel, 9, "not caching listing for '%s': "
+      "larger than %lu bytes", capture_dir,
+      (unsigned long) PR_TUNABLE_LISTCACHE_MAX_SIZE);
+    capture_failed = TRUE;
+    return 0;
+  }
+
+  if (pr_cachedir_write(capture_fd, buf, buflen) < 0) {
+    pr_trace_msg(trace_channel, 3, "error writing cached listing for '%s': "
+      "%s", capture_dir, strerror(errno));
+    capture_failed = TRUE;
+    return 0;
+  }
+
+  capture_hdr.datalen += buflen;
+  return 0;
+}
+
+int pr_listcache_commit(void) {
+  int xerrno;
+  struct stat st;
+
+  if (capture_fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (capture_failed == TRUE) {
+    pr_listcache_discard();
+    errno = EIO;
+    return -1;
+  }
+
+  /* Entries added or removed while the listing was being read make for an
+   * inconsistent listing.
+   */
+  if (listcache_stat_dir(capture_dir, &st) < 0 ||
+      capture_hdr.dev != (uint64_t) st.st_dev ||
+      capture_hdr.ino != (uint64_t) st.st_ino ||
+      capture_hdr.mtime != (int64_t) st.st_mtime ||
+      capture_hdr.ctime != (int64_t) st.st_ctime) {
+    pr_trace_msg(trace_channel, 9, "not caching listing for '%s': "
+      "directory changed while being listed", capture_dir);
+    pr_listcache_discard();
+    errno = EPERM;
+    return -1;
+  }
+
+  if (pwrite(capture_fd, &capture_hdr, sizeof(capture_hdr), 0) !=
+      sizeof(capture_hdr)) {
+    xerrno = errno;
+
+    pr_listcache_discard();
+    errno = xerrno;
+    return -1;
+  }
+
+  if (renameat(capture_userfd, capture_tmp_name, capture_userfd,
+      capture_name) < 0) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error committing cached listing for "
+      "'%s': %s", capture_dir, strerror(xerrno));
+    pr_listcache_discard();
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 8, "cached listing for '%s' (%" PR_LU
+    " bytes)", capture_dir, (pr_off_t) capture_hdr.datalen);
+
+  (void) close(capture_fd);
+  capture_fd = capture_userfd = -1;
+  capture_dir = NULL;
+
+  return 0;
+}
+
+void pr_listcache_discard(void) {
+  if (capture_fd >= 0) {
+    (void) close(capture_fd);
+    capture_fd = -1;
+
+    (void) unlinkat(capture_userfd, capture_tmp_name, 0);
+  }
+
+  /* Note that capture_userfd belongs to listcache_dir; it is not ours to
+   * close.
+   */
+  capture_userfd = -1;
+  capture_dir = NULL;
+  capture_failed = FALSE;
+}
+
+int pr_listcache_invalidate(const char *path) {
+  char parent[PR_TUNABLE_PATH_MAX+1], *ptr;
+  struct stat st;
+  struct listcache_dirid *ids, *id;
+  register unsigned int i;
+
+  if (listcache_dir.dirfd < 0) {
+    return 0;
+  }
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  sstrncpy(parent, path, sizeof(parent));
+
+  /* Ignore any trailing slashes. */
+  ptr = parent + strlen(parent) - 1;
+  while (ptr > parent &&
+         *ptr == '/') {
+    *ptr-- = '\0';
+  }
+
+  ptr = strrchr(parent, '/');
+  if (ptr == NULL) {
+    sstrncpy(parent, ".", sizeof(parent));
+
+  } else if (ptr == parent) {
+    parent[1] = '\0';
+
+  } else {
+    *ptr = '\0';
+  }
+
+  if (pr_fsio_stat(parent, &st) < 0) {
+    return -1;
+  }
+
+  ids = listcache_pending->elts;
+  for (i = 0; i < listcache_pending->nelts; i++) {
+    if (ids[i].dev == st.st_dev &&
+        ids[i].ino == st.st_ino) {
+      return 0;
+    }
+  }
+
+  id = push_array(listcache_pending);
+  id->dev = st.st_dev;
+  id->ino = st.st_ino;
+
+  pr_trace_msg(trace_channel, 17, "invalidated listings of '%s' (for '%s')",
+    parent, path);
+  return 0;
+}
+
+int pr_listcache_flush(void) {
+  struct listcache_dirid *ids;
+  register unsigned int i;
+
+  if (listcache_dir.dirfd < 0 ||
+      listcache_pending->nelts == 0) {
+    return 0;
+  }
+
+  ids = listcache_pending->elts;
+  for (i = 0; i < listcache_pending->nelts; i++) {
+    char marker[64];
+    int fd;
+    struct stat st;
+
+    listcache_get_marker(marker, sizeof(marker), ids[i].dev, ids[i].ino);
+
+    fd = openat(listcache_dir.dirfd, marker, O_WRONLY|O_CREAT|O_NOFOLLOW,
+      LISTCACHE_MARKER_MODE);
+    if (fd < 0) {
+      pr_trace_msg(trace_channel, 3, "error opening marker '%s': %s",
+        marker, strerror(errno));
+      continue;
+    }
+
+    /* Whoever creates the marker makes sure that everyone can update it. */
+    if (fstat(fd, &st) == 0 &&
+        st.st_uid == geteuid() &&
+        (st.st_mode & 0777) != LISTCACHE_MARKER_MODE) {
+      (void) fchmod(fd, LISTCACHE_MARKER_MODE);
+    }
+
+    /* Writing to the marker updates its mtime. */
+    if (pwrite(fd, "", 1, 0) != 1) {
+      pr_trace_msg(trace_channel, 3, "error updating marker '%s': %s",
+        marker, strerror(errno));
+
+    } else {
+      pr_trace_msg(trace_channel, 9, "flushed cached listings for '%s'",
+        marker);
+    }
+
+    (void) close(fd);
+  }
+
+  listcache_pending->nelts = 0;
+  return 0;
+}
+
+#else
+
+int pr_listcache_clear(const char *path) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_listcache_open(const char *path) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int pr_listcache_close(void) {
+  errno = EINVAL;
+  return -1;
+}
+
+int pr_listcache_set_max_age(unsigned int max_age) {
+  return 0;
+}
+
+int pr_listcache_send(pool *p, const char *dir, const char *key) {
+  errno = ENOENT;
+  return -1;
+}
+
+int pr_listcache_capture(pool *p, const char *dir, const char *key) {
+  errno = EPERM;
+  return -1;
+}
+
+int pr_listcache_write(const char *buf, size_t buflen) {
+  return 0;
+}
+
+int pr_listcache_commit(void) {
+  errno = EINVAL;
+  return -1;
+}
+
+void pr_listcache_discard(void) {
+}
+
+int pr_listcache_invalidate(const char *path) {
+  return 0;
+}
+
+int pr_listcache_flush(void) {
+  return 0;
+}
+
+#endif /* AT_FDCWD */
@@ -84,10 +84,19 @@ static int quiet = 0;
 static int shutting_down = 0;
 static int syntax_check = 0;
 
+/* Pre-forked worker pool (MinSpareServers/MaxSpareServers). */
+unsigned int prefork_min_spare = 0;
+unsigned int prefork_max_spare = 0;
+
 /* Command handling */
 static void cmd_loop(server_rec *s, conn_t *conn);
 
-static cmd_rec *make_ftp_cmd(pool *p, char *buf, size_t buflen, int flags);
+static void handle_session(int fd, conn_t *l, int semfd);
+static void prefork_close_fds(void);
+static void prefork_stop(void);
+
+static cmd_rec *make_ftp_cmd(pool *p, pool *arena, char *buf, size_t buflen,
+  int flags);
 
 static const char *config_filename = PR_CONFIG_FILE_PATH;
 
@@ -397,8 +406,12 @@ static int _dispatch(cmd_rec *cmd, int cmd_type, int validate, char *match) {
         pr_session_set_idle();
       }
 
-      destroy_pool(cmd->tmp_pool);
-      cmd->tmp_pool = NULL;
+      /* The tmp_pool is cleared, rather than destroyed, so that it can be
+       * reused by the next handler.  A tmp_pool made above is a subpool of
+       * the command's pool, and is freed with it; the session's cmd_rec tmp
+       * pool, set by cmd_loop(), is also cleared there after each command.
+       */
+      pr_pool_clear(cmd->tmp_pool);
     }
 
     if (!success) {
@@ -458,7 +471,11 @@ static size_t get_max_cmd_sz(void) {
   return res;
 }
 
-int pr_cmd_read(cmd_rec **res) {
+/* Reads a command from the control connection.  If an arena is given, the
+ * command is allocated from it, rather than from a new sub-pool of the
+ * session pool.
+ */
+static int cmd_read(pool *arena, cmd_rec **res) {
   static long cmd_bufsz = -1;
   static char *cmd_buf = NULL;
   int cmd_buflen;
@@ -544,7 +561,7 @@ int pr_cmd_read(cmd_rec **res) {
       flags |= PR_STR_FL_PRESERVE_WHITESPACE;
     }
 
-    cmd = make_ftp_cmd(session.pool, ptr, cmd_buflen, flags);
+    cmd = make_ftp_cmd(session.pool, arena, ptr, cmd_buflen, flags);
     if (cmd != NULL) {
       *res = cmd;
 
@@ -571,6 +588,10 @@ int pr_cmd_read(cmd_rec **res) {
   return 0;
 }
 
+int pr_cmd_read(cmd_rec **res) {
+  return cmd_read(NULL, res);
+}
+
 static int set_cmd_start_ms(cmd_rec *cmd) {
   void *v;
   uint64_t start_ms;
@@ -768,7 +789,8 @@ int pr_cmd_dispatch(cmd_rec *cmd) {
     PR_CMD_DISPATCH_FL_SEND_RESPONSE|PR_CMD_DISPATCH_FL_CLEAR_RESPONSE);
 }
 
-static cmd_rec *make_ftp_cmd(pool *p, char *buf, size_t buflen, int flags) {
+static cmd_rec *make_ftp_cmd(pool *p, pool *arena, char *buf, size_t buflen,
+    int flags) {
   register unsigned int i, j;
   char *arg, *ptr, *wrd;
   size_t arg_len;
@@ -796,8 +818,14 @@ static cmd_rec *make_ftp_cmd(pool *p, char *buf, size_t buflen, int flags) {
     return NULL;
   }
 
-  subpool = make_sub_pool(p);
-  pr_pool_tag(subpool, "make_ftp_cmd pool");
+  if (arena != NULL) {
+    subpool = arena;
+
+  } else {
+    subpool = make_sub_pool(p);
+    pr_pool_tag(subpool, "make_ftp_cmd pool");
+  }
+
   cmd = pcalloc(subpool, sizeof(cmd_rec));
   cmd->pool = subpool;
   cmd->tmp_pool = NULL;
@@ -865,6 +893,19 @@ static cmd_rec *make_ftp_cmd(pool *p, char *buf, size_t buflen, int flags) {
 }
 
 static void cmd_loop(server_rec *server, conn_t *c) {
+  pool *cmd_arena, *cmd_tmp_arena;
+
+  /* Each command is allocated from the same arena, and given the same
+   * tmp_pool, which are cleared once the command has been handled, instead
+   * of creating and destroying pools per command.  Commands read while
+   * another is being handled, e.g. ABOR during a data transfer, still get
+   * pools of their own.
+   */
+  cmd_arena = pr_pool_create_sz(session.pool, PR_TUNABLE_CMD_ARENA_SIZE);
+  pr_pool_tag(cmd_arena, "make_ftp_cmd pool");
+
+  cmd_tmp_arena = make_sub_pool(session.pool);
+  pr_pool_tag(cmd_tmp_arena, "cmd_rec tmp pool");
 
   while (TRUE) {
     int res = 0; 
@@ -872,7 +913,7 @@ static void cmd_loop(server_rec *server, conn_t *c) {
 
     pr_signals_handle();
 
-    res = pr_cmd_read(&cmd);
+    res = cmd_read(cmd_arena, &cmd);
     if (res < 0) {
       if (PR_NETIO_ERRNO(session.c->instrm) == EINTR) {
         /* Simple interrupted syscall */
@@ -907,8 +948,11 @@ static void cmd_loop(server_rec *server, conn_t *c) {
           cmd->protocol);
       }
  
+      cmd->tmp_pool = cmd_tmp_arena;
       pr_cmd_dispatch(cmd);
-      destroy_pool(cmd->pool);
+
+      pr_pool_clear(cmd_tmp_arena);
+      pr_pool_clear(cmd_arena);
 
     } else {
       pr_event_generate("core.invalid-command", NULL);
@@ -964,6 +1008,12 @@ void restart_daemon(void *d1, void *d2, void *d3, void *d4) {
       }
     }
 
+    /* Idle workers hold the old configuration; replace them once the new
+     * one has been parsed.
+     */
+    prefork_stop();
+    prefork_min_spare = prefork_max_spare = 0;
+
     free_bindings();
 
     /* Run through the list of registered restart callbacks. */
@@ -1080,14 +1130,12 @@ static void set_server_privs(void) {
 }
 
 static void fork_server(int fd, conn_t *l, unsigned char no_fork) {
-  conn_t *conn = NULL;
-  int i, rev;
   int semfds[2] = { -1, -1 };
-  int xerrno = 0;
 
 #ifndef PR_DEVEL_NO_FORK
   pid_t pid;
   sigset_t sig_set;
+  int xerrno = 0;
 
   if (no_fork == FALSE) {
 
@@ -1143,8 +1191,11 @@ static void fork_server(int fd, conn_t *l, unsigned char no_fork) {
           "unable to unblock signal set: %s", strerror(errno));
       }
 
-      /* No longer need the read side of the semaphore pipe. */
+      /* No longer need the read side of the semaphore pipe, nor the
+       * master's ends of any idle worker sockets.
+       */
       (void) close(semfds[0]);
+      prefork_close_fds();
       break;
 
     case -1:
@@ -1209,6 +1260,17 @@ static void fork_server(int fd, conn_t *l, unsigned char no_fork) {
 
 #endif /* PR_DEVEL_NO_FORK */
 
+  handle_session(fd, l, semfds[1]);
+}
+
+/* Everything a freshly forked (or pre-forked) child does to service a
+ * connection, once it has closed the listening sockets.
+ */
+static void handle_session(int fd, conn_t *l, int semfd) {
+  conn_t *conn = NULL;
+  int i, rev;
+  int xerrno = 0;
+
   /* Child is running here */
   if (signal(SIGUSR1, pr_signals_handle_disconnect) == SIG_ERR) {
     pr_log_pri(PR_LOG_NOTICE,
@@ -1331,7 +1393,9 @@ static void fork_server(int fd, conn_t *l, unsigned char no_fork) {
    * we are all grown up and have finished housekeeping (closing
    * former listen sockets).
    */
-  close(semfds[1]);
+  if (semfd != -1) {
+    (void) close(semfd);
+  }
 
   /* Now perform reverse DNS lookups. */
   if (ServerUseReverseDNS) {
@@ -1481,6 +1545,428 @@ static void fork_server(int fd, conn_t *l, unsigned char no_fork) {
 #endif /* PR_DEVEL_NO_DAEMON */
 }
 
+/* Pre-forked worker pool.  Idle workers are forked ahead of time, with the
+ * configuration already parsed, and block on their end of a Unix socketpair
+ * until the master hands them an accepted connection via SCM_RIGHTS.  A
+ * worker services exactly one session (chroot/setuid make reuse
+ * impossible); used workers are replaced outside of the accept path.
+ */
+struct prefork_worker {
+  pid_t pid;
+  int fd;
+  int ready;
+};
+
+struct prefork_msg {
+  conn_t *listen_conn;
+};
+
+static struct prefork_worker prefork_workers[PR_TUNABLE_PREFORK_MAX_SPARE];
+static unsigned int prefork_nworkers = 0;
+static int prefork_refilling = FALSE;
+
+/* Limit the number of workers forked per daemon_loop() iteration, so that a
+ * large refill does not delay pending connections.
+ */
+#define PR_PREFORK_SPAWN_BATCH		8
+
+static const char *prefork_channel = "prefork";
+
+static void prefork_close_fds(void) {
+  register unsigned int i;
+
+  for (i = 0; i < prefork_nworkers; i++) {
+    (void) close(prefork_workers[i].fd);
+  }
+
+  prefork_nworkers = 0;
+}
+
+static void prefork_remove(unsigned int idx) {
+  (void) close(prefork_workers[idx].fd);
+
+  prefork_nworkers--;
+  if (idx != prefork_nworkers) {
+    prefork_workers[idx] = prefork_workers[prefork_nworkers];
+  }
+}
+
+/* Retire all idle workers; they exit once they see EOF on their socket. */
+static void prefork_stop(void) {
+  register unsigned int i;
+
+  for (i = 0; i < prefork_nworkers; i++) {
+    /* Wait for any worker still starting up to close its copies of the
+     * listening sockets, just as restart_daemon() waits on the semaphore
+     * pipes of newly forked session processes.
+     */
+    if (prefork_workers[i].ready == FALSE) {
+      char ready;
+
+      while (read(prefork_workers[i].fd, &ready, 1) < 0 &&
+             errno == EINTR) {
+        pr_signals_handle();
+      }
+    }
+
+    (void) close(prefork_workers[i].fd);
+  }
+
+  if (prefork_nworkers > 0) {
+    pr_trace_msg(prefork_channel, 9, "retired %u idle %s", prefork_nworkers,
+      prefork_nworkers != 1 ? "workers" : "worker");
+  }
+
+  prefork_nworkers = 0;
+  prefork_refilling = FALSE;
+}
+
+/* Runs in the idle worker: wait for a connection from the master, then
+ * handle it as a freshly forked child would.
+ */
+static void prefork_worker_wait(int sockfd) {
+  struct prefork_msg pm;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } ctrl;
+  ssize_t res;
+  int fd = -1;
+  char ready = 1;
+
+  /* Tell the master that we have closed the listening sockets. */
+  while (write(sockfd, &ready, 1) < 0) {
+    if (errno != EINTR) {
+      exit(1);
+    }
+
+    pr_signals_handle();
+  }
+
+  while (TRUE) {
+    memset(&pm, 0, sizeof(pm));
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &pm;
+    iov.iov_len = sizeof(pm);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+
+    res = recvmsg(sockfd, &msg, 0);
+    if (res < 0 &&
+        errno == EINTR) {
+      pr_signals_handle();
+      continue;
+    }
+
+    break;
+  }
+
+  if (res <= 0) {
+    /* The master has retired us (or gone away). */
+    exit(res == 0 ? 0 : 1);
+  }
+
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET &&
+        cmsg->cmsg_type == SCM_RIGHTS) {
+      memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+  }
+
+  (void) close(sockfd);
+
+  if (fd < 0 ||
+      (size_t) res != sizeof(pm) ||
+      pm.listen_conn == NULL) {
+    pr_log_pri(PR_LOG_NOTICE, "pre-forked worker received malformed "
+      "connection handoff, exiting");
+    exit(1);
+  }
+
+  handle_session(fd, pm.listen_conn, -1);
+  pr_session_end(0);
+}
+
+static int prefork_spawn(void) {
+  int sv[2];
+  pid_t pid;
+  sigset_t sig_set;
+  int xerrno;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+    pr_log_pri(PR_LOG_ALERT, "socketpair(2) failed: %s", strerror(errno));
+    return -1;
+  }
+
+  (void) fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+
+  sigemptyset(&sig_set);
+  sigaddset(&sig_set, SIGTERM);
+  sigaddset(&sig_set, SIGCHLD);
+  sigaddset(&sig_set, SIGUSR1);
+  sigaddset(&sig_set, SIGUSR2);
+
+  if (sigprocmask(SIG_BLOCK, &sig_set, NULL) < 0) {
+    pr_log_pri(PR_LOG_NOTICE,
+      "unable to block signal set: %s", strerror(errno));
+  }
+
+  pid = fork();
+  xerrno = errno;
+
+  switch (pid) {
+    case 0:
+      is_master = FALSE;
+      if (sigprocmask(SIG_UNBLOCK, &sig_set, NULL) < 0) {
+        pr_log_pri(PR_LOG_NOTICE,
+          "unable to unblock signal set: %s", strerror(errno));
+      }
+
+      (void) close(sv[0]);
+      prefork_close_fds();
+      (void) pr_fs_get_usable_fd2(&sv[1]);
+
+      session.pid = getpid();
+      pr_ipbind_close_listeners();
+      pr_random_init();
+
+      if (signal(SIGHUP, SIG_IGN) == SIG_ERR) {
+        pr_log_pri(PR_LOG_NOTICE,
+          "unable to install SIGHUP (signal %d) handler: %s", SIGHUP,
+          strerror(errno));
+      }
+
+      pr_proctitle_set("(idle)");
+      prefork_worker_wait(sv[1]);
+
+      /* Not reached. */
+      exit(0);
+
+    case -1:
+      if (sigprocmask(SIG_UNBLOCK, &sig_set, NULL) < 0) {
+        pr_log_pri(PR_LOG_NOTICE,
+          "unable to unblock signal set: %s", strerror(errno));
+      }
+
+      pr_log_pri(PR_LOG_ALERT, "unable to fork(): %s", strerror(xerrno));
+      (void) close(sv[0]);
+      (void) close(sv[1]);
+      return -1;
+
+    default:
+      (void) close(sv[1]);
+
+      prefork_workers[prefork_nworkers].pid = pid;
+      prefork_workers[prefork_nworkers].fd = sv[0];
+      prefork_workers[prefork_nworkers].ready = FALSE;
+      prefork_nworkers++;
+
+      if (sigprocmask(SIG_UNBLOCK, &sig_set, NULL) < 0) {
+        pr_log_pri(PR_LOG_NOTICE,
+          "unable to unblock signal set: %s", strerror(errno));
+      }
+
+      break;
+  }
+
+  return 0;
+}
+
+/* Top up the idle pool: once it drops below MinSpareServers, spawn workers
+ * (a batch at a time) until MaxSpareServers are idle.  Returns TRUE if more
+ * spawning is still pending.
+ */
+static int prefork_maintain(void) {
+  unsigned int max_spare, nspawned = 0;
+
+  if (prefork_min_spare == 0 ||
+      no_forking ||
+      shutting_down) {
+    if (prefork_nworkers > 0) {
+      prefork_stop();
+    }
+
+    return FALSE;
+  }
+
+  max_spare = prefork_max_spare;
+  if (max_spare < prefork_min_spare) {
+    max_spare = prefork_min_spare;
+  }
+
+  if (max_spare > PR_TUNABLE_PREFORK_MAX_SPARE) {
+    max_spare = PR_TUNABLE_PREFORK_MAX_SPARE;
+  }
+
+  if (prefork_nworkers < prefork_min_spare) {
+    prefork_refilling = TRUE;
+  }
+
+  while (prefork_refilling &&
+         prefork_nworkers < max_spare &&
+         nspawned < PR_PREFORK_SPAWN_BATCH) {
+    if (prefork_spawn() < 0) {
+      prefork_refilling = FALSE;
+      break;
+    }
+
+    nspawned++;
+  }
+
+  if (prefork_nworkers >= max_spare) {
+    prefork_refilling = FALSE;
+  }
+
+  if (nspawned > 0) {
+    pr_trace_msg(prefork_channel, 15, "spawned %u %s (%u idle)", nspawned,
+      nspawned != 1 ? "workers" : "worker", prefork_nworkers);
+  }
+
+  return prefork_refilling;
+}
+
+/* Add the idle workers' sockets into the rfd for selecting. */
+static int prefork_fds(fd_set *rfd, int maxfd) {
+  register unsigned int i;
+
+  for (i = 0; i < prefork_nworkers; i++) {
+    FD_SET(prefork_workers[i].fd, rfd);
+    if (prefork_workers[i].fd > maxfd) {
+      maxfd = prefork_workers[i].fd;
+    }
+  }
+
+  return maxfd;
+}
+
+/* A readable worker socket is either the worker's readiness byte, or EOF
+ * because the worker died.
+ */
+static void prefork_check_fds(fd_set *rfd) {
+  register unsigned int i = 0;
+
+  while (i < prefork_nworkers) {
+    if (FD_ISSET(prefork_workers[i].fd, rfd)) {
+      char ready;
+
+      if (prefork_workers[i].ready == FALSE &&
+          read(prefork_workers[i].fd, &ready, 1) == 1) {
+        prefork_workers[i].ready = TRUE;
+
+      } else {
+        pr_trace_msg(prefork_channel, 3, "idle worker PID %lu exited",
+          (unsigned long) prefork_workers[i].pid);
+        prefork_remove(i);
+        continue;
+      }
+    }
+
+    i++;
+  }
+}
+
+/* Hand the accepted connection to an idle worker.  Returns 0 if a worker
+ * took it (and the fd has been closed), -1 otherwise.
+ */
+static int prefork_handoff(int fd, conn_t *l) {
+  unsigned int i;
+  int flags = 0;
+
+#ifdef MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+#endif
+
+  i = prefork_nworkers;
+  while (i-- > 0) {
+    struct prefork_msg pm;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+      struct cmsghdr align;
+      char buf[CMSG_SPACE(sizeof(int))];
+    } ctrl;
+    sigset_t sig_set;
+    pid_t pid;
+    ssize_t res;
+
+    if (prefork_workers[i].ready == FALSE) {
+      continue;
+    }
+
+    pid = prefork_workers[i].pid;
+
+    memset(&pm, 0, sizeof(pm));
+    pm.listen_conn = l;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&ctrl, 0, sizeof(ctrl));
+    iov.iov_base = &pm;
+    iov.iov_len = sizeof(pm);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    /* As in fork_server(), block SIGCHLD so that a worker which finishes
+     * its session very quickly cannot be reaped before it is in the child
+     * list.
+     */
+    sigemptyset(&sig_set);
+    sigaddset(&sig_set, SIGTERM);
+    sigaddset(&sig_set, SIGCHLD);
+    sigaddset(&sig_set, SIGUSR1);
+    sigaddset(&sig_set, SIGUSR2);
+
+    if (sigprocmask(SIG_BLOCK, &sig_set, NULL) < 0) {
+      pr_log_pri(PR_LOG_NOTICE,
+        "unable to block signal set: %s", strerror(errno));
+    }
+
+    /* A worker that has already been reaped cannot take the connection. */
+    if (kill(pid, 0) < 0 &&
+        errno == ESRCH) {
+      res = -1;
+
+    } else {
+      res = sendmsg(prefork_workers[i].fd, &msg, flags);
+    }
+
+    if (res == (ssize_t) sizeof(pm)) {
+      child_add(pid, -1);
+    }
+
+    if (sigprocmask(SIG_UNBLOCK, &sig_set, NULL) < 0) {
+      pr_log_pri(PR_LOG_NOTICE,
+        "unable to unblock signal set: %s", strerror(errno));
+    }
+
+    /* Either way, this worker is no longer idle. */
+    prefork_remove(i);
+
+    if (res == (ssize_t) sizeof(pm)) {
+      pr_trace_msg(prefork_channel, 19,
+        "handed connection to worker PID %lu (%u idle)", (unsigned long) pid,
+        prefork_nworkers);
+      (void) close(fd);
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
 static void disc_children(void) {
 
   if (disc && disc <= time(NULL) && child_count()) {
@@ -1512,7 +1998,7 @@ static void daemon_loop(void) {
   fd_set listenfds;
   conn_t *listen_conn;
   int fd, maxfd;
-  int i, err_count = 0, xerrno = 0;
+  int i, err_count = 0, refilling = FALSE, xerrno = 0;
   unsigned long nconnects = 0UL;
   time_t last_error;
   struct timeval tv;
@@ -1547,10 +2033,21 @@ static void daemon_loop(void) {
         break;
     }
 
+    /* Keep the pool of pre-forked idle workers topped up. */
+    refilling = prefork_maintain();
+    maxfd = prefork_fds(&listenfds, maxfd);
+
     if (shutting_down) {
       tv.tv_sec = 5L;
       tv.tv_usec = 0L;
 
+    } else if (refilling) {
+      /* Finish topping up the pool as soon as the pending connections (if
+       * any) have been handed off.
+       */
+      tv.tv_sec = 0L;
+      tv.tv_usec = 0L;
+
     } else {
 
       tv.tv_sec = PR_TUNABLE_SELECT_TIMEOUT;
@@ -1591,7 +2088,11 @@ static void daemon_loop(void) {
 
     if (i == -1 &&
         xerrno == EINTR) {
-      errno = xerrno;
+      /* Leave errno cleared, so that pr_signals_handle() does not impose
+       * its EINTR retry delay; the daemon would otherwise stop accepting
+       * connections for that interval every time a session process exits.
+       */
+      errno = 0;
       pr_signals_handle();
 
       /* We handled our signal; clear errno. */
@@ -1676,6 +2177,8 @@ static void daemon_loop(void) {
       continue;
     }
 
+    prefork_check_fds(&listenfds);
+
     /* Accept the connection. */
     listen_conn = pr_ipbind_accept_conn(&listenfds, &fd);
 
@@ -1705,8 +2208,16 @@ static void daemon_loop(void) {
           max_connects, max_connect_interval);
         close(fd);
 
-      /* Fork off a child to handle the connection. */
-      } else {
+      /* Check whether any module rejects this client outright, e.g. due
+       * to a ban, without going to the expense of forking.
+       */
+      } else if (pr_session_precheck(fd) < 0) {
+        close(fd);
+
+      /* Hand the connection to an idle pre-forked worker if there is one,
+       * otherwise fork off a child to handle the connection.
+       */
+      } else if (prefork_handoff(fd, listen_conn) < 0) {
         PR_DEVEL_CLOCK(fork_server(fd, listen_conn, no_forking));
       }
     }
@@ -56,11 +56,26 @@ union block_hdr {
   } h;
 };
 
-static union block_hdr *block_freelist = NULL;
+/* Free blocks are kept on size-classed lists.  List i holds the blocks
+ * whose capacity, in multiples of BLOCK_MINFREE, is i (rounded down); the
+ * last list holds all of the larger blocks.  Blocks are normally allocated
+ * in multiples of BLOCK_MINFREE, so a block taken from the head of any list
+ * at or above the requested size will do, and only the last list needs to
+ * be searched.
+ */
+#define POOL_NFREELISTS		PR_TUNABLE_POOL_FREELISTS
+
+static union block_hdr *block_freelists[POOL_NFREELISTS];
+
+/* Maximum number of bytes held in free blocks; blocks freed beyond this
+ * are returned to the system.
+ */
+static size_t block_freelist_max = PR_TUNABLE_POOL_FREELIST_MAX;
 
 /* Statistics */
-static unsigned int stat_malloc = 0;	/* incr when malloc required */
-static unsigned int stat_freehit = 0;	/* incr when freelist used */
+static pr_pool_stats_t pool_stats;
+
+#define BLOCK_SIZE(b)	((size_t) ((char *) (b)->h.endp - (char *) ((b) + 1)))
 
 #ifdef PR_USE_DEVEL
 static const char *trace_channel = "pool";
@@ -132,15 +147,30 @@ static union block_hdr *malloc_block(size_t size) {
   blok->h.first_avail = (char *) (blok + 1);
   blok->h.endp = size + (char *) blok->h.first_avail;
 
+  pool_stats.blocks_allocated++;
+  pool_stats.bytes_allocated += size;
+
   return blok;
 }
 
-static void chk_on_blk_list(union block_hdr *blok, union block_hdr *free_blk,
-    const char *pool_tag) {
+static unsigned int freelist_index(size_t size) {
+  size_t idx;
+
+  idx = size / BLOCK_MINFREE;
+  if (idx >= POOL_NFREELISTS) {
+    idx = POOL_NFREELISTS - 1;
+  }
+
+  return (unsigned int) idx;
+}
+
+static void chk_on_blk_list(union block_hdr *blok, const char *pool_tag) {
 
 #ifdef PR_USE_DEVEL
   /* Debug code */
+  union block_hdr *free_blk;
 
+  free_blk = block_freelists[freelist_index(BLOCK_SIZE(blok))];
   while (free_blk) {
     if (free_blk != blok) {
       free_blk = free_blk->h.next;
@@ -157,28 +187,37 @@ static void chk_on_blk_list(union block_hdr *blok, union block_hdr *free_blk,
 /* Free a chain of blocks -- _must_ call with alarms blocked. */
 
 static void free_blocks(union block_hdr *blok, const char *pool_tag) {
-  /* Puts new blocks at head of block list, point next pointer of
-   * last block in chain to free blocks we already had.
+  union block_hdr *next;
+
+  /* Puts each block at the head of the list for its size, unless that would
+   * take the free lists past their cap, in which case the block is released.
    */
+  for (; blok; blok = next) {
+    size_t size;
+    unsigned int idx;
 
-  union block_hdr *old_free_list = block_freelist;
+    next = blok->h.next;
+    size = BLOCK_SIZE(blok);
 
-  if (!blok)
-    return;		/* Shouldn't be freeing an empty pool */
+    chk_on_blk_list(blok, pool_tag);
 
-  block_freelist = blok;
+    if (pool_stats.freelist_bytes + size > block_freelist_max) {
+      pool_stats.blocks_released++;
+      pool_stats.bytes_allocated -= size;
+      free(blok);
+      continue;
+    }
 
-  /* Adjust first_avail pointers */
+    idx = freelist_index(size);
 
-  while (blok->h.next) {
-    chk_on_blk_list(blok, old_free_list, pool_tag);
+    /* Adjust first_avail pointers */
     blok->h.first_avail = (char *) (blok + 1);
-    blok = blok->h.next;
-  }
+    blok->h.next = block_freelists[idx];
+    block_freelists[idx] = blok;
 
-  chk_on_blk_list(blok, old_free_list, pool_tag);
-  blok->h.first_avail = (char *) (blok + 1);
-  blok->h.next = old_free_list;
+    pool_stats.freelist_len++;
+    pool_stats.freelist_bytes += size;
+  }
 }
 
 /* Get a new block, from the free list if possible, otherwise malloc a new
@@ -191,32 +230,49 @@ static void free_blocks(union block_hdr *blok, const char *pool_tag) {
  */
 
 static union block_hdr *new_block(int minsz, int exact) {
-  union block_hdr **lastptr = &block_freelist;
-  union block_hdr *blok = block_freelist;
+  register unsigned int i;
+  union block_hdr **lastptr, *blok;
 
   if (!exact) {
     minsz = 1 + ((minsz - 1) / BLOCK_MINFREE);
     minsz *= BLOCK_MINFREE;
   }
 
-  /* Check if we have anything of the requested size on our free list first...
+  /* Check if we have anything of the requested size on our free lists
+   * first.  The list for minsz itself may hold smaller blocks, when minsz is
+   * not a multiple of BLOCK_MINFREE, so its head needs checking; the head of
+   * any larger list (except the last) will do.
    */
-  while (blok) {
-    if (minsz <= ((char *) blok->h.endp - (char *) blok->h.first_avail)) {
-      *lastptr = blok->h.next;
-      blok->h.next = NULL;
+  i = freelist_index(minsz);
+  for (; i < POOL_NFREELISTS - 1; i++) {
+    blok = block_freelists[i];
+    if (blok != NULL &&
+        (size_t) minsz <= BLOCK_SIZE(blok)) {
+      block_freelists[i] = blok->h.next;
+      goto found;
+    }
+  }
 
-      stat_freehit++;
-      return blok;
+  lastptr = &block_freelists[POOL_NFREELISTS - 1];
+  for (blok = *lastptr; blok; blok = blok->h.next) {
+    if ((size_t) minsz <= BLOCK_SIZE(blok)) {
+      *lastptr = blok->h.next;
+      goto found;
     }
 
     lastptr = &blok->h.next;
-    blok = blok->h.next;
   }
 
   /* Nope...damn.  Have to malloc() a new one. */
-  stat_malloc++;
   return malloc_block(minsz);
+
+found:
+  blok->h.next = NULL;
+
+  pool_stats.blocks_reused++;
+  pool_stats.freelist_len--;
+  pool_stats.freelist_bytes -= BLOCK_SIZE(blok);
+  return blok;
 }
 
 struct cleanup;
@@ -341,16 +397,31 @@ static long walk_pools(pool *p, unsigned long level,
 }
 
 static void debug_pool_info(void (*debugf)(const char *, ...)) {
-  if (block_freelist) {
-    debugf("Free block list: %lu bytes",
-      bytes_in_block_list(block_freelist));
+  register unsigned int i;
+
+  if (pool_stats.freelist_len > 0) {
+    debugf("Free block lists: %lu bytes in %lu blocks",
+      pool_stats.freelist_bytes, pool_stats.freelist_len);
+
+    for (i = 0; i < POOL_NFREELISTS; i++) {
+      if (block_freelists[i] == NULL) {
+        continue;
+      }
+
+      debugf("  %s%lu B: %lu bytes in %lu blocks",
+        i == POOL_NFREELISTS - 1 ? ">= " : "",
+        (unsigned long) (i * BLOCK_MINFREE),
+        bytes_in_block_list(block_freelists[i]),
+        blocks_in_block_list(block_freelists[i]));
+    }
 
   } else {
-    debugf("Free block list: empty");
+    debugf("Free block lists: empty");
   }
 
-  debugf("%u blocks allocated", stat_malloc);
-  debugf("%u blocks reused", stat_freehit);
+  debugf("%lu blocks allocated", pool_stats.blocks_allocated);
+  debugf("%lu blocks reused", pool_stats.blocks_reused);
+  debugf("%lu blocks released", pool_stats.blocks_released);
 }
 
 static void pool_printf(const char *fmt, ...) {
@@ -397,19 +468,56 @@ void pr_pool_tag(pool *p, const char *tag) {
   p->tag = tag;
 }
 
-/* Release the entire free block list */
-static void pool_release_free_block_list(void) {
-  union block_hdr *blok = NULL, *next = NULL;
+int pr_pool_get_stats(pr_pool_stats_t *stats) {
+  if (stats == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
 
-  pr_alarms_block();
+  memcpy(stats, &pool_stats, sizeof(pr_pool_stats_t));
+  return 0;
+}
 
-  for (blok = block_freelist; blok; blok = next) {
-    next = blok->h.next;
-    free(blok);
-  }
-  block_freelist = NULL;
+int pr_pool_set_freelist_max(size_t max_bytes) {
+  block_freelist_max = max_bytes;
 
+  /* Trim the free lists, largest blocks first, down to the new cap. */
+  pr_alarms_block();
+  if (pool_stats.freelist_bytes > block_freelist_max) {
+    register int i;
+
+    for (i = POOL_NFREELISTS - 1;
+         i >= 0 && pool_stats.freelist_bytes > block_freelist_max;
+         i--) {
+      while (block_freelists[i] != NULL &&
+             pool_stats.freelist_bytes > block_freelist_max) {
+        union block_hdr *blok;
+        size_t size;
+
+        blok = block_freelists[i];
+        block_freelists[i] = blok->h.next;
+        size = BLOCK_SIZE(blok);
+
+        pool_stats.freelist_len--;
+        pool_stats.freelist_bytes -= size;
+        pool_stats.blocks_released++;
+        pool_stats.bytes_allocated -= size;
+        free(blok);
+      }
+    }
+  }
   pr_alarms_unblock();
+
+  return 0;
+}
+
+/* Release the entire free block list */
+static void pool_release_free_block_list(void) {
+  size_t max_bytes;
+
+  max_bytes = block_freelist_max;
+  pr_pool_set_freelist_max(0);
+  block_freelist_max = max_bytes;
 }
 
 struct pool_rec *make_sub_pool(struct pool_rec *p) {
@@ -517,6 +625,10 @@ static void clear_pool(struct pool_rec *p) {
   pr_alarms_unblock();
 }
 
+void pr_pool_clear(pool *p) {
+  clear_pool(p);
+}
+
 void destroy_pool(pool *p) {
   if (p == NULL) {
     return;
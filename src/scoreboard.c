@@ -27,6 +27,10 @@
 #include "conf.h"
 #include "privs.h"
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
 /* From src/dirtree.c */
 extern char ServerType;
 
@@ -39,9 +43,28 @@ static char scoreboard_file[PR_TUNABLE_PATH_MAX] = PR_RUN_DIR "/proftpd.scoreboa
 static int scoreboard_mutex_fd = -1;
 static char scoreboard_mutex[PR_TUNABLE_PATH_MAX] = PR_RUN_DIR "/proftpd.scoreboard.lck";
 
-static off_t current_pos = 0;
+/* The scoreboard file is mapped shared into every process which has it
+ * open.  Each session writes only its own slot, bracketed by the slot's
+ * sequence number, so neither updates nor reads need any file locks; the
+ * ScoreboardMutex is only taken to allocate, free, and scrub slots.
+ */
+static void *scoreboard_map = NULL;
+static size_t scoreboard_mapsz = 0;
+static unsigned int scoreboard_nslots = 0;
+
+/* Index of the next slot to be examined by pr_scoreboard_entry_read(), and
+ * its value prior to the last pr_rewind_scoreboard().
+ */
+static unsigned int scan_idx = 0;
+static unsigned int saved_scan_idx = 0;
+static int have_saved_scan = FALSE;
+
 static pr_scoreboard_header_t header;
 static pr_scoreboard_entry_t entry;
+static unsigned int entry_idx = 0;
+
+/* Copy of our entry as last tallied in the session counters. */
+static pr_scoreboard_entry_t counted_entry;
 static int have_entry = FALSE;
 static struct flock entry_lock;
 
@@ -51,6 +74,26 @@ static unsigned char scoreboard_write_locked = FALSE;
 /* Max number of attempts for lock requests */
 #define SCOREBOARD_MAX_LOCK_ATTEMPTS	10
 
+/* Max number of attempts to read a consistent copy of a slot */
+#define SCOREBOARD_MAX_READ_ATTEMPTS	100
+
+#if defined(__GNUC__)
+# define scoreboard_barrier()		__sync_synchronize()
+#else
+# define scoreboard_barrier()
+#endif
+
+#define SCOREBOARD_SEQNO(sce)	(*((volatile unsigned int *) &(sce)->sce_seqno))
+
+/* The table of session counters sits between the header and the slots. */
+#define SCOREBOARD_COUNTERS_OFFSET	sizeof(pr_scoreboard_header_t)
+#define SCOREBOARD_SLOTS_OFFSET		\
+  (sizeof(pr_scoreboard_header_t) + PR_SCOREBOARD_COUNTERS_SIZE)
+
+/* Only fill the counters table to three quarters, to keep probes short. */
+#define SCOREBOARD_COUNTERS_MAX_USED	\
+  ((PR_TUNABLE_SCOREBOARD_COUNTERS / 4) * 3)
+
 static const char *trace_channel = "scoreboard";
 
 /* Internal routines */
@@ -211,17 +254,6 @@ int pr_lock_scoreboard(int mutex_fd, int lock_type) {
   return 0;
 }
 
-static int rlock_scoreboard(void) {
-  int res;
-
-  res = pr_lock_scoreboard(scoreboard_mutex_fd, F_RDLCK);
-  if (res == 0) {
-    scoreboard_read_locked = TRUE;
-  }
-
-  return res;
-}
-
 static int wlock_scoreboard(void) {
   int res;
 
@@ -302,57 +334,407 @@ int pr_scoreboard_entry_lock(int fd, int lock_type) {
   return 0;
 }
 
-static int unlock_entry(int fd) {
-  int res;
+static pr_scoreboard_entry_t *get_slot(void *map, unsigned int idx) {
+  return (pr_scoreboard_entry_t *) ((char *) map + SCOREBOARD_SLOTS_OFFSET +
+    (idx * sizeof(pr_scoreboard_entry_t)));
+}
 
-  res = pr_scoreboard_entry_lock(fd, F_UNLCK); 
-  return res;
+/* (Re)map the scoreboard file, if its size has changed since we last
+ * mapped it (e.g. because another process grew it).
+ */
+static int map_scoreboard(void) {
+  struct stat st;
+  void *map;
+
+  if (fstat(scoreboard_fd, &st) < 0) {
+    return -1;
+  }
+
+  if ((size_t) st.st_size == scoreboard_mapsz) {
+    return 0;
+  }
+
+  if (scoreboard_map != NULL) {
+    (void) munmap(scoreboard_map, scoreboard_mapsz);
+    scoreboard_map = NULL;
+    scoreboard_mapsz = 0;
+    scoreboard_nslots = 0;
+  }
+
+  if ((size_t) st.st_size < SCOREBOARD_SLOTS_OFFSET) {
+    return 0;
+  }
+
+  map = mmap(NULL, (size_t) st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+    scoreboard_fd, 0);
+  if (map == MAP_FAILED) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 1, "error mapping scoreboard fd %d: %s",
+      scoreboard_fd, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  scoreboard_map = map;
+  scoreboard_mapsz = (size_t) st.st_size;
+  scoreboard_nslots = (scoreboard_mapsz - SCOREBOARD_SLOTS_OFFSET) /
+    sizeof(pr_scoreboard_entry_t);
+
+  pr_trace_msg(trace_channel, 9, "mapped scoreboard fd %d (%u slots)",
+    scoreboard_fd, scoreboard_nslots);
+  return 0;
 }
 
-static int wlock_entry(int fd) {
-  int res;
+static void unmap_scoreboard(void) {
+  if (scoreboard_map != NULL) {
+    (void) munmap(scoreboard_map, scoreboard_mapsz);
+  }
 
-  res = pr_scoreboard_entry_lock(fd, F_UNLCK); 
-  return res;
+  scoreboard_map = NULL;
+  scoreboard_mapsz = 0;
+  scoreboard_nslots = 0;
 }
 
-static int write_entry(int fd) {
-  int res;
+/* Copy the given data into a slot.  The slot's sequence number is odd for
+ * the duration, so that concurrent readers know to retry.  Callers must be
+ * the only writer of the slot: either its owning session, or the holder of
+ * the ScoreboardMutex for a slot whose owner is gone.
+ */
+static void write_slot(pr_scoreboard_entry_t *slot,
+    pr_scoreboard_entry_t *data) {
+  unsigned int seqno;
 
-  if (fd < 0) {
-    errno = EINVAL;
-    return -1;
+  seqno = SCOREBOARD_SEQNO(slot);
+  if (seqno & 1) {
+    /* A previous writer died mid-update. */
+    seqno++;
   }
 
-  if (lseek(fd, entry_lock.l_start, SEEK_SET) < 0) {
-    return -1;
+  SCOREBOARD_SEQNO(slot) = seqno + 1;
+  scoreboard_barrier();
+
+  data->sce_seqno = seqno + 1;
+  memcpy(slot, data, sizeof(pr_scoreboard_entry_t));
+
+  scoreboard_barrier();
+  SCOREBOARD_SEQNO(slot) = seqno + 2;
+}
+
+/* Copy a consistent snapshot of the slot.  Returns -1 if the slot kept
+ * changing underneath us; the copy is then only a best effort.
+ */
+static int read_slot(pr_scoreboard_entry_t *slot,
+    pr_scoreboard_entry_t *data) {
+  register unsigned int i;
+
+  for (i = 0; i < SCOREBOARD_MAX_READ_ATTEMPTS; i++) {
+    unsigned int seqno;
+
+    seqno = SCOREBOARD_SEQNO(slot);
+    scoreboard_barrier();
+
+    memcpy(data, slot, sizeof(pr_scoreboard_entry_t));
+
+    scoreboard_barrier();
+    if ((seqno & 1) == 0 &&
+        SCOREBOARD_SEQNO(slot) == seqno) {
+      return 0;
+    }
   }
 
-  res = write(fd, &entry, sizeof(entry));
-  while (res != sizeof(entry)) {
-    if (res < 0) {
-      if (errno == EINTR) {
-        pr_signals_handle();
-        res = write(fd, &entry, sizeof(entry));
-        continue;
+  return -1;
+}
+
+static pr_scoreboard_counter_header_t *get_counters(void *map) {
+  return (pr_scoreboard_counter_header_t *) ((char *) map +
+    SCOREBOARD_COUNTERS_OFFSET);
+}
+
+static pr_scoreboard_counter_t *get_counter(void *map, unsigned int idx) {
+  return (pr_scoreboard_counter_t *) ((char *) map +
+    SCOREBOARD_COUNTERS_OFFSET + sizeof(pr_scoreboard_counter_header_t) +
+    (idx * sizeof(pr_scoreboard_counter_t)));
+}
+
+static unsigned int hash_counter_str(unsigned int h, const char *str) {
+  /* FNV-1a */
+  while (*str) {
+    h ^= (unsigned char) *str++;
+    h *= 16777619;
+  }
+
+  /* Separate the fields. */
+  h *= 16777619;
+  return h;
+}
+
+static void make_counter_key(pr_scoreboard_counter_t *key, int type,
+    const char *server_addr, const char *name, const char *client_addr) {
+  unsigned int h = 2166136261U;
+
+  memset(key, '\0', sizeof(pr_scoreboard_counter_t));
+  key->scc_type = type;
+
+  sstrncpy(key->scc_server_addr, server_addr ? server_addr : "",
+    sizeof(key->scc_server_addr));
+  sstrncpy(key->scc_name, name ? name : "", sizeof(key->scc_name));
+  sstrncpy(key->scc_client_addr, client_addr ? client_addr : "",
+    sizeof(key->scc_client_addr));
+
+  if (type == PR_SCORE_COUNT_CLASS) {
+    register unsigned int i;
+
+    /* Class names are matched case-insensitively. */
+    for (i = 0; key->scc_name[i]; i++) {
+      key->scc_name[i] = tolower((int) key->scc_name[i]);
+    }
+  }
+
+  h ^= (unsigned int) type;
+  h *= 16777619;
+  h = hash_counter_str(h, key->scc_server_addr);
+  h = hash_counter_str(h, key->scc_name);
+  h = hash_counter_str(h, key->scc_client_addr);
+  key->scc_hash = h;
+}
+
+/* Find the record for the given key.  Returns its index, or the index of the
+ * free record at which it would be added (with *found set to FALSE), or -1
+ * if the table is full.
+ */
+static int find_counter(void *map, pr_scoreboard_counter_t *key,
+    int *found) {
+  register unsigned int i;
+  unsigned int idx;
+
+  idx = key->scc_hash % PR_TUNABLE_SCOREBOARD_COUNTERS;
+  for (i = 0; i < PR_TUNABLE_SCOREBOARD_COUNTERS; i++) {
+    pr_scoreboard_counter_t *rec;
+
+    rec = get_counter(map, idx);
+    if (rec->scc_count == 0) {
+      *found = FALSE;
+      return (int) idx;
+    }
+
+    /* Bounded comparisons, as lock-free readers may see a record while it
+     * is being rewritten.
+     */
+    if (rec->scc_hash == key->scc_hash &&
+        rec->scc_type == key->scc_type &&
+        strncmp(rec->scc_server_addr, key->scc_server_addr,
+          sizeof(key->scc_server_addr)) == 0 &&
+        strncmp(rec->scc_name, key->scc_name, sizeof(key->scc_name)) == 0 &&
+        strncmp(rec->scc_client_addr, key->scc_client_addr,
+          sizeof(key->scc_client_addr)) == 0) {
+      *found = TRUE;
+      return (int) idx;
+    }
+
+    idx = (idx + 1) % PR_TUNABLE_SCOREBOARD_COUNTERS;
+  }
+
+  return -1;
+}
+
+/* Free the record at the given index, moving any later records of the same
+ * probe sequence back into the hole, so that lookups never need tombstones.
+ */
+static void remove_counter(void *map, unsigned int idx) {
+  unsigned int hole = idx, next = idx;
+
+  while (TRUE) {
+    pr_scoreboard_counter_t *rec;
+    unsigned int home;
+
+    next = (next + 1) % PR_TUNABLE_SCOREBOARD_COUNTERS;
+    rec = get_counter(map, next);
+    if (rec->scc_count == 0) {
+      break;
+    }
+
+    /* The record can fill the hole unless its home position lies
+     * (cyclically) after the hole, up to its current position.
+     */
+    home = rec->scc_hash % PR_TUNABLE_SCOREBOARD_COUNTERS;
+    if (hole < next ?
+        (home <= hole || home > next) :
+        (home <= hole && home > next)) {
+      memcpy(get_counter(map, hole), rec, sizeof(pr_scoreboard_counter_t));
+      hole = next;
+    }
+  }
+
+  memset(get_counter(map, hole), '\0', sizeof(pr_scoreboard_counter_t));
+}
+
+static void adjust_counter(void *map, int type, const char *server_addr,
+    const char *name, const char *client_addr, int delta) {
+  pr_scoreboard_counter_header_t *counters;
+  pr_scoreboard_counter_t key, *rec;
+  int idx, found = FALSE;
+
+  counters = get_counters(map);
+  make_counter_key(&key, type, server_addr, name, client_addr);
+
+  idx = find_counter(map, &key, &found);
+  if (delta > 0) {
+    if (found) {
+      get_counter(map, idx)->scc_count++;
+      return;
+    }
+
+    if (idx < 0 ||
+        counters->scc_nused >= SCOREBOARD_COUNTERS_MAX_USED) {
+      if (!counters->scc_stale) {
+        pr_log_pri(PR_LOG_NOTICE, "notice: scoreboard counters table full "
+          "(%u records), see PR_TUNABLE_SCOREBOARD_COUNTERS",
+          (unsigned int) PR_TUNABLE_SCOREBOARD_COUNTERS);
       }
 
-      return -1;
+      counters->scc_stale = TRUE;
+      return;
     }
 
-    /* Watch out for short writes here. */
-    pr_log_pri(PR_LOG_NOTICE,
-      "error updating scoreboard entry: only wrote %d of %lu bytes", res,
-      (unsigned long) sizeof(entry));
-    errno = EIO;
-    return -1;
+    rec = get_counter(map, idx);
+    memcpy(rec, &key, sizeof(key));
+    rec->scc_count = 1;
+    counters->scc_nused++;
+    return;
+  }
+
+  /* A missing record can only be due to the table having been full. */
+  if (!found) {
+    return;
+  }
+
+  rec = get_counter(map, idx);
+  if (rec->scc_count > 1) {
+    rec->scc_count--;
+    return;
+  }
+
+  remove_counter(map, idx);
+  counters->scc_nused--;
+}
+
+/* Add (delta 1) or remove (delta -1) the given entry's contribution to the
+ * session counters.  Entries only count once they have a server address.
+ */
+static void count_entry(void *map, pr_scoreboard_entry_t *sce, int delta) {
+  const char *server_addr, *client_addr;
+
+  if (sce->sce_pid == 0 ||
+      sce->sce_server_addr[0] == '\0') {
+    return;
+  }
+
+  server_addr = sce->sce_server_addr;
+  client_addr = sce->sce_client_addr;
+
+  adjust_counter(map, PR_SCORE_COUNT_SERVER, server_addr, NULL, NULL, delta);
+  if (*client_addr) {
+    adjust_counter(map, PR_SCORE_COUNT_HOST, server_addr, NULL, client_addr,
+      delta);
+  }
+
+  if (sce->sce_user[0] == '\0' ||
+      strncmp(sce->sce_user, "(none)", 7) == 0) {
+    return;
+  }
+
+  adjust_counter(map, PR_SCORE_COUNT_AUTH, server_addr, NULL, NULL, delta);
+  adjust_counter(map, PR_SCORE_COUNT_USER, server_addr, sce->sce_user, NULL,
+    delta);
+
+  if (*client_addr) {
+    adjust_counter(map, PR_SCORE_COUNT_AUTH_HOST, server_addr, NULL,
+      client_addr, delta);
+    adjust_counter(map, PR_SCORE_COUNT_USER_HOST, server_addr, sce->sce_user,
+      client_addr, delta);
+  }
+
+  if (sce->sce_class[0] != '\0') {
+    adjust_counter(map, PR_SCORE_COUNT_CLASS, server_addr, sce->sce_class,
+      NULL, delta);
+  }
+}
+
+/* Changes to the counters are made while holding the ScoreboardMutex, and
+ * bracketed by the table's sequence number, so that readers need no locks.
+ */
+static void begin_counters_update(void *map) {
+  pr_scoreboard_counter_header_t *counters;
+
+  counters = get_counters(map);
+  if (counters->scc_seqno & 1) {
+    /* A previous writer died mid-update; distrust the table until it is
+     * rebuilt.
+     */
+    counters->scc_seqno++;
+    counters->scc_stale = TRUE;
+  }
+
+  counters->scc_seqno++;
+  scoreboard_barrier();
+}
+
+static void end_counters_update(void *map) {
+  scoreboard_barrier();
+  get_counters(map)->scc_seqno++;
+}
+
+/* Recount all of the sessions in the given slots. */
+static void rebuild_counters(void *map, unsigned int nslots) {
+  register unsigned int i;
+  pr_scoreboard_counter_header_t *counters;
+
+  begin_counters_update(map);
+
+  counters = get_counters(map);
+  memset((char *) counters + sizeof(pr_scoreboard_counter_header_t), '\0',
+    PR_SCOREBOARD_COUNTERS_SIZE - sizeof(pr_scoreboard_counter_header_t));
+  counters->scc_nused = 0;
+  counters->scc_stale = FALSE;
+
+  for (i = 0; i < nslots; i++) {
+    pr_scoreboard_entry_t sce;
+
+    if (get_slot(map, i)->sce_pid == 0) {
+      continue;
+    }
+
+    (void) read_slot(get_slot(map, i), &sce);
+    count_entry(map, &sce, 1);
   }
 
-  /* Rewind. */
-  if (lseek(fd, entry_lock.l_start, SEEK_SET) < 0) {
+  end_counters_update(map);
+}
+
+/* Whether the entry differs from its last tallied copy in any of the fields
+ * used as counter keys.
+ */
+static int entry_counts_changed(void) {
+  if (strcmp(entry.sce_server_addr, counted_entry.sce_server_addr) != 0 ||
+      strcmp(entry.sce_client_addr, counted_entry.sce_client_addr) != 0 ||
+      strcmp(entry.sce_user, counted_entry.sce_user) != 0 ||
+      strcmp(entry.sce_class, counted_entry.sce_class) != 0) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static int write_entry(void) {
+  if (scoreboard_map == NULL ||
+      entry_idx >= scoreboard_nslots) {
+    errno = EINVAL;
     return -1;
   }
 
+  write_slot(get_slot(scoreboard_map, entry_idx), &entry);
   return 0;
 }
 
@@ -372,6 +754,8 @@ int pr_close_scoreboard(int keep_mutex) {
 
   pr_trace_msg(trace_channel, 4, "closing scoreboard fd %d", scoreboard_fd);
 
+  unmap_scoreboard();
+
   while (close(scoreboard_fd) < 0) {
     if (errno == EINTR) {
       pr_signals_handle();
@@ -430,6 +814,8 @@ void pr_delete_scoreboard(void) {
     }
   }
 
+  unmap_scoreboard();
+
   scoreboard_fd = -1;
   scoreboard_mutex_fd = -1;
   scoreboard_opener = 0;
@@ -510,6 +896,11 @@ int pr_open_scoreboard(int flags) {
     }
   }
 
+  /* Any mapping inherited from our parent is not ours to use. */
+  unmap_scoreboard();
+  scan_idx = 0;
+  have_saved_scan = FALSE;
+
   pr_log_debug(DEBUG7, "opening scoreboard '%s'", scoreboard_file);
 
   scoreboard_fd = open(scoreboard_file, flags|O_CREAT, PR_SCOREBOARD_MODE);
@@ -642,8 +1033,41 @@ int pr_open_scoreboard(int flags) {
       return -1;
     }
 
+    /* Make room for the (empty, thus zeroed) table of session counters. */
+    while (ftruncate(scoreboard_fd, (off_t) SCOREBOARD_SLOTS_OFFSET) < 0) {
+      int xerrno = errno;
+
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      unlock_scoreboard();
+
+      close(scoreboard_mutex_fd);
+      scoreboard_mutex_fd = -1;
+
+      close(scoreboard_fd);
+      scoreboard_fd = -1;
+
+      errno = xerrno;
+      return -1;
+    }
+
     unlock_scoreboard();
-    return 0;
+    res = 0;
+  }
+
+  if (res == 0 &&
+      map_scoreboard() < 0) {
+    int xerrno = errno;
+
+    pr_log_pri(PR_LOG_NOTICE, "error mapping ScoreboardFile '%s': %s",
+      scoreboard_file, strerror(xerrno));
+    pr_close_scoreboard(FALSE);
+
+    errno = xerrno;
+    return -1;
   }
 
   return res;
@@ -659,7 +1083,7 @@ int pr_restore_scoreboard(void) {
     return -1;
   }
 
-  if (current_pos == 0) {
+  if (have_saved_scan == FALSE) {
     /* This can happen if pr_restore_scoreboard() is called BEFORE
      * pr_rewind_scoreboard() has been called.
      */
@@ -667,19 +1091,14 @@ int pr_restore_scoreboard(void) {
     return -1;
   }
 
-  /* Position the file position pointer of the scoreboard back to
-   * where it was, prior to the last pr_rewind_scoreboard() call.
+  /* Position the scan back to where it was, prior to the last
+   * pr_rewind_scoreboard() call.
    */
-  if (lseek(scoreboard_fd, current_pos, SEEK_SET) == (off_t) -1) {
-    return -1;
-  }
-
+  scan_idx = saved_scan_idx;
   return 0;
 }
 
 int pr_rewind_scoreboard(void) {
-  off_t res;
-
   if (scoreboard_engine == FALSE) {
     return 0;
   }
@@ -689,18 +1108,14 @@ int pr_rewind_scoreboard(void) {
     return -1;
   }
 
-  res = lseek(scoreboard_fd, (off_t) 0, SEEK_CUR);
-  if (res == (off_t) -1) {
-    return -1;
-  }
-
-  current_pos = res;
+  saved_scan_idx = scan_idx;
+  have_saved_scan = TRUE;
 
-  /* Position the file position pointer of the scoreboard at the
-   * start of the scoreboard (past the header).
+  /* Position the scan at the first slot, and pick up any slots added by
+   * other processes since we last looked.
    */
-  if (lseek(scoreboard_fd, (off_t) sizeof(pr_scoreboard_header_t),
-      SEEK_SET) == (off_t) -1) {
+  scan_idx = 0;
+  if (map_scoreboard() < 0) {
     return -1;
   }
 
@@ -817,6 +1232,7 @@ int pr_set_scoreboard_mutex(const char *path) {
 
 int pr_scoreboard_entry_add(void) {
   int res;
+  register unsigned int i;
   unsigned char found_slot = FALSE;
 
   if (scoreboard_engine == FALSE) {
@@ -845,39 +1261,60 @@ int pr_scoreboard_entry_add(void) {
   /* No interruptions, please. */
   pr_signals_block();
 
-  /* If the scoreboard is open, the file position is already past the
-   * header.
-   */
-  while (TRUE) {
-    while ((res = read(scoreboard_fd, &entry, sizeof(entry))) ==
-        sizeof(entry)) {
+  res = map_scoreboard();
+  if (res == 0) {
+    for (i = 0; i < scoreboard_nslots; i++) {
 
       /* If this entry's PID is marked as zero, it means this slot can be
        * reused.
        */
-      if (!entry.sce_pid) {
-        entry_lock.l_start = lseek(scoreboard_fd, (off_t) 0, SEEK_CUR) - sizeof(entry);
+      if (get_slot(scoreboard_map, i)->sce_pid == 0) {
+        entry_idx = i;
         found_slot = TRUE;
         break;
       }
     }
 
-    if (res == 0) {
-      entry_lock.l_start = lseek(scoreboard_fd, (off_t) 0, SEEK_CUR);
-      found_slot = TRUE;
-    }
+    if (!found_slot) {
+      off_t len;
 
-    if (found_slot)
-      break;
+      /* Grow the scoreboard by several (zeroed, thus free) slots at once,
+       * so that every process does not need to remap it for every new
+       * session.
+       */
+      entry_idx = scoreboard_nslots;
+      len = (off_t) (SCOREBOARD_SLOTS_OFFSET +
+        ((scoreboard_nslots + PR_TUNABLE_SCOREBOARD_GROW_SLOTS) *
+         sizeof(pr_scoreboard_entry_t)));
+
+      while ((res = ftruncate(scoreboard_fd, len)) < 0) {
+        if (errno == EINTR) {
+          pr_signals_handle();
+          continue;
+        }
+
+        break;
+      }
+
+      if (res == 0) {
+        res = map_scoreboard();
+      }
+    }
   }
 
-  memset(&entry, '\0', sizeof(entry));
+  if (res == 0) {
+    memset(&entry, '\0', sizeof(entry));
+
+    entry.sce_pid = session.pid ? session.pid : getpid();
+    entry.sce_uid = geteuid();
+    entry.sce_gid = getegid();
 
-  entry.sce_pid = session.pid ? session.pid : getpid();
-  entry.sce_uid = geteuid();
-  entry.sce_gid = getegid();
+    /* A new entry has no server address yet, thus counts for nothing. */
+    memcpy(&counted_entry, &entry, sizeof(counted_entry));
+
+    res = write_entry();
+  }
 
-  res = write_entry(scoreboard_fd);
   if (res < 0) {
     pr_log_pri(PR_LOG_NOTICE, "error writing scoreboard entry: %s",
       strerror(errno));
@@ -895,6 +1332,8 @@ int pr_scoreboard_entry_add(void) {
 }
 
 int pr_scoreboard_entry_del(unsigned char verbose) {
+  int res;
+
   if (scoreboard_engine == FALSE) {
     return 0;
   }
@@ -913,15 +1352,24 @@ int pr_scoreboard_entry_del(unsigned char verbose) {
 
   memset(&entry, '\0', sizeof(entry));
 
-  /* Write-lock this entry */
-  wlock_entry(scoreboard_fd);
-
   /* Write-lock the scoreboard (using the ScoreboardMutex), since new
    * connections might try to use the slot being opened up here.
    */
-  wlock_scoreboard();
+  res = wlock_scoreboard();
+
+  if (scoreboard_map != NULL) {
+    if (res == 0) {
+      begin_counters_update(scoreboard_map);
+      count_entry(scoreboard_map, &counted_entry, -1);
+      end_counters_update(scoreboard_map);
+
+    } else {
+      get_counters(scoreboard_map)->scc_stale = TRUE;
+    }
+  }
+  memset(&counted_entry, '\0', sizeof(counted_entry));
 
-  if (write_entry(scoreboard_fd) < 0 &&
+  if (write_entry() < 0 &&
       verbose) {
     pr_log_pri(PR_LOG_NOTICE, "error deleting scoreboard entry: %s",
       strerror(errno));
@@ -929,7 +1377,6 @@ int pr_scoreboard_entry_del(unsigned char verbose) {
 
   have_entry = FALSE;
   unlock_scoreboard();
-  unlock_entry(scoreboard_fd);
 
   return 0;
 }
@@ -952,7 +1399,6 @@ time_t pr_scoreboard_get_daemon_uptime(void) {
 
 pr_scoreboard_entry_t *pr_scoreboard_entry_read(void) {
   static pr_scoreboard_entry_t scan_entry;
-  int res = 0;
 
   if (scoreboard_engine == FALSE) {
     return NULL;
@@ -963,43 +1409,113 @@ pr_scoreboard_entry_t *pr_scoreboard_entry_read(void) {
     return NULL;
   }
 
-  /* Make sure the scoreboard file is read-locked. */
-  if (!scoreboard_read_locked) {
+  pr_trace_msg(trace_channel, 5, "reading scoreboard entry");
 
-    /* Do not proceed if we cannot lock the scoreboard. */
-    res = rlock_scoreboard();
-    if (res < 0) {
-      return NULL; 
-    }
+  /* Other processes may have grown the scoreboard since we mapped it. */
+  if (scan_idx >= scoreboard_nslots &&
+      map_scoreboard() < 0) {
+    return NULL;
   }
 
-  pr_trace_msg(trace_channel, 5, "reading scoreboard entry");
+  while (scan_idx < scoreboard_nslots) {
+    pr_scoreboard_entry_t *slot;
 
-  memset(&scan_entry, '\0', sizeof(scan_entry));
+    slot = get_slot(scoreboard_map, scan_idx++);
 
-  /* NOTE: use readv(2)? */
-  while (TRUE) {
-    while ((res = read(scoreboard_fd, &scan_entry, sizeof(scan_entry))) <= 0) {
-      if (res < 0 && errno == EINTR) {
-        pr_signals_handle();
-        continue;
+    /* Skip free slots without copying them. */
+    if (slot->sce_pid == 0) {
+      continue;
+    }
 
-      } else {
-        unlock_scoreboard();
-        return NULL;
-      }
+    if (read_slot(slot, &scan_entry) < 0) {
+      pr_trace_msg(trace_channel, 9, "slot %u changed while reading, "
+        "using inconsistent copy", scan_idx - 1);
     }
 
     if (scan_entry.sce_pid) {
-      unlock_scoreboard();
       return &scan_entry;
     }
   }
 
-  /* Technically we never reach this. */
   return NULL;
 }
 
+int pr_scoreboard_count_get(int type, const char *server_addr,
+    const char *name, const char *client_addr, unsigned int *count) {
+  register unsigned int i;
+  pr_scoreboard_counter_header_t *counters;
+  pr_scoreboard_counter_t key;
+
+  if (server_addr == NULL ||
+      count == NULL ||
+      type < PR_SCORE_COUNT_SERVER ||
+      type > PR_SCORE_COUNT_CLASS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (scoreboard_engine == FALSE) {
+    *count = 0;
+    return 0;
+  }
+
+  if (scoreboard_fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (scoreboard_map == NULL &&
+      map_scoreboard() < 0) {
+    return -1;
+  }
+
+  if (scoreboard_map == NULL) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  make_counter_key(&key, type, server_addr, name, client_addr);
+  counters = get_counters(scoreboard_map);
+
+  for (i = 0; i < SCOREBOARD_MAX_READ_ATTEMPTS; i++) {
+    unsigned int seqno, n = 0;
+    int idx, found = FALSE;
+
+    seqno = *((volatile unsigned int *) &counters->scc_seqno);
+    scoreboard_barrier();
+
+    if (seqno & 1) {
+      continue;
+    }
+
+    if (counters->scc_stale) {
+      pr_trace_msg(trace_channel, 9,
+        "scoreboard counters are stale, not using them");
+      errno = EAGAIN;
+      return -1;
+    }
+
+    idx = find_counter(scoreboard_map, &key, &found);
+    if (found) {
+      n = get_counter(scoreboard_map, idx)->scc_count;
+    }
+
+    scoreboard_barrier();
+    if (*((volatile unsigned int *) &counters->scc_seqno) == seqno) {
+      pr_trace_msg(trace_channel, 17, "scoreboard counter %d for '%s' "
+        "(name '%s', client '%s'): %u", type, key.scc_server_addr,
+        key.scc_name, key.scc_client_addr, n);
+      *count = n;
+      return 0;
+    }
+  }
+
+  pr_trace_msg(trace_channel, 9,
+    "scoreboard counters kept changing while reading");
+  errno = EAGAIN;
+  return -1;
+}
+
 /* We get clever with the next functions, so that they can be used for
  * various entry attributes.
  */
@@ -1339,6 +1855,42 @@ int pr_scoreboard_entry_update(pid_t pid, ...) {
           "'%s'", entry.sce_protocol);
         break;
 
+      case PR_SCORE_STATCACHE_HITS:
+        entry.sce_statcache_hits = va_arg(ap, unsigned long);
+        pr_trace_msg(trace_channel, 15, "updated scoreboard entry statcache "
+          "hits to %lu", entry.sce_statcache_hits);
+        break;
+
+      case PR_SCORE_STATCACHE_MISSES:
+        entry.sce_statcache_misses = va_arg(ap, unsigned long);
+        pr_trace_msg(trace_channel, 15, "updated scoreboard entry statcache "
+          "misses to %lu", entry.sce_statcache_misses);
+        break;
+
+      case PR_SCORE_STATCACHE_EVICTIONS:
+        entry.sce_statcache_evictions = va_arg(ap, unsigned long);
+        pr_trace_msg(trace_channel, 15, "updated scoreboard entry statcache "
+          "evictions to %lu", entry.sce_statcache_evictions);
+        break;
+
+      case PR_SCORE_POOL_BYTES:
+        entry.sce_pool_bytes = va_arg(ap, unsigned long);
+        pr_trace_msg(trace_channel, 15, "updated scoreboard entry pool "
+          "bytes to %lu", entry.sce_pool_bytes);
+        break;
+
+      case PR_SCORE_POOL_REUSED:
+        entry.sce_pool_reused = va_arg(ap, unsigned long);
+        pr_trace_msg(trace_channel, 15, "updated scoreboard entry pool "
+          "reused blocks to %lu", entry.sce_pool_reused);
+        break;
+
+      case PR_SCORE_POOL_FREELIST_LEN:
+        entry.sce_pool_freelist_len = va_arg(ap, unsigned long);
+        pr_trace_msg(trace_channel, 15, "updated scoreboard entry pool "
+          "free list length to %lu", entry.sce_pool_freelist_len);
+        break;
+
       default:
         va_end(ap);
         errno = ENOENT;
@@ -1348,13 +1900,46 @@ int pr_scoreboard_entry_update(pid_t pid, ...) {
 
   va_end(ap);
 
-  /* Write-lock this entry */
-  wlock_entry(scoreboard_fd);
-  if (write_entry(scoreboard_fd) < 0) {
+  if (entry_counts_changed() &&
+      scoreboard_map != NULL) {
+    int res;
+
+    /* Move our tallies to the new keys, and write the entry, as one change
+     * with respect to the ScoreboardMutex; scrubbing recounts the entries.
+     */
+    PR_DEVEL_CLOCK(res = wlock_scoreboard());
+
+    pr_signals_block();
+
+    if (res == 0) {
+      begin_counters_update(scoreboard_map);
+      count_entry(scoreboard_map, &counted_entry, -1);
+      count_entry(scoreboard_map, &entry, 1);
+      end_counters_update(scoreboard_map);
+
+    } else {
+      pr_log_pri(PR_LOG_NOTICE, "error locking scoreboard: %s",
+        strerror(errno));
+      get_counters(scoreboard_map)->scc_stale = TRUE;
+    }
+
+    memcpy(&counted_entry, &entry, sizeof(counted_entry));
+
+    if (write_entry() < 0) {
+      pr_log_pri(PR_LOG_NOTICE, "error writing scoreboard entry: %s",
+        strerror(errno));
+    }
+
+    pr_signals_unblock();
+
+    if (res == 0) {
+      unlock_scoreboard();
+    }
+
+  } else if (write_entry() < 0) {
     pr_log_pri(PR_LOG_NOTICE, "error writing scoreboard entry: %s",
       strerror(errno));
   }
-  unlock_entry(scoreboard_fd);
 
   pr_trace_msg(trace_channel, 3, "finished updating scoreboard entry");
   return 0;
@@ -1394,9 +1979,11 @@ static int scoreboard_valid_pid(pid_t pid, pid_t curr_pgrp) {
 
 int pr_scoreboard_scrub(void) {
   int fd = -1, res, xerrno;
-  off_t curr_offset = 0;
+  register unsigned int i;
+  unsigned int nslots;
   pid_t curr_pgrp = 0;
-  pr_scoreboard_entry_t sce;
+  struct stat st;
+  void *map;
 
   if (scoreboard_engine == FALSE) {
     return 0;
@@ -1421,7 +2008,9 @@ int pr_scoreboard_scrub(void) {
     return -1;
   }
 
-  /* Write-lock the scoreboard file. */
+  /* Write-lock the scoreboard file, so that no slots are allocated or
+   * freed while we look.
+   */
   PR_DEVEL_CLOCK(res = wlock_scoreboard());
   if (res < 0) {
     xerrno = errno;
@@ -1432,15 +2021,7 @@ int pr_scoreboard_scrub(void) {
     return -1;
   }
 
-#ifdef HAVE_GETPGRP
-  curr_pgrp = getpgrp();
-#elif HAVE_GETPGID
-  curr_pgrp = getpgid(0);
-#endif /* !HAVE_GETPGRP and !HAVE_GETPGID */
- 
-  /* Skip past the scoreboard header. */
-  curr_offset = lseek(fd, (off_t) sizeof(pr_scoreboard_header_t), SEEK_SET);
-  if (curr_offset < 0) {
+  if (fstat(fd, &st) < 0) {
     xerrno = errno;
 
     unlock_scoreboard();
@@ -1450,119 +2031,77 @@ int pr_scoreboard_scrub(void) {
     return -1;
   }
 
-  entry_lock.l_start = curr_offset;
- 
-  PRIVS_ROOT
-
-  while (TRUE) {
-    pr_signals_handle();
-
-    /* First, lock the scoreboard entry/slot about to be checked.  If we can't
-     * (e.g. because the session process has it locked), then just move on.
-     * If another process has it locked, then it is presumed to be valid.
-     */
-    if (wlock_entry(fd) < 0) {
-      /* Seek to the next entry/slot.  If it fails for any reason, just
-       * be done with the scrubbing.
-       */
-      curr_offset = lseek(fd, sizeof(sce), SEEK_CUR);
-      entry_lock.l_start = curr_offset;
+  if ((size_t) st.st_size < SCOREBOARD_SLOTS_OFFSET +
+      sizeof(pr_scoreboard_entry_t)) {
+    /* No slots to scrub. */
+    unlock_scoreboard();
+    (void) close(fd);
 
-      if (curr_offset < 0) {
-        pr_trace_msg(trace_channel, 3,
-          "error seeking to next scoreboard entry (fd %d): %s", fd,
-          strerror(xerrno));
-        break;
-      }
+    pr_trace_msg(trace_channel, 9, "%s", "finished scrubbing scoreboard");
+    return 0;
+  }
 
-      continue;
-    }
+  map = mmap(NULL, (size_t) st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd,
+    0);
+  if (map == MAP_FAILED) {
+    xerrno = errno;
 
-    memset(&sce, 0, sizeof(sce));
-    res = read(fd, &sce, sizeof(sce));
-    if (res == 0) {
-      /* EOF */
-      unlock_entry(fd);
-      break;
-    }
+    pr_log_debug(DEBUG1, "unable to map ScoreboardFile '%s' for scrubbing: %s",
+      pr_get_scoreboard(), strerror(xerrno));
 
-    if (res == sizeof(sce)) {
+    unlock_scoreboard();
+    (void) close(fd);
 
-      /* Check to see if the PID in this entry is valid.  If not, erase
-       * the slot.
-       */
-      if (sce.sce_pid &&
-          scoreboard_valid_pid(sce.sce_pid, curr_pgrp) < 0) {
-        pid_t slot_pid;
+    errno = xerrno;
+    return -1;
+  }
 
-        slot_pid = sce.sce_pid;
+  nslots = ((size_t) st.st_size - SCOREBOARD_SLOTS_OFFSET) /
+    sizeof(pr_scoreboard_entry_t);
 
-        /* OK, the recorded PID is no longer valid. */
-        pr_log_debug(DEBUG9, "scrubbing scoreboard entry for PID %lu",
-          (unsigned long) slot_pid);
+#ifdef HAVE_GETPGRP
+  curr_pgrp = getpgrp();
+#elif HAVE_GETPGID
+  curr_pgrp = getpgid(0);
+#endif /* !HAVE_GETPGRP and !HAVE_GETPGID */
 
-        /* Rewind to the start of this slot. */
-        if (lseek(fd, curr_offset, SEEK_SET) < 0) {
-          xerrno = errno;
+  PRIVS_ROOT
 
-          pr_log_debug(DEBUG0, "error seeking to scoreboard entry to scrub: %s",
-            strerror(xerrno));
+  for (i = 0; i < nslots; i++) {
+    pr_scoreboard_entry_t *slot;
+    pid_t slot_pid;
 
-          pr_trace_msg(trace_channel, 3,
-            "error seeking to scoreboard entry for PID %lu (offset %" PR_LU ") "
-            "to scrub: %s", (unsigned long) slot_pid, (pr_off_t) curr_offset,
-            strerror(xerrno));
-        }
+    pr_signals_handle();
 
-        memset(&sce, 0, sizeof(sce));
-
-        /* Note: It does not matter that we only have a read-lock on this
-         * slot; we can safely write over the byte range here, since we know
-         * that the process for this slot is not around anymore, and there
-         * are no incoming processes to use take it.
-         */
-
-        res = write(fd, &sce, sizeof(sce));
-        while (res != sizeof(sce)) {
-          if (res < 0) {
-            xerrno = errno;
-
-            if (xerrno == EINTR) {
-              pr_signals_handle();
-              res = write(fd, &sce, sizeof(sce));
-              continue;
-            }
-
-            pr_log_debug(DEBUG0, "error scrubbing scoreboard: %s",
-              strerror(xerrno));
-            pr_trace_msg(trace_channel, 3,
-              "error writing out scrubbed scoreboard entry for PID %lu: %s",
-              (unsigned long) slot_pid, strerror(xerrno));
-
-          } else {
-            /* Watch out for short writes here. */
-            pr_log_pri(PR_LOG_NOTICE,
-              "error scrubbing scoreboard entry: only wrote %d of %lu bytes",
-              res, (unsigned long) sizeof(sce));
-          }
-        }
-      }
+    slot = get_slot(map, i);
+    slot_pid = slot->sce_pid;
 
-      /* Unlock the slot, and move to the next one. */
-      unlock_entry(fd);
+    /* Check to see if the PID in this entry is valid.  If not, erase
+     * the slot.  Since the owning process is gone, and we hold the
+     * ScoreboardMutex, nothing else can be writing to this slot.
+     */
+    if (slot_pid &&
+        scoreboard_valid_pid(slot_pid, curr_pgrp) < 0) {
+      pr_scoreboard_entry_t sce;
 
-      /* Mark the current offset. */
-      curr_offset = lseek(fd, (off_t) 0, SEEK_CUR);
-      if (curr_offset < 0) {
-        break;
-      }
+      pr_log_debug(DEBUG9, "scrubbing scoreboard entry for PID %lu",
+        (unsigned long) slot_pid);
 
-      entry_lock.l_start = curr_offset;
+      memset(&sce, 0, sizeof(sce));
+      write_slot(slot, &sce);
     }
   }
 
   PRIVS_RELINQUISH
 
+  /* Recount the remaining sessions, dropping the tallies of any scrubbed
+   * ones, and correcting any drift (e.g. from sessions which died while
+   * updating the counters, or from a full table).
+   */
+  rebuild_counters(map, nslots);
+
+  (void) munmap(map, (size_t) st.st_size);
+
   /* Release the scoreboard. */
   unlock_scoreboard();
 
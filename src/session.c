@@ -27,6 +27,21 @@
 /* From src/main.c */
 extern unsigned char is_master;
 
+/* Pre-session checks, run by the daemon process for each accepted
+ * connection before forking.
+ */
+struct sess_precheck {
+  struct sess_precheck *next;
+  module *m;
+  const char *name;
+  int (*cb)(pool *, server_rec *, const pr_netaddr_t *);
+};
+
+static pool *precheck_pool = NULL;
+static struct sess_precheck *prechecks = NULL;
+
+static const char *trace_channel = "session";
+
 static void sess_cleanup(int flags) {
 
   /* Clear the scoreboard entry. */
@@ -370,9 +385,23 @@ void pr_session_send_banner(server_rec *s, int flags) {
 
 int pr_session_set_idle(void) {
   const char *user = NULL;
+  pr_fs_statcache_stats_t stats;
+  pr_pool_stats_t pool_stats;
+
+  memset(&stats, 0, sizeof(stats));
+  (void) pr_fs_statcache_get_stats(&stats);
+
+  memset(&pool_stats, 0, sizeof(pool_stats));
+  (void) pr_pool_get_stats(&pool_stats);
 
   pr_scoreboard_entry_update(session.pid,
     PR_SCORE_BEGIN_IDLE, time(NULL),
+    PR_SCORE_STATCACHE_HITS, stats.hits,
+    PR_SCORE_STATCACHE_MISSES, stats.misses,
+    PR_SCORE_STATCACHE_EVICTIONS, stats.evictions,
+    PR_SCORE_POOL_BYTES, pool_stats.bytes_allocated,
+    PR_SCORE_POOL_REUSED, pool_stats.blocks_reused,
+    PR_SCORE_POOL_FREELIST_LEN, pool_stats.freelist_len,
     PR_SCORE_CMD, "%s", "idle", NULL, NULL);
 
   pr_scoreboard_entry_update(session.pid,
@@ -484,3 +513,171 @@ const char *pr_session_get_ttyname(pool *p) {
 
   return pstrdup(p, sess_ttyname);
 }
+
+int pr_session_register_precheck(module *m, const char *name,
+    int (*cb)(pool *, server_rec *, const pr_netaddr_t *)) {
+  struct sess_precheck *pc;
+
+  if (name == NULL ||
+      cb == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (precheck_pool == NULL) {
+    precheck_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(precheck_pool, "Session Precheck Pool");
+  }
+
+  for (pc = prechecks; pc; pc = pc->next) {
+    if (pc->m == m &&
+        strcmp(pc->name, name) == 0) {
+      errno = EEXIST;
+      return -1;
+    }
+  }
+
+  pc = pcalloc(precheck_pool, sizeof(struct sess_precheck));
+  pc->m = m;
+  pc->name = pstrdup(precheck_pool, name);
+  pc->cb = cb;
+
+  pc->next = prechecks;
+  prechecks = pc;
+
+  return 0;
+}
+
+int pr_session_unregister_precheck(module *m, const char *name) {
+  struct sess_precheck *pc, *prev = NULL;
+  int count = 0;
+
+  pc = prechecks;
+  while (pc != NULL) {
+    struct sess_precheck *next;
+
+    next = pc->next;
+
+    if ((m == NULL || pc->m == m) &&
+        (name == NULL || strcmp(pc->name, name) == 0)) {
+      if (prev != NULL) {
+        prev->next = next;
+
+      } else {
+        prechecks = next;
+      }
+
+      count++;
+
+    } else {
+      prev = pc;
+    }
+
+    pc = next;
+  }
+
+  if (count == 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  return 0;
+}
+
+int pr_session_precheck(int fd) {
+  struct sess_precheck *pc;
+  struct sockaddr_storage local_sa, remote_sa;
+  socklen_t sa_len;
+  pr_netaddr_t *local_addr, *remote_addr;
+  server_rec *s;
+  pool *tmp_pool;
+  int res = 0;
+
+  if (prechecks == NULL) {
+    return 0;
+  }
+
+  if (fd < 0) {
+    errno = EBADF;
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(precheck_pool);
+  pr_pool_tag(tmp_pool, "Session Precheck tmp pool");
+
+  memset(&local_sa, 0, sizeof(local_sa));
+  sa_len = sizeof(local_sa);
+  if (getsockname(fd, (struct sockaddr *) &local_sa, &sa_len) < 0) {
+    int xerrno = errno;
+
+    destroy_pool(tmp_pool);
+    errno = xerrno;
+    return -1;
+  }
+
+  memset(&remote_sa, 0, sizeof(remote_sa));
+  sa_len = sizeof(remote_sa);
+  if (getpeername(fd, (struct sockaddr *) &remote_sa, &sa_len) < 0) {
+    int xerrno = errno;
+
+    destroy_pool(tmp_pool);
+    errno = xerrno;
+    return -1;
+  }
+
+  local_addr = pr_netaddr_alloc(tmp_pool);
+  pr_netaddr_set_family(local_addr, local_sa.ss_family);
+  pr_netaddr_set_sockaddr(local_addr, (struct sockaddr *) &local_sa);
+
+  remote_addr = pr_netaddr_alloc(tmp_pool);
+  pr_netaddr_set_family(remote_addr, remote_sa.ss_family);
+  pr_netaddr_set_sockaddr(remote_addr, (struct sockaddr *) &remote_sa);
+
+  /* Handle IPv4-mapped IPv6 peers as IPv4 peers, as pr_inet_openrw() does. */
+  if (pr_netaddr_is_v4mappedv6(remote_addr) == TRUE) {
+    remote_addr = pr_netaddr_v6tov4(tmp_pool, remote_addr);
+  }
+
+  /* If no server handles this address, the session process will deal with
+   * it; there is nothing to check against here.
+   */
+  s = pr_ipbind_get_server(local_addr, ntohs(pr_netaddr_get_port(local_addr)));
+  if (s == NULL) {
+    destroy_pool(tmp_pool);
+    return 0;
+  }
+
+  for (pc = prechecks; pc; pc = pc->next) {
+    pr_signals_handle();
+
+    if (pc->cb(tmp_pool, s, remote_addr) < 0) {
+      const char *mesg = R_421 " Service not available, closing control "
+        "connection.\r\n";
+      int flags = 0;
+
+      pr_log_pri(PR_LOG_NOTICE, "Connection from %s denied by %s%s%s "
+        "precheck", pr_netaddr_get_ipstr(remote_addr),
+        pc->m != NULL ? "mod_" : "", pc->m != NULL ? pc->m->name : "",
+        pc->m != NULL ? "" : pc->name);
+
+#if defined(MSG_DONTWAIT)
+      flags |= MSG_DONTWAIT;
+#endif /* MSG_DONTWAIT */
+      if (send(fd, mesg, strlen(mesg), flags) < 0) {
+        pr_trace_msg(trace_channel, 9, "error sending %s response to %s: %s",
+          R_421, pr_netaddr_get_ipstr(remote_addr), strerror(errno));
+      }
+
+      res = -1;
+      break;
+    }
+  }
+
+  destroy_pool(tmp_pool);
+
+  if (res < 0) {
+    errno = EACCES;
+  }
+
+  return res;
+}
@@ -51,6 +51,7 @@ xaset_t *xaset_create(pool *p, XASET_COMPARE cmpfunc) {
   new_set->xas_list = NULL;
   new_set->pool = p;
   new_set->xas_compare = cmpfunc;
+  new_set->xas_index = NULL;
 
   return new_set;
 }
@@ -67,6 +68,7 @@ int xaset_insert(xaset_t *set, xasetmember_t *member) {
     return -1;
   }
 
+  set->xas_index = NULL;
   member->next = set->xas_list;
 
   if (set->xas_list)
@@ -87,6 +89,8 @@ int xaset_insert_end(xaset_t *set, xasetmember_t *member) {
     return -1;
   }
 
+  set->xas_index = NULL;
+
   for (tmp = &set->xas_list; *tmp; prev = *tmp, tmp = &(*tmp)->next)
     ;
 
@@ -128,6 +132,8 @@ int xaset_insert_sort(xaset_t *set, xasetmember_t *member, int dups_allowed) {
     mprev = *setp;
   }
 
+  set->xas_index = NULL;
+
   if (*setp)
     (*setp)->prev = member;
 
@@ -162,6 +168,8 @@ int xaset_remove(xaset_t *set, xasetmember_t *member) {
     return -1;  
   }
 
+  set->xas_index = NULL;
+
   if (member->prev)
     member->prev->next = member->next;
 
@@ -332,6 +332,153 @@ START_TEST (ascii_ftp_to_crlf_test) {
 }
 END_TEST
 
+/* Fills the buffer with text lines, mixing LF and CRLF line endings, and
+ * the odd lone CR.
+ */
+static void fill_text(char *buf, size_t buflen) {
+  register size_t i;
+  unsigned long r = 1;
+
+  for (i = 0; i < buflen; i++) {
+    r = (r * 1103515245UL) + 12345UL;
+
+    switch ((r >> 16) % 64) {
+      case 0:
+        buf[i] = '\n';
+        break;
+
+      case 1:
+        buf[i] = '\r';
+        if (i + 1 < buflen) {
+          buf[++i] = '\n';
+        }
+        break;
+
+      case 2:
+        buf[i] = ((r >> 24) % 8) == 0 ? '\r' : ' ';
+        break;
+
+      default:
+        buf[i] = 'a' + ((r >> 8) % 26);
+        break;
+    }
+  }
+}
+
+static const char *ascii_impl_names[] = { "auto", "scalar", "SSE2", "AVX2" };
+
+/* Converts the buffer in chunks, as the Data API does, using the given
+ * implementation.
+ */
+static char *convert_text(int impl, int to_crlf, char *text, size_t textlen,
+    size_t *outlen, uint64_t *elapsed_ms) {
+  char *out;
+  size_t chunksz = 8192, i, total = 0;
+  uint64_t start_ms = 0, end_ms = 0;
+
+  out = palloc(p, textlen * 2);
+  pr_ascii_ftp_set_impl(impl);
+  pr_ascii_ftp_reset();
+
+  pr_gettimeofday_millis(&start_ms);
+  for (i = 0; i < textlen; i += chunksz) {
+    size_t len, dst_len = 0;
+    char *dst;
+    int res;
+
+    len = (textlen - i) < chunksz ? (textlen - i) : chunksz;
+
+    if (to_crlf) {
+      dst = NULL;
+      res = pr_ascii_ftp_to_crlf(p, text + i, len, &dst, &dst_len);
+      fail_unless(res >= 0, "Failed to convert text: %s", strerror(errno));
+
+    } else {
+      /* Converted in place, as the Data API does. */
+      dst = text + i;
+      res = pr_ascii_ftp_from_crlf(p, text + i, len, &dst, &dst_len);
+      fail_unless(res >= 0, "Failed to convert text: %s", strerror(errno));
+    }
+
+    memcpy(out + total, dst, dst_len);
+    total += dst_len;
+  }
+  pr_gettimeofday_millis(&end_ms);
+
+  *outlen = total;
+  *elapsed_ms = end_ms - start_ms;
+  return out;
+}
+
+START_TEST (ascii_ftp_set_impl_test) {
+  int res;
+
+  res = pr_ascii_ftp_set_impl(-1);
+  fail_unless(res < 0, "Failed to handle invalid implementation");
+  fail_unless(errno == ENOSYS, "Expected ENOSYS (%d), got %s (%d)", ENOSYS,
+    strerror(errno), errno);
+
+  res = pr_ascii_ftp_set_impl(PR_ASCII_IMPL_SCALAR);
+  fail_unless(res == 0, "Failed to select scalar implementation: %s",
+    strerror(errno));
+
+  res = pr_ascii_ftp_set_impl(PR_ASCII_IMPL_AUTO);
+  fail_unless(res == 0, "Failed to select default implementation: %s",
+    strerror(errno));
+}
+END_TEST
+
+START_TEST (ascii_ftp_large_buffer_test) {
+  size_t textlen = 8 * 1024 * 1024;
+  int impl, to_crlf;
+
+  /* Every supported implementation must produce the same output as the
+   * scalar one; the throughput of each is reported in verbose mode.
+   */
+  for (to_crlf = 0; to_crlf <= 1; to_crlf++) {
+    char *text, *expected = NULL;
+    size_t expected_len = 0;
+
+    text = palloc(p, textlen);
+
+    for (impl = PR_ASCII_IMPL_SCALAR; impl <= PR_ASCII_IMPL_AVX2; impl++) {
+      char *out;
+      size_t outlen = 0;
+      uint64_t elapsed_ms = 0;
+
+      if (pr_ascii_ftp_set_impl(impl) < 0) {
+        continue;
+      }
+
+      fill_text(text, textlen);
+      out = convert_text(impl, to_crlf, text, textlen, &outlen, &elapsed_ms);
+
+      if (getenv("TEST_VERBOSE") != NULL) {
+        fprintf(stderr, "%s (%s): %lu bytes in %lu ms\n",
+          to_crlf ? "pr_ascii_ftp_to_crlf" : "pr_ascii_ftp_from_crlf",
+          ascii_impl_names[impl], (unsigned long) textlen,
+          (unsigned long) elapsed_ms);
+      }
+
+      if (expected == NULL) {
+        expected = out;
+        expected_len = outlen;
+        continue;
+      }
+
+      fail_unless(outlen == expected_len,
+        "Expected %s output length %lu, got %lu", ascii_impl_names[impl],
+        (unsigned long) expected_len, (unsigned long) outlen);
+      fail_unless(memcmp(out, expected, outlen) == 0,
+        "%s output differs from scalar output", ascii_impl_names[impl]);
+    }
+  }
+
+  pr_ascii_ftp_set_impl(PR_ASCII_IMPL_AUTO);
+  pr_ascii_ftp_reset();
+}
+END_TEST
+
 Suite *tests_get_ascii_suite(void) {
   Suite *suite;
   TCase *testcase;
@@ -344,6 +491,8 @@ Suite *tests_get_ascii_suite(void) {
 
   tcase_add_test(testcase, ascii_ftp_from_crlf_test);
   tcase_add_test(testcase, ascii_ftp_to_crlf_test);
+  tcase_add_test(testcase, ascii_ftp_set_impl_test);
+  tcase_add_test(testcase, ascii_ftp_large_buffer_test);
 
   suite_add_tcase(suite, testcase);
 
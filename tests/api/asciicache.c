@@ -0,0 +1,270 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* ASCII cache API tests */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+static const char *cache_dir = "/tmp/prt-asciicache.d";
+static const char *text_file = "/tmp/prt-asciicache-text.txt";
+static const char *translated_text = "foo\r\nbar\r\n";
+
+static void set_up(void) {
+  (void) unlink(text_file);
+
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  init_fs();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("asciicache", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) pr_asciicache_close();
+
+  if (pr_asciicache_clear(cache_dir) == 0) {
+    (void) rmdir(cache_dir);
+  }
+
+  (void) unlink(text_file);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("asciicache", 0, 0);
+  }
+
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+/* Creates a file to be downloaded, old enough for its translation to be
+ * cached, and opens the cache.
+ */
+static void make_text_file(struct stat *st) {
+  int fd, res;
+  struct timeval tvs[2];
+  const char *text = "foo\nbar\n";
+
+  fd = open(text_file, O_WRONLY|O_CREAT, 0644);
+  fail_unless(fd >= 0, "Failed to create '%s': %s", text_file,
+    strerror(errno));
+  res = write(fd, text, strlen(text));
+  fail_unless(res == (int) strlen(text), "Failed to write '%s': %s",
+    text_file, strerror(errno));
+  (void) close(fd);
+
+  tvs[0].tv_sec = tvs[1].tv_sec = time(NULL) - 60;
+  tvs[0].tv_usec = tvs[1].tv_usec = 0;
+  res = utimes(text_file, tvs);
+  fail_unless(res == 0, "Failed to set times on '%s': %s", text_file,
+    strerror(errno));
+
+  /* Setting the times changes the ctime, which cannot be backdated; wait
+   * for it to be in the past.
+   */
+  sleep(1);
+
+  res = stat(text_file, st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", text_file,
+    strerror(errno));
+
+  res = pr_asciicache_clear(cache_dir);
+  fail_unless(res == 0, "Failed to clear '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_asciicache_open(cache_dir);
+  fail_unless(res == 0, "Failed to open '%s': %s", cache_dir,
+    strerror(errno));
+}
+
+/* Caches the translated copy of the text file. */
+static void cache_text_file(struct stat *st) {
+  int res;
+
+  res = pr_asciicache_capture(text_file, st);
+  fail_unless(res == 0, "Failed to capture '%s': %s", text_file,
+    strerror(errno));
+
+  res = pr_asciicache_write(translated_text, strlen(translated_text));
+  fail_unless(res == 0, "Failed to write copy: %s", strerror(errno));
+
+  res = pr_asciicache_commit(st);
+  fail_unless(res == 0, "Failed to commit copy: %s", strerror(errno));
+}
+
+START_TEST (asciicache_get_test) {
+  int fd, res;
+  off_t offset = 0, len = 0;
+  char buf[32];
+  struct stat st;
+
+  fd = pr_asciicache_get(NULL, NULL, NULL);
+  fail_unless(fd < 0, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  make_text_file(&st);
+
+  fd = pr_asciicache_get(&st, &offset, &len);
+  fail_unless(fd < 0, "Got uncached copy unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  cache_text_file(&st);
+
+  /* The translated bytes follow the header, and are of the translated
+   * length, not the file's.
+   */
+  fd = pr_asciicache_get(&st, &offset, &len);
+  fail_unless(fd >= 0, "Failed to get copy of '%s': %s", text_file,
+    strerror(errno));
+  fail_unless(offset > 0, "Expected offset past the header, got %lu",
+    (unsigned long) offset);
+  fail_unless(len == (off_t) strlen(translated_text),
+    "Expected length %lu, got %lu", (unsigned long) strlen(translated_text),
+    (unsigned long) len);
+  fail_unless(len != st.st_size, "Expected translated length");
+
+  memset(buf, '\0', sizeof(buf));
+  res = pread(fd, buf, sizeof(buf)-1, offset);
+  (void) close(fd);
+  fail_unless(res == (int) len, "Expected to read %lu bytes, got %d",
+    (unsigned long) len, res);
+  fail_unless(strcmp(buf, translated_text) == 0, "Expected '%s', got '%s'",
+    translated_text, buf);
+}
+END_TEST
+
+START_TEST (asciicache_get_stale_test) {
+  int fd, res;
+  off_t offset = 0, len = 0;
+  struct stat st, changed;
+
+  make_text_file(&st);
+  cache_text_file(&st);
+
+  /* A copy is not used once its file's device, inode or mtime changes. */
+  memcpy(&changed, &st, sizeof(changed));
+  changed.st_dev++;
+  fd = pr_asciicache_get(&changed, &offset, &len);
+  fail_unless(fd < 0, "Got copy for other device unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  memcpy(&changed, &st, sizeof(changed));
+  changed.st_ino++;
+  fd = pr_asciicache_get(&changed, &offset, &len);
+  fail_unless(fd < 0, "Got copy for other inode unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  memcpy(&changed, &st, sizeof(changed));
+  changed.st_mtime++;
+  fd = pr_asciicache_get(&changed, &offset, &len);
+  fail_unless(fd < 0, "Got copy for changed mtime unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  fd = pr_asciicache_get(&st, &offset, &len);
+  fail_unless(fd >= 0, "Failed to get copy of '%s': %s", text_file,
+    strerror(errno));
+  (void) close(fd);
+
+  /* Nor is a copy of a file which changed while being captured kept. */
+  (void) pr_fsio_unlink(text_file);
+  make_text_file(&st);
+
+  res = pr_asciicache_capture(text_file, &st);
+  fail_unless(res == 0, "Failed to capture '%s': %s", text_file,
+    strerror(errno));
+
+  memcpy(&changed, &st, sizeof(changed));
+  changed.st_mtime++;
+  res = pr_asciicache_commit(&changed);
+  fail_unless(res < 0, "Committed changed file unexpectedly");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  fd = pr_asciicache_get(&st, &offset, &len);
+  fail_unless(fd < 0, "Got copy of changed file unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (asciicache_rest_test) {
+  int fd, res;
+  off_t offset = 0, len = 0, rest;
+  char buf[32];
+  struct stat st;
+
+  make_text_file(&st);
+  cache_text_file(&st);
+
+  fd = pr_asciicache_get(&st, &offset, &len);
+  fail_unless(fd >= 0, "Failed to get copy of '%s': %s", text_file,
+    strerror(errno));
+
+  /* A REST offset counts translated bytes: resuming after "foo\r\n" sends
+   * the rest of the translated copy, from that offset past the header.
+   */
+  rest = 5;
+  memset(buf, '\0', sizeof(buf));
+  res = pread(fd, buf, sizeof(buf)-1, offset + rest);
+  fail_unless(res == (int) (len - rest), "Expected to read %lu bytes, got %d",
+    (unsigned long) (len - rest), res);
+  fail_unless(strcmp(buf, translated_text + rest) == 0,
+    "Expected '%s', got '%s'", translated_text + rest, buf);
+
+  /* Resuming at the end of the translated length sends nothing. */
+  res = pread(fd, buf, sizeof(buf)-1, offset + len);
+  fail_unless(res == 0, "Expected to read 0 bytes, got %d", res);
+
+  (void) close(fd);
+}
+END_TEST
+
+Suite *tests_get_asciicache_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("asciicache");
+
+  testcase = tcase_create("base");
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, asciicache_get_test);
+  tcase_add_test(testcase, asciicache_get_stale_test);
+  tcase_add_test(testcase, asciicache_rest_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -0,0 +1,268 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Cache directory API tests */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+static const char *cache_dir = "/tmp/prt-cachedir.d";
+static const char *other_file = "/tmp/prt-cachedir.d/other.txt";
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("cachedir", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) unlink(other_file);
+
+  if (pr_cachedir_clear(cache_dir) == 0) {
+    (void) rmdir(cache_dir);
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("cachedir", 0, 0);
+  }
+
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+static void make_file(const char *path) {
+  int fd;
+
+  fd = open(path, O_WRONLY|O_CREAT, 0600);
+  fail_unless(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  (void) close(fd);
+}
+
+START_TEST (cachedir_is_cache_name_test) {
+  int res;
+
+  res = pr_cachedir_is_cache_name(NULL);
+  fail_unless(res == FALSE, "Expected FALSE for null name");
+
+  res = pr_cachedir_is_cache_name("");
+  fail_unless(res == FALSE, "Expected FALSE for empty name");
+
+  res = pr_cachedir_is_cache_name("803-1a2b-00ff00ff00ff00ff");
+  fail_unless(res == TRUE, "Expected TRUE for cached file name");
+
+  res = pr_cachedir_is_cache_name(PR_CACHEDIR_TMP_PREFIX "1234");
+  fail_unless(res == TRUE, "Expected TRUE for temporary file name");
+
+  res = pr_cachedir_is_cache_name("other.txt");
+  fail_unless(res == FALSE, "Expected FALSE for other file name");
+}
+END_TEST
+
+START_TEST (cachedir_clear_test) {
+  int res;
+  struct stat st;
+  char *path;
+
+  res = pr_cachedir_clear(NULL);
+  fail_unless(res < 0, "Failed to handle null path");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_cachedir_clear("foo");
+  fail_unless(res < 0, "Failed to handle relative path");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_cachedir_clear(cache_dir);
+  fail_unless(res == 0, "Failed to clear '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = stat(cache_dir, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", cache_dir,
+    strerror(errno));
+  fail_unless((st.st_mode & 07777) == 01733,
+    "Expected mode 01733, got %04o", (unsigned int) (st.st_mode & 07777));
+
+  /* Cached files, and the per-UID subdirectories, are removed; nothing
+   * else is.
+   */
+  make_file(other_file);
+  make_file(pdircat(p, cache_dir, "803-1a2b", NULL));
+
+  path = pdircat(p, cache_dir, "u1234", NULL);
+  res = mkdir(path, 0700);
+  fail_unless(res == 0, "Failed to create '%s': %s", path, strerror(errno));
+  make_file(pdircat(p, path, "803-1a2b-00ff", NULL));
+  make_file(pdircat(p, path, PR_CACHEDIR_TMP_PREFIX "1234", NULL));
+
+  res = pr_cachedir_clear(cache_dir);
+  fail_unless(res == 0, "Failed to clear '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = stat(pdircat(p, cache_dir, "803-1a2b", NULL), &st);
+  fail_unless(res < 0, "Cached file not removed");
+
+  res = stat(path, &st);
+  fail_unless(res < 0, "Subdirectory '%s' not removed", path);
+
+  res = stat(other_file, &st);
+  fail_unless(res == 0, "Other file '%s' removed unexpectedly", other_file);
+}
+END_TEST
+
+START_TEST (cachedir_open_test) {
+  int res;
+  pr_cachedir_t cd;
+
+  res = pr_cachedir_open(NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_cachedir_close(NULL);
+  fail_unless(res < 0, "Failed to handle null cache directory");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_cachedir_open(&cd, cache_dir);
+  fail_unless(res < 0, "Opened nonexistent '%s' unexpectedly", cache_dir);
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = pr_cachedir_clear(cache_dir);
+  fail_unless(res == 0, "Failed to clear '%s': %s", cache_dir,
+    strerror(errno));
+
+  /* A world-writable cache directory must be sticky. */
+  res = chmod(cache_dir, 0777);
+  fail_unless(res == 0, "Failed to chmod '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_cachedir_open(&cd, cache_dir);
+  fail_unless(res < 0, "Opened non-sticky '%s' unexpectedly", cache_dir);
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = chmod(cache_dir, 01733);
+  fail_unless(res == 0, "Failed to chmod '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_cachedir_open(&cd, cache_dir);
+  fail_unless(res == 0, "Failed to open '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_cachedir_close(&cd);
+  fail_unless(res == 0, "Failed to close '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_cachedir_close(&cd);
+  fail_unless(res < 0, "Closed cache directory twice unexpectedly");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (cachedir_get_userfd_test) {
+  int fd, res;
+  pr_cachedir_t cd;
+  struct stat st;
+  char *path;
+
+  fd = pr_cachedir_get_userfd(NULL, FALSE);
+  fail_unless(fd < 0, "Failed to handle null cache directory");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_cachedir_clear(cache_dir);
+  fail_unless(res == 0, "Failed to clear '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_cachedir_open(&cd, cache_dir);
+  fail_unless(res == 0, "Failed to open '%s': %s", cache_dir,
+    strerror(errno));
+
+  fd = pr_cachedir_get_userfd(&cd, FALSE);
+  fail_unless(fd < 0, "Got nonexistent subdirectory unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  fd = pr_cachedir_get_userfd(&cd, TRUE);
+  fail_unless(fd >= 0, "Failed to create subdirectory: %s", strerror(errno));
+
+  path = pdircat(p, cache_dir, pstrcat(p, "u",
+    pr_uid2str(p, geteuid()), NULL), NULL);
+  res = stat(path, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", path, strerror(errno));
+  fail_unless(st.st_uid == geteuid(), "Expected UID %lu, got %lu",
+    (unsigned long) geteuid(), (unsigned long) st.st_uid);
+  fail_unless((st.st_mode & 0777) == 0700, "Expected mode 0700, got %04o",
+    (unsigned int) (st.st_mode & 0777));
+
+  /* The subdirectory stays open for the same UID. */
+  res = pr_cachedir_get_userfd(&cd, FALSE);
+  fail_unless(res == fd, "Expected fd %d, got %d", fd, res);
+
+  (void) pr_cachedir_close(&cd);
+
+  /* A subdirectory accessible by others is not used. */
+  res = chmod(path, 0755);
+  fail_unless(res == 0, "Failed to chmod '%s': %s", path, strerror(errno));
+
+  res = pr_cachedir_open(&cd, cache_dir);
+  fail_unless(res == 0, "Failed to open '%s': %s", cache_dir,
+    strerror(errno));
+
+  fd = pr_cachedir_get_userfd(&cd, TRUE);
+  fail_unless(fd < 0, "Used accessible subdirectory unexpectedly");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  (void) pr_cachedir_close(&cd);
+}
+END_TEST
+
+Suite *tests_get_cachedir_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("cachedir");
+
+  testcase = tcase_create("base");
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, cachedir_is_cache_name_test);
+  tcase_add_test(testcase, cachedir_clear_test);
+  tcase_add_test(testcase, cachedir_open_test);
+  tcase_add_test(testcase, cachedir_get_userfd_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
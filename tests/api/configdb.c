@@ -689,6 +689,168 @@ START_TEST (config_merge_down_test) {
 }
 END_TEST
 
+START_TEST (config_find_config_index_test) {
+  xaset_t *set = NULL;
+  config_rec *c, *foo, *foo2, *bar;
+  const char *name;
+
+  name = "foo";
+  foo = add_config_param_set(&set, name, 1, "alef");
+  fail_unless(foo != NULL, "Failed to add config '%s': %s", name,
+    strerror(errno));
+
+  name = "bar";
+  bar = add_config_param_set(&set, name, 1, "bet");
+  fail_unless(bar != NULL, "Failed to add config '%s': %s", name,
+    strerror(errno));
+
+  name = "foo";
+  foo2 = add_config_param_set(&set, name, 1, "vet");
+  fail_unless(foo2 != NULL, "Failed to add config '%s': %s", name,
+    strerror(errno));
+
+  name = "<Directory>";
+  c = add_config_param_set(&set, name, 1, "/baz");
+  c->config_type = CONF_DIR;
+
+  fail_unless(set->xas_index == NULL, "Set indexed unexpectedly");
+
+  mark_point();
+  pr_config_merge_down(set, FALSE);
+  fail_unless(set->xas_index != NULL, "Set not indexed after merge down");
+
+  /* A hit in the index returns the first config with that name. */
+  name = "foo";
+  c = find_config(set, CONF_PARAM, name, FALSE);
+  fail_unless(c == foo, "Expected config %p for '%s', got %p", foo, name, c);
+
+  name = "bar";
+  c = find_config(set, CONF_PARAM, name, FALSE);
+  fail_unless(c == bar, "Expected config %p for '%s', got %p", bar, name, c);
+
+  /* Later configs of the same name are found by continuing the search. */
+  name = "foo";
+  c = find_config_next(foo, foo->next, CONF_PARAM, name, FALSE);
+  fail_unless(c == foo2, "Expected config %p for '%s', got %p", foo2, name,
+    c);
+
+  /* A miss in the index, for a name which does have an ID. */
+  name = "baz";
+  fail_unless(pr_config_set_id(name) > 0, "Failed to set ID for '%s': %s",
+    name, strerror(errno));
+
+  c = find_config(set, CONF_PARAM, name, FALSE);
+  fail_unless(c == NULL, "Found config '%s' unexpectedly", name);
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* Only CONF_PARAMs are indexed. */
+  name = "<Directory>";
+  c = find_config(set, CONF_DIR, name, FALSE);
+  fail_unless(c != NULL, "Failed to find config '%s': %s", name,
+    strerror(errno));
+  fail_unless(c->config_type == CONF_DIR, "Expected CONF_DIR, got %d",
+    c->config_type);
+}
+END_TEST
+
+START_TEST (config_find_config_index_invalidate_test) {
+  xaset_t *set = NULL;
+  config_rec *c, *foo;
+  const char *name;
+  int res;
+
+  name = "foo";
+  c = add_config_param_set(&set, name, 1, "alef");
+  fail_unless(c != NULL, "Failed to add config '%s': %s", name,
+    strerror(errno));
+
+  name = "bar";
+  c = add_config_param_set(&set, name, 1, "bet");
+  fail_unless(c != NULL, "Failed to add config '%s': %s", name,
+    strerror(errno));
+
+  pr_config_merge_down(set, FALSE);
+  fail_unless(set->xas_index != NULL, "Set not indexed after merge down");
+
+  /* Inserting a config drops the index, so that the new config is found. */
+  name = "foo";
+  foo = pr_config_add_set(&set, name, PR_CONFIG_FL_INSERT_HEAD);
+  fail_unless(foo != NULL, "Failed to add config '%s': %s", name,
+    strerror(errno));
+  foo->config_type = CONF_PARAM;
+  fail_unless(set->xas_index == NULL, "Index not dropped after insert");
+
+  c = find_config(set, CONF_PARAM, name, FALSE);
+  fail_unless(c == foo, "Expected config %p for '%s', got %p", foo, name, c);
+
+  name = "baz";
+  c = add_config_param_set(&set, name, 1, "gimel");
+  fail_unless(c != NULL, "Failed to add config '%s': %s", name,
+    strerror(errno));
+
+  c = find_config(set, CONF_PARAM, name, FALSE);
+  fail_unless(c != NULL, "Failed to find config '%s': %s", name,
+    strerror(errno));
+
+  /* Removing a config drops the index, too. */
+  pr_config_merge_down(set, FALSE);
+  fail_unless(set->xas_index != NULL, "Set not indexed after merge down");
+
+  name = "foo";
+  c = find_config(set, CONF_PARAM, name, FALSE);
+  fail_unless(c == foo, "Expected config %p for '%s', got %p", foo, name, c);
+
+  name = "bar";
+  res = remove_config(set, name, FALSE);
+  fail_unless(res > 0, "Failed to remove config '%s': %s", name,
+    strerror(errno));
+  fail_unless(set->xas_index == NULL, "Index not dropped after remove");
+
+  c = find_config(set, CONF_PARAM, name, FALSE);
+  fail_unless(c == NULL, "Found removed config '%s' unexpectedly", name);
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  name = "baz";
+  c = find_config(set, CONF_PARAM, name, FALSE);
+  fail_unless(c != NULL, "Failed to find config '%s': %s", name,
+    strerror(errno));
+}
+END_TEST
+
+START_TEST (config_find_config_index_no_id_test) {
+  xaset_t *set = NULL;
+  config_rec *c, *bar;
+  const char *name;
+
+  name = "foo";
+  c = add_config_param_set(&set, name, 1, "alef");
+  fail_unless(c != NULL, "Failed to add config '%s': %s", name,
+    strerror(errno));
+
+  /* A CONF_PARAM without an ID can only be found by name; such a set is
+   * not indexed.
+   */
+  name = "bar";
+  bar = add_config_param_set(&set, name, 1, "bet");
+  fail_unless(bar != NULL, "Failed to add config '%s': %s", name,
+    strerror(errno));
+  bar->config_id = 0;
+
+  pr_config_merge_down(set, FALSE);
+  fail_unless(set->xas_index == NULL, "Set indexed unexpectedly");
+
+  c = find_config(set, CONF_PARAM, name, FALSE);
+  fail_unless(c == bar, "Expected config %p for '%s', got %p", bar, name, c);
+
+  name = "foo";
+  c = find_config(set, CONF_PARAM, name, FALSE);
+  fail_unless(c != NULL, "Failed to find config '%s': %s", name,
+    strerror(errno));
+}
+END_TEST
+
 Suite *tests_get_config_suite(void) {
   Suite *suite;
   TCase *testcase;
@@ -711,6 +873,9 @@ Suite *tests_get_config_suite(void) {
   tcase_add_test(testcase, config_get_param_ptr_test);
   tcase_add_test(testcase, config_set_get_id_test);
   tcase_add_test(testcase, config_merge_down_test);
+  tcase_add_test(testcase, config_find_config_index_test);
+  tcase_add_test(testcase, config_find_config_index_invalidate_test);
+  tcase_add_test(testcase, config_find_config_index_no_id_test);
 
   suite_add_tcase(suite, testcase);
   return suite;
@@ -0,0 +1,265 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Dirtree API tests */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+static const char *dir_path = "/tmp/prt-dirtree.d";
+static const char *ftpaccess_path = "/tmp/prt-dirtree.d/.ftpaccess";
+
+static void test_cleanup(void) {
+  (void) unlink(ftpaccess_path);
+  (void) rmdir(dir_path);
+}
+
+static void set_up(void) {
+  test_cleanup();
+
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  init_fs();
+  init_config();
+  init_dirtree();
+
+  session.anon_config = NULL;
+  session.chroot_path = NULL;
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("directory", 1, 20);
+    pr_trace_set_levels("ftpaccess", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("directory", 0, 0);
+    pr_trace_set_levels("ftpaccess", 0, 0);
+  }
+
+  test_cleanup();
+
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+/* Adds a <Directory> section, as build_dyn_config() does, without going
+ * through any of the dirtree functions which flush the match cache.
+ */
+static config_rec *add_dir(xaset_t **set, const char *path) {
+  config_rec *c;
+
+  c = pr_config_add_set(set, path, 0);
+  c->config_type = CONF_DIR;
+  c->argc = 1;
+  c->argv = pcalloc(c->pool, 2 * sizeof(void *));
+
+  return c;
+}
+
+static void write_ftpaccess(time_t mtime) {
+  int fd, res;
+  struct timeval tvs[2];
+  const char *text = "# .ftpaccess\n";
+
+  fd = open(ftpaccess_path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  fail_unless(fd >= 0, "Failed to open '%s': %s", ftpaccess_path,
+    strerror(errno));
+  res = write(fd, text, strlen(text));
+  fail_unless(res == (int) strlen(text), "Failed to write '%s': %s",
+    ftpaccess_path, strerror(errno));
+  (void) close(fd);
+
+  tvs[0].tv_sec = tvs[1].tv_sec = mtime;
+  tvs[0].tv_usec = tvs[1].tv_usec = 0;
+  res = utimes(ftpaccess_path, tvs);
+  fail_unless(res == 0, "Failed to set times on '%s': %s", ftpaccess_path,
+    strerror(errno));
+}
+
+START_TEST (dir_match_path_test) {
+  config_rec *c, *res;
+  char *path;
+
+  res = dir_match_path(NULL, NULL);
+  fail_unless(res == NULL, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = dir_match_path(p, "");
+  fail_unless(res == NULL, "Failed to handle empty path");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  c = add_dir(&main_server->conf, "/tmp");
+
+  /* The same section is returned for repeated lookups of a path. */
+  path = pstrdup(p, "/tmp/prt-dirtree.d/foo");
+  res = dir_match_path(p, path);
+  fail_unless(res == c, "Expected <Directory /tmp> for '%s', got %p", path,
+    res);
+
+  res = dir_match_path(p, path);
+  fail_unless(res == c, "Expected <Directory /tmp> for '%s', got %p", path,
+    res);
+
+  /* A trailing slash or '*' does not make for a different path. */
+  res = dir_match_path(p, "/tmp/prt-dirtree.d/foo/");
+  fail_unless(res == c, "Expected <Directory /tmp> for '%s/', got %p", path,
+    res);
+
+  res = dir_match_path(p, "/tmp/prt-dirtree.d/foo*");
+  fail_unless(res == c, "Expected <Directory /tmp> for '%s*', got %p", path,
+    res);
+
+  /* Repeated lookups which match nothing fail the same way. */
+  res = dir_match_path(p, "/usr");
+  fail_unless(res == NULL, "Expected no section for '/usr', got %p", res);
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = dir_match_path(p, "/usr");
+  fail_unless(res == NULL, "Expected no section for '/usr', got %p", res);
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (dir_match_path_cache_test) {
+  config_rec *c, *d, *res;
+
+  c = add_dir(&main_server->conf, "/tmp");
+
+  res = dir_match_path(p, "/tmp/prt-dirtree.d");
+  fail_unless(res == c, "Expected <Directory /tmp>, got %p", res);
+
+  /* Add a closer section behind dirtree's back.  A cached match still
+   * returns the previous section; without the cache, the tree is walked
+   * for every lookup.
+   */
+  d = add_dir(&c->subset, dir_path);
+  d->parent = c;
+
+  res = dir_match_path(p, "/tmp/prt-dirtree.d");
+#if PR_TUNABLE_DIR_MATCH_CACHE_SIZE > 0
+  fail_unless(res == c, "Expected cached <Directory /tmp>, got %p", res);
+#else
+  fail_unless(res == d, "Expected <Directory %s>, got %p", dir_path, res);
+#endif /* PR_TUNABLE_DIR_MATCH_CACHE_SIZE */
+
+  /* Changing the session's chroot flushes the cache. */
+  session.chroot_path = "/";
+
+  res = dir_match_path(p, "/tmp/prt-dirtree.d");
+  fail_unless(res == d, "Expected <Directory %s>, got %p", dir_path, res);
+}
+END_TEST
+
+START_TEST (build_dyn_config_test) {
+  int res;
+  config_rec *c, *d, *sub, *match;
+  struct stat st;
+  time_t now;
+
+  c = add_dir(&main_server->conf, "/tmp");
+
+  res = mkdir(dir_path, 0755);
+  fail_unless(res == 0, "Failed to create '%s': %s", dir_path,
+    strerror(errno));
+
+  match = dir_match_path(p, "/tmp/prt-dirtree.d");
+  fail_unless(match == c, "Expected <Directory /tmp>, got %p", match);
+
+  /* Reading a new .ftpaccess file adds a section, which must be matched
+   * in place of the cached one.
+   */
+  now = time(NULL);
+  write_ftpaccess(now - 60);
+
+  res = stat(dir_path, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", dir_path, strerror(errno));
+
+  build_dyn_config(p, dir_path, &st, FALSE);
+
+  d = dir_match_path(p, "/tmp/prt-dirtree.d");
+  fail_unless(d != NULL, "Failed to match '%s': %s", dir_path,
+    strerror(errno));
+  fail_unless(d != c, "Expected .ftpaccess section, got <Directory /tmp>");
+  fail_unless(strcmp(d->name, dir_path) == 0, "Expected '%s', got '%s'",
+    dir_path, d->name);
+
+  match = dir_match_path(p, "/tmp/prt-dirtree.d/sub");
+  fail_unless(match == d, "Expected .ftpaccess section, got %p", match);
+
+  /* Re-reading a changed .ftpaccess file flushes the cache, too. */
+  sub = add_dir(&d->subset, "/tmp/prt-dirtree.d/sub");
+  sub->parent = d;
+
+  write_ftpaccess(now - 30);
+  build_dyn_config(p, dir_path, &st, FALSE);
+
+  match = dir_match_path(p, "/tmp/prt-dirtree.d/sub");
+  fail_unless(match == sub, "Expected <Directory %s/sub>, got %p", dir_path,
+    match);
+
+  /* And so does removing the .ftpaccess file, along with its section. */
+  (void) xaset_remove(d->subset, (xasetmember_t *) sub);
+  c = add_config_param_set(&d->subset, "DynamicParam", 0);
+  c->flags |= CF_DYNAMIC;
+
+  match = dir_match_path(p, "/tmp/prt-dirtree.d");
+  fail_unless(match == d, "Expected .ftpaccess section, got %p", match);
+
+  (void) unlink(ftpaccess_path);
+  build_dyn_config(p, dir_path, &st, FALSE);
+
+  match = dir_match_path(p, "/tmp/prt-dirtree.d");
+  fail_unless(match != d, "Expected removed .ftpaccess section to not match");
+  fail_unless(match != NULL && strcmp(match->name, "/tmp") == 0,
+    "Expected <Directory /tmp>, got %p", match);
+}
+END_TEST
+
+Suite *tests_get_dirtree_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("dirtree");
+
+  testcase = tcase_create("base");
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, dir_match_path_test);
+  tcase_add_test(testcase, dir_match_path_cache_test);
+  tcase_add_test(testcase, build_dyn_config_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -2337,6 +2337,94 @@ START_TEST (fsio_statcache_dump_test) {
 }
 END_TEST
 
+START_TEST (fsio_statcache_lru_test) {
+  int res;
+  struct stat st;
+  pr_fs_statcache_stats_t before, after;
+
+  res = pr_fs_statcache_get_stats(NULL);
+  fail_unless(res < 0, "Failed to handle null stats");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  pr_fs_statcache_set_policy(2, 30, 0);
+  pr_fs_clear_cache();
+
+  res = pr_fs_statcache_get_stats(&before);
+  fail_unless(res == 0, "Failed to get statcache stats: %s", strerror(errno));
+
+  /* Two misses, then a hit, which makes '/' the most recently used entry. */
+  (void) pr_fsio_stat("/", &st);
+  (void) pr_fsio_stat("/tmp", &st);
+  (void) pr_fsio_stat("/", &st);
+
+  /* This miss evicts the least recently used entry, '/tmp'. */
+  (void) pr_fsio_stat("/foo.bar.baz.d", &st);
+
+  res = pr_fs_clear_cache2("/tmp");
+  fail_unless(res == 0, "Expected 0, got %d", res);
+
+  res = pr_fs_clear_cache2("/");
+  fail_unless(res == 1, "Expected 1, got %d", res);
+
+  res = pr_fs_statcache_get_stats(&after);
+  fail_unless(res == 0, "Failed to get statcache stats: %s", strerror(errno));
+
+  fail_unless(after.hits - before.hits == 1, "Expected 1 hit, got %lu",
+    after.hits - before.hits);
+  fail_unless(after.misses - before.misses == 3, "Expected 3 misses, got %lu",
+    after.misses - before.misses);
+  fail_unless(after.evictions - before.evictions == 1,
+    "Expected 1 eviction, got %lu", after.evictions - before.evictions);
+
+  pr_fs_clear_cache();
+}
+END_TEST
+
+START_TEST (fsio_statcache_negative_max_age_test) {
+  int res;
+  struct stat st;
+  pr_fs_statcache_stats_t before, after;
+
+  pr_fs_clear_cache();
+  pr_fs_statcache_set_negative_max_age(0);
+
+  res = pr_fs_statcache_get_stats(&before);
+  fail_unless(res == 0, "Failed to get statcache stats: %s", strerror(errno));
+
+  /* With negative caching disabled, both of these are misses. */
+  res = pr_fsio_stat("/foo.bar.baz.d", &st);
+  fail_unless(res < 0, "Check of '/foo.bar.baz.d' succeeded unexpectedly");
+  res = pr_fsio_stat("/foo.bar.baz.d", &st);
+  fail_unless(res < 0, "Check of '/foo.bar.baz.d' succeeded unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = pr_fs_statcache_get_stats(&after);
+  fail_unless(res == 0, "Failed to get statcache stats: %s", strerror(errno));
+  fail_unless(after.hits == before.hits, "Expected no hits, got %lu",
+    after.hits - before.hits);
+
+  pr_fs_statcache_set_negative_max_age(30);
+
+  res = pr_fsio_stat("/foo.bar.baz.d", &st);
+  fail_unless(res < 0, "Check of '/foo.bar.baz.d' succeeded unexpectedly");
+  res = pr_fsio_stat("/foo.bar.baz.d", &st);
+  fail_unless(res < 0, "Check of '/foo.bar.baz.d' succeeded unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  before = after;
+  res = pr_fs_statcache_get_stats(&after);
+  fail_unless(res == 0, "Failed to get statcache stats: %s", strerror(errno));
+  fail_unless(after.negative_hits - before.negative_hits == 1,
+    "Expected 1 negative hit, got %lu",
+    after.negative_hits - before.negative_hits);
+
+  pr_fs_clear_cache();
+}
+END_TEST
+
 START_TEST (fs_create_fs_test) {
   pr_fs_t *fs;
 
@@ -4226,6 +4314,8 @@ Suite *tests_get_fsio_suite(void) {
   tcase_add_test(testcase, fsio_statcache_negative_cache_test);
   tcase_add_test(testcase, fsio_statcache_expired_test);
   tcase_add_test(testcase, fsio_statcache_dump_test);
+  tcase_add_test(testcase, fsio_statcache_lru_test);
+  tcase_add_test(testcase, fsio_statcache_negative_max_age_test);
 
   /* Custom FSIO management tests */
   tcase_add_test(testcase, fs_create_fs_test);
@@ -0,0 +1,295 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Listing cache API tests */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+static const char *cache_dir = "/tmp/prt-listcache.d";
+static const char *list_dir = "/tmp/prt-listcache-list.d";
+static const char *list_file = "/tmp/prt-listcache-list.d/file.txt";
+
+static void set_up(void) {
+  (void) unlink(list_file);
+  (void) rmdir(list_dir);
+
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  init_fs();
+  init_netaddr();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("listcache", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  session.c = NULL;
+  (void) pr_listcache_close();
+
+  if (pr_listcache_clear(cache_dir) == 0) {
+    (void) rmdir(cache_dir);
+  }
+
+  (void) unlink(list_file);
+  (void) rmdir(list_dir);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("listcache", 0, 0);
+  }
+
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+/* Creates a directory to be listed, old enough for its listing to be
+ * cached.
+ */
+static void make_list_dir(void) {
+  int fd, res;
+  struct timeval tvs[2];
+
+  res = mkdir(list_dir, 0755);
+  fail_unless(res == 0, "Failed to create '%s': %s", list_dir,
+    strerror(errno));
+
+  fd = open(list_file, O_WRONLY|O_CREAT, 0644);
+  fail_unless(fd >= 0, "Failed to create '%s': %s", list_file,
+    strerror(errno));
+  (void) close(fd);
+
+  tvs[0].tv_sec = tvs[1].tv_sec = time(NULL) - 60;
+  tvs[0].tv_usec = tvs[1].tv_usec = 0;
+  res = utimes(list_dir, tvs);
+  fail_unless(res == 0, "Failed to set times on '%s': %s", list_dir,
+    strerror(errno));
+
+  /* Setting the times changes the ctime, which cannot be backdated; wait
+   * for it to be in the past.
+   */
+  sleep(1);
+}
+
+START_TEST (listcache_clear_test) {
+  int res;
+  struct stat st;
+
+  res = pr_listcache_clear(NULL);
+  fail_unless(res < 0, "Failed to handle null path");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_listcache_clear(cache_dir);
+  fail_unless(res == 0, "Failed to clear '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = stat(cache_dir, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", cache_dir,
+    strerror(errno));
+}
+END_TEST
+
+START_TEST (listcache_open_test) {
+  int res;
+
+  res = pr_listcache_open(NULL);
+  fail_unless(res < 0, "Failed to handle null path");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_listcache_close();
+  fail_unless(res < 0, "Closed unopened cache unexpectedly");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_listcache_clear(cache_dir);
+  fail_unless(res == 0, "Failed to clear '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_listcache_open(cache_dir);
+  fail_unless(res == 0, "Failed to open '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_listcache_close();
+  fail_unless(res == 0, "Failed to close cache: %s", strerror(errno));
+}
+END_TEST
+
+START_TEST (listcache_send_test) {
+  int res;
+
+  res = pr_listcache_send(NULL, NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_listcache_send(p, list_dir, "LIST");
+  fail_unless(res < 0, "Sent listing from unopened cache unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  make_list_dir();
+
+  res = pr_listcache_clear(cache_dir);
+  fail_unless(res == 0, "Failed to clear '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_listcache_open(cache_dir);
+  fail_unless(res == 0, "Failed to open '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_listcache_send(p, list_dir, "LIST");
+  fail_unless(res < 0, "Sent uncached listing unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (listcache_capture_test) {
+  int res;
+  const char *text = "file.txt\r\n";
+
+  res = pr_listcache_capture(NULL, NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_listcache_commit();
+  fail_unless(res < 0, "Committed without capture unexpectedly");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  make_list_dir();
+
+  res = pr_listcache_clear(cache_dir);
+  fail_unless(res == 0, "Failed to clear '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_listcache_open(cache_dir);
+  fail_unless(res == 0, "Failed to open '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_listcache_capture(p, list_dir, "LIST");
+  fail_unless(res == 0, "Failed to capture '%s': %s", list_dir,
+    strerror(errno));
+
+  res = pr_listcache_write(text, strlen(text));
+  fail_unless(res == 0, "Failed to write listing: %s", strerror(errno));
+
+  res = pr_listcache_commit();
+  fail_unless(res == 0, "Failed to commit listing: %s", strerror(errno));
+
+  /* Without a data connection, a cached listing is found, but not sent. */
+  res = pr_listcache_send(p, list_dir, "LIST");
+  fail_unless(res < 0, "Sent listing without data connection unexpectedly");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = pr_listcache_send(p, list_dir, "LIST -a");
+  fail_unless(res < 0, "Sent listing for other key unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* Listings are not shared between client addresses. */
+  session.c = pcalloc(p, sizeof(conn_t));
+  session.c->remote_addr = pr_netaddr_get_addr(p, "127.0.0.1", NULL);
+  fail_unless(session.c->remote_addr != NULL,
+    "Failed to get address for 127.0.0.1: %s", strerror(errno));
+
+  res = pr_listcache_send(p, list_dir, "LIST");
+  fail_unless(res < 0, "Sent listing for other address unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+  session.c = NULL;
+
+  /* Changing a file in the directory makes its cached listings stale. */
+  res = pr_listcache_invalidate(list_file);
+  fail_unless(res == 0, "Failed to invalidate '%s': %s", list_file,
+    strerror(errno));
+
+  res = pr_listcache_flush();
+  fail_unless(res == 0, "Failed to flush listings: %s", strerror(errno));
+
+  res = pr_listcache_send(p, list_dir, "LIST");
+  fail_unless(res < 0, "Sent stale listing unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (listcache_capture_recent_test) {
+  int res;
+  struct timeval tvs[2];
+
+  res = mkdir(list_dir, 0755);
+  fail_unless(res == 0, "Failed to create '%s': %s", list_dir,
+    strerror(errno));
+
+  tvs[0].tv_sec = tvs[1].tv_sec = time(NULL) + 60;
+  tvs[0].tv_usec = tvs[1].tv_usec = 0;
+  res = utimes(list_dir, tvs);
+  fail_unless(res == 0, "Failed to set times on '%s': %s", list_dir,
+    strerror(errno));
+
+  res = pr_listcache_clear(cache_dir);
+  fail_unless(res == 0, "Failed to clear '%s': %s", cache_dir,
+    strerror(errno));
+
+  res = pr_listcache_open(cache_dir);
+  fail_unless(res == 0, "Failed to open '%s': %s", cache_dir,
+    strerror(errno));
+
+  /* A directory changed in the current second (or later) is not cached. */
+  res = pr_listcache_capture(p, list_dir, "LIST");
+  fail_unless(res < 0, "Captured recently changed '%s' unexpectedly",
+    list_dir);
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+}
+END_TEST
+
+Suite *tests_get_listcache_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("listcache");
+
+  testcase = tcase_create("base");
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, listcache_clear_test);
+  tcase_add_test(testcase, listcache_open_test);
+  tcase_add_test(testcase, listcache_send_test);
+  tcase_add_test(testcase, listcache_capture_test);
+  tcase_add_test(testcase, listcache_capture_recent_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
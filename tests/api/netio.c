@@ -75,6 +75,7 @@ static void set_up(void) {
     p = permanent_pool = make_sub_pool(NULL);
   }
 
+  init_dirtree();
   init_netio();
   xfer_bufsz = pr_config_get_server_xfer_bufsz(PR_NETIO_IO_RD);
 
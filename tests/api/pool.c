@@ -301,6 +301,99 @@ START_TEST (pool_tag_test) {
 }
 END_TEST
 
+START_TEST (pool_get_stats_test) {
+  int res;
+  pool *p;
+  pr_pool_stats_t before, after;
+
+  res = pr_pool_get_stats(NULL);
+  fail_unless(res < 0, "Failed to handle null stats");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_pool_get_stats(&before);
+  fail_unless(res == 0, "Failed to get stats: %s", strerror(errno));
+
+  /* A destroyed pool's block goes onto the free lists... */
+  p = make_sub_pool(permanent_pool);
+  destroy_pool(p);
+
+  res = pr_pool_get_stats(&after);
+  fail_unless(res == 0, "Failed to get stats: %s", strerror(errno));
+  fail_unless(after.freelist_len == before.freelist_len + 1,
+    "Expected %lu free blocks, got %lu", before.freelist_len + 1,
+    after.freelist_len);
+  fail_unless(after.freelist_bytes > before.freelist_bytes,
+    "Expected more than %lu free bytes, got %lu", before.freelist_bytes,
+    after.freelist_bytes);
+
+  /* ...from which the next pool's block is taken. */
+  before = after;
+  p = make_sub_pool(permanent_pool);
+
+  res = pr_pool_get_stats(&after);
+  fail_unless(res == 0, "Failed to get stats: %s", strerror(errno));
+  fail_unless(after.blocks_reused == before.blocks_reused + 1,
+    "Expected %lu reused blocks, got %lu", before.blocks_reused + 1,
+    after.blocks_reused);
+  fail_unless(after.freelist_len == before.freelist_len - 1,
+    "Expected %lu free blocks, got %lu", before.freelist_len - 1,
+    after.freelist_len);
+  fail_unless(after.blocks_allocated == before.blocks_allocated,
+    "Expected %lu allocated blocks, got %lu", before.blocks_allocated,
+    after.blocks_allocated);
+
+  destroy_pool(p);
+}
+END_TEST
+
+START_TEST (pool_set_freelist_max_test) {
+  int res;
+  pool *p;
+  pr_pool_stats_t before, after;
+
+  p = make_sub_pool(permanent_pool);
+  destroy_pool(p);
+
+  res = pr_pool_get_stats(&before);
+  fail_unless(res == 0, "Failed to get stats: %s", strerror(errno));
+  fail_unless(before.freelist_len > 0, "Expected free blocks, got none");
+
+  /* Lowering the cap releases the blocks already held... */
+  res = pr_pool_set_freelist_max(0);
+  fail_unless(res == 0, "Failed to set freelist max: %s", strerror(errno));
+
+  res = pr_pool_get_stats(&after);
+  fail_unless(res == 0, "Failed to get stats: %s", strerror(errno));
+  fail_unless(after.freelist_len == 0, "Expected no free blocks, got %lu",
+    after.freelist_len);
+  fail_unless(after.freelist_bytes == 0, "Expected no free bytes, got %lu",
+    after.freelist_bytes);
+  fail_unless(after.blocks_released == before.blocks_released +
+    before.freelist_len, "Expected %lu released blocks, got %lu",
+    before.blocks_released + before.freelist_len, after.blocks_released);
+  fail_unless(after.bytes_allocated == before.bytes_allocated -
+    before.freelist_bytes, "Expected %lu allocated bytes, got %lu",
+    before.bytes_allocated - before.freelist_bytes, after.bytes_allocated);
+
+  /* ...and blocks freed later. */
+  before = after;
+  p = make_sub_pool(permanent_pool);
+  destroy_pool(p);
+
+  res = pr_pool_get_stats(&after);
+  fail_unless(res == 0, "Failed to get stats: %s", strerror(errno));
+  fail_unless(after.freelist_len == 0, "Expected no free blocks, got %lu",
+    after.freelist_len);
+  fail_unless(after.blocks_released == before.blocks_released + 1,
+    "Expected %lu released blocks, got %lu", before.blocks_released + 1,
+    after.blocks_released);
+
+  res = pr_pool_set_freelist_max(PR_TUNABLE_POOL_FREELIST_MAX);
+  fail_unless(res == 0, "Failed to set freelist max: %s", strerror(errno));
+}
+END_TEST
+
 #if defined(PR_USE_DEVEL)
 START_TEST (pool_debug_memory_test) {
   pool *p, *sub_pool;
@@ -395,6 +488,47 @@ START_TEST (pool_unregister_cleanup_test) {
 }
 END_TEST
 
+START_TEST (pool_clear_test) {
+  pool *p, *sub_pool;
+  char *first, *ptr;
+  pr_pool_stats_t before, after;
+
+  mark_point();
+  pr_pool_clear(NULL);
+
+  pool_cleanup_count = 0;
+
+  p = pr_pool_create_sz(permanent_pool, 256);
+  first = palloc(p, 64);
+  register_cleanup(p, NULL, cleanup_cb, cleanup_cb);
+  sub_pool = make_sub_pool(p);
+  fail_if(sub_pool == NULL, "Failed to allocate sub pool");
+
+  /* Spill past the first block. */
+  (void) palloc(p, 4096);
+
+  (void) pr_pool_get_stats(&before);
+  pr_pool_clear(p);
+  (void) pr_pool_get_stats(&after);
+
+  fail_unless(pool_cleanup_count == 1, "Expected cleanup count 1, got %u",
+    pool_cleanup_count);
+
+  /* The sub-pool and the extra block are freed; the first block is kept. */
+  fail_unless(after.freelist_len == before.freelist_len + 2,
+    "Expected %lu free blocks, got %lu", before.freelist_len + 2,
+    after.freelist_len);
+
+  /* And the pool's first block is reused for the next allocation. */
+  ptr = palloc(p, 64);
+  fail_unless(ptr == first, "Expected %p, got %p", first, ptr);
+
+  destroy_pool(p);
+  fail_unless(pool_cleanup_count == 1, "Expected cleanup count 1, got %u",
+    pool_cleanup_count);
+}
+END_TEST
+
 Suite *tests_get_pool_suite(void) {
   Suite *suite;
   TCase *testcase;
@@ -429,12 +563,15 @@ Suite *tests_get_pool_suite(void) {
   tcase_add_test(testcase, pool_pcalloc_test);
   tcase_add_test(testcase, pool_pcallocsz_test);
   tcase_add_test(testcase, pool_tag_test);
+  tcase_add_test(testcase, pool_get_stats_test);
+  tcase_add_test(testcase, pool_set_freelist_max_test);
 #if defined(PR_USE_DEVEL)
   tcase_add_test(testcase, pool_debug_memory_test);
   tcase_add_test(testcase, pool_debug_flags_test);
 #endif /* PR_USE_DEVEL */
   tcase_add_test(testcase, pool_register_cleanup_test);
   tcase_add_test(testcase, pool_unregister_cleanup_test);
+  tcase_add_test(testcase, pool_clear_test);
 
   suite_add_tcase(suite, testcase);
   return suite;
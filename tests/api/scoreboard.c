@@ -879,6 +879,223 @@ START_TEST (scoreboard_entry_update_test) {
 }
 END_TEST
 
+START_TEST (scoreboard_entry_update_read_test) {
+  int res;
+  off_t len = 1024;
+  struct stat st;
+  pr_scoreboard_entry_t *score;
+
+  res = mkdir(test_dir, 0775);
+  fail_unless(res == 0, "Failed to create directory '%s': %s", test_dir,
+    strerror(errno));
+
+  res = chmod(test_dir, 0775);
+  fail_unless(res == 0, "Failed to set perms on '%s' to 0775': %s", test_dir,
+    strerror(errno));
+
+  res = pr_set_scoreboard(test_file);
+  fail_unless(res == 0, "Failed to set scoreboard to '%s': %s", test_file,
+    strerror(errno));
+
+  res = pr_open_scoreboard(O_RDWR);
+  fail_unless(res == 0, "Failed to open scoreboard: %s", strerror(errno));
+
+  res = pr_scoreboard_entry_add();
+  fail_unless(res == 0, "Failed to add entry to scoreboard: %s",
+    strerror(errno));
+
+  /* The scoreboard grows by several slots at a time. */
+  res = stat(test_file, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", test_file, strerror(errno));
+  fail_unless((size_t) st.st_size >= sizeof(pr_scoreboard_header_t) +
+    (PR_TUNABLE_SCOREBOARD_GROW_SLOTS * sizeof(pr_scoreboard_entry_t)),
+    "Expected scoreboard to have grown, got size %lu",
+    (unsigned long) st.st_size);
+
+  res = pr_scoreboard_entry_update(getpid(), PR_SCORE_CWD, "/foo",
+    PR_SCORE_XFER_DONE, len, NULL);
+  fail_unless(res == 0, "Failed to update entry: %s", strerror(errno));
+
+  res = pr_rewind_scoreboard();
+  fail_unless(res == 0, "Failed to rewind scoreboard: %s", strerror(errno));
+
+  /* Updates are visible to readers of the shared scoreboard. */
+  score = pr_scoreboard_entry_read();
+  fail_unless(score != NULL, "Failed to read scoreboard entry: %s",
+    strerror(errno));
+  fail_unless(score->sce_pid == getpid(), "Expected PID %lu, got %lu",
+    (unsigned long) getpid(), (unsigned long) score->sce_pid);
+  fail_unless(strcmp(score->sce_cwd, "/foo") == 0,
+    "Expected cwd '/foo', got '%s'", score->sce_cwd);
+  fail_unless(score->sce_xfer_done == len, "Expected %lu bytes done, got %lu",
+    (unsigned long) len, (unsigned long) score->sce_xfer_done);
+  fail_unless((score->sce_seqno % 2) == 0,
+    "Expected even sequence number, got %u", score->sce_seqno);
+
+  score = pr_scoreboard_entry_read();
+  fail_unless(score == NULL, "Unexpectedly read scoreboard entry");
+
+  res = pr_restore_scoreboard();
+  fail_unless(res == 0, "Failed to restore scoreboard: %s", strerror(errno));
+
+  res = pr_scoreboard_entry_del(FALSE);
+  fail_unless(res == 0, "Failed to delete entry from scoreboard: %s",
+    strerror(errno));
+
+  res = pr_rewind_scoreboard();
+  fail_unless(res == 0, "Failed to rewind scoreboard: %s", strerror(errno));
+
+  score = pr_scoreboard_entry_read();
+  fail_unless(score == NULL, "Unexpectedly read deleted scoreboard entry");
+
+  (void) unlink(test_mutex);
+  (void) unlink(test_file);
+  (void) rmdir(test_dir);
+}
+END_TEST
+
+START_TEST (scoreboard_count_get_test) {
+  int res;
+  unsigned int count = 0;
+  const pr_netaddr_t *addr;
+  const char *server_addr = "127.0.0.1:2121";
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_SERVER, NULL, NULL, NULL,
+    &count);
+  fail_unless(res < 0, "Failed to handle null server address");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_SERVER, server_addr, NULL,
+    NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null count");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_scoreboard_count_get(-1, server_addr, NULL, NULL, &count);
+  fail_unless(res < 0, "Failed to handle bad counter type");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = mkdir(test_dir, 0775);
+  fail_unless(res == 0, "Failed to create directory '%s': %s", test_dir,
+    strerror(errno));
+
+  res = chmod(test_dir, 0775);
+  fail_unless(res == 0, "Failed to set perms on '%s' to 0775': %s", test_dir,
+    strerror(errno));
+
+  res = pr_set_scoreboard(test_file);
+  fail_unless(res == 0, "Failed to set scoreboard to '%s': %s", test_file,
+    strerror(errno));
+
+  res = pr_open_scoreboard(O_RDWR);
+  fail_unless(res == 0, "Failed to open scoreboard: %s", strerror(errno));
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_SERVER, server_addr, NULL,
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get server count: %s", strerror(errno));
+  fail_unless(count == 0, "Expected 0, got %u", count);
+
+  res = pr_scoreboard_entry_add();
+  fail_unless(res == 0, "Failed to add entry to scoreboard: %s",
+    strerror(errno));
+
+  addr = pr_netaddr_get_addr(p, "127.0.0.1", NULL);
+  fail_unless(addr != NULL, "Failed to get addr: %s", strerror(errno));
+
+  res = pr_scoreboard_entry_update(getpid(),
+    PR_SCORE_USER, "(none)",
+    PR_SCORE_SERVER_ADDR, addr, 2121,
+    PR_SCORE_CLIENT_ADDR, addr,
+    PR_SCORE_CLASS, "Local",
+    NULL);
+  fail_unless(res == 0, "Failed to update entry: %s", strerror(errno));
+
+  /* Unauthenticated sessions only count for the server and host. */
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_SERVER, server_addr, NULL,
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get server count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected 1, got %u", count);
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_HOST, server_addr, NULL,
+    "127.0.0.1", &count);
+  fail_unless(res == 0, "Failed to get host count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected 1, got %u", count);
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_AUTH, server_addr, NULL,
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get auth count: %s", strerror(errno));
+  fail_unless(count == 0, "Expected 0, got %u", count);
+
+  res = pr_scoreboard_entry_update(getpid(), PR_SCORE_USER, "foo", NULL);
+  fail_unless(res == 0, "Failed to update entry: %s", strerror(errno));
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_SERVER, server_addr, NULL,
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get server count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected 1, got %u", count);
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_AUTH_HOST, server_addr, NULL,
+    "127.0.0.1", &count);
+  fail_unless(res == 0, "Failed to get auth host count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected 1, got %u", count);
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_USER, server_addr, "foo",
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get user count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected 1, got %u", count);
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_USER, server_addr, "bar",
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get user count: %s", strerror(errno));
+  fail_unless(count == 0, "Expected 0, got %u", count);
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_USER_HOST, server_addr, "foo",
+    "127.0.0.1", &count);
+  fail_unless(res == 0, "Failed to get user host count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected 1, got %u", count);
+
+  /* Class names are matched case-insensitively. */
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_CLASS, server_addr, "local",
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get class count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected 1, got %u", count);
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_SERVER, "127.0.0.1:21", NULL,
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get server count: %s", strerror(errno));
+  fail_unless(count == 0, "Expected 0, got %u", count);
+
+  /* Scrubbing recounts the live entries. */
+  res = pr_scoreboard_scrub();
+  fail_unless(res == 0, "Failed to scrub scoreboard: %s", strerror(errno));
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_USER, server_addr, "foo",
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get user count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected 1, got %u", count);
+
+  res = pr_scoreboard_entry_del(FALSE);
+  fail_unless(res == 0, "Failed to delete entry from scoreboard: %s",
+    strerror(errno));
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_SERVER, server_addr, NULL,
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get server count: %s", strerror(errno));
+  fail_unless(count == 0, "Expected 0, got %u", count);
+
+  res = pr_scoreboard_count_get(PR_SCORE_COUNT_USER, server_addr, "foo",
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get user count: %s", strerror(errno));
+  fail_unless(count == 0, "Expected 0, got %u", count);
+
+  (void) unlink(test_mutex);
+  (void) unlink(test_file);
+  (void) rmdir(test_dir);
+}
+END_TEST
+
 START_TEST (scoreboard_entry_kill_test) {
   int res;
   pr_scoreboard_entry_t sce;
@@ -1046,6 +1263,8 @@ Suite *tests_get_scoreboard_suite(void) {
   tcase_add_test(testcase, scoreboard_entry_read_test);
   tcase_add_test(testcase, scoreboard_entry_get_test);
   tcase_add_test(testcase, scoreboard_entry_update_test);
+  tcase_add_test(testcase, scoreboard_entry_update_read_test);
+  tcase_add_test(testcase, scoreboard_count_get_test);
   tcase_add_test(testcase, scoreboard_entry_kill_test);
   tcase_add_test(testcase, scoreboard_entry_lock_test);
   tcase_add_test(testcase, scoreboard_disabled_test);
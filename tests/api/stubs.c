@@ -28,13 +28,9 @@
 
 session_t session;
 
-char ServerType = SERVER_STANDALONE;
-int ServerUseReverseDNS = 1;
-server_rec *main_server = NULL;
 pid_t mpid = 1;
 module *static_modules[] = { NULL };
 module *loaded_modules = NULL;
-xaset_t *server_list = NULL;
 
 static cmd_rec *next_cmd = NULL;
 
@@ -48,34 +44,6 @@ int tests_stubs_set_main_server(server_rec *s) {
   return 0;
 }
 
-void init_dirtree(void) {
-  pool *main_pool;
-  xaset_t *servers;
-
-  main_pool = make_sub_pool(permanent_pool);
-  pr_pool_tag(main_pool, "testsuite#main_server pool");
-
-  servers = xaset_create(main_pool, NULL);
-
-  main_server = (server_rec *) pcalloc(main_pool, sizeof(server_rec));
-  xaset_insert(servers, (xasetmember_t *) main_server);
-
-  main_server->pool = main_pool;
-  main_server->set = servers;
-  main_server->sid = 1;
-  main_server->notes = pr_table_nalloc(main_pool, 0, 8);
-
-  /* TCP KeepAlive is enabled by default, with the system defaults. */
-  main_server->tcp_keepalive = palloc(main_server->pool,
-    sizeof(struct tcp_keepalive));
-  main_server->tcp_keepalive->keepalive_enabled = TRUE;
-  main_server->tcp_keepalive->keepalive_idle = -1;
-  main_server->tcp_keepalive->keepalive_count = -1;
-  main_server->tcp_keepalive->keepalive_intvl = -1;
-
-  main_server->ServerPort = 21;
-}
-
 int pr_cmd_dispatch(cmd_rec *cmd) {
   return 0;
 }
@@ -92,26 +60,6 @@ int pr_cmd_read(cmd_rec **cmd) {
   return 0;
 }
 
-int pr_config_get_server_xfer_bufsz(int direction) {
-  int bufsz = -1;
-
-  switch (direction) {
-    case PR_NETIO_IO_RD:
-      bufsz = PR_TUNABLE_DEFAULT_RCVBUFSZ;
-      break;
-
-    case PR_NETIO_IO_WR:
-      bufsz = PR_TUNABLE_DEFAULT_SNDBUFSZ;
-      break;
-
-    default:
-      errno = EINVAL;
-      return -1;
-  }
-
-  return bufsz;
-}
-
 int pr_ctrls_unregister(module *m, const char *action) {
   return 0;
 }
@@ -58,6 +58,7 @@ static struct testsuite_info suites[] = {
   { "parser",		tests_get_parser_suite },
   { "pidfile",		tests_get_pidfile_suite },
   { "config",		tests_get_config_suite },
+  { "dirtree",		tests_get_dirtree_suite },
   { "auth",		tests_get_auth_suite },
   { "filter",		tests_get_filter_suite },
   { "inet",		tests_get_inet_suite },
@@ -71,6 +72,9 @@ static struct testsuite_info suites[] = {
   { "misc",		tests_get_misc_suite },
   { "json",		tests_get_json_suite },
   { "redis",		tests_get_redis_suite },
+  { "cachedir",	tests_get_cachedir_suite },
+  { "listcache",	tests_get_listcache_suite },
+  { "asciicache",	tests_get_asciicache_suite },
 
   { NULL, NULL }
 };
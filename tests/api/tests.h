@@ -67,6 +67,7 @@ Suite *tests_get_trace_suite(void);
 Suite *tests_get_parser_suite(void);
 Suite *tests_get_pidfile_suite(void);
 Suite *tests_get_config_suite(void);
+Suite *tests_get_dirtree_suite(void);
 Suite *tests_get_auth_suite(void);
 Suite *tests_get_filter_suite(void);
 Suite *tests_get_inet_suite(void);
@@ -80,6 +81,9 @@ Suite *tests_get_display_suite(void);
 Suite *tests_get_misc_suite(void);
 Suite *tests_get_json_suite(void);
 Suite *tests_get_redis_suite(void);
+Suite *tests_get_cachedir_suite(void);
+Suite *tests_get_listcache_suite(void);
+Suite *tests_get_asciicache_suite(void);
 
 /* Temporary hack/placement for this variable, until we get to testing
  * the Signals API.
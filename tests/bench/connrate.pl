@@ -0,0 +1,196 @@
+#!/usr/bin/env perl
+
+# Measures how many control connections per second a standalone proftpd can
+# accept, and how long clients wait for the banner: each client connects,
+# reads the 220 banner, sends QUIT and waits for the 221 reply.
+#
+# Given --proftpd, the script starts the daemon itself, once without and
+# once with a pre-forked worker pool (MinSpareServers/MaxSpareServers), and
+# reports both rates.  Otherwise it measures an already running server at
+# --host/--port.
+
+use strict;
+use warnings;
+
+use File::Spec;
+use File::Temp qw(tempdir);
+use Getopt::Long;
+use IO::Socket::INET;
+use POSIX qw(:sys_wait_h);
+use Time::HiRes qw(time sleep);
+
+my $host = '127.0.0.1';
+my $port = 2121;
+my $count = 2000;
+my $concurrency = 8;
+my $proftpd;
+my $min_spare = 8;
+my $max_spare = 32;
+
+GetOptions(
+  'host=s' => \$host,
+  'port=i' => \$port,
+  'count=i' => \$count,
+  'concurrency=i' => \$concurrency,
+  'proftpd=s' => \$proftpd,
+  'min-spare=i' => \$min_spare,
+  'max-spare=i' => \$max_spare,
+) or die("usage: $0 [--host addr] [--port port] [--count n] " .
+  "[--concurrency n] [--proftpd path [--min-spare n] [--max-spare n]]\n");
+
+# Returns the time taken to receive the banner, or undef on failure.
+sub session {
+  my $start = time();
+  my $client = IO::Socket::INET->new(
+    PeerAddr => $host,
+    PeerPort => $port,
+    Proto => 'tcp',
+  ) or return undef;
+
+  my $banner = <$client>;
+  unless (defined($banner) && $banner =~ /^220 /) {
+    return undef;
+  }
+
+  my $latency = time() - $start;
+
+  print $client "QUIT\r\n";
+  my $resp = <$client>;
+  close($client);
+
+  return (defined($resp) && $resp =~ /^221 /) ? $latency : undef;
+}
+
+# Runs $count sessions spread across $concurrency client processes, and
+# returns the rate of successful sessions, the mean time to banner (in
+# millisecs), and the number of failed sessions.
+sub measure {
+  my $per_client = int(($count + $concurrency - 1) / $concurrency);
+  my $start = time();
+  my @pids;
+
+  for (my $i = 0; $i < $concurrency; $i++) {
+    pipe(my $rfh, my $wfh) or die("pipe: $!");
+
+    my $pid = fork();
+    die("fork: $!") unless defined($pid);
+
+    if ($pid == 0) {
+      my ($ok, $failed, $latency) = (0, 0, 0);
+
+      close($rfh);
+      for (my $j = 0; $j < $per_client; $j++) {
+        my $res = session();
+        if (defined($res)) {
+          $ok++;
+          $latency += $res;
+
+        } else {
+          $failed++;
+        }
+      }
+
+      print $wfh "$ok $failed $latency\n";
+      close($wfh);
+      POSIX::_exit(0);
+    }
+
+    close($wfh);
+    push(@pids, [$pid, $rfh]);
+  }
+
+  my ($ok, $failed, $latency) = (0, 0, 0);
+  foreach my $client (@pids) {
+    my ($pid, $rfh) = @$client;
+
+    my $line = <$rfh>;
+    close($rfh);
+    waitpid($pid, 0);
+
+    if (defined($line)) {
+      my ($client_ok, $client_failed, $client_latency) = split(' ', $line);
+      $ok += $client_ok;
+      $failed += $client_failed;
+      $latency += $client_latency;
+
+    } else {
+      $failed += $per_client;
+    }
+  }
+
+  my $elapsed = time() - $start;
+  return ($ok / $elapsed, $ok ? ($latency * 1000) / $ok : 0, $failed);
+}
+
+sub run_daemon {
+  my ($label, $extra) = @_;
+
+  my $dir = tempdir(CLEANUP => 1);
+  my $config_file = File::Spec->catfile($dir, 'proftpd.conf');
+  my $pid_file = File::Spec->catfile($dir, 'proftpd.pid');
+  my $user = getpwuid($<);
+  my $group = getgrgid($();
+
+  open(my $fh, '>', $config_file) or die("$config_file: $!");
+  print $fh <<EOC;
+ServerType standalone
+DefaultAddress $host
+Port $port
+User $user
+Group $group
+PidFile $pid_file
+ScoreboardFile $dir/proftpd.scoreboard
+WtmpLog off
+UseReverseDNS off
+MaxInstances none
+
+<IfModule mod_delay.c>
+  DelayEngine off
+</IfModule>
+
+<IfModule mod_ident.c>
+  IdentLookups off
+</IfModule>
+
+$extra
+EOC
+  close($fh);
+
+  my $pid = fork();
+  die("fork: $!") unless defined($pid);
+
+  if ($pid == 0) {
+    open(STDOUT, '>', '/dev/null');
+    open(STDERR, '>', '/dev/null');
+    exec($proftpd, '-n', '-q', '-c', $config_file) or POSIX::_exit(1);
+  }
+
+  # Wait for the daemon (and its pool, if any) to come up.
+  for (my $i = 0; $i < 50; $i++) {
+    last if defined(session());
+    sleep(0.1);
+  }
+  sleep(0.5);
+
+  my ($rate, $latency, $failed) = measure();
+  printf("%-28s %10.1f conns/sec, %6.2f ms to banner (%d failed)\n", $label,
+    $rate, $latency, $failed);
+
+  kill('TERM', $pid);
+  waitpid($pid, 0);
+
+  return $rate;
+}
+
+if (defined($proftpd)) {
+  my $forked = run_daemon('fork per connection:', '');
+  my $pooled = run_daemon("pre-fork ($min_spare/$max_spare spare):",
+    "MinSpareServers $min_spare\nMaxSpareServers $max_spare");
+
+  printf("%-28s %10.2fx\n", 'speedup:', $pooled / $forked) if $forked > 0;
+
+} else {
+  my ($rate, $latency, $failed) = measure();
+  printf("%s:%d: %.1f conns/sec, %.2f ms to banner (%d failed)\n", $host,
+    $port, $rate, $latency, $failed);
+}
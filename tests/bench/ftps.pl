@@ -0,0 +1,499 @@
+#!/usr/bin/env perl
+
+# Measures FTPS performance for each of a list of ciphers: the rate of
+# control connection TLS handshakes (AUTH TLS, then QUIT) and how many of
+# them resume a previous session, then the throughput of a series of
+# protected (PBSZ 0, PROT P) binary downloads, how many of their data
+# connections resume the control connection's session, and the CPU time
+# spent per MB transferred.
+#
+# Given --proftpd, the script starts the daemon itself for each cipher and
+# phase, running as the current user, authenticating via a generated
+# AuthUserFile, and using a generated self-signed certificate unless --cert
+# and --key are given; on Linux, the CPU time of the daemon and its session
+# processes during the downloads is then reported as well.  Otherwise it
+# measures an already running server at --host/--port, using --user,
+# --password and --file (a file on that server to download), with the
+# ciphers chosen by the client.
+#
+# --full disables session resumption for the control connections only; the
+# data connections always resume the control connection's session, as the
+# server requires unless "TLSOptions NoSessionReuseRequired" is used.
+#
+# Requires IO::Socket::SSL, as do the mod_tls tests.
+
+use strict;
+use warnings;
+
+use File::Spec;
+use File::Temp qw(tempdir);
+use Getopt::Long;
+use IO::Socket::INET;
+use IO::Socket::SSL;
+use POSIX qw(:sys_wait_h);
+use Time::HiRes qw(time sleep);
+
+my $host = '127.0.0.1';
+my $port = 2121;
+my $proftpd;
+my $user = 'bench';
+my $passwd = 'bench';
+my $file;
+my $protocol = 'TLSv1.2';
+my @ciphers;
+my $sessions = 500;
+my $concurrency = 4;
+my $transfers = 20;
+my $size = 16;
+my $full = 0;
+my ($cert, $key);
+my $sess_cache;
+
+GetOptions(
+  'host=s' => \$host,
+  'port=i' => \$port,
+  'proftpd=s' => \$proftpd,
+  'user=s' => \$user,
+  'password=s' => \$passwd,
+  'file=s' => \$file,
+  'protocol=s' => \$protocol,
+  'cipher=s' => \@ciphers,
+  'sessions=i' => \$sessions,
+  'concurrency=i' => \$concurrency,
+  'transfers=i' => \$transfers,
+  'size=i' => \$size,
+  'full' => \$full,
+  'cert=s' => \$cert,
+  'key=s' => \$key,
+  'session-cache=s' => \$sess_cache,
+) or die("usage: $0 [--host addr] [--port port] [--protocol name] " .
+  "[--cipher name ...] [--sessions n] [--concurrency n] [--transfers n] " .
+  "[--size MB] [--full] [--proftpd path [--cert file --key file] " .
+  "[--session-cache type:/info] | --user name --password pass " .
+  "--file path]\n");
+
+@ciphers = qw(ECDHE-RSA-AES128-GCM-SHA256 ECDHE-RSA-AES256-GCM-SHA384
+  ECDHE-RSA-CHACHA20-POLY1305 AES128-SHA) unless @ciphers;
+
+my $tmpdir = tempdir(CLEANUP => 1);
+
+# Reads a (possibly multiline) reply, returning its code and last line.
+sub ftp_reply {
+  my ($sock) = @_;
+
+  while (defined(my $line = <$sock>)) {
+    return ($1, $line) if $line =~ /^(\d{3}) /;
+  }
+
+  return (0, '');
+}
+
+sub ftp_cmd {
+  my ($sock, $cmd, $expected) = @_;
+
+  print $sock "$cmd\r\n";
+  my ($code, $line) = ftp_reply($sock);
+  die("$cmd: unexpected reply: $line\n") unless $code =~ /^$expected/;
+
+  return $line;
+}
+
+# All of the connections of a client process share one context, and thus
+# its session cache.  Keying all of the sessions by the control connection's
+# address lets the data connections resume the control connection's
+# session, as the server requires by default; without a cache (e.g. for
+# --full handshakes), the server refuses the data connections.
+sub client_ctx {
+  my ($cipher, $cache) = @_;
+
+  # IO::Socket::SSL spells e.g. TLSv1.2 as TLSv1_2.
+  (my $version = $protocol) =~ s/\./_/g;
+
+  my $ctx = IO::Socket::SSL::SSL_Context->new(
+    SSL_verify_mode => SSL_VERIFY_NONE,
+    SSL_version => $version,
+    SSL_cipher_list => $cipher,
+    SSL_session_cache_size => $cache ? 128 : 0,
+  ) or die("unable to create SSL context: " . IO::Socket::SSL::errstr() .
+    "\n");
+
+  return $ctx;
+}
+
+sub start_tls {
+  my ($sock, $ctx) = @_;
+
+  my $ssl = IO::Socket::SSL->start_SSL($sock,
+    SSL_reuse_ctx => $ctx,
+    SSL_session_key => "$host:$port",
+  ) or die("TLS handshake failed: " . IO::Socket::SSL::errstr() . "\n");
+
+  return ($ssl, Net::SSLeay::session_reused($ssl->_get_ssl_object()) ? 1 : 0);
+}
+
+sub ctrl_connect {
+  my ($ctx) = @_;
+
+  my $sock = IO::Socket::INET->new(
+    PeerAddr => $host,
+    PeerPort => $port,
+    Proto => 'tcp',
+  ) or die("unable to connect to $host:$port: $!\n");
+
+  my ($code, $line) = ftp_reply($sock);
+  die("unexpected banner: $line\n") unless $code == 220;
+
+  ftp_cmd($sock, 'AUTH TLS', 234);
+  return start_tls($sock, $ctx);
+}
+
+# Runs the given function in a child process, which writes its results as
+# a line to the returned pipe.
+sub spawn {
+  my ($func) = @_;
+
+  pipe(my $rfh, my $wfh) or die("pipe: $!");
+
+  my $pid = fork();
+  die("fork: $!") unless defined($pid);
+
+  if ($pid == 0) {
+    close($rfh);
+    my $res = eval { $func->() };
+    print $wfh defined($res) ? "$res\n" : "0 0 0 # $@";
+    close($wfh);
+    POSIX::_exit(0);
+  }
+
+  close($wfh);
+  return [$pid, $rfh];
+}
+
+sub collect {
+  my ($child) = @_;
+  my ($pid, $rfh) = @$child;
+
+  my $line = <$rfh>;
+  close($rfh);
+  waitpid($pid, 0);
+
+  warn("client failed: $1") if defined($line) && $line =~ /# (.*)$/s;
+  return defined($line) ? split(' ', $line) : (0, 0, 0);
+}
+
+# Returns the rate of handshakes, the number of them which resumed a
+# session, and the number of failed sessions.
+sub measure_handshakes {
+  my ($cipher) = @_;
+  my $per_client = int(($sessions + $concurrency - 1) / $concurrency);
+  my @clients;
+
+  my $start = time();
+  for (my $i = 0; $i < $concurrency; $i++) {
+    push(@clients, spawn(sub {
+      my $ctx = client_ctx($cipher, !$full);
+      my ($ok, $resumed, $failed) = (0, 0, 0);
+
+      for (my $j = 0; $j < $per_client; $j++) {
+        my $reused = eval {
+          my ($ssl, $reused) = ctrl_connect($ctx);
+          ftp_cmd($ssl, 'QUIT', 221);
+          $ssl->close();
+          $reused;
+        };
+
+        unless (defined($reused)) {
+          $failed++;
+          next;
+        }
+
+        $ok++;
+        $resumed += $reused;
+      }
+
+      return "$ok $resumed $failed";
+    }));
+  }
+
+  my ($ok, $resumed, $failed) = (0, 0, 0);
+  foreach my $client (@clients) {
+    my @res = collect($client);
+    $ok += $res[0];
+    $resumed += $res[1];
+    $failed += $res[2];
+  }
+
+  my $elapsed = time() - $start;
+  return ($ok / $elapsed, $ok, $resumed, $failed);
+}
+
+# Returns the number of bytes downloaded, the download rate (in MB/sec),
+# and the number of data connections which resumed a session.
+sub measure_transfers {
+  my ($cipher, $path) = @_;
+
+  my $start = time();
+  my ($bytes, $resumed) = collect(spawn(sub {
+    my $ctx = client_ctx($cipher, 1);
+    my ($ctrl) = ctrl_connect($ctx);
+    my ($bytes, $resumed) = (0, 0);
+
+    ftp_cmd($ctrl, "USER $user", 331);
+    ftp_cmd($ctrl, "PASS $passwd", 230);
+    ftp_cmd($ctrl, 'PBSZ 0', 200);
+    ftp_cmd($ctrl, 'PROT P', 200);
+    ftp_cmd($ctrl, 'TYPE I', 200);
+
+    for (my $i = 0; $i < $transfers; $i++) {
+      my $line = ftp_cmd($ctrl, 'PASV', 227);
+      die("unable to parse PASV reply: $line\n")
+        unless $line =~ /(\d+),(\d+),(\d+),(\d+),(\d+),(\d+)/;
+
+      my $data = IO::Socket::INET->new(
+        PeerAddr => "$1.$2.$3.$4",
+        PeerPort => ($5 * 256) + $6,
+        Proto => 'tcp',
+      ) or die("unable to open data connection: $!\n");
+
+      ftp_cmd($ctrl, "RETR $path", 150);
+
+      my ($ssl, $reused) = start_tls($data, $ctx);
+      $resumed += $reused;
+
+      my $buf;
+      while (my $len = $ssl->sysread($buf, 262144)) {
+        $bytes += $len;
+      }
+      $ssl->close();
+
+      my ($code, $reply) = ftp_reply($ctrl);
+      die("RETR $path: unexpected reply: $reply\n") unless $code == 226;
+    }
+
+    ftp_cmd($ctrl, 'QUIT', 221);
+    return "$bytes $resumed";
+  }));
+
+  my $elapsed = time() - $start;
+  return ($bytes, ($bytes / (1024 * 1024)) / $elapsed, $resumed);
+}
+
+# Returns the CPU time used by our reaped children, e.g. the client process
+# run by measure_transfers().
+sub cpu_time {
+  my ($user_secs, $sys_secs, $cuser_secs, $csys_secs) = times();
+  return $cuser_secs + $csys_secs;
+}
+
+# The daemon is our child, but its sessions are not: times() would only
+# count them once the daemon had reaped them and exited, along with the
+# daemon's startup, and the daemon does not reap the sessions it kills on
+# SIGTERM.  So, on Linux, read the CPU time used by the running daemon and
+# the sessions it has reaped from /proc instead, once it has no sessions
+# left.  Returns undef where /proc is not available.
+sub daemon_cpu_time {
+  my ($pid) = @_;
+
+  return undef unless -r "/proc/$pid/stat";
+
+  for (my $i = 0; $i < 100; $i++) {
+    my $sessions = 0;
+
+    foreach my $stat_file (glob('/proc/[0-9]*/stat')) {
+      open(my $fh, '<', $stat_file) or next;
+      my $stat = <$fh>;
+      close($fh);
+
+      # The parent PID follows the command name, which may contain spaces.
+      $sessions++ if defined($stat) && $stat =~ /\) \S+ (\d+) / && $1 == $pid;
+    }
+
+    last unless $sessions;
+    sleep(0.1);
+  }
+
+  open(my $fh, '<', "/proc/$pid/stat") or return undef;
+  my $stat = <$fh>;
+  close($fh);
+
+  # utime, stime, cutime and cstime, in clock ticks.
+  $stat =~ s/^.*\) //s;
+  my @fields = split(' ', $stat);
+  return ($fields[11] + $fields[12] + $fields[13] + $fields[14]) /
+    POSIX::sysconf(POSIX::_SC_CLK_TCK);
+}
+
+sub run_daemon {
+  my ($cipher) = @_;
+
+  my $config_file = File::Spec->catfile($tmpdir, 'proftpd.conf');
+  my $pid_file = File::Spec->catfile($tmpdir, 'proftpd.pid');
+  my $sys_user = getpwuid($<);
+  my $sys_group = getgrgid($();
+
+  my $cache = defined($sess_cache) ? "TLSSessionCache $sess_cache" : '';
+
+  # The user file maps the bench user to us, whoever we are.
+  my $root_login = $< == 0 ? 'RootLogin on' : '';
+
+  open(my $fh, '>', $config_file) or die("$config_file: $!");
+  print $fh <<EOC;
+ServerType standalone
+DefaultAddress $host
+Port $port
+User $sys_user
+Group $sys_group
+PidFile $pid_file
+ScoreboardFile $tmpdir/proftpd.scoreboard
+WtmpLog off
+TransferLog none
+UseReverseDNS off
+MaxInstances none
+AuthUserFile $tmpdir/proftpd.passwd
+AuthGroupFile $tmpdir/proftpd.group
+AuthOrder mod_auth_file.c
+RequireValidShell off
+$root_login
+
+<IfModule mod_delay.c>
+  DelayEngine off
+</IfModule>
+
+<IfModule mod_ident.c>
+  IdentLookups off
+</IfModule>
+
+<IfModule mod_tls.c>
+  TLSEngine on
+  TLSProtocol $protocol
+  TLSCipherSuite $cipher
+  TLSRSACertificateFile $cert
+  TLSRSACertificateKeyFile $key
+  TLSVerifyClient off
+
+  # Otherwise each session loads OpenSSL's default CA certificates, which
+  # can take longer than the handshake itself.
+  TLSCACertificateFile $cert
+  TLSRenegotiate none
+  $cache
+</IfModule>
+EOC
+  close($fh);
+
+  my $pid = fork();
+  die("fork: $!") unless defined($pid);
+
+  if ($pid == 0) {
+    open(STDOUT, '>', '/dev/null');
+    open(STDERR, '>', '/dev/null');
+    exec($proftpd, '-n', '-q', '-c', $config_file) or POSIX::_exit(1);
+  }
+
+  # Wait for the daemon to come up.
+  for (my $i = 0; $i < 50; $i++) {
+    my $client = IO::Socket::INET->new(
+      PeerAddr => $host,
+      PeerPort => $port,
+      Proto => 'tcp',
+    );
+
+    if (defined($client)) {
+      close($client);
+      last;
+    }
+
+    sleep(0.1);
+  }
+
+  return $pid;
+}
+
+sub stop_daemon {
+  my ($pid) = @_;
+
+  kill('TERM', $pid);
+  waitpid($pid, 0);
+}
+
+if (defined($proftpd)) {
+  my $gid = (split(' ', $())[0];
+
+  unless (defined($cert)) {
+    $cert = File::Spec->catfile($tmpdir, 'cert.pem');
+    $key = File::Spec->catfile($tmpdir, 'key.pem');
+
+    system("openssl req -x509 -newkey rsa:2048 -nodes -days 1 " .
+      "-subj /CN=$host -keyout $key -out $cert >/dev/null 2>&1") == 0
+      or die("unable to generate certificate using openssl\n");
+  }
+  $key = $cert unless defined($key);
+
+  my $passwd_file = File::Spec->catfile($tmpdir, 'proftpd.passwd');
+  open(my $fh, '>', $passwd_file) or die("$passwd_file: $!");
+  print $fh "$user:" . crypt($passwd, 'pb') . ":$<:${gid}::$tmpdir:/bin/sh\n";
+  close($fh);
+
+  # mod_auth_file refuses world-readable files.
+  chmod(0400, $passwd_file);
+
+  my $group_file = File::Spec->catfile($tmpdir, 'proftpd.group');
+  open($fh, '>', $group_file) or die("$group_file: $!");
+  print $fh getgrgid($() . ":x:$gid:$user\n";
+  close($fh);
+
+  $file = File::Spec->catfile($tmpdir, 'bench.dat');
+  open($fh, '>', $file) or die("$file: $!");
+  my $chunk = join('', map { chr(int(rand(256))) } 1..65536);
+  for (my $i = 0; $i < $size * 16; $i++) {
+    print $fh $chunk;
+  }
+  close($fh);
+
+} elsif (!defined($file)) {
+  $transfers = 0;
+}
+
+printf("%s, %d handshakes (%d clients)%s, %d x %s transfers\n", $protocol,
+  $sessions, $concurrency, $full ? ' without resumption' : '', $transfers,
+  defined($proftpd) ? "$size MB" : $file);
+printf("%-30s %9s %8s %9s %8s %12s %12s\n", 'cipher', 'hs/sec', 'resumed',
+  'MB/sec', 'resumed', 'client ms/MB', 'server ms/MB');
+
+foreach my $cipher (@ciphers) {
+  my $pid;
+
+  $pid = run_daemon($cipher) if defined($proftpd);
+  my ($rate, $ok, $resumed, $failed) = measure_handshakes($cipher);
+  stop_daemon($pid) if defined($pid);
+
+  my $hs = sprintf("%-30s %9.1f %7.1f%%", $cipher, $rate,
+    $ok ? ($resumed * 100) / $ok : 0);
+  $hs .= " ($failed failed)" if $failed;
+
+  unless ($transfers > 0 && $ok > 0) {
+    print "$hs\n";
+    next;
+  }
+
+  my $server_cpu;
+  if (defined($proftpd)) {
+    $pid = run_daemon($cipher);
+    $server_cpu = daemon_cpu_time($pid);
+  }
+
+  my $client_cpu = cpu_time();
+  my ($bytes, $mb_rate, $data_resumed) = measure_transfers($cipher, $file);
+  $client_cpu = cpu_time() - $client_cpu;
+
+  if (defined($pid)) {
+    $server_cpu = daemon_cpu_time($pid) - $server_cpu
+      if defined($server_cpu);
+    stop_daemon($pid);
+  }
+
+  my $mb = $bytes / (1024 * 1024);
+  printf("%s %9.1f %7.1f%% %12.2f %12s\n", $hs, $mb_rate,
+    ($data_resumed * 100) / $transfers, $mb ? ($client_cpu * 1000) / $mb : 0,
+    defined($server_cpu) && $mb ?
+      sprintf("%.2f", ($server_cpu * 1000) / $mb) : '-');
+}
@@ -0,0 +1,180 @@
+#!/usr/bin/env perl
+
+# Measures how long LIST and NLST take for large directories.  For each
+# requested size, a directory with that many empty files is created, and
+# the script reports the time to the first byte of the listing, the total
+# time, and the listing rate.
+#
+# Given --proftpd, the script starts the daemon itself, running as the
+# current user and authenticating via a generated AuthUserFile.  Otherwise
+# it measures an already running server at --host/--port, using --user,
+# --password and --dir (a directory on that server in which the test
+# directories are created by this script, locally).
+
+use strict;
+use warnings;
+
+use File::Path qw(rmtree);
+use File::Spec;
+use File::Temp qw(tempdir);
+use Getopt::Long;
+use Net::FTP;
+use POSIX qw(:sys_wait_h);
+use Time::HiRes qw(time sleep);
+
+my $host = '127.0.0.1';
+my $port = 2121;
+my $sizes = '10000,100000,1000000';
+my $proftpd;
+my $user = 'bench';
+my $passwd = 'bench';
+my $dir;
+my $keep = 0;
+
+GetOptions(
+  'host=s' => \$host,
+  'port=i' => \$port,
+  'sizes=s' => \$sizes,
+  'proftpd=s' => \$proftpd,
+  'user=s' => \$user,
+  'password=s' => \$passwd,
+  'dir=s' => \$dir,
+  'keep' => \$keep,
+) or die("usage: $0 [--host addr] [--port port] [--sizes n,n,...] " .
+  "[--proftpd path | --user name --password pass --dir path] [--keep]\n");
+
+my $tmpdir = tempdir(CLEANUP => !$keep);
+$dir = $tmpdir unless defined($dir);
+
+sub make_dir {
+  my ($count) = @_;
+
+  my $path = File::Spec->catdir($dir, "list-$count");
+  return $path if -d $path;
+
+  mkdir($path) or die("$path: $!");
+  for (my $i = 0; $i < $count; $i++) {
+    my $file = File::Spec->catfile($path, sprintf("file-%08d.dat", $i));
+    open(my $fh, '>', $file) or die("$file: $!");
+    close($fh);
+  }
+
+  return $path;
+}
+
+# Returns the time to the first byte of the listing, the total time, and the
+# number of lines received.
+sub list {
+  my ($cmd, $path) = @_;
+
+  my $client = Net::FTP->new($host, Port => $port, Timeout => 3600)
+    or die("unable to connect to $host:$port: $@");
+  $client->login($user, $passwd) or die("login failed: " . $client->message);
+
+  my $start = time();
+  my $conn = $cmd eq 'LIST' ? $client->list($path) : $client->nlst($path);
+  die("$cmd $path failed: " . $client->message) unless defined($conn);
+
+  my ($buf, $ttfb, $lines) = ('', undef, 0);
+  while (my $len = $conn->read($buf, 65536)) {
+    $ttfb = time() - $start unless defined($ttfb);
+    $lines += ($buf =~ tr/\n//);
+  }
+  $conn->close();
+  my $elapsed = time() - $start;
+
+  $client->quit();
+  return (defined($ttfb) ? $ttfb : $elapsed, $elapsed, $lines);
+}
+
+sub run_daemon {
+  my $config_file = File::Spec->catfile($tmpdir, 'proftpd.conf');
+  my $pid_file = File::Spec->catfile($tmpdir, 'proftpd.pid');
+  my $passwd_file = File::Spec->catfile($tmpdir, 'proftpd.passwd');
+  my $group_file = File::Spec->catfile($tmpdir, 'proftpd.group');
+  my $sys_user = getpwuid($<);
+  my $sys_group = getgrgid($();
+  my $gid = (split(' ', $())[0];
+
+  open(my $fh, '>', $passwd_file) or die("$passwd_file: $!");
+  print $fh "$user:" . crypt($passwd, 'pb') . ":$<:${gid}::$dir:/bin/sh\n";
+  close($fh);
+
+  # mod_auth_file refuses world-readable files.
+  chmod(0400, $passwd_file);
+
+  open($fh, '>', $group_file) or die("$group_file: $!");
+  print $fh "$sys_group:x:$gid:$user\n";
+  close($fh);
+
+  open($fh, '>', $config_file) or die("$config_file: $!");
+  print $fh <<EOC;
+ServerType standalone
+DefaultAddress $host
+Port $port
+User $sys_user
+Group $sys_group
+PidFile $pid_file
+ScoreboardFile $tmpdir/proftpd.scoreboard
+WtmpLog off
+TransferLog none
+UseReverseDNS off
+AuthUserFile $passwd_file
+AuthGroupFile $group_file
+AuthOrder mod_auth_file.c
+RequireValidShell off
+TimeoutIdle 3600
+TimeoutNoTransfer 3600
+
+<IfModule mod_delay.c>
+  DelayEngine off
+</IfModule>
+
+<IfModule mod_ident.c>
+  IdentLookups off
+</IfModule>
+EOC
+  close($fh);
+
+  my $pid = fork();
+  die("fork: $!") unless defined($pid);
+
+  if ($pid == 0) {
+    open(STDOUT, '>', '/dev/null');
+    open(STDERR, '>', '/dev/null');
+    exec($proftpd, '-n', '-q', '-c', $config_file) or POSIX::_exit(1);
+  }
+
+  # Wait for the daemon to come up.
+  for (my $i = 0; $i < 50; $i++) {
+    my $client = Net::FTP->new($host, Port => $port, Timeout => 1);
+    if (defined($client)) {
+      $client->quit();
+      last;
+    }
+
+    sleep(0.1);
+  }
+
+  return $pid;
+}
+
+my $pid = defined($proftpd) ? run_daemon() : undef;
+
+foreach my $count (split(/,/, $sizes)) {
+  my $path = make_dir($count);
+
+  foreach my $cmd (qw(NLST LIST)) {
+    my ($ttfb, $elapsed, $lines) = list($cmd, $path);
+    printf("%-4s %8d entries: %8.3f s to first byte, %8.3f s total, " .
+      "%10.1f entries/sec (%d lines)\n", $cmd, $count, $ttfb, $elapsed,
+      $elapsed > 0 ? $lines / $elapsed : 0, $lines);
+  }
+
+  rmtree($path) unless $keep;
+}
+
+if (defined($pid)) {
+  kill('TERM', $pid);
+  waitpid($pid, 0);
+}
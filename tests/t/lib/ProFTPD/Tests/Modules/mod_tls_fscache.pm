@@ -9,7 +9,9 @@ use File::Copy;
 use File::Path qw(mkpath);
 use File::Spec;
 use IO::Handle;
+use POSIX qw(strftime);
 use Socket;
+use Time::HiRes qw(gettimeofday tv_interval);
 
 use ProFTPD::TestSuite::FTP;
 use ProFTPD::TestSuite::Utils qw(:auth :config :running :test :testsuite);
@@ -24,6 +26,16 @@ my $TESTS = {
     test_class => [qw(bug forking mod_tls_fscache)],
   },
 
+  tls_stapling_prefetch_fscache => {
+    order => ++$order,
+    test_class => [qw(forking mod_tls_fscache)],
+  },
+
+  tls_stapling_no_prefetch_fscache => {
+    order => ++$order,
+    test_class => [qw(forking mod_tls_fscache)],
+  },
+
 };
 
 sub new {
@@ -120,6 +132,224 @@ sub starttls_ftp {
   $client->close();
 }
 
+# Creates a CA, and a server certificate issued by it, along with the index
+# of issued certificates which openssl-ocsp(1) reads when acting as the OCSP
+# responder for that CA.  The certificates in t/etc/modules/mod_tls/ have
+# expired, and so any OCSP responses signed using them fail verification.
+sub ocsp_create_certs {
+  my $dir = shift;
+
+  my $certs = {
+    ca_file => "$dir/ocsp-ca.pem",
+    ca_key_file => "$dir/ocsp-ca-key.pem",
+    cert_file => "$dir/ocsp-server.pem",
+    key_file => "$dir/ocsp-server-key.pem",
+    index_file => "$dir/ocsp-index.txt",
+  };
+
+  my $cmds = [
+    "openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=ocsp-ca -keyout $certs->{ca_key_file} -out $certs->{ca_file}",
+    "openssl req -new -newkey rsa:2048 -nodes -subj /CN=ocsp-server -keyout $certs->{key_file} -out $dir/ocsp-server.csr",
+    "openssl x509 -req -days 1 -set_serial 2 -in $dir/ocsp-server.csr -CA $certs->{ca_file} -CAkey $certs->{ca_key_file} -out $certs->{cert_file}",
+  ];
+
+  local $SIG{CHLD} = 'DEFAULT';
+
+  foreach my $cmd (@$cmds) {
+    if ($ENV{TEST_VERBOSE}) {
+      print STDERR "Executing: $cmd\n";
+    }
+
+    unless (system("$cmd > /dev/null 2>&1") == 0) {
+      croak("Can't create OCSP certificates using '$cmd'");
+    }
+  }
+
+  my $expires = strftime('%y%m%d%H%M%SZ', gmtime(time() + 86400));
+
+  if (open(my $fh, "> $certs->{index_file}")) {
+    print $fh "V\t$expires\t\t02\tunknown\t/CN=ocsp-server\n";
+
+    unless (close($fh)) {
+      croak("Can't write $certs->{index_file}: $!");
+    }
+
+  } else {
+    croak("Can't open $certs->{index_file}: $!");
+  }
+
+  return $certs;
+}
+
+# Starts a stub OCSP responder for the given certificates, returning its PID
+# and port.  The responder logs each request it receives to the given file,
+# then answers it, using openssl-ocsp(1); every request after the first is
+# answered only after the given delay.
+#
+# The responder is not our child process: our SIGCHLD handler waits for all
+# of our children, and would wait for the responder as soon as the server
+# exits.
+sub ocsp_responder_start {
+  my $certs = shift;
+  my $log_file = shift;
+  my $delay = shift;
+
+  my $listener = IO::Socket::INET->new(
+    LocalAddr => '127.0.0.1',
+    Listen => 5,
+    Proto => 'tcp',
+    ReuseAddr => 1,
+  );
+  unless ($listener) {
+    croak("Can't listen for OCSP requests: $!");
+  }
+
+  my $port = $listener->sockport();
+
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    croak("Can't open pipe: $!");
+  }
+
+  local $SIG{CHLD} = 'DEFAULT';
+
+  defined(my $pid = fork()) or croak("Can't fork: $!");
+  if ($pid) {
+    $listener->close();
+    $wfh->close();
+
+    my $responder_pid = <$rfh>;
+    $rfh->close();
+    waitpid($pid, 0);
+
+    unless ($responder_pid) {
+      croak("Can't start OCSP responder");
+    }
+
+    chomp($responder_pid);
+    return ($responder_pid, $port);
+  }
+
+  $rfh->close();
+
+  defined($pid = fork()) or POSIX::_exit(1);
+  if ($pid) {
+    $wfh->print("$pid\n");
+    $wfh->close();
+    POSIX::_exit(0);
+  }
+
+  $wfh->close();
+
+  my $req_file = "$log_file.req";
+  my $resp_file = "$log_file.resp";
+  my $count = 0;
+
+  while (my $client = $listener->accept()) {
+    binmode($client);
+
+    my $len = 0;
+    while (defined(my $line = <$client>)) {
+      $line =~ s/\r?\n$//;
+      last if $line eq '';
+
+      if ($line =~ /^Content-Length:\s*(\d+)/i) {
+        $len = $1;
+      }
+    }
+
+    my $req = '';
+    read($client, $req, $len);
+
+    if (open(my $fh, "> $req_file")) {
+      binmode($fh);
+      print $fh $req;
+      close($fh);
+    }
+
+    $count++;
+    if (open(my $fh, ">> $log_file")) {
+      print $fh "request $count\n";
+      close($fh);
+    }
+
+    system("openssl ocsp -index $certs->{index_file} -CA $certs->{ca_file} -rsigner $certs->{ca_file} -rkey $certs->{ca_key_file} -ndays 1 -reqin $req_file -respout $resp_file > /dev/null 2>&1");
+
+    my $resp = '';
+    if (open(my $fh, "< $resp_file")) {
+      binmode($fh);
+      local $/;
+      $resp = <$fh>;
+      close($fh);
+    }
+
+    if ($count > 1 &&
+        $delay > 0) {
+      sleep($delay);
+    }
+
+    print $client "HTTP/1.0 200 OK\r\n",
+      "Content-Type: application/ocsp-response\r\n",
+      "Content-Length: " . length($resp) . "\r\n\r\n", $resp;
+    $client->close();
+  }
+
+  POSIX::_exit(0);
+}
+
+sub ocsp_responder_get_count {
+  my $log_file = shift;
+
+  my $count = 0;
+  if (open(my $fh, "< $log_file")) {
+    while (my $line = <$fh>) {
+      $count++;
+    }
+
+    close($fh);
+  }
+
+  return $count;
+}
+
+sub ocsp_cache_get_count {
+  my $cache_dir = shift;
+
+  my @files = glob("$cache_dir/*.der");
+  return scalar(@files);
+}
+
+# Performs the STARTTLS handshake, requesting a stapled OCSP response.
+# Returns the status of the stapled response (or -1 if there is none), and
+# the time taken.
+sub starttls_ftp_stapled {
+  my $port = shift;
+
+  my $resp_status = -1;
+
+  my $ssl_opts = {
+    SSL_ocsp_mode => IO::Socket::SSL::SSL_OCSP_TRY_STAPLE(),
+    SSL_ocsp_staple_callback => sub {
+      my ($ssl, $resp) = @_;
+
+      if (defined($resp)) {
+        $resp_status = Net::SSLeay::OCSP_response_status($resp);
+      }
+    },
+    SSL_verify_mode => IO::Socket::SSL::SSL_VERIFY_NONE(),
+  };
+
+  my $start = [gettimeofday];
+  starttls_ftp($port, $ssl_opts);
+  my $elapsed = tv_interval($start);
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Stapled OCSP response status $resp_status, handshake took $elapsed secs\n";
+  }
+
+  return ($resp_status, $elapsed);
+}
+
 sub tls_stapling_on_fscache_bug4175 {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
@@ -232,4 +462,251 @@ sub tls_stapling_on_fscache_bug4175 {
   test_cleanup($setup->{log_file}, $ex);
 }
 
+sub tls_stapling_prefetch_fscache {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'tls_fscache');
+
+  my $certs = ocsp_create_certs($tmpdir);
+
+  my $cache_tab = File::Spec->rel2abs("$tmpdir/var/tls/cache/ocsp");
+  mkpath($cache_tab);
+
+  # The responder answers the daemon's prefetch request promptly, but any
+  # later request, e.g. from a handshake, only after the stapling timeout.
+  my $stapling_timeout = 2;
+  my $responder_log = File::Spec->rel2abs("$tmpdir/ocsp-responder.log");
+  my ($responder_pid, $responder_port) = ocsp_responder_start($certs,
+    $responder_log, $stapling_timeout + 3);
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'tls:20 tls.fscache:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_tls.c' => {
+        TLSEngine => 'on',
+        TLSLog => $setup->{log_file},
+        TLSRequired => 'on',
+        TLSRSACertificateFile => $certs->{cert_file},
+        TLSRSACertificateKeyFile => $certs->{key_file},
+        TLSCACertificateFile => $certs->{ca_file},
+        TLSOptions => 'EnableDiags',
+        TLSStapling => 'on',
+        TLSStaplingCache => "fs:/path=$cache_tab",
+        TLSStaplingResponder => "http://127.0.0.1:$responder_port",
+        TLSStaplingTimeout => $stapling_timeout,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require IO::Socket::INET;
+  require IO::Socket::SSL;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server a chance to start up, and to fill the cache
+      sleep(2);
+
+      for (my $i = 0; $i < 10; $i++) {
+        last if ocsp_cache_get_count($cache_tab) > 0;
+        sleep(1);
+      }
+
+      my $count = ocsp_cache_get_count($cache_tab);
+      $self->assert($count == 1,
+        test_msg("Expected 1 cached OCSP response before login, got $count"));
+
+      $count = ocsp_responder_get_count($responder_log);
+      $self->assert($count == 1,
+        test_msg("Expected 1 OCSP request before login, got $count"));
+
+      my ($resp_status, $elapsed) = starttls_ftp_stapled($port);
+
+      my $expected = Net::SSLeay::OCSP_RESPONSE_STATUS_SUCCESSFUL();
+      $self->assert($resp_status == $expected,
+        test_msg("Expected stapled OCSP response status $expected, got $resp_status"));
+
+      $self->assert($elapsed < $stapling_timeout,
+        test_msg("Expected handshake within $stapling_timeout secs, took $elapsed secs"));
+
+      # The handshake used the cached response, without asking the responder.
+      $count = ocsp_responder_get_count($responder_log);
+      $self->assert($count == 1,
+        test_msg("Expected 1 OCSP request after login, got $count"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh, 30) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  kill('TERM', $responder_pid);
+
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub tls_stapling_no_prefetch_fscache {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'tls_fscache');
+
+  my $certs = ocsp_create_certs($tmpdir);
+
+  my $cache_tab = File::Spec->rel2abs("$tmpdir/var/tls/cache/ocsp");
+  mkpath($cache_tab);
+
+  my $stapling_timeout = 5;
+  my $responder_log = File::Spec->rel2abs("$tmpdir/ocsp-responder.log");
+  my ($responder_pid, $responder_port) = ocsp_responder_start($certs,
+    $responder_log, 0);
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'tls:20 tls.fscache:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_tls.c' => {
+        TLSEngine => 'on',
+        TLSLog => $setup->{log_file},
+        TLSRequired => 'on',
+        TLSRSACertificateFile => $certs->{cert_file},
+        TLSRSACertificateKeyFile => $certs->{key_file},
+        TLSCACertificateFile => $certs->{ca_file},
+        TLSOptions => 'EnableDiags',
+        TLSStapling => 'on',
+        TLSStaplingCache => "fs:/path=$cache_tab",
+        TLSStaplingOptions => 'NoPrefetch',
+        TLSStaplingResponder => "http://127.0.0.1:$responder_port",
+        TLSStaplingTimeout => $stapling_timeout,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require IO::Socket::INET;
+  require IO::Socket::SSL;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server a chance to start up
+      sleep(2);
+
+      # Without prefetching, nothing asks the responder until a handshake.
+      my $count = ocsp_cache_get_count($cache_tab);
+      $self->assert($count == 0,
+        test_msg("Expected no cached OCSP responses before login, got $count"));
+
+      $count = ocsp_responder_get_count($responder_log);
+      $self->assert($count == 0,
+        test_msg("Expected no OCSP requests before login, got $count"));
+
+      my ($resp_status, $elapsed) = starttls_ftp_stapled($port);
+
+      my $expected = Net::SSLeay::OCSP_RESPONSE_STATUS_SUCCESSFUL();
+      $self->assert($resp_status == $expected,
+        test_msg("Expected stapled OCSP response status $expected, got $resp_status"));
+
+      $count = ocsp_responder_get_count($responder_log);
+      $self->assert($count == 1,
+        test_msg("Expected 1 OCSP request after login, got $count"));
+
+      $count = ocsp_cache_get_count($cache_tab);
+      $self->assert($count == 1,
+        test_msg("Expected 1 cached OCSP response after login, got $count"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  kill('TERM', $responder_pid);
+
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
 1;
@@ -31,8 +31,6 @@ static char util_scoreboard_file[PR_TUNABLE_PATH_MAX] = PR_RUN_DIR "/proftpd.sco
 
 static pr_scoreboard_header_t util_header;
 
-static unsigned char util_scoreboard_read_locked = FALSE;
-
 /* Internal routines
  */
 
@@ -67,53 +65,6 @@ static int read_scoreboard_header(pr_scoreboard_header_t *header) {
   return 0;
 }
 
-static int rlock_scoreboard(void) {
-  struct flock lock;
-
-  lock.l_type = F_RDLCK;
-  lock.l_whence = 0;
-  lock.l_start = 0;
-  lock.l_len = 0;
-
-  while (fcntl(util_scoreboard_fd, F_SETLKW, &lock) < 0) {
-
-    /* It would be nice to try to restart the fcntl(2) in cases where
-     * it is interrupted.  However, that could possibly lead to a tight
-     * loop which leaves the scoreboard file locked, which in turn causes
-     * problems for the proftpd daemon trying to read that scoreboard.
-     *
-     * Instead, only retry the fcntl(2) on EAGAIN, and NOT on EINTR.
-     */
-    if (errno == EAGAIN)
-      continue;
-
-    return -1;
-  }
-
-  util_scoreboard_read_locked = TRUE;
-  return 0;
-}
-
-static int unlock_scoreboard(void) {
-  struct flock lock;
-
-  lock.l_type = F_UNLCK;
-  lock.l_whence = 0;
-  lock.l_start = 0;
-  lock.l_len = 0;
-
-  util_scoreboard_read_locked = FALSE;
-
-  while (fcntl(util_scoreboard_fd, F_SETLK, &lock) < 0) {
-    if (errno == EAGAIN)
-      continue;
-
-    return -1;
-  }
-
-  return 0;
-}
-
 /* Public routines
  */
 
@@ -121,10 +72,6 @@ int util_close_scoreboard(void) {
   if (util_scoreboard_fd == -1)
     return 0;
 
-  if (util_scoreboard_read_locked) {
-    unlock_scoreboard();
-  }
-
   (void) close(util_scoreboard_fd);
   util_scoreboard_fd = -1;
 
@@ -166,6 +113,12 @@ int util_open_scoreboard(int flags) {
   if (res < 0)
     return res;
 
+  /* Skip past the table of session counters, to the first entry. */
+  if (lseek(util_scoreboard_fd, (off_t) (sizeof(pr_scoreboard_header_t) +
+      UTIL_SCOREBOARD_COUNTERS_SIZE), SEEK_SET) < 0) {
+    return -1;
+  }
+
   return 0;
 }
 
@@ -215,6 +168,9 @@ time_t util_scoreboard_get_daemon_uptime(void) {
   return util_header.sch_uptime;
 }
 
+/* Max number of attempts to read a consistent copy of a slot */
+#define UTIL_SCOREBOARD_MAX_READ_ATTEMPTS	100
+
 pr_scoreboard_entry_t *util_scoreboard_entry_read(void) {
   static pr_scoreboard_entry_t scan_entry;
   int res = 0;
@@ -224,41 +180,62 @@ pr_scoreboard_entry_t *util_scoreboard_entry_read(void) {
     return NULL;
   }
 
-  /* Make sure the scoreboard file is read-locked. */
-  if (!util_scoreboard_read_locked)
-    rlock_scoreboard();
-
   memset(&scan_entry, '\0', sizeof(scan_entry));
 
-  /* NOTE: use readv(2)? */
+  /* The daemon updates slots in place without locking; each slot carries a
+   * sequence number which is odd while the slot is being written.  Re-read
+   * a slot if its sequence number was odd, or changed while we read it.
+   */
   errno = 0;
   while (scan_entry.sce_pid == 0) {
-    while ((res = read(util_scoreboard_fd, &scan_entry,
-        sizeof(scan_entry))) <= 0) {
+    unsigned int i, seqno = 0;
+    off_t offset;
+
+    offset = lseek(util_scoreboard_fd, (off_t) 0, SEEK_CUR);
 
+    for (i = 0; i < UTIL_SCOREBOARD_MAX_READ_ATTEMPTS; i++) {
+      res = pread(util_scoreboard_fd, &scan_entry, sizeof(scan_entry),
+        offset);
       if (res < 0 &&
           errno == EINTR) {
         continue;
- 
-      } else {
-        unlock_scoreboard();
+      }
 
-        if (errno) {
-          fprintf(stdout, "error reading scoreboard entry: %s\n",
-            strerror(errno));
-        }
+      if (res != sizeof(scan_entry)) {
+        break;
+      }
+
+      if (pread(util_scoreboard_fd, &seqno, sizeof(seqno), offset) !=
+          sizeof(seqno)) {
+        break;
+      }
+
+      if ((seqno & 1) == 0 &&
+          seqno == scan_entry.sce_seqno) {
+        break;
+      }
+    }
 
-        return NULL;
+    if (res != sizeof(scan_entry)) {
+      if (res < 0 &&
+          errno) {
+        fprintf(stdout, "error reading scoreboard entry: %s\n",
+          strerror(errno));
       }
+
+      return NULL;
+    }
+
+    if (lseek(util_scoreboard_fd, offset + sizeof(scan_entry),
+        SEEK_SET) < 0) {
+      return NULL;
     }
 
     if (scan_entry.sce_pid) {
-      unlock_scoreboard();
       return &scan_entry;
     }
   }
 
-  unlock_scoreboard();
   return NULL;
 }
 
@@ -304,8 +281,11 @@ int util_scoreboard_scrub(int verbose) {
     return -1;
   }
 
-  /* Skip past the scoreboard header. */
-  curr_offset = lseek(fd, (off_t) sizeof(pr_scoreboard_header_t), SEEK_SET);
+  /* Skip past the scoreboard header, and the table of session counters.
+   * The daemon rebuilds the counters when it next scrubs the scoreboard.
+   */
+  curr_offset = lseek(fd, (off_t) (sizeof(pr_scoreboard_header_t) +
+    UTIL_SCOREBOARD_COUNTERS_SIZE), SEEK_SET);
   if (curr_offset < 0) {
     int xerrno = errno;
 
@@ -338,6 +318,7 @@ int util_scoreboard_scrub(int verbose) {
     if (sce.sce_pid &&
         kill(sce.sce_pid, 0) < 0 &&
         errno == ESRCH) {
+      unsigned int seqno;
 
       /* OK, the recorded PID is no longer valid. */
       if (verbose) {
@@ -353,7 +334,13 @@ int util_scoreboard_scrub(int verbose) {
         }
       }
 
+      /* Keep the slot's sequence number moving forward (and even), so that
+       * concurrent readers notice the change.
+       */
+      seqno = (sce.sce_seqno + 2) & ~1U;
       memset(&sce, 0, sizeof(sce));
+      sce.sce_seqno = seqno;
+
       while (write(fd, &sce, sizeof(sce)) != sizeof(sce)) {
         if (errno == EINTR) {
           continue;
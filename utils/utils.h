@@ -88,7 +88,7 @@
 
 /* UTIL_SCOREBOARD_VERSION is used for checking for scoreboard compatibility
  */
-#define UTIL_SCOREBOARD_VERSION        0x01040003
+#define UTIL_SCOREBOARD_VERSION        0x01040007
 
 /* Structure used as a header for scoreboard files.
  */
@@ -114,6 +114,8 @@ typedef struct {
  */
 
 typedef struct {
+  unsigned int sce_seqno;
+
   pid_t	sce_pid;
   uid_t sce_uid;
   gid_t sce_gid;
@@ -141,8 +143,42 @@ typedef struct {
   off_t sce_xfer_size, sce_xfer_done, sce_xfer_len;
   unsigned long sce_xfer_elapsed;
 
+  unsigned long sce_statcache_hits, sce_statcache_misses,
+    sce_statcache_evictions;
+
+  unsigned long sce_pool_bytes, sce_pool_reused, sce_pool_freelist_len;
+
 } pr_scoreboard_entry_t;
 
+/* Table of session counters, between the header and the entries; the
+ * utilities only need to skip over it.
+ */
+typedef struct {
+  unsigned int scc_seqno;
+  unsigned int scc_nused;
+  unsigned int scc_stale;
+} pr_scoreboard_counter_header_t;
+
+typedef struct {
+  unsigned int scc_hash;
+  unsigned int scc_count;
+  int scc_type;
+
+  char scc_server_addr[80];
+  char scc_name[32];
+
+#ifdef PR_USE_IPV6
+  char scc_client_addr[INET6_ADDRSTRLEN];
+#else
+  char scc_client_addr[INET_ADDRSTRLEN];
+#endif /* PR_USE_IPV6 */
+
+} pr_scoreboard_counter_t;
+
+#define UTIL_SCOREBOARD_COUNTERS_SIZE \
+  (sizeof(pr_scoreboard_counter_header_t) + \
+   (PR_TUNABLE_SCOREBOARD_COUNTERS * sizeof(pr_scoreboard_counter_t)))
+
 /* Scoreboard error values */
 #define UTIL_SCORE_ERR_BAD_MAGIC	-2
 #define UTIL_SCORE_ERR_OLDER_VERSION	-3